@@ -0,0 +1,11 @@
+/**
+ * @file WProgram.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Pre Arduino 1.0 name of Arduino.h, for older TinyGPSPlus versions
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Arduino.h"
@@ -0,0 +1,298 @@
+/**
+ * @file bench_decoder.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Throughput of td_decode_batch() with 1..N threads
+ *        The corpus has track batches, compact positions, stored positions, packed frames and Cayenne LPP uplinks
+ *        of many devices. Each thread decodes the uplinks of its own devices.
+ *        Usage: tracker_decoder_bench [max threads] [repeats]
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "tracker_decoder.h"
+#include "payload_pack.h"
+
+/** Corpus size */
+#define BENCH_DEVICES 256
+#define BENCH_UPLINKS_PER_DEVICE 1000
+/** Max fields of an uplink, a full track batch of 40 points */
+#define BENCH_MAX_FIELDS 48
+
+/** An uplink of the corpus */
+struct bench_uplink_s
+{
+	uint8_t data[242];
+	uint8_t size;
+	uint8_t fport;
+};
+
+/** Uplinks of one device */
+struct bench_device_s
+{
+	std::vector<bench_uplink_s> uplinks;
+	td_device_s keyframes;
+};
+
+/**
+ * @brief Write a big endian value
+ *
+ */
+static uint8_t put_value(uint8_t *data, int32_t value, uint8_t size)
+{
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		data[idx] = (uint8_t)(value >> (8 * (size - 1 - idx)));
+	}
+	return size;
+}
+
+/**
+ * @brief Write a zig-zag varint
+ *
+ */
+static uint8_t put_varint(uint8_t *data, int32_t value)
+{
+	uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	uint8_t size = 0;
+	while (zigzag >= 0x80)
+	{
+		data[size++] = (uint8_t)(zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	data[size++] = (uint8_t)zigzag;
+	return size;
+}
+
+/**
+ * @brief Random value in [min, max]
+ *
+ */
+static int32_t random_range(int32_t min, int32_t max)
+{
+	uint32_t value = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+	return min + (int32_t)(value % (uint32_t)(max - min + 1));
+}
+
+/**
+ * @brief Generate the uplinks of a device driving around
+ * 		Uplink mix: 30% Cayenne LPP, 20% compact positions, 20% packed, 20% track batches, 10% stored positions
+ *
+ */
+static void generate_device(bench_device_s *device)
+{
+	int32_t lat = random_range(-600000000, 600000000);
+	int32_t lon = random_range(-1790000000, 1790000000);
+	int32_t alt = random_range(0, 2000);
+	uint32_t time = 1718000000;
+	uint8_t key_id = 0;
+	int32_t key_lat = 0;
+	int32_t key_lon = 0;
+	device->uplinks.resize(BENCH_UPLINKS_PER_DEVICE);
+	for (size_t idx = 0; idx < device->uplinks.size(); idx++)
+	{
+		bench_uplink_s *uplink = &device->uplinks[idx];
+		uint8_t *data = uplink->data;
+		uint8_t size = 0;
+		lat += random_range(-5000, 5000);
+		lon += random_range(-5000, 5000);
+		time += 60;
+		uint8_t kind = rand() % 10;
+		if (kind < 3)
+		{
+			uplink->fport = 2;
+			size += put_value(&data[size], 1, 1);
+			size += put_value(&data[size], 137, 1);
+			size += put_value(&data[size], lat / 10, 4);
+			size += put_value(&data[size], lon / 10, 4);
+			size += put_value(&data[size], alt * 100, 3);
+			size += put_value(&data[size], 2, 1);
+			size += put_value(&data[size], 116, 1);
+			size += put_value(&data[size], random_range(340, 420), 2);
+			size += put_value(&data[size], 4, 1);
+			size += put_value(&data[size], 103, 1);
+			size += put_value(&data[size], random_range(-100, 350), 2);
+			size += put_value(&data[size], 3, 1);
+			size += put_value(&data[size], 104, 1);
+			size += put_value(&data[size], random_range(40, 180), 1);
+			size += put_value(&data[size], 5, 1);
+			size += put_value(&data[size], 115, 1);
+			size += put_value(&data[size], random_range(9500, 10300), 2);
+		}
+		else if (kind < 5)
+		{
+			uplink->fport = TD_POS_FPORT;
+			if ((idx % 50) == 0)
+			{
+				// New keyframe
+				key_id = (key_id + 1) & 0x3F;
+				key_lat = lat;
+				key_lon = lon;
+				size += put_value(&data[size], 0x80 | key_id, 1);
+				size += put_value(&data[size], lat, 4);
+				size += put_value(&data[size], lon, 4);
+				size += put_varint(&data[size], alt);
+			}
+			else
+			{
+				size += put_value(&data[size], 0x40 | key_id, 1);
+				size += put_varint(&data[size], (lat - key_lat) / 100);
+				size += put_varint(&data[size], (lon - key_lon) / 100);
+				size += put_varint(&data[size], random_range(-5, 5));
+			}
+			size += put_value(&data[size], 2, 1);
+			size += put_value(&data[size], 116, 1);
+			size += put_value(&data[size], random_range(340, 420), 2);
+		}
+		else if (kind < 7)
+		{
+			uplink->fport = TD_PACKED_FPORT;
+			pack_values_s values;
+			values.battery = random_range(0, 100);
+			values.has_position = true;
+			values.latitude = lat;
+			values.longitude = lon;
+			values.altitude = alt * 1000;
+			values.sat_num = random_range(4, 15);
+			values.dop = random_range(60, 400);
+			values.has_env = true;
+			values.temperature = random_range(-100, 350);
+			values.humidity = random_range(40, 180);
+			values.pressure = random_range(9500, 10300);
+			values.has_acc = (rand() % 4) == 0;
+			values.event_num = (rand() % 8) == 0 ? 1 : 0;
+			values.events[0] = random_range(0, 255);
+			size = pack_encode(&values, data, 51);
+		}
+		else if (kind < 9)
+		{
+			uplink->fport = TD_TRACK_FPORT;
+			uint8_t points = random_range(2, 20);
+			size += put_value(&data[size], points, 1);
+			size += put_value(&data[size], points * 30, 2);
+			size += put_value(&data[size], lat, 4);
+			size += put_value(&data[size], lon, 4);
+			for (uint8_t point = 1; point < points; point++)
+			{
+				size += put_value(&data[size], random_range(-2000, 2000), 2);
+				size += put_value(&data[size], random_range(-2000, 2000), 2);
+				size += put_value(&data[size], 30, 2);
+			}
+		}
+		else
+		{
+			uplink->fport = TD_STORE_FPORT;
+			uint8_t records = random_range(1, 8);
+			size += put_value(&data[size], records, 1);
+			for (uint8_t record = 0; record < records; record++)
+			{
+				size += put_value(&data[size], time - 60 * (records - record), 4);
+				size += put_value(&data[size], lat, 4);
+				size += put_value(&data[size], lon, 4);
+				size += put_value(&data[size], alt, 2);
+			}
+		}
+		uplink->size = size;
+	}
+}
+
+/**
+ * @brief Decode the uplinks of a range of devices
+ *
+ * @return size_t number of uplinks with an error
+ */
+static size_t decode_devices(bench_device_s *devices, size_t first, size_t last, uint32_t repeats)
+{
+	std::vector<td_uplink_s> uplinks(BENCH_UPLINKS_PER_DEVICE);
+	std::vector<td_result_s> results(BENCH_UPLINKS_PER_DEVICE);
+	std::vector<td_field_s> fields(BENCH_UPLINKS_PER_DEVICE * BENCH_MAX_FIELDS);
+	size_t errors = 0;
+	for (uint32_t repeat = 0; repeat < repeats; repeat++)
+	{
+		for (size_t dev = first; dev < last; dev++)
+		{
+			bench_device_s *device = &devices[dev];
+			device->keyframes.valid = 0;
+			for (size_t idx = 0; idx < device->uplinks.size(); idx++)
+			{
+				uplinks[idx] = {device->uplinks[idx].data, device->uplinks[idx].size, device->uplinks[idx].fport, 0, &device->keyframes};
+			}
+			td_decode_batch(uplinks.data(), device->uplinks.size(), fields.data(), fields.size(), results.data());
+			for (size_t idx = 0; idx < device->uplinks.size(); idx++)
+			{
+				errors += results[idx].status != TD_OK;
+			}
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned max_threads = argc > 1 ? (unsigned)atoi(argv[1]) : std::thread::hardware_concurrency();
+	uint32_t repeats = argc > 2 ? (uint32_t)atoi(argv[2]) : 20;
+	if (max_threads == 0)
+	{
+		max_threads = 1;
+	}
+	if (repeats == 0)
+	{
+		repeats = 1;
+	}
+
+	srand(20240610);
+	std::vector<bench_device_s> devices(BENCH_DEVICES);
+	size_t bytes = 0;
+	for (size_t dev = 0; dev < devices.size(); dev++)
+	{
+		generate_device(&devices[dev]);
+		for (size_t idx = 0; idx < devices[dev].uplinks.size(); idx++)
+		{
+			bytes += devices[dev].uplinks[idx].size;
+		}
+	}
+	size_t uplink_num = (size_t)BENCH_DEVICES * BENCH_UPLINKS_PER_DEVICE;
+	printf("Corpus: %zu devices, %zu uplinks, %zu bytes, %u repeats\n", devices.size(), uplink_num, bytes, repeats);
+
+	// Warm up and check the corpus
+	size_t errors = decode_devices(devices.data(), 0, devices.size(), 1);
+	if (errors != 0)
+	{
+		printf("%zu uplinks of the corpus failed to decode\n", errors);
+		return 1;
+	}
+
+	printf("threads  payloads/s    MB/s  speedup\n");
+	double single = 0;
+	for (unsigned threads = 1; threads <= max_threads; threads++)
+	{
+		std::vector<std::thread> workers;
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned thread = 0; thread < threads; thread++)
+		{
+			size_t first = devices.size() * thread / threads;
+			size_t last = devices.size() * (thread + 1) / threads;
+			workers.emplace_back(decode_devices, devices.data(), first, last, repeats);
+		}
+		for (size_t thread = 0; thread < workers.size(); thread++)
+		{
+			workers[thread].join();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double rate = uplink_num * repeats / seconds;
+		if (threads == 1)
+		{
+			single = rate;
+		}
+		printf("%7u  %10.0f  %6.1f  %7.2f\n", threads, rate, bytes * repeats / seconds / 1e6, rate / single);
+	}
+	return 0;
+}
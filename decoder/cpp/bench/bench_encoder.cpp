@@ -0,0 +1,210 @@
+/**
+ * @file bench_encoder.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Cost of the schema driven encoder of the packed format
+ *        Encodes the same frames with pack_put() and the field indices of payload_schema.h
+ *        and with hand-written put_bits() calls with the scaling written out, checks that both
+ *        produce the same bytes and prints the time per frame.
+ *        Usage: tracker_encoder_bench [frames]
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "payload_pack.h"
+
+/** Repeats of the frames, the best run is used */
+#define BENCH_RUNS 15
+
+/** Frame with all blocks and one fence event */
+#define BENCH_FLAGS (PACK_POSITION | PACK_QUALITY | PACK_ENV | PACK_GAS | PACK_ACC | PACK_FENCE)
+#define BENCH_FRAME_SIZE PACK_FRAME_SIZE(pack_block_bits(PACK_HEADER) + pack_block_bits(PACK_POSITION) + pack_block_bits(PACK_QUALITY) + \
+										 pack_block_bits(PACK_ENV) + pack_block_bits(PACK_GAS) + pack_block_bits(PACK_ACC) + pack_block_bits(PACK_FENCE))
+
+/**
+ * @brief Encode a frame with the schema
+ *
+ */
+static uint8_t encode_schema(const pack_values_s *values, uint8_t *buffer)
+{
+	bit_writer_s writer = {buffer, 0};
+	pack_put(&writer, PACK_F_flags, BENCH_FLAGS);
+	pack_put(&writer, PACK_F_battery, values->battery);
+	pack_put(&writer, PACK_F_latitude, values->latitude);
+	pack_put(&writer, PACK_F_longitude, values->longitude);
+	pack_put(&writer, PACK_F_altitude, values->altitude);
+	pack_put(&writer, PACK_F_satellites, values->sat_num);
+	pack_put(&writer, PACK_F_dop, values->dop);
+	pack_put(&writer, PACK_F_temperature, values->temperature);
+	pack_put(&writer, PACK_F_humidity, values->humidity);
+	pack_put(&writer, PACK_F_pressure, values->pressure);
+	pack_put(&writer, PACK_F_gas, values->gas);
+	pack_put(&writer, PACK_F_acc_x, values->acc[0]);
+	pack_put(&writer, PACK_F_acc_y, values->acc[1]);
+	pack_put(&writer, PACK_F_acc_z, values->acc[2]);
+	pack_put(&writer, PACK_F_fence_count, 1);
+	pack_put(&writer, PACK_F_fence_event, values->events[0]);
+	put_bits(&writer, 0, (8 - (writer.bits & 7)) & 7);
+	return writer.bits / 8;
+}
+
+/**
+ * @brief Round a division to the nearest integer
+ *
+ */
+static inline int64_t round_div(int64_t value, int64_t div)
+{
+	return (value >= 0 ? value + div / 2 : value - div / 2) / div;
+}
+
+/**
+ * @brief Limit a raw value to its number of bits
+ *
+ */
+static inline int64_t clamp(int64_t value, int64_t min, int64_t max)
+{
+	return value < min ? min : (value > max ? max : value);
+}
+
+/**
+ * @brief Encode a frame with the scaling of every field written out
+ *
+ */
+static uint8_t encode_hand(const pack_values_s *values, uint8_t *buffer)
+{
+	bit_writer_s writer = {buffer, 0};
+	put_bits(&writer, BENCH_FLAGS, 8);
+	put_bits(&writer, (uint32_t)clamp(values->battery, 0, 127), 7);
+	put_bits(&writer, (uint32_t)clamp(round_div(((int64_t)values->latitude + 900000000) * 0xFFFFFF, 1800000000), 0, 0xFFFFFF), 24);
+	put_bits(&writer, (uint32_t)clamp(round_div(((int64_t)values->longitude + 1800000000) * 0x1FFFFFF, 3600000000LL), 0, 0x1FFFFFF), 25);
+	put_bits(&writer, (uint32_t)clamp(round_div(values->altitude, 1000), -32768, 32767), 16);
+	put_bits(&writer, (uint32_t)clamp(values->sat_num, 0, 15), 4);
+	put_bits(&writer, (uint32_t)clamp(round_div(values->dop, 20), 0, 63), 6);
+	put_bits(&writer, (uint32_t)clamp(values->temperature + 400, 0, 1023), 10);
+	put_bits(&writer, (uint32_t)clamp(round_div(values->humidity, 2), 0, 127), 7);
+	put_bits(&writer, (uint32_t)clamp(round_div(values->pressure - 3000, 10), 0, 1023), 10);
+	put_bits(&writer, (uint32_t)clamp(values->gas > 0 ? lroundf(16 * (log2f(values->gas * 0.01f) + 4)) : 0, 0, 255), 8);
+	put_bits(&writer, (uint32_t)clamp(round_div(values->acc[0], 4), -512, 511), 10);
+	put_bits(&writer, (uint32_t)clamp(round_div(values->acc[1], 4), -512, 511), 10);
+	put_bits(&writer, (uint32_t)clamp(round_div(values->acc[2], 4), -512, 511), 10);
+	put_bits(&writer, 0, 3);
+	put_bits(&writer, values->events[0], 8);
+	put_bits(&writer, 0, (8 - (writer.bits & 7)) & 7);
+	return writer.bits / 8;
+}
+
+/**
+ * @brief Random value in [min, max]
+ *
+ */
+static int32_t random_range(int32_t min, int32_t max)
+{
+	uint32_t value = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+	return min + (int32_t)(value % (uint32_t)(max - min + 1));
+}
+
+/**
+ * @brief Time an encoder over all frames
+ *
+ * @return double ns per frame
+ */
+template <typename Encoder>
+static double time_encoder(Encoder encoder, std::vector<pack_values_s> &frames, uint8_t *output)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (size_t idx = 0; idx < frames.size(); idx++)
+	{
+		encoder(&frames[idx], &output[idx * BENCH_FRAME_SIZE]);
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames.size();
+}
+
+/**
+ * @brief Encode the frames with pack_encode(), all blocks and one fence event
+ *
+ */
+static uint8_t encode_frame(pack_values_s *values, uint8_t *buffer)
+{
+	values->event_num = 1;
+	return pack_encode(values, buffer, BENCH_FRAME_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t frame_num = argc > 1 ? (size_t)atol(argv[1]) : 200000;
+	if (frame_num == 0)
+	{
+		frame_num = 1;
+	}
+
+	srand(20240610);
+	std::vector<pack_values_s> frames(frame_num);
+	for (size_t idx = 0; idx < frames.size(); idx++)
+	{
+		pack_values_s *values = &frames[idx];
+		values->battery = random_range(0, 100);
+		values->has_position = true;
+		values->has_env = true;
+		values->has_gas = true;
+		values->has_acc = true;
+		values->latitude = random_range(-900000000, 900000000);
+		values->longitude = random_range(-1800000000, 1800000000);
+		values->altitude = random_range(-500000, 9000000);
+		values->sat_num = random_range(0, 15);
+		values->dop = random_range(0, 1260);
+		values->temperature = random_range(-400, 623);
+		values->humidity = random_range(0, 200);
+		values->pressure = random_range(3000, 13230);
+		values->gas = random_range(10, 300000);
+		for (uint8_t axis = 0; axis < 3; axis++)
+		{
+			values->acc[axis] = random_range(-2000, 2000);
+		}
+		values->events[0] = random_range(0, 255);
+	}
+
+	std::vector<uint8_t> schema(frame_num * BENCH_FRAME_SIZE);
+	std::vector<uint8_t> hand(frame_num * BENCH_FRAME_SIZE);
+	std::vector<uint8_t> frame(frame_num * BENCH_FRAME_SIZE);
+	// Runs of the encoders alternate, the best run of each is used
+	double best[3] = {0, 0, 0};
+	for (uint8_t run = 0; run < BENCH_RUNS; run++)
+	{
+		double ns[3] = {time_encoder(encode_schema, frames, schema.data()),
+						time_encoder(encode_hand, frames, hand.data()),
+						time_encoder(encode_frame, frames, frame.data())};
+		for (uint8_t idx = 0; idx < 3; idx++)
+		{
+			best[idx] = (run == 0) || (ns[idx] < best[idx]) ? ns[idx] : best[idx];
+		}
+	}
+
+	size_t diff = 0;
+	for (size_t idx = 0; idx < frame_num; idx++)
+	{
+		// pack_encode() selects all blocks, so all three produce the same frame
+		if ((memcmp(&schema[idx * BENCH_FRAME_SIZE], &hand[idx * BENCH_FRAME_SIZE], BENCH_FRAME_SIZE) != 0) ||
+			(memcmp(&schema[idx * BENCH_FRAME_SIZE], &frame[idx * BENCH_FRAME_SIZE], BENCH_FRAME_SIZE) != 0))
+		{
+			diff++;
+		}
+	}
+	printf("Frames: %zu of %d bytes, best of %d runs\n", frame_num, BENCH_FRAME_SIZE, BENCH_RUNS);
+	printf("schema pack_put      %7.1f ns/frame\n", best[0]);
+	printf("hand-written         %7.1f ns/frame\n", best[1]);
+	printf("pack_encode()        %7.1f ns/frame\n", best[2]);
+	printf("schema / hand-written %6.2f\n", best[0] / best[1]);
+	if (diff != 0)
+	{
+		printf("%zu frames differ between the encoders\n", diff);
+		return 1;
+	}
+	return 0;
+}
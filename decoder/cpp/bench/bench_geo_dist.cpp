@@ -0,0 +1,124 @@
+/**
+ * @file bench_geo_dist.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Time per call of geo_distance_m() against a double precision haversine
+ *        Random position pairs up to 10 km apart and up to 70 degrees latitude, the range of the firmware.
+ *        Usage: tracker_geo_bench [pairs]
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "geo_dist.h"
+
+/** Repeats of the pairs, the best run is used */
+#define BENCH_RUNS 15
+
+/** A pair of positions in 1e-7 degrees */
+struct bench_pair_s
+{
+	int32_t lat_from;
+	int32_t lon_from;
+	int32_t lat_to;
+	int32_t lon_to;
+};
+
+/**
+ * @brief Haversine distance in double precision on the same sphere as geo_dist.cpp
+ *
+ */
+static uint32_t haversine_m(int32_t lat_from, int32_t lon_from, int32_t lat_to, int32_t lon_to)
+{
+	double phi_from = lat_from * (M_PI / 180e7);
+	double phi_to = lat_to * (M_PI / 180e7);
+	double d_phi = phi_to - phi_from;
+	double d_lambda = ((double)lon_to - lon_from) * (M_PI / 180e7);
+	double a = sin(d_phi / 2) * sin(d_phi / 2) + cos(phi_from) * cos(phi_to) * sin(d_lambda / 2) * sin(d_lambda / 2);
+	return (uint32_t)(2 * 6371008.8 * asin(sqrt(a)));
+}
+
+/**
+ * @brief Random value in [min, max]
+ *
+ */
+static int32_t random_range(int32_t min, int32_t max)
+{
+	uint32_t value = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+	return min + (int32_t)(value % (uint32_t)(max - min + 1));
+}
+
+/**
+ * @brief Time a distance function over all pairs, best of BENCH_RUNS
+ *
+ * @param distance distance function
+ * @param pairs position pairs
+ * @param results distance of each pair
+ * @return double ns per call
+ */
+template <typename Distance>
+static double time_distance(Distance distance, const std::vector<bench_pair_s> &pairs, std::vector<uint32_t> &results)
+{
+	double best = 0;
+	for (uint8_t run = 0; run < BENCH_RUNS; run++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (size_t idx = 0; idx < pairs.size(); idx++)
+		{
+			results[idx] = distance(pairs[idx].lat_from, pairs[idx].lon_from, pairs[idx].lat_to, pairs[idx].lon_to);
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / pairs.size();
+		best = (run == 0) || (ns < best) ? ns : best;
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t pair_num = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+	if (pair_num == 0)
+	{
+		pair_num = 1;
+	}
+
+	srand(20240610);
+	std::vector<bench_pair_s> pairs(pair_num);
+	for (size_t idx = 0; idx < pairs.size(); idx++)
+	{
+		// About 10 km in each direction, longitudes wrap at the date line
+		pairs[idx].lat_from = random_range(-700000000, 700000000);
+		pairs[idx].lon_from = random_range(-1800000000, 1799999999);
+		pairs[idx].lat_to = pairs[idx].lat_from + random_range(-900000, 900000);
+		int64_t lon_to = (int64_t)pairs[idx].lon_from + random_range(-900000, 900000);
+		pairs[idx].lon_to = (int32_t)(lon_to >= 1800000000 ? lon_to - 3600000000LL : (lon_to < -1800000000 ? lon_to + 3600000000LL : lon_to));
+	}
+
+	std::vector<uint32_t> kernel(pair_num);
+	std::vector<uint32_t> reference(pair_num);
+	double kernel_ns = time_distance(geo_distance_m, pairs, kernel);
+	double reference_ns = time_distance(haversine_m, pairs, reference);
+
+	double max_error = 0;
+	for (size_t idx = 0; idx < pair_num; idx++)
+	{
+		// Date line pairs are measured the long way by the plain haversine, skip them
+		if (labs(pairs[idx].lon_to - pairs[idx].lon_from) > 1800000000)
+		{
+			continue;
+		}
+		double error = fabs((double)kernel[idx] - reference[idx]) / (reference[idx] > 100 ? reference[idx] : 100);
+		max_error = error > max_error ? error : max_error;
+	}
+	printf("Pairs: %zu, best of %d runs\n", pair_num, BENCH_RUNS);
+	printf("geo_distance_m()     %6.1f ns/call\n", kernel_ns);
+	printf("double haversine     %6.1f ns/call\n", reference_ns);
+	printf("speedup              %6.2f\n", reference_ns / kernel_ns);
+	printf("max error            %6.3f %% (distances below 100 m relative to 100 m)\n", max_error * 100);
+	return 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * @file bench_nmea.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Parse cost of the NMEA parser of the firmware (src/nmea.cpp) in cycles per byte
+ *        The built-in corpus has the sentences of the RAK12501 with GSV enabled plus sentences the parser skips.
+ *        Recorded NMEA logs can be given as arguments, each file is measured as its own corpus.
+ *        With -DTINYGPSPLUS_DIR=<path to TinyGPSPlus/src> the same corpora are parsed with TinyGPSPlus,
+ *        read out the way the firmware did before nmea.cpp.
+ *        Usage: tracker_nmea_bench [recorded.nmea ...]
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "nmea.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+/** Time stamp counter, reference cycles at the nominal clock */
+#define BENCH_UNIT "TSC cycles/byte"
+static inline uint64_t bench_clock(void)
+{
+	return __rdtsc();
+}
+#else
+#define BENCH_UNIT "ns/byte"
+static inline uint64_t bench_clock(void)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#ifdef BENCH_TINYGPSPLUS
+#include <TinyGPS++.h>
+#endif
+
+/** Epochs of the built-in corpus, one per second */
+#define BENCH_EPOCHS 20000
+/** Repeats of a corpus, the best run is used */
+#define BENCH_RUNS 9
+
+/** Results of a parser */
+struct bench_result_s
+{
+	double per_byte = 0; // BENCH_UNIT
+	uint32_t positions = 0;
+	int32_t latitude = 0;  // last position, 1e-7 degrees
+	int32_t longitude = 0; // last position, 1e-7 degrees
+};
+
+/**
+ * @brief Add a sentence with checksum and line end to the corpus
+ *
+ * @param corpus output
+ * @param body sentence without '$' and checksum
+ */
+static void add_sentence(std::string *corpus, const char *body)
+{
+	uint8_t checksum = 0;
+	for (const char *ch = body; *ch != 0; ch++)
+	{
+		checksum ^= (uint8_t)*ch;
+	}
+	char tail[8];
+	snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+	corpus->append("$");
+	corpus->append(body);
+	corpus->append(tail);
+}
+
+/**
+ * @brief NMEA coordinate ddmm.mmmmm or dddmm.mmmmm with hemisphere
+ *
+ */
+static void format_coord(char *buffer, size_t size, int32_t value, bool is_lat)
+{
+	uint32_t abs_value = value < 0 ? -(int64_t)value : value;
+	uint32_t deg = abs_value / 10000000;
+	// Minutes with 5 decimals
+	uint32_t min_e5 = (uint32_t)(((uint64_t)(abs_value % 10000000) * 6000000 + 5000000) / 10000000);
+	snprintf(buffer, size, is_lat ? "%02u%02u.%05u,%c" : "%03u%02u.%05u,%c", deg, min_e5 / 100000, min_e5 % 100000,
+			 is_lat ? (value < 0 ? 'S' : 'N') : (value < 0 ? 'W' : 'E'));
+}
+
+/**
+ * @brief Sentences of a tracker moving at walking speed
+ * 		Per epoch GGA, GSA of GPS and BeiDou, 3 GSV, RMC, VTG and ZDA, as the RAK12501 sends them
+ *
+ */
+static std::string generate_corpus(void)
+{
+	std::string corpus;
+	int32_t lat = 356812000;
+	int32_t lon = 1397671000;
+	uint32_t sec_of_day = 0;
+	srand(20240610);
+	for (uint32_t epoch = 0; epoch < BENCH_EPOCHS; epoch++)
+	{
+		lat += rand() % 30 - 15;
+		lon += rand() % 30 - 15;
+		sec_of_day = (sec_of_day + 1) % 86400;
+		char time[16];
+		snprintf(time, sizeof(time), "%02u%02u%02u.000", sec_of_day / 3600, (sec_of_day / 60) % 60, sec_of_day % 60);
+		char lat_text[24];
+		char lon_text[24];
+		format_coord(lat_text, sizeof(lat_text), lat, true);
+		format_coord(lon_text, sizeof(lon_text), lon, false);
+		char body[128];
+		snprintf(body, sizeof(body), "GNGGA,%s,%s,%s,1,%02d,%d.%02d,%d.%d,M,39.4,M,,", time, lat_text, lon_text, 8 + rand() % 6,
+				 rand() % 2, rand() % 100, 30 + rand() % 20, rand() % 10);
+		add_sentence(&corpus, body);
+		add_sentence(&corpus, "GNGSA,A,3,05,13,15,18,20,23,24,,,,,,1.8,0.9,1.5,1");
+		add_sentence(&corpus, "GNGSA,A,3,07,10,21,27,,,,,,,,,1.8,0.9,1.5,4");
+		snprintf(body, sizeof(body), "GPGSV,3,1,10,05,42,112,%02d,13,59,310,%02d,15,31,072,%02d,18,25,210,%02d,1", 30 + rand() % 15, 25 + rand() % 15,
+				 18 + rand() % 15, 20 + rand() % 15);
+		add_sentence(&corpus, body);
+		snprintf(body, sizeof(body), "GPGSV,3,2,10,20,17,044,%02d,23,67,125,%02d,24,12,265,%02d,29,05,330,,1", 15 + rand() % 15, 35 + rand() % 10,
+				 12 + rand() % 15);
+		add_sentence(&corpus, body);
+		add_sentence(&corpus, "GPGSV,3,3,10,30,02,180,,36,45,150,38,1");
+		snprintf(body, sizeof(body), "GNRMC,%s,A,%s,%s,0.%02d,%03d.%d,170624,,,A,V", time, lat_text, lon_text, rand() % 100, rand() % 360, rand() % 10);
+		add_sentence(&corpus, body);
+		snprintf(body, sizeof(body), "GNVTG,%03d.%d,T,,M,0.%02d,N,0.%02d,K,A", rand() % 360, rand() % 10, rand() % 100, rand() % 100);
+		add_sentence(&corpus, body);
+		snprintf(body, sizeof(body), "GNZDA,%s,17,06,2024,00,00", time);
+		add_sentence(&corpus, body);
+	}
+	return corpus;
+}
+
+/**
+ * @brief Parse a corpus with nmea.cpp, read out as gnss.cpp does
+ *
+ */
+static bench_result_s bench_nmea(const std::string &corpus)
+{
+	bench_result_s result;
+	for (uint8_t run = 0; run < BENCH_RUNS; run++)
+	{
+		nmea_reset();
+		uint32_t positions = 0;
+		uint64_t start = bench_clock();
+		for (size_t idx = 0; idx < corpus.size(); idx++)
+		{
+			if (nmea_parse(corpus[idx]) && g_nmea_fix.pos_updated)
+			{
+				g_nmea_fix.pos_updated = false;
+				positions++;
+			}
+		}
+		double per_byte = (double)(bench_clock() - start) / corpus.size();
+		if ((run == 0) || (per_byte < result.per_byte))
+		{
+			result.per_byte = per_byte;
+		}
+		result.positions = positions;
+		result.latitude = g_nmea_fix.latitude;
+		result.longitude = g_nmea_fix.longitude;
+	}
+	return result;
+}
+
+#ifdef BENCH_TINYGPSPLUS
+/**
+ * @brief Parse a corpus with TinyGPSPlus, read out as gnss.cpp did before nmea.cpp
+ *
+ */
+static bench_result_s bench_tinygpsplus(const std::string &corpus)
+{
+	bench_result_s result;
+	for (uint8_t run = 0; run < BENCH_RUNS; run++)
+	{
+		TinyGPSPlus gps;
+		uint32_t positions = 0;
+		int32_t latitude = 0;
+		int32_t longitude = 0;
+		volatile int32_t sink = 0;
+		uint64_t start = bench_clock();
+		for (size_t idx = 0; idx < corpus.size(); idx++)
+		{
+			if (gps.encode(corpus[idx]))
+			{
+				if (gps.location.isUpdated() && gps.location.isValid())
+				{
+					latitude = (int32_t)(gps.location.lat() * 10000000.0);
+					longitude = (int32_t)(gps.location.lng() * 10000000.0);
+					positions++;
+				}
+				if (gps.altitude.isUpdated() && gps.altitude.isValid())
+				{
+					sink = (int32_t)(gps.altitude.meters() * 1000);
+				}
+				if (gps.hdop.isUpdated() && gps.hdop.isValid())
+				{
+					sink = (int32_t)(gps.hdop.hdop() * 100);
+				}
+				sink = gps.satellites.value();
+			}
+		}
+		double per_byte = (double)(bench_clock() - start) / corpus.size();
+		(void)sink;
+		if ((run == 0) || (per_byte < result.per_byte))
+		{
+			result.per_byte = per_byte;
+		}
+		result.positions = positions;
+		result.latitude = latitude;
+		result.longitude = longitude;
+	}
+	return result;
+}
+#endif
+
+/**
+ * @brief Read a recorded NMEA log
+ *
+ * @return false if the file cannot be read
+ */
+static bool read_corpus(const char *path, std::string *corpus)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	char buffer[4096];
+	size_t size;
+	while ((size = fread(buffer, 1, sizeof(buffer), file)) != 0)
+	{
+		corpus->append(buffer, size);
+	}
+	fclose(file);
+	return !corpus->empty();
+}
+
+/**
+ * @brief Measure and print one corpus
+ *
+ * @return false if the parsers disagree on the last position
+ */
+static bool run_corpus(const char *name, const std::string &corpus)
+{
+	bench_result_s result = bench_nmea(corpus);
+	printf("%-24s %9zu bytes  nmea.cpp     %7.1f %s, %u positions\n", name, corpus.size(), result.per_byte, BENCH_UNIT, result.positions);
+#ifdef BENCH_TINYGPSPLUS
+	bench_result_s reference = bench_tinygpsplus(corpus);
+	printf("%-24s %9s        TinyGPSPlus  %7.1f %s, %u positions, %.1fx\n", "", "", reference.per_byte, BENCH_UNIT, reference.positions,
+		   reference.per_byte / result.per_byte);
+	// TinyGPSPlus truncates through double, allow 1e-7 degrees
+	if ((labs(result.latitude - reference.latitude) > 1) || (labs(result.longitude - reference.longitude) > 1))
+	{
+		printf("Last position differs: %d %d, TinyGPSPlus %d %d\n", result.latitude, result.longitude, reference.latitude, reference.longitude);
+		return false;
+	}
+#endif
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	bool ok = run_corpus("generated", generate_corpus());
+	for (int arg = 1; arg < argc; arg++)
+	{
+		std::string corpus;
+		if (!read_corpus(argv[arg], &corpus))
+		{
+			printf("Cannot read %s\n", argv[arg]);
+			return 1;
+		}
+		const char *name = strrchr(argv[arg], '/');
+		ok &= run_corpus(name != NULL ? name + 1 : argv[arg], corpus);
+	}
+#ifndef BENCH_TINYGPSPLUS
+	printf("Built without TinyGPSPlus, configure with -DTINYGPSPLUS_DIR=<path to TinyGPSPlus/src> to compare\n");
+#endif
+	return ok ? 0 : 1;
+}
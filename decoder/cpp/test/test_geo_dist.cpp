@@ -0,0 +1,220 @@
+/**
+ * @file test_geo_dist.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the integer distance kernel against a double precision haversine
+ *        Grid of positions, distances and bearings, plus the date line and the poles
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <math.h>
+#include <stdio.h>
+
+#include "geo_dist.h"
+
+/** Number of failed checks */
+static int failed = 0;
+
+#define CHECK(cond, ...)                                        \
+	do                                                          \
+	{                                                           \
+		if (!(cond))                                            \
+		{                                                       \
+			printf("%s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__);                                \
+			printf("\n");                                       \
+			failed++;                                           \
+		}                                                       \
+	} while (0)
+
+/** Mean earth radius in m, the same sphere as GEO_MM_PER_E7_Q16 */
+#define EARTH_RADIUS 6371008.8
+/** Rounding down to 1 m and the integer scaling */
+#define ROUNDING_M 1.02
+
+/**
+ * @brief Haversine distance in double precision
+ *
+ * @return double distance in m
+ */
+static double haversine_m(int32_t lat_from, int32_t lon_from, int32_t lat_to, int32_t lon_to)
+{
+	double phi_from = lat_from * 1e-7 * M_PI / 180;
+	double phi_to = lat_to * 1e-7 * M_PI / 180;
+	double d_phi = phi_to - phi_from;
+	double d_lambda = ((double)lon_to - lon_from) * 1e-7 * M_PI / 180;
+	double a = sin(d_phi / 2) * sin(d_phi / 2) + cos(phi_from) * cos(phi_to) * sin(d_lambda / 2) * sin(d_lambda / 2);
+	return 2 * EARTH_RADIUS * asin(sqrt(a > 1 ? 1 : a));
+}
+
+/**
+ * @brief Destination of a distance and bearing on the sphere
+ *
+ */
+static void destination(double lat, double lon, double bearing, double distance, int32_t *lat_to, int32_t *lon_to)
+{
+	double phi = lat * M_PI / 180;
+	double theta = bearing * M_PI / 180;
+	double delta = distance / EARTH_RADIUS;
+	double phi_to = asin(sin(phi) * cos(delta) + cos(phi) * sin(delta) * cos(theta));
+	double lambda_to = lon * M_PI / 180 + atan2(sin(theta) * sin(delta) * cos(phi), cos(delta) - sin(phi) * sin(phi_to));
+	*lat_to = (int32_t)lround(phi_to * 180 / M_PI * 1e7);
+	*lon_to = (int32_t)lround(remainder(lambda_to * 180 / M_PI, 360) * 1e7);
+}
+
+/**
+ * @brief Max relative error over a grid of start positions, distances and bearings
+ * 		The start longitudes include the date line, so the destinations wrap around.
+ *
+ * @param lat_min smallest absolute latitude in degrees
+ * @param lat_max largest absolute latitude in degrees
+ * @param dist_max largest distance in m
+ * @return double max error relative to the haversine distance, after ROUNDING_M
+ */
+static double grid_error(double lat_min, double lat_max, double dist_max)
+{
+	static const double distances[] = {1, 10, 100, 1000, 5000, 10000, 50000, 100000};
+	double max_error = 0;
+	for (double lat = lat_min; lat <= lat_max; lat += 0.5)
+	{
+		for (double lon = -180; lon < 180; lon += 7.5)
+		{
+			for (size_t idx = 0; idx < sizeof(distances) / sizeof(distances[0]) && distances[idx] <= dist_max; idx++)
+			{
+				for (int bearing = 0; bearing < 360; bearing += 15)
+				{
+					for (int sign = -1; sign <= 1; sign += 2)
+					{
+						int32_t lat_from = (int32_t)lround(sign * lat * 1e7);
+						int32_t lon_from = (int32_t)lround(lon * 1e7);
+						int32_t lat_to;
+						int32_t lon_to;
+						destination(sign * lat, lon, bearing, distances[idx], &lat_to, &lon_to);
+						double reference = haversine_m(lat_from, lon_from, lat_to, lon_to);
+						double error = fabs(geo_distance_m(lat_from, lon_from, lat_to, lon_to) - reference) - ROUNDING_M;
+						if (error / reference > max_error)
+						{
+							max_error = error / reference;
+						}
+					}
+				}
+			}
+		}
+	}
+	return max_error;
+}
+
+/**
+ * @brief Accuracy over the grid, the limits of geo_dist.cpp up to 70 degrees and the measured limits above
+ *
+ */
+static void test_grid(void)
+{
+	double error = grid_error(0, 70, 10000);
+	CHECK(error <= 1e-4, "up to 70 deg, up to 10 km: %.5f %%", error * 100);
+	// Geofence circles up to 100 km
+	error = grid_error(0, 70, 100000);
+	CHECK(error <= 2e-4, "up to 70 deg, up to 100 km: %.5f %%", error * 100);
+	error = grid_error(70, 85, 10000);
+	CHECK(error <= 5e-4, "70 to 85 deg, up to 10 km: %.5f %%", error * 100);
+	// Near the poles the cosine of the mean latitude no longer describes the longitude offset
+	error = grid_error(85, 89.5, 10000);
+	CHECK(error <= 2e-2, "85 to 89.5 deg, up to 10 km: %.5f %%", error * 100);
+}
+
+/**
+ * @brief Positions on both sides of the date line
+ *
+ */
+static void test_date_line(void)
+{
+	for (int32_t lat = -800000000; lat <= 800000000; lat += 100000000)
+	{
+		// 1e-7 degrees east and west of +-180 degrees
+		for (int32_t offset = 1; offset <= 10000000; offset *= 10)
+		{
+			int32_t east = 1800000000 - offset;
+			int32_t west = -1800000000 + offset;
+			double reference = haversine_m(lat, east, lat, east + 2 * offset);
+			uint32_t distance = geo_distance_m(lat, east, lat, west);
+			CHECK(fabs(distance - reference) <= 1e-4 * reference + ROUNDING_M, "lat %d offset %d: %u m, reference %.2f m", lat, offset, distance, reference);
+			CHECK(geo_distance_m(lat, west, lat, east) == distance, "lat %d offset %d: not symmetric", lat, offset);
+			CHECK(geo_lon_offset(east, west) == 2 * offset, "lat %d offset %d: lon offset %d", lat, offset, geo_lon_offset(east, west));
+		}
+		// +180 and -180 degrees are the same meridian
+		CHECK(geo_distance_m(lat, 1800000000, lat, -1800000000) == 0, "lat %d: +180 to -180 deg", lat);
+	}
+	// Across the date line on the equator, north and south
+	CHECK(geo_distance_m(0, 1799990000, 0, -1799990000) == 222, "equator: %u m", geo_distance_m(0, 1799990000, 0, -1799990000));
+	CHECK(geo_distance_m(-10000, 1799990000, 10000, -1799990000) == 314, "diagonal: %u m", geo_distance_m(-10000, 1799990000, 10000, -1799990000));
+}
+
+/**
+ * @brief Positions at and around the poles
+ *
+ */
+static void test_poles(void)
+{
+	CHECK(geo_cos_q15(900000000) == 0, "cos(90 deg) = %d", geo_cos_q15(900000000));
+	CHECK(geo_cos_q15(-900000000) == 0, "cos(-90 deg) = %d", geo_cos_q15(-900000000));
+	CHECK(geo_cos_q15(0) == 32768, "cos(0 deg) = %d", geo_cos_q15(0));
+	for (int32_t lon = -1800000000; lon < 1800000000; lon += 150000000)
+	{
+		for (int sign = -1; sign <= 1; sign += 2)
+		{
+			int32_t pole = sign * 900000000;
+			// All longitudes of a pole are the same position
+			CHECK(geo_distance_m(pole, 0, pole, lon) == 0, "pole %d lon %d", pole, lon);
+			// Along a meridian to the pole
+			int32_t lat = sign * 890000000;
+			double reference = haversine_m(lat, lon, pole, lon);
+			uint32_t distance = geo_distance_m(lat, lon, pole, lon);
+			CHECK(fabs(distance - reference) <= 1e-4 * reference + ROUNDING_M, "to pole %d lon %d: %u m, reference %.2f m", pole, lon, distance, reference);
+			// Across the pole the offset is taken around it, pi / 2 of the direct way
+			// plus the Q15 resolution of the cosine (6 instead of 5.72 at 89.99 degrees)
+			int32_t lat_near = sign * 899900000;
+			int32_t lon_opposite = lon < 0 ? lon + 1800000000 : lon - 1800000000;
+			reference = haversine_m(lat_near, lon, lat_near, lon_opposite);
+			distance = geo_distance_m(lat_near, lon, lat_near, lon_opposite);
+			CHECK((distance >= reference - ROUNDING_M) && (distance <= reference * M_PI / 2 * 1.1 + ROUNDING_M), "across pole lon %d: %u m, reference %.2f m", lon, distance, reference);
+		}
+	}
+}
+
+/**
+ * @brief Distances above the 32 bit mm range, along the equator and a meridian the kernel is exact
+ *
+ */
+static void test_long_distances(void)
+{
+	static const int32_t points[][4] = {
+		{0, 0, 0, 1800000000},
+		{0, -1700000000, 0, 1700000000},
+		{-900000000, 0, 900000000, 0},
+		{-450000000, 100000000, 450000000, 100000000},
+		{0, 0, 0, 200000000},
+	};
+	for (size_t idx = 0; idx < sizeof(points) / sizeof(points[0]); idx++)
+	{
+		double reference = haversine_m(points[idx][0], points[idx][1], points[idx][2], points[idx][3]);
+		uint32_t distance = geo_distance_m(points[idx][0], points[idx][1], points[idx][2], points[idx][3]);
+		CHECK(fabs(distance - reference) <= 1e-4 * reference + ROUNDING_M, "points %zu: %u m, reference %.0f m", idx, distance, reference);
+	}
+}
+
+int main(void)
+{
+	test_grid();
+	test_date_line();
+	test_poles();
+	test_long_distances();
+	if (failed != 0)
+	{
+		printf("%d checks failed\n", failed);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file test_gnss_filter.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host replay test of the position filter
+ *        Feeds the raw fixes of a track through gnss_filter_update() and compares the raw and the filtered
+ *        positions with the true positions of the track.
+ *        Usage: test_gnss_filter <test data directory>
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string>
+
+#include "gnss_filter.h"
+
+/** Number of failed checks */
+static int failed = 0;
+
+#define CHECK(cond, ...)                                        \
+	do                                                          \
+	{                                                           \
+		if (!(cond))                                            \
+		{                                                       \
+			printf("%s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__);                                \
+			printf("\n");                                       \
+			failed++;                                           \
+		}                                                       \
+	} while (0)
+
+/** A fix of the track */
+struct track_fix_s
+{
+	long time_ms;
+	int motion; // 1 if motion was detected since the last fix
+	long true_lat;
+	long true_lon;
+	long raw_lat;
+	long raw_lon;
+	unsigned long accuracy_mm;
+};
+
+/** Sum of the squared errors */
+struct error_sum_s
+{
+	double sum = 0;
+	double max = 0;
+	unsigned num = 0;
+};
+
+/**
+ * @brief Distance between two positions in m, local flat earth is enough for the errors of a fix
+ *
+ */
+static double error_m(long lat_from, long lon_from, long lat_to, long lon_to)
+{
+	double north = (lat_to - lat_from) * 1e-7 * M_PI / 180 * 6371008.8;
+	double east = (lon_to - lon_from) * 1e-7 * M_PI / 180 * 6371008.8 * cos(lat_from * 1e-7 * M_PI / 180);
+	return sqrt(north * north + east * east);
+}
+
+/**
+ * @brief Add an error
+ *
+ */
+static void add_error(error_sum_s *sum, double error)
+{
+	sum->sum += error * error;
+	sum->max = error > sum->max ? error : sum->max;
+	sum->num++;
+}
+
+/**
+ * @brief RMS of the errors
+ *
+ */
+static double rms(const error_sum_s &sum)
+{
+	return sum.num != 0 ? sqrt(sum.sum / sum.num) : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string path = std::string(argc > 1 ? argv[1] : "data") + "/track.csv";
+	FILE *file = fopen(path.c_str(), "r");
+	if (file == NULL)
+	{
+		printf("Cannot read %s\n", path.c_str());
+		return 1;
+	}
+
+	error_sum_s raw;
+	error_sum_s filtered;
+	error_sum_s raw_parked;
+	error_sum_s filtered_parked;
+	long last_motion = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		track_fix_s fix;
+		if (sscanf(line, "%ld,%d,%ld,%ld,%ld,%ld,%lu", &fix.time_ms, &fix.motion, &fix.true_lat, &fix.true_lon, &fix.raw_lat, &fix.raw_lon,
+				   &fix.accuracy_mm) != 7)
+		{
+			// Comment or header
+			continue;
+		}
+		if (fix.motion)
+		{
+			last_motion = fix.time_ms - 1;
+		}
+		int64_t latitude = fix.raw_lat;
+		int64_t longitude = fix.raw_lon;
+		gnss_filter_update(&latitude, &longitude, fix.accuracy_mm, fix.time_ms, last_motion);
+		double raw_error = error_m(fix.true_lat, fix.true_lon, fix.raw_lat, fix.raw_lon);
+		double filtered_error = error_m(fix.true_lat, fix.true_lon, (long)latitude, (long)longitude);
+		add_error(&raw, raw_error);
+		add_error(&filtered, filtered_error);
+		if (!fix.motion)
+		{
+			add_error(&raw_parked, raw_error);
+			add_error(&filtered_parked, filtered_error);
+		}
+	}
+	fclose(file);
+
+	printf("%u fixes, %u parked, %u rejected, %u restarts\n", raw.num, raw_parked.num, g_gnss_filter_stats.rejected, g_gnss_filter_stats.restarts);
+	printf("raw      RMS %6.2f m, max %6.2f m, parked RMS %6.2f m\n", rms(raw), raw.max, rms(raw_parked));
+	printf("filtered RMS %6.2f m, max %6.2f m, parked RMS %6.2f m\n", rms(filtered), filtered.max, rms(filtered_parked));
+	CHECK(raw.num > 100, "%u fixes in %s", raw.num, path.c_str());
+	CHECK(rms(filtered) < rms(raw), "filtered RMS %.2f m, raw RMS %.2f m", rms(filtered), rms(raw));
+	CHECK(rms(filtered_parked) < rms(raw_parked), "parked: filtered RMS %.2f m, raw RMS %.2f m", rms(filtered_parked), rms(raw_parked));
+	// The multipath jumps of the track are rejected
+	CHECK(filtered.max < raw.max / 2, "filtered max %.2f m, raw max %.2f m", filtered.max, raw.max);
+	CHECK(g_gnss_filter_stats.rejected >= 4, "%u fixes rejected", g_gnss_filter_stats.rejected);
+	if (failed != 0)
+	{
+		printf("%d checks failed\n", failed);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * @file test_motion.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the motion classifier
+ *        Synthetic acceleration signals are sampled at 10 Hz and quantized to the 16 mg steps of the
+ *        LIS3DH 8 bit low power mode, then classified window by window with motion_classify().
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "motion_class.h"
+
+/** Number of failed checks */
+static int failed = 0;
+
+#define CHECK(cond, ...)                                        \
+	do                                                          \
+	{                                                           \
+		if (!(cond))                                            \
+		{                                                       \
+			printf("%s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__);                                \
+			printf("\n");                                       \
+			failed++;                                           \
+		}                                                       \
+	} while (0)
+
+/** Step of the LIS3DH 8 bit low power mode at +/-2 g in mg */
+#define LSB_MG 16
+
+/** Number of windows per signal */
+#define WINDOW_RUNS 200
+
+/**
+ * @brief Random value in [-1, 1]
+ *
+ */
+static double random_unit(void)
+{
+	return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+/**
+ * @brief Quantize an axis value to the steps of the sensor
+ *
+ */
+static int16_t quantize(double value_mg)
+{
+	return (int16_t)(lround(value_mg / LSB_MG) * LSB_MG);
+}
+
+/** Names of the states */
+static const char *state_names[MOTION_STATE_NUM] = {"parked", "walking", "driving", "vibration"};
+
+/**
+ * @brief Acceleration of a signal at a time
+ * 		parked: gravity on a tilted device and a little sensor noise
+ * 		walking: steps at 1.6 to 2.2 Hz with 250 to 400 mg vertical and some sway
+ * 		driving: body sway at 0.2 to 0.6 Hz with 40 to 90 mg and road noise
+ * 		vibration: engine or conveyor vibration at 3 to 4.5 Hz with 40 to 80 mg and noise
+ *
+ * @param state signal, MOTION_*
+ * @param param random parameters of the window in [0, 1]
+ * @param time_s time in s
+ * @param axis returns x, y and z in mg
+ */
+static void synth_signal(uint8_t state, const double *param, double time_s, double *axis)
+{
+	double tilt = param[0] * 0.5;
+	axis[0] = 1000.0 * sin(tilt);
+	axis[1] = 0;
+	axis[2] = 1000.0 * cos(tilt);
+	double noise = 4.0;
+	switch (state)
+	{
+	case MOTION_WALKING:
+	{
+		double freq = 1.6 + 0.6 * param[1];
+		double amp = 250 + 150 * param[2];
+		axis[2] += amp * sin(2 * M_PI * freq * time_s + 6.28 * param[3]) + 0.3 * amp * sin(4 * M_PI * freq * time_s);
+		axis[0] += 0.2 * amp * sin(M_PI * freq * time_s);
+		noise = 20;
+		break;
+	}
+	case MOTION_VEHICLE:
+	{
+		double freq = 0.2 + 0.4 * param[1];
+		double amp = 40 + 50 * param[2];
+		axis[2] += amp * sin(2 * M_PI * freq * time_s + 6.28 * param[3]);
+		axis[1] += 0.5 * amp * sin(2 * M_PI * 0.7 * freq * time_s);
+		noise = 6;
+		break;
+	}
+	case MOTION_VIBRATION:
+	{
+		double freq = 3.0 + 1.5 * param[1];
+		double amp = 40 + 40 * param[2];
+		axis[2] += amp * sin(2 * M_PI * freq * time_s + 6.28 * param[3]);
+		noise = 10;
+		break;
+	}
+	default:
+		break;
+	}
+	for (uint8_t idx = 0; idx < 3; idx++)
+	{
+		axis[idx] += noise * random_unit();
+	}
+}
+
+/**
+ * @brief Magnitude of the firmware against a double precision magnitude
+ *
+ */
+static void test_magnitude(void)
+{
+	for (uint32_t run = 0; run < 100000; run++)
+	{
+		int16_t x = (int16_t)(random_unit() * 2048);
+		int16_t y = (int16_t)(random_unit() * 2048);
+		int16_t z = (int16_t)(random_unit() * 2048);
+		double reference = sqrt((double)x * x + (double)y * y + (double)z * z);
+		uint16_t magnitude = motion_magnitude(x, y, z);
+		CHECK((magnitude <= reference) && (magnitude > reference - 1.0), "%d %d %d: %d, reference %.2f", x, y, z, magnitude, reference);
+	}
+}
+
+/**
+ * @brief Classify windows of every signal
+ *
+ */
+static void test_classify(void)
+{
+	for (uint8_t state = 0; state < MOTION_STATE_NUM; state++)
+	{
+		uint32_t correct = 0;
+		for (uint32_t run = 0; run < WINDOW_RUNS; run++)
+		{
+			double param[4];
+			for (uint8_t idx = 0; idx < 4; idx++)
+			{
+				param[idx] = (random_unit() + 1.0) / 2;
+			}
+			uint16_t window[MOTION_WINDOW];
+			for (uint8_t idx = 0; idx < MOTION_WINDOW; idx++)
+			{
+				double axis[3];
+				synth_signal(state, param, idx * MOTION_SAMPLE_MS / 1000.0, axis);
+				window[idx] = motion_magnitude(quantize(axis[0]), quantize(axis[1]), quantize(axis[2]));
+			}
+			uint16_t std_mg = 0;
+			uint16_t jerk_mg = 0;
+			uint8_t result = motion_classify(window, &std_mg, &jerk_mg);
+			if (result == state)
+			{
+				correct++;
+			}
+			else
+			{
+				printf("%s window %u classified as %s, std %d mg, jerk %d mg\n", state_names[state], run,
+					   result < MOTION_STATE_NUM ? state_names[result] : "?", std_mg, jerk_mg);
+			}
+		}
+		printf("%-9s %3u of %u windows correct\n", state_names[state], correct, WINDOW_RUNS);
+		CHECK(correct == WINDOW_RUNS, "%s: %u of %u windows correct", state_names[state], correct, WINDOW_RUNS);
+	}
+}
+
+/**
+ * @brief Constant and alternating windows at the limits of the thresholds
+ *
+ */
+static void test_limits(void)
+{
+	uint16_t window[MOTION_WINDOW];
+	uint16_t std_mg = 0;
+	uint16_t jerk_mg = 0;
+	for (uint8_t idx = 0; idx < MOTION_WINDOW; idx++)
+	{
+		window[idx] = 1000;
+	}
+	CHECK(motion_classify(window, &std_mg, &jerk_mg) == MOTION_STATIONARY, "constant window");
+	CHECK((std_mg == 0) && (jerk_mg == 0), "constant window std %d jerk %d", std_mg, jerk_mg);
+
+	// One 16 mg step now and then is sensor noise
+	for (uint8_t idx = 0; idx < MOTION_WINDOW; idx++)
+	{
+		window[idx] = idx % 4 == 0 ? 1000 + LSB_MG : 1000;
+	}
+	CHECK(motion_classify(window, &std_mg, &jerk_mg) == MOTION_STATIONARY, "single steps std %d", std_mg);
+
+	// Square wave of +/- amplitude, the standard deviation is the amplitude
+	for (uint8_t idx = 0; idx < MOTION_WINDOW; idx++)
+	{
+		window[idx] = idx % 2 == 0 ? 1000 + MOTION_WALK_MG : 1000 - MOTION_WALK_MG;
+	}
+	CHECK(motion_classify(window, &std_mg, &jerk_mg) == MOTION_WALKING, "square wave at the walking limit std %d", std_mg);
+	for (uint8_t idx = 0; idx < MOTION_WINDOW; idx++)
+	{
+		window[idx] = idx % 2 == 0 ? 1000 + MOTION_STILL_MG : 1000 - MOTION_STILL_MG;
+	}
+	CHECK(motion_classify(window, &std_mg, &jerk_mg) == MOTION_VIBRATION, "fast square wave std %d jerk %d", std_mg, jerk_mg);
+	for (uint8_t idx = 0; idx < MOTION_WINDOW; idx++)
+	{
+		window[idx] = idx < MOTION_WINDOW / 2 ? 1000 + MOTION_STILL_MG : 1000 - MOTION_STILL_MG;
+	}
+	CHECK(motion_classify(window, &std_mg, &jerk_mg) == MOTION_VEHICLE, "slow square wave std %d jerk %d", std_mg, jerk_mg);
+}
+
+int main(void)
+{
+	srand(20240610);
+	test_magnitude();
+	test_classify();
+	test_limits();
+	if (failed != 0)
+	{
+		printf("%d checks failed\n", failed);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,250 @@
+/**
+ * @file test_nmea.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the streaming NMEA parser
+ *        Checksums, hemispheres, empty fields, truncated and overlong sentences
+ *        and the merge of GGA and RMC into the values of one epoch.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nmea.h"
+
+/** Number of failed checks */
+static int failed = 0;
+
+#define CHECK(cond, ...)                                        \
+	do                                                          \
+	{                                                           \
+		if (!(cond))                                            \
+		{                                                       \
+			printf("%s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__);                                \
+			printf("\n");                                       \
+			failed++;                                           \
+		}                                                       \
+	} while (0)
+
+/** Position of the test sentences, 4807.03812 N 01131.00050 E in 1e-7 degrees */
+#define TEST_LAT 481173020
+#define TEST_LON 115166750
+
+/**
+ * @brief Feed characters into the parser
+ *
+ * @return uint8_t number of completed sentences
+ */
+static uint8_t feed_raw(const char *data)
+{
+	uint8_t completed = 0;
+	for (; *data != 0; data++)
+	{
+		if (nmea_parse(*data))
+		{
+			completed++;
+		}
+	}
+	return completed;
+}
+
+/**
+ * @brief Feed a sentence with a calculated checksum
+ *
+ * @param body sentence between '$' and '*'
+ * @param checksum_xor changes the checksum, 0 for a valid checksum
+ * @return true if the parser completed the sentence
+ */
+static bool feed(const char *body, uint8_t checksum_xor = 0)
+{
+	uint8_t checksum = checksum_xor;
+	for (const char *ptr = body; *ptr != 0; ptr++)
+	{
+		checksum ^= (uint8_t)*ptr;
+	}
+	char sentence[320];
+	snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+	return feed_raw(sentence) == 1;
+}
+
+/**
+ * @brief GGA and RMC of one epoch, values of both sentences end up in the fix
+ *
+ */
+static void test_epoch_merge(void)
+{
+	nmea_reset();
+	CHECK(feed("GNGGA,123519.00,4807.03812,N,01131.00050,E,1,08,0.94,545.4,M,46.9,M,,"), "GGA not completed");
+	CHECK(feed("GNRMC,123519.00,A,4807.03812,N,01131.00050,E,0.022,,100624,,,A"), "RMC not completed");
+	CHECK(g_nmea_fix.pos_updated, "position not updated");
+	CHECK(g_nmea_fix.latitude == TEST_LAT, "latitude %d", g_nmea_fix.latitude);
+	CHECK(g_nmea_fix.longitude == TEST_LON, "longitude %d", g_nmea_fix.longitude);
+	CHECK(g_nmea_fix.alt_updated && (g_nmea_fix.altitude == 545400), "altitude %d", g_nmea_fix.altitude);
+	CHECK(g_nmea_fix.hdop_updated && (g_nmea_fix.hdop == 94), "hdop %d", g_nmea_fix.hdop);
+	CHECK(g_nmea_fix.sat_num == 8, "satellites %d", g_nmea_fix.sat_num);
+	// 2024-06-10 12:35:19 UTC
+	CHECK(g_nmea_fix.utc == 1718022919UL, "utc %u", g_nmea_fix.utc);
+
+	// GSA of the epoch adds the fix type and the HDOP
+	CHECK(feed("GNGSA,A,3,05,07,13,15,,,,,,,,,1.52,0.87,1.25,1"), "GSA not completed");
+	CHECK(g_nmea_fix.fix_type == 3, "fix type %d", g_nmea_fix.fix_type);
+	CHECK(g_nmea_fix.hdop == 87, "GSA hdop %d", g_nmea_fix.hdop);
+
+	// Signal strengths of the GSV sentences are published with the GGA of the next epoch
+	CHECK(feed("GPGSV,2,1,05,05,45,120,30,07,30,200,18,13,60,090,41,15,10,300,"), "GSV 1 not completed");
+	CHECK(feed("GPGSV,2,2,05,20,05,010,22"), "GSV 2 not completed");
+	CHECK(!g_nmea_sky.updated || (g_nmea_sky.tracked == 0), "sky published before the next epoch");
+	CHECK(feed("GNGGA,123520.00,4807.03812,N,01131.00050,E,1,08,0.94,545.4,M,46.9,M,,"), "GGA not completed");
+	CHECK(g_nmea_sky.updated, "sky not updated");
+	CHECK((g_nmea_sky.tracked == 4) && (g_nmea_sky.usable == 3) && (g_nmea_sky.max_cno == 41), "sky %d %d %d",
+		  g_nmea_sky.tracked, g_nmea_sky.usable, g_nmea_sky.max_cno);
+}
+
+/**
+ * @brief Southern and western hemisphere
+ *
+ */
+static void test_hemispheres(void)
+{
+	static const struct
+	{
+		const char *body;
+		int32_t lat;
+		int32_t lon;
+	} cases[] = {
+		{"GPRMC,123519,A,4807.03812,S,01131.00050,E,0.0,,100624,,", -TEST_LAT, TEST_LON},
+		{"GPRMC,123519,A,4807.03812,N,01131.00050,W,0.0,,100624,,", TEST_LAT, -TEST_LON},
+		{"GPRMC,123519,A,4807.03812,S,01131.00050,W,0.0,,100624,,", -TEST_LAT, -TEST_LON},
+		{"GPRMC,123519,A,0000.00000,S,18000.00000,W,0.0,,100624,,", 0, -1800000000},
+	};
+	for (size_t idx = 0; idx < sizeof(cases) / sizeof(cases[0]); idx++)
+	{
+		nmea_reset();
+		CHECK(feed(cases[idx].body), "case %zu not completed", idx);
+		CHECK(g_nmea_fix.pos_updated && (g_nmea_fix.latitude == cases[idx].lat) && (g_nmea_fix.longitude == cases[idx].lon),
+			  "case %zu: %d %d, expected %d %d", idx, g_nmea_fix.latitude, g_nmea_fix.longitude, cases[idx].lat, cases[idx].lon);
+	}
+}
+
+/**
+ * @brief Sentences with a wrong, missing or invalid checksum are not used
+ *
+ */
+static void test_checksum(void)
+{
+	nmea_reset();
+	CHECK(!feed("GPRMC,123519,A,4807.03812,N,01131.00050,E,0.0,,100624,,", 0x01), "wrong checksum accepted");
+	CHECK(!g_nmea_fix.pos_updated, "position of a wrong checksum used");
+	CHECK(feed_raw("$GPRMC,123519,A,4807.03812,N,01131.00050,E,0.0,,100624,,\r\n") == 0, "sentence without checksum accepted");
+	CHECK(feed_raw("$GPRMC,123519,A,4807.03812,N,01131.00050,E,0.0,,100624,,*G1\r\n") == 0, "invalid hex accepted");
+	CHECK(!g_nmea_fix.pos_updated, "position of an invalid sentence used");
+
+	// Lower case hex is valid
+	const char body[] = "GPRMC,123519,A,4807.03812,N,01131.00050,E,0.0,,100624,,";
+	uint8_t checksum = 0;
+	for (const char *ptr = body; *ptr != 0; ptr++)
+	{
+		checksum ^= (uint8_t)*ptr;
+	}
+	char sentence[100];
+	snprintf(sentence, sizeof(sentence), "$%s*%02x\r\n", body, checksum);
+	CHECK(feed_raw(sentence) == 1, "lower case checksum not accepted");
+	CHECK(g_nmea_fix.pos_updated, "position not updated");
+
+	// Unknown sentences are skipped
+	CHECK(!feed("GPVTG,054.7,T,034.4,M,005.5,N,010.2,K"), "VTG completed");
+}
+
+/**
+ * @brief Empty fields do not set values and do not keep values of an earlier sentence
+ *
+ */
+static void test_empty_fields(void)
+{
+	nmea_reset();
+	CHECK(feed("GNGGA,123519.00,4807.03812,N,01131.00050,E,1,08,0.94,545.4,M,46.9,M,,"), "GGA not completed");
+	CHECK(feed("GNGSA,A,3,05,07,13,15,,,,,,,,,1.52,0.87,1.25,1"), "GSA not completed");
+	CHECK((g_nmea_fix.sat_num == 8) && (g_nmea_fix.fix_type == 3), "satellites %d fix type %d", g_nmea_fix.sat_num, g_nmea_fix.fix_type);
+
+	// No fix yet, all fields empty
+	g_nmea_fix = nmea_fix_s();
+	CHECK(feed("GNGGA,,,,,,0,,,,,,,,"), "empty GGA not completed");
+	CHECK(feed("GNGSA,A,,,,,,,,,,,,,,,,,1"), "empty GSA not completed");
+	CHECK(feed("GNRMC,,V,,,,,,,,,,N"), "empty RMC not completed");
+	CHECK(g_nmea_fix.sat_num == 0, "satellites %d of an earlier sentence kept", g_nmea_fix.sat_num);
+	CHECK(g_nmea_fix.fix_type == 0, "fix type %d of an earlier sentence kept", g_nmea_fix.fix_type);
+	CHECK(!g_nmea_fix.pos_updated && !g_nmea_fix.alt_updated && !g_nmea_fix.hdop_updated, "values updated from empty fields");
+	CHECK(g_nmea_fix.utc == 0, "utc %u from empty fields", g_nmea_fix.utc);
+
+	// Valid status but no position
+	CHECK(feed("GNRMC,123519.00,A,,,,,0.0,,100624,,,A"), "RMC not completed");
+	CHECK(!g_nmea_fix.pos_updated, "empty position used");
+	CHECK(g_nmea_fix.utc == 1718022919UL, "utc %u", g_nmea_fix.utc);
+
+	// Latitude without longitude
+	CHECK(feed("GNRMC,123519.00,A,4807.03812,N,,,0.0,,100624,,,A"), "RMC not completed");
+	CHECK(!g_nmea_fix.pos_updated, "half position used");
+}
+
+/**
+ * @brief Sentences cut off by a new '$' and sentences longer than usual
+ *
+ */
+static void test_truncated_overlong(void)
+{
+	nmea_reset();
+	// Cut off before the checksum, the next sentence starts over
+	CHECK(feed_raw("$GNRMC,123519.00,A,4807.038") == 0, "truncated sentence completed");
+	CHECK(feed("GNGGA,123519.00,4807.03812,N,01131.00050,E,1,08,0.94,545.4,M,46.9,M,,"), "GGA after a truncated sentence not completed");
+	CHECK(!g_nmea_fix.pos_updated, "position of a truncated sentence used");
+	CHECK(g_nmea_fix.sat_num == 8, "satellites %d", g_nmea_fix.sat_num);
+	// Cut off between the checksum digits
+	CHECK(feed_raw("$GNRMC,123519.00,A,4807.03812,N,01131.00050,E,0.0,,100624,,,A*7") == 0, "half checksum completed");
+	CHECK(!g_nmea_fix.pos_updated, "position of a sentence with half checksum used");
+	// Garbage and line noise before a sentence
+	CHECK(feed_raw("\xFF**,,,\r\n") == 0, "garbage completed");
+
+	// More decimals than the buffer of a term holds are ignored
+	CHECK(feed("GNRMC,123519.00,A,4807.0381200000000000000,N,01131.0005000000000000000,E,0.0,,100624,,,A"), "long decimals not completed");
+	CHECK(g_nmea_fix.pos_updated && (g_nmea_fix.latitude == TEST_LAT) && (g_nmea_fix.longitude == TEST_LON), "long decimals %d %d",
+		  g_nmea_fix.latitude, g_nmea_fix.longitude);
+
+	// Numbers that do not fit are rejected instead of overflowing
+	g_nmea_fix = nmea_fix_s();
+	CHECK(feed("GNRMC,123519.00,A,99999999999999999999,N,01131.00050,E,0.0,,100624,,,A"), "overlong coordinate not completed");
+	CHECK(!g_nmea_fix.pos_updated, "overlong coordinate used, %d", g_nmea_fix.latitude);
+	CHECK(feed("GNGGA,123519.00,4807.03812,N,01131.00050,E,1,08,0.94,99999999999.9,M,46.9,M,,"), "overlong altitude not completed");
+	CHECK(!g_nmea_fix.alt_updated, "overlong altitude used, %d", g_nmea_fix.altitude);
+
+	// A sentence with many more terms than a GSV
+	char body[300] = "GPGSV,9,1,36";
+	for (uint8_t sat = 0; sat < 20; sat++)
+	{
+		strcat(body, ",01,02,003,40");
+	}
+	body[sizeof(body) - 1] = 0;
+	CHECK(feed(body), "long GSV not completed");
+	CHECK(feed("GNGGA,123520.00,4807.03812,N,01131.00050,E,1,08,0.94,545.4,M,46.9,M,,"), "GGA not completed");
+	CHECK(g_nmea_sky.tracked == 20, "tracked %d", g_nmea_sky.tracked);
+}
+
+int main(void)
+{
+	test_epoch_merge();
+	test_hemispheres();
+	test_checksum();
+	test_empty_fields();
+	test_truncated_overlong();
+	if (failed != 0)
+	{
+		printf("%d checks failed\n", failed);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
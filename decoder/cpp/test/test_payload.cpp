@@ -0,0 +1,476 @@
+/**
+ * @file test_payload.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the max payload and time on air per region and data rate,
+ *        a randomized round trip of the packed format through the firmware encoder and the host decoder
+ *        and the payload assembly of all formats for every data rate
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracker_decoder.h"
+#include "lora_region.h"
+#include "payload_lpp.h"
+#include "payload_pack.h"
+
+/** Number of failed checks */
+static int failed = 0;
+
+#define CHECK(cond, ...)                                        \
+	do                                                          \
+	{                                                           \
+		if (!(cond))                                            \
+		{                                                       \
+			printf("%s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__);                                \
+			printf("\n");                                       \
+			failed++;                                           \
+		}                                                       \
+	} while (0)
+
+/** Region codes of the firmware */
+#define REGION_AS923 0
+#define REGION_AU915 1
+#define REGION_EU433 4
+#define REGION_EU868 5
+#define REGION_US915 8
+
+/** Expected max payload per data rate, LoRaWAN Regional Parameters RP002-1.0.3 */
+static const struct
+{
+	uint8_t region;
+	const char *name;
+	uint8_t dr_num;
+	uint8_t max_payload[8];
+	uint8_t sf[8]; // 0 = FSK
+	uint16_t bw[8];
+} regions[] = {
+	{REGION_EU868, "EU868", 8, {51, 51, 51, 115, 242, 242, 242, 242}, {12, 11, 10, 9, 8, 7, 7, 0}, {125, 125, 125, 125, 125, 125, 250, 0}},
+	{REGION_EU433, "EU433", 8, {51, 51, 51, 115, 242, 242, 242, 242}, {12, 11, 10, 9, 8, 7, 7, 0}, {125, 125, 125, 125, 125, 125, 250, 0}},
+	{REGION_US915, "US915", 5, {11, 53, 125, 242, 242}, {10, 9, 8, 7, 8}, {125, 125, 125, 125, 500}},
+	{REGION_AU915, "AU915", 7, {51, 51, 51, 115, 242, 242, 242}, {12, 11, 10, 9, 8, 7, 8}, {125, 125, 125, 125, 125, 125, 500}},
+	{REGION_AS923, "AS923", 8, {0, 0, 11, 53, 125, 242, 242, 242}, {12, 11, 10, 9, 8, 7, 7, 0}, {125, 125, 125, 125, 125, 125, 250, 0}},
+};
+
+/**
+ * @brief Time on air in double precision, Semtech AN1200.13
+ * 		Explicit header, CRC on, coding rate 4/5, 8 symbols preamble
+ *
+ * @return double time on air in ms
+ */
+static double reference_airtime_ms(uint8_t sf, uint16_t bw, uint16_t length)
+{
+	double symbol_ms = pow(2.0, sf) / bw;
+	int low_dr = (sf >= 11) && (bw == 125);
+	double blocks = ceil((8.0 * length - 4.0 * sf + 28 + 16) / (4.0 * (sf - 2 * low_dr)));
+	double payload_symbols = 8 + (blocks > 0 ? blocks : 0) * 5;
+	return (8 + 4.25 + payload_symbols) * symbol_ms;
+}
+
+/**
+ * @brief Max payload and time on air of every data rate of EU868, EU433, US915, AU915 and AS923
+ *
+ */
+static void test_regions(void)
+{
+	for (size_t idx = 0; idx < sizeof(regions) / sizeof(regions[0]); idx++)
+	{
+		uint8_t region = regions[idx].region;
+		for (uint8_t dr = 0; dr < 16; dr++)
+		{
+			uint8_t expected = dr < regions[idx].dr_num ? regions[idx].max_payload[dr] : 0;
+			CHECK(lora_region_max_payload(region, dr) == expected, "%s DR%d max payload %d, expected %d",
+				  regions[idx].name, dr, lora_region_max_payload(region, dr), expected);
+		}
+		for (uint8_t dr = 0; dr < regions[idx].dr_num; dr++)
+		{
+			uint8_t max_payload = regions[idx].max_payload[dr];
+			if (max_payload == 0)
+			{
+				continue;
+			}
+			// The packed position must fit into every usable data rate
+			CHECK(PACK_FRAME_SIZE(pack_block_bits(PACK_HEADER) + pack_block_bits(PACK_POSITION)) <= max_payload,
+				  "%s DR%d packed position does not fit", regions[idx].name, dr);
+			uint32_t last = 0;
+			for (uint16_t size = 0; size <= max_payload; size++)
+			{
+				uint32_t airtime = lora_region_airtime_ms(region, dr, size);
+				uint16_t length = size + LORA_FRAME_OVERHEAD;
+				double reference = regions[idx].sf[dr] == 0 ? (length + 11) * 8 / 50.0 : reference_airtime_ms(regions[idx].sf[dr], regions[idx].bw[dr], length);
+				// Rounded up to full ms, the FSK formula adds 1 ms instead
+				CHECK((airtime >= reference - 1e-6) && (airtime < reference + 1.0 + 1e-6), "%s DR%d %d bytes airtime %u ms, reference %.3f ms",
+					  regions[idx].name, dr, size, airtime, reference);
+				CHECK(airtime >= last, "%s DR%d %d bytes airtime decreases", regions[idx].name, dr, size);
+				last = airtime;
+			}
+		}
+	}
+	// AS923-2..4 use the AS923 table
+	for (uint8_t region = 9; region <= 11; region++)
+	{
+		for (uint8_t dr = 0; dr < 8; dr++)
+		{
+			CHECK(lora_region_max_payload(region, dr) == lora_region_max_payload(REGION_AS923, dr), "AS923 variant %d DR%d", region, dr);
+		}
+	}
+	// Values of the TTN airtime calculator for 11 bytes application payload (61.7 ms, 1482.8 ms) and 242 bytes (176.8 ms)
+	CHECK(lora_region_airtime_ms(REGION_EU868, 5, 11) == 62, "EU868 DR5 11 bytes %u ms", lora_region_airtime_ms(REGION_EU868, 5, 11));
+	CHECK(lora_region_airtime_ms(REGION_EU868, 0, 11) == 1483, "EU868 DR0 11 bytes %u ms", lora_region_airtime_ms(REGION_EU868, 0, 11));
+	CHECK(lora_region_airtime_ms(REGION_US915, 4, 242) == 177, "US915 DR4 242 bytes %u ms", lora_region_airtime_ms(REGION_US915, 4, 242));
+}
+
+/**
+ * @brief Random value in [min, max]
+ *
+ */
+static int32_t random_range(int32_t min, int32_t max)
+{
+	uint32_t value = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+	return min + (int32_t)(value % (uint32_t)(max - min + 1));
+}
+
+/**
+ * @brief Find a decoded field
+ *
+ * @return const td_field_s* field, NULL if not found
+ */
+static const td_field_s *find_field(const td_field_s *fields, uint16_t num, uint8_t channel, uint8_t type)
+{
+	for (uint16_t idx = 0; idx < num; idx++)
+	{
+		if ((fields[idx].channel == channel) && (fields[idx].type == type))
+		{
+			return &fields[idx];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Max decoding error of a linear field, half a step for the encoder rounding and a full step for the decoder truncation
+ *
+ */
+static int32_t step_error(uint8_t idx)
+{
+	return (int32_t)((pack_schema[idx].div + pack_schema[idx].mul - 1) / pack_schema[idx].mul) * 3 / 2 + 1;
+}
+
+/**
+ * @brief Encode random frames for the max payload of random regions and data rates and decode them again
+ *
+ */
+static void test_round_trip(void)
+{
+	static const uint8_t max_sizes[] = {11, 51, 53, 115, 125, 242};
+	srand(20240610);
+	for (uint32_t run = 0; run < 20000; run++)
+	{
+		pack_values_s values;
+		values.battery = rand() % 8 == 0 ? PACK_BATT_UNKNOWN : random_range(0, 100);
+		values.has_position = rand() % 8 != 0;
+		values.latitude = random_range(-900000000, 900000000);
+		values.longitude = random_range(-1800000000, 1800000000);
+		values.altitude = random_range(-500000, 9000000);
+		values.sat_num = random_range(0, 15);
+		values.dop = random_range(0, 1260);
+		values.has_env = rand() % 2 != 0;
+		values.temperature = random_range(-400, 623);
+		values.humidity = random_range(0, 200);
+		values.pressure = random_range(3000, 13230);
+		values.has_gas = rand() % 2 != 0;
+		values.gas = random_range(10, 300000);
+		values.has_acc = rand() % 2 != 0;
+		for (uint8_t axis = 0; axis < 3; axis++)
+		{
+			values.acc[axis] = random_range(-2000, 2000);
+		}
+		values.event_num = rand() % 3 == 0 ? random_range(1, PACK_EVENT_MAX) : 0;
+		for (uint8_t event = 0; event < PACK_EVENT_MAX; event++)
+		{
+			values.events[event] = random_range(0, 255);
+		}
+		pack_values_s sent = values;
+		uint8_t max_size = max_sizes[rand() % sizeof(max_sizes)];
+
+		uint8_t buffer[256];
+		uint8_t size = pack_encode(&sent, buffer, max_size);
+		CHECK(size <= max_size, "run %u: %d bytes for max %d", run, size, max_size);
+		CHECK(sent.event_num <= values.event_num, "run %u: more events sent than given", run);
+		if (values.has_position && (values.event_num != 0))
+		{
+			// Position and one event need 12 bytes, at 11 bytes the events are left for the next uplink
+			CHECK((sent.event_num != 0) == (max_size > 11), "run %u: %d fence events sent with max %d", run, sent.event_num, max_size);
+		}
+		if (max_size == 242)
+		{
+			CHECK(sent.event_num == values.event_num, "run %u: events dropped with max 242", run);
+		}
+
+		td_uplink_s uplink = {buffer, size, TD_PACKED_FPORT, 0, NULL};
+		td_field_s fields[32];
+		uint16_t num = 0;
+		uint8_t status = td_decode(&uplink, fields, 32, &num);
+		CHECK(status == TD_OK, "run %u: decoder status %d", run, status);
+		if (status != TD_OK)
+		{
+			continue;
+		}
+
+		const td_field_s *field = find_field(fields, num, 0, TD_TYPE_BATTERY_SOC);
+		CHECK((field != NULL) && (field->value[0] == (values.battery == PACK_BATT_UNKNOWN ? -1 : values.battery)), "run %u: battery", run);
+
+		field = find_field(fields, num, 0, TD_TYPE_POSITION);
+		CHECK((field != NULL) == values.has_position, "run %u: position present %d", run, field != NULL);
+		if ((field != NULL) && values.has_position)
+		{
+			CHECK(labs(field->value[0] - values.latitude) <= step_error(PACK_F_latitude), "run %u: latitude %d, sent %d", run, field->value[0], values.latitude);
+			CHECK(labs(field->value[1] - values.longitude) <= step_error(PACK_F_longitude), "run %u: longitude %d, sent %d", run, field->value[1], values.longitude);
+			CHECK(labs(field->value[2] * 10 - values.altitude) <= 500, "run %u: altitude %d cm, sent %d mm", run, field->value[2], values.altitude);
+		}
+
+		const td_field_s *sats = find_field(fields, num, 12, 0);
+		const td_field_s *dop = find_field(fields, num, 0, TD_TYPE_DOP);
+		if ((sats != NULL) && (dop != NULL))
+		{
+			CHECK(sats->value[0] == values.sat_num, "run %u: satellites %d, sent %d", run, sats->value[0], values.sat_num);
+			CHECK(labs(dop->value[0] - values.dop) <= step_error(PACK_F_dop), "run %u: dop %d, sent %d", run, dop->value[0], values.dop);
+		}
+		else
+		{
+			CHECK((sats == NULL) && (dop == NULL), "run %u: incomplete quality block", run);
+		}
+		if (max_size == 242)
+		{
+			// Everything fits into the largest payload
+			CHECK((sats != NULL) == values.has_position, "run %u: quality block missing", run);
+			CHECK((find_field(fields, num, 4, 103) != NULL) == values.has_env, "run %u: env block", run);
+			CHECK((find_field(fields, num, 6, 2) != NULL) == values.has_gas, "run %u: gas block", run);
+			CHECK((find_field(fields, num, 64, 113) != NULL) == values.has_acc, "run %u: acc block", run);
+		}
+
+		if ((field = find_field(fields, num, 4, 103)) != NULL)
+		{
+			CHECK(values.has_env, "run %u: env block not given", run);
+			CHECK(field->value[0] == values.temperature, "run %u: temperature %d, sent %d", run, field->value[0], values.temperature);
+			field = find_field(fields, num, 3, 104);
+			CHECK((field != NULL) && (labs(field->value[0] - values.humidity) <= step_error(PACK_F_humidity)), "run %u: humidity, sent %d", run, values.humidity);
+			field = find_field(fields, num, 5, 115);
+			CHECK((field != NULL) && (labs(field->value[0] - values.pressure) <= step_error(PACK_F_pressure)), "run %u: pressure, sent %d", run, values.pressure);
+		}
+		if ((field = find_field(fields, num, 6, 2)) != NULL)
+		{
+			// 16 steps per octave
+			CHECK(values.has_gas, "run %u: gas block not given", run);
+			CHECK(fabs(log2((double)field->value[0] / values.gas)) <= 1.0 / 32 + 1e-3, "run %u: gas %d, sent %d", run, field->value[0], values.gas);
+		}
+		if ((field = find_field(fields, num, 64, 113)) != NULL)
+		{
+			CHECK(values.has_acc, "run %u: acc block not given", run);
+			for (uint8_t axis = 0; axis < 3; axis++)
+			{
+				CHECK(labs(field->value[axis] - values.acc[axis]) <= step_error(PACK_F_acc_x), "run %u: acc %d, sent %d", run, field->value[axis], values.acc[axis]);
+			}
+		}
+
+		uint8_t event_num = 0;
+		for (uint16_t idx = 0; idx < num; idx++)
+		{
+			if ((fields[idx].channel == 13) && (fields[idx].type == 0))
+			{
+				CHECK((event_num < sent.event_num) && (fields[idx].value[0] == values.events[event_num]), "run %u: event %d", run, event_num);
+				event_num++;
+			}
+		}
+		CHECK(event_num == sent.event_num, "run %u: %d events decoded, %d sent", run, event_num, sent.event_num);
+	}
+}
+
+/**
+ * @brief Add an LPP field with a big endian value
+ *
+ */
+static void lpp_add(uint8_t *buffer, uint8_t *size, uint8_t channel, uint8_t type, int32_t value, uint8_t bytes)
+{
+	buffer[(*size)++] = channel;
+	buffer[(*size)++] = type;
+	for (int8_t idx = bytes - 1; idx >= 0; idx--)
+	{
+		buffer[(*size)++] = (uint8_t)(value >> (8 * idx));
+	}
+}
+
+/**
+ * @brief Add a value in the big endian format of the LPP and compact position fields
+ *
+ */
+static void put_be(uint8_t *buffer, uint8_t *size, int32_t value, uint8_t bytes)
+{
+	for (int8_t idx = bytes - 1; idx >= 0; idx--)
+	{
+		buffer[(*size)++] = (uint8_t)(value >> (8 * idx));
+	}
+}
+
+/** Position formats of the payload assembly test */
+enum build_format_e
+{
+	BUILD_GNSS_4,
+	BUILD_GNSS_6,
+	BUILD_KEYFRAME,
+	BUILD_PACKED,
+	BUILD_FORMAT_NUM,
+};
+
+/**
+ * @brief Build uplinks of all position formats with the max payload of every data rate as payload_build() does
+ * 		No uplink may be larger than the max payload, the position must be in every uplink that can hold 11 bytes
+ *
+ */
+static void test_payload_build(void)
+{
+	static const char *format_names[BUILD_FORMAT_NUM] = {"GNSS 4", "GNSS 6", "keyframe", "packed"};
+	srand(20240611);
+	for (size_t idx = 0; idx < sizeof(regions) / sizeof(regions[0]); idx++)
+	{
+		uint8_t region = regions[idx].region;
+		for (uint8_t dr = 0; dr < regions[idx].dr_num; dr++)
+		{
+			uint8_t max_size = lora_region_max_payload(region, dr);
+			if (max_size == 0)
+			{
+				continue;
+			}
+			for (uint8_t format = 0; format < BUILD_FORMAT_NUM; format++)
+			{
+				for (uint8_t run = 0; run < 50; run++)
+				{
+					int32_t latitude = random_range(-900000000, 900000000);
+					int32_t longitude = random_range(-1800000000, 1800000000);
+					int32_t altitude = random_range(-500000, 9000000);
+
+					// LPP data as the firmware collects it in g_data_packet
+					uint8_t lpp[128];
+					uint8_t lpp_size = 0;
+					uint8_t record[16];
+					uint8_t record_size = 0;
+					if (format == BUILD_GNSS_4)
+					{
+						lpp_add(lpp, &lpp_size, PAYLOAD_LPP_GPS, PAYLOAD_LPP_GNSS_4, 0, 0);
+						put_be(lpp, &lpp_size, latitude / 1000, 3);
+						put_be(lpp, &lpp_size, longitude / 1000, 3);
+						put_be(lpp, &lpp_size, altitude / 10, 3);
+					}
+					else if (format == BUILD_GNSS_6)
+					{
+						lpp_add(lpp, &lpp_size, PAYLOAD_LPP_GPS, PAYLOAD_LPP_GNSS_6, 0, 0);
+						put_be(lpp, &lpp_size, latitude / 10, 4);
+						put_be(lpp, &lpp_size, longitude / 10, 4);
+						put_be(lpp, &lpp_size, altitude / 10, 3);
+					}
+					else if (format == BUILD_KEYFRAME)
+					{
+						// Keyframe as pos_codec_encode() writes it, altitude in m as zig-zag varint
+						record[record_size++] = 0xC0 | run;
+						put_be(record, &record_size, latitude, 4);
+						put_be(record, &record_size, longitude, 4);
+						int32_t alt_m = altitude / 1000;
+						uint32_t zigzag = ((uint32_t)alt_m << 1) ^ (uint32_t)(alt_m >> 31);
+						while (zigzag >= 0x80)
+						{
+							record[record_size++] = (uint8_t)(zigzag | 0x80);
+							zigzag >>= 7;
+						}
+						record[record_size++] = (uint8_t)zigzag;
+					}
+					if (format != BUILD_PACKED)
+					{
+						lpp_add(lpp, &lpp_size, LPP_CHANNEL_SATS, 0, random_range(0, 20), 1);
+						lpp_add(lpp, &lpp_size, LPP_CHANNEL_ACCURACY, 0, random_range(0, 255), 1);
+					}
+					lpp_add(lpp, &lpp_size, PAYLOAD_LPP_BATT, 116, random_range(330, 420), 2);
+					lpp_add(lpp, &lpp_size, PAYLOAD_LPP_HUMID, 104, random_range(0, 200), 1);
+					lpp_add(lpp, &lpp_size, PAYLOAD_LPP_TEMP, 103, random_range(-400, 600), 2);
+					lpp_add(lpp, &lpp_size, PAYLOAD_LPP_PRESS, 115, random_range(3000, 11000), 2);
+					lpp_add(lpp, &lpp_size, PAYLOAD_LPP_GAS, 2, random_range(10, 30000), 2);
+					uint8_t event_num = random_range(0, 2);
+					for (uint8_t event = 0; event < event_num; event++)
+					{
+						lpp_add(lpp, &lpp_size, LPP_CHANNEL_FENCE, 0, random_range(0, 255), 1);
+					}
+
+					uint8_t buffer[256];
+					uint8_t size;
+					uint8_t fport = 2;
+					if (format == BUILD_PACKED)
+					{
+						pack_fix_s fix;
+						fix.latitude = latitude;
+						fix.longitude = longitude;
+						fix.altitude = altitude;
+						fix.sat_num = random_range(0, 20);
+						fix.dop = random_range(0, 1260);
+						fix.valid = true;
+						size = payload_packed_frame(&fix, lpp, lpp_size, buffer, max_size);
+						fport = TD_PACKED_FPORT;
+					}
+					else
+					{
+						bool with_record = false;
+						size = payload_lpp_frame(record, record_size, lpp, lpp_size, buffer, max_size, &with_record);
+						fport = with_record ? TD_POS_FPORT : 2;
+						CHECK(with_record == ((record_size != 0) && (record_size <= max_size)), "%s DR%d %s: compact position sent %d",
+							  regions[idx].name, dr, format_names[format], with_record);
+					}
+					CHECK(size <= max_size, "%s DR%d %s: %d bytes, max %d", regions[idx].name, dr, format_names[format], size, max_size);
+
+					td_device_s device;
+					td_uplink_s uplink = {buffer, size, fport, 0, &device};
+					td_field_s fields[32];
+					uint16_t num = 0;
+					uint8_t status = td_decode(&uplink, fields, 32, &num);
+					CHECK(status == TD_OK, "%s DR%d %s: decoder status %d", regions[idx].name, dr, format_names[format], status);
+					const td_field_s *position = NULL;
+					for (uint16_t field = 0; field < num; field++)
+					{
+						if (fields[field].type == TD_TYPE_POSITION)
+						{
+							position = &fields[field];
+						}
+					}
+					CHECK(position != NULL, "%s DR%d %s: position missing", regions[idx].name, dr, format_names[format]);
+					if (position != NULL)
+					{
+						// 4 digit precision is the coarsest format
+						CHECK((labs(position->value[0] - latitude) <= 1000) && (labs(position->value[1] - longitude) <= 1000),
+							  "%s DR%d %s: position %d %d, sent %d %d", regions[idx].name, dr, format_names[format],
+							  position->value[0], position->value[1], latitude, longitude);
+						CHECK(labs(position->value[2] - altitude / 10) <= 100, "%s DR%d %s: altitude %d cm, sent %d mm",
+							  regions[idx].name, dr, format_names[format], position->value[2], altitude);
+					}
+				}
+			}
+		}
+	}
+}
+
+int main(void)
+{
+	test_regions();
+	test_round_trip();
+	test_payload_build();
+	if (failed != 0)
+	{
+		printf("%d checks failed\n", failed);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,661 @@
+/**
+ * @file tracker_decoder.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host side decoder for all uplink formats of the LPWAN Tracker
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <math.h>
+
+#include "tracker_decoder.h"
+#include "payload_schema.h"
+
+/** LPP channels used by the tracker */
+#define LPP_CHANNEL_BATT 2
+#define LPP_CHANNEL_HUMID 3
+#define LPP_CHANNEL_TEMP 4
+#define LPP_CHANNEL_PRESS 5
+#define LPP_CHANNEL_GAS 6
+#define LPP_CHANNEL_SATS 12
+#define LPP_CHANNEL_FENCE 13
+#define LPP_ACC 64
+
+/** Size of a Helium Mapper payload */
+#define HELIUM_SIZE 14
+/** Size of a stored position */
+#define STORE_RECORD_SIZE 14
+
+/** Output of a decoder */
+struct td_out_s
+{
+	td_field_s *fields;
+	uint16_t max;
+	uint16_t num;
+};
+
+/**
+ * @brief Add a field
+ *
+ * @return td_field_s* new field, NULL if the array is full
+ */
+static inline td_field_s *add_field(td_out_s *out, uint8_t channel, uint8_t type, uint8_t count)
+{
+	if (out->num == out->max)
+	{
+		return NULL;
+	}
+	td_field_s *field = &out->fields[out->num++];
+	field->channel = channel;
+	field->type = type;
+	field->count = count;
+	return field;
+}
+
+/**
+ * @brief Read a big endian value
+ *
+ */
+static inline int32_t get_value(const uint8_t *data, uint8_t size, bool is_signed)
+{
+	uint32_t value = 0;
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		value = (value << 8) | data[idx];
+	}
+	if (is_signed && (size < 4) && (value & (1UL << (8 * size - 1))))
+	{
+		value |= ~0UL << (8 * size);
+	}
+	return (int32_t)value;
+}
+
+/**
+ * @brief Read a zig-zag varint
+ *
+ * @return false if the varint exceeds the payload
+ */
+static bool get_varint(const uint8_t *data, uint8_t size, uint8_t *offset, int32_t *value)
+{
+	uint32_t zigzag = 0;
+	for (uint8_t shift = 0; shift < 35; shift += 7)
+	{
+		if (*offset >= size)
+		{
+			return false;
+		}
+		uint8_t byte = data[(*offset)++];
+		zigzag |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			*value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Longitude in 1e-7 degrees back into -180 to +180 degrees
+ *
+ */
+static inline int32_t wrap_lon(int64_t lon)
+{
+	if (lon > 1800000000LL)
+	{
+		lon -= 3600000000LL;
+	}
+	else if (lon < -1800000000LL)
+	{
+		lon += 3600000000LL;
+	}
+	return (int32_t)lon;
+}
+
+/**
+ * @brief Size of an LPP field value, 0 if the type is unknown
+ *
+ */
+static inline uint8_t lpp_data_size(uint8_t type)
+{
+	switch (type)
+	{
+	case 0:
+	case 1:
+	case 102:
+	case 104:
+		return 1;
+	case 2:
+	case 3:
+	case 101:
+	case 103:
+	case 115:
+	case 116:
+		return 2;
+	case 113:
+	case 134:
+		return 6;
+	case 136:
+		return 9;
+	case 137:
+		return 11;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Decode Cayenne LPP fields
+ *
+ */
+static uint8_t decode_lpp(const uint8_t *data, uint8_t size, uint8_t offset, td_out_s *out)
+{
+	while (offset < size)
+	{
+		if (size - offset < 2)
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		uint8_t channel = data[offset];
+		uint8_t type = data[offset + 1];
+		uint8_t data_size = lpp_data_size(type);
+		if (data_size == 0)
+		{
+			return TD_ERR_UNKNOWN_TYPE;
+		}
+		offset += 2;
+		if (offset + data_size > size)
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		const uint8_t *value = &data[offset];
+		offset += data_size;
+
+		td_field_s *field;
+		if ((type == 136) || (type == 137))
+		{
+			field = add_field(out, channel, TD_TYPE_POSITION, 4);
+			if (field == NULL)
+			{
+				return TD_ERR_NO_SPACE;
+			}
+			// 1e-4 or 1e-6 degrees into 1e-7 degrees, altitude is in cm in both formats
+			uint8_t coord_size = type == 136 ? 3 : 4;
+			int32_t factor = type == 136 ? 1000 : 10;
+			field->value[0] = get_value(value, coord_size, true) * factor;
+			field->value[1] = get_value(&value[coord_size], coord_size, true) * factor;
+			field->value[2] = get_value(&value[2 * coord_size], 3, true);
+			field->value[3] = type;
+			continue;
+		}
+		uint8_t count = ((type == 113) || (type == 134)) ? 3 : 1;
+		field = add_field(out, channel, type, count);
+		if (field == NULL)
+		{
+			return TD_ERR_NO_SPACE;
+		}
+		bool is_signed = (type == 2) || (type == 3) || (type == 103) || (type == 113) || (type == 134);
+		uint8_t value_size = data_size / count;
+		for (uint8_t idx = 0; idx < count; idx++)
+		{
+			field->value[idx] = get_value(&value[idx * value_size], value_size, is_signed);
+		}
+	}
+	return TD_OK;
+}
+
+/**
+ * @brief Decode a compact position, followed by LPP fields
+ *
+ */
+static uint8_t decode_compact(const uint8_t *data, uint8_t size, td_device_s *device, td_out_s *out)
+{
+	if (size < 1)
+	{
+		return TD_ERR_TRUNCATED;
+	}
+	uint8_t header = data[0];
+	uint8_t key_id = header & 0x3F;
+	uint8_t offset = 1;
+	int32_t lat;
+	int32_t lon;
+	int32_t alt = 0;
+	bool known = true;
+	if (header & 0x80)
+	{
+		if (size < 9)
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		lat = get_value(&data[1], 4, true);
+		lon = get_value(&data[5], 4, true);
+		offset = 9;
+		if (!get_varint(data, size, &offset, &alt))
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		if (device != NULL)
+		{
+			device->lat[key_id] = lat;
+			device->lon[key_id] = lon;
+			device->alt[key_id] = alt;
+			device->valid |= 1ULL << key_id;
+		}
+	}
+	else
+	{
+		int32_t d_lat;
+		int32_t d_lon;
+		int32_t d_alt = 0;
+		if (!get_varint(data, size, &offset, &d_lat) || !get_varint(data, size, &offset, &d_lon) ||
+			((header & 0x40) && !get_varint(data, size, &offset, &d_alt)))
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		known = (device != NULL) && (device->valid & (1ULL << key_id));
+		if (known)
+		{
+			lat = device->lat[key_id] + d_lat * 100;
+			lon = wrap_lon((int64_t)device->lon[key_id] + (int64_t)d_lon * 100);
+			alt = device->alt[key_id] + d_alt;
+		}
+	}
+
+	td_field_s *field = known ? add_field(out, 0, TD_TYPE_POSITION, 4) : add_field(out, 0, TD_TYPE_MISSING_KEYFRAME, 1);
+	if (field == NULL)
+	{
+		return TD_ERR_NO_SPACE;
+	}
+	if (known)
+	{
+		field->value[0] = lat;
+		field->value[1] = lon;
+		field->value[2] = alt * 100;
+		field->value[3] = TD_POS_FPORT;
+	}
+	else
+	{
+		field->value[0] = key_id;
+	}
+	return decode_lpp(data, size, offset, out);
+}
+
+/**
+ * @brief Decode a track batch
+ *
+ */
+static uint8_t decode_track(const uint8_t *data, uint8_t size, td_out_s *out)
+{
+	if ((size < 11) || (data[0] == 0) || (11 + (data[0] - 1) * 6 > size))
+	{
+		return TD_ERR_TRUNCATED;
+	}
+	int32_t time = -get_value(&data[1], 2, false);
+	int32_t lat = get_value(&data[3], 4, true);
+	int64_t lon = get_value(&data[7], 4, true);
+	uint8_t offset = 11;
+	for (uint8_t point = 0; point < data[0]; point++)
+	{
+		if (point != 0)
+		{
+			lat += get_value(&data[offset], 2, true) * 10;
+			lon += get_value(&data[offset + 2], 2, true) * 10;
+			time += get_value(&data[offset + 4], 2, false);
+			offset += 6;
+		}
+		td_field_s *field = add_field(out, 0, TD_TYPE_TRACK_POINT, 4);
+		if (field == NULL)
+		{
+			return TD_ERR_NO_SPACE;
+		}
+		field->value[0] = lat;
+		field->value[1] = wrap_lon(lon);
+		field->value[2] = 0;
+		field->value[3] = time;
+	}
+	return TD_OK;
+}
+
+/**
+ * @brief Decode a batch of stored positions
+ *
+ */
+static uint8_t decode_store(const uint8_t *data, uint8_t size, td_out_s *out)
+{
+	if ((size < 1) || (1 + data[0] * STORE_RECORD_SIZE > size))
+	{
+		return TD_ERR_TRUNCATED;
+	}
+	for (uint8_t record = 0; record < data[0]; record++)
+	{
+		const uint8_t *value = &data[1 + record * STORE_RECORD_SIZE];
+		td_field_s *field = add_field(out, 0, TD_TYPE_STORED, 4);
+		if (field == NULL)
+		{
+			return TD_ERR_NO_SPACE;
+		}
+		field->value[0] = get_value(&value[4], 4, true);
+		field->value[1] = get_value(&value[8], 4, true);
+		field->value[2] = get_value(&value[12], 2, true) * 100;
+		field->value[3] = get_value(value, 4, false);
+	}
+	return TD_OK;
+}
+
+/**
+ * @brief Decode a Helium Mapper payload
+ *
+ */
+static uint8_t decode_helium(const uint8_t *data, uint8_t size, td_out_s *out)
+{
+	if (size < HELIUM_SIZE)
+	{
+		return TD_ERR_TRUNCATED;
+	}
+	td_field_s *position = add_field(out, 0, TD_TYPE_POSITION, 4);
+	td_field_s *dop = add_field(out, 0, TD_TYPE_DOP, 1);
+	td_field_s *battery = add_field(out, 0, TD_TYPE_BATTERY_MV, 1);
+	if (battery == NULL)
+	{
+		return TD_ERR_NO_SPACE;
+	}
+	position->value[0] = get_value(data, 4, true);
+	position->value[1] = get_value(&data[4], 4, true);
+	position->value[2] = get_value(&data[8], 2, true) * 100;
+	position->value[3] = 0;
+	dop->value[0] = get_value(&data[10], 2, false);
+	battery->value[0] = get_value(&data[12], 2, false);
+	return TD_OK;
+}
+
+/**
+ * @brief Bit reader for the packed format, MSB first
+ *
+ */
+struct bit_reader_s
+{
+	const uint8_t *data;
+	uint16_t size_bits;
+	uint16_t bits;
+};
+
+/**
+ * @brief Read a field of the packed format in device units
+ *
+ * @return false if the field exceeds the payload
+ */
+static bool pack_get(bit_reader_s *reader, uint8_t idx, int32_t *value)
+{
+	const pack_field_s &field = pack_schema[idx];
+	if (reader->bits + field.bits > reader->size_bits)
+	{
+		return false;
+	}
+	uint32_t raw = 0;
+	for (uint8_t bit = 0; bit < field.bits; bit++)
+	{
+		raw = (raw << 1) | ((reader->data[reader->bits >> 3] >> (7 - (reader->bits & 7))) & 1);
+		reader->bits++;
+	}
+	int64_t signed_raw = raw;
+	if (field.is_signed && (raw & (1UL << (field.bits - 1))))
+	{
+		signed_raw -= 1LL << field.bits;
+	}
+	if (field.encoding == PACK_LOG2)
+	{
+		*value = (int32_t)lround(exp2((double)signed_raw / field.mul - field.offset) / field.unit);
+	}
+	else
+	{
+		*value = (int32_t)(signed_raw * field.div / field.mul - field.offset);
+	}
+	return true;
+}
+
+/**
+ * @brief Decode the packed format into the same fields as the LPP format
+ *
+ */
+static uint8_t decode_packed(const uint8_t *data, uint8_t size, td_out_s *out)
+{
+	bit_reader_s reader = {data, (uint16_t)(size * 8), 0};
+	int32_t flags;
+	int32_t battery;
+	if (!pack_get(&reader, PACK_F_flags, &flags) || !pack_get(&reader, PACK_F_battery, &battery))
+	{
+		return TD_ERR_TRUNCATED;
+	}
+	td_field_s *field = add_field(out, 0, TD_TYPE_BATTERY_SOC, 1);
+	if (field == NULL)
+	{
+		return TD_ERR_NO_SPACE;
+	}
+	field->value[0] = battery == PACK_BATT_UNKNOWN ? -1 : battery;
+
+	if (flags & PACK_POSITION)
+	{
+		int32_t value[3];
+		if (!pack_get(&reader, PACK_F_latitude, &value[0]) || !pack_get(&reader, PACK_F_longitude, &value[1]) ||
+			!pack_get(&reader, PACK_F_altitude, &value[2]))
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		if ((field = add_field(out, 0, TD_TYPE_POSITION, 4)) == NULL)
+		{
+			return TD_ERR_NO_SPACE;
+		}
+		field->value[0] = value[0];
+		field->value[1] = value[1];
+		field->value[2] = value[2] / 10;
+		field->value[3] = TD_PACKED_FPORT;
+	}
+	if (flags & PACK_QUALITY)
+	{
+		int32_t sats;
+		int32_t dop;
+		if (!pack_get(&reader, PACK_F_satellites, &sats) || !pack_get(&reader, PACK_F_dop, &dop))
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		if ((field = add_field(out, LPP_CHANNEL_SATS, 0, 1)) == NULL)
+		{
+			return TD_ERR_NO_SPACE;
+		}
+		field->value[0] = sats;
+		if ((field = add_field(out, 0, TD_TYPE_DOP, 1)) == NULL)
+		{
+			return TD_ERR_NO_SPACE;
+		}
+		field->value[0] = dop;
+	}
+	// Device units of the schema are the LPP units
+	static const struct
+	{
+		uint8_t block;
+		uint8_t idx;
+		uint8_t channel;
+		uint8_t type;
+	} lpp_map[] = {
+		{PACK_ENV, PACK_F_temperature, LPP_CHANNEL_TEMP, 103},
+		{PACK_ENV, PACK_F_humidity, LPP_CHANNEL_HUMID, 104},
+		{PACK_ENV, PACK_F_pressure, LPP_CHANNEL_PRESS, 115},
+		{PACK_GAS, PACK_F_gas, LPP_CHANNEL_GAS, 2},
+	};
+	for (uint8_t map = 0; map < sizeof(lpp_map) / sizeof(lpp_map[0]); map++)
+	{
+		if (!(flags & lpp_map[map].block))
+		{
+			continue;
+		}
+		int32_t value;
+		if (!pack_get(&reader, lpp_map[map].idx, &value))
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		if ((field = add_field(out, lpp_map[map].channel, lpp_map[map].type, 1)) == NULL)
+		{
+			return TD_ERR_NO_SPACE;
+		}
+		field->value[0] = value;
+	}
+	if (flags & PACK_ACC)
+	{
+		int32_t value[3];
+		if (!pack_get(&reader, PACK_F_acc_x, &value[0]) || !pack_get(&reader, PACK_F_acc_y, &value[1]) ||
+			!pack_get(&reader, PACK_F_acc_z, &value[2]))
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		if ((field = add_field(out, LPP_ACC, 113, 3)) == NULL)
+		{
+			return TD_ERR_NO_SPACE;
+		}
+		field->value[0] = value[0];
+		field->value[1] = value[1];
+		field->value[2] = value[2];
+	}
+	if (flags & PACK_FENCE)
+	{
+		int32_t count;
+		if (!pack_get(&reader, PACK_F_fence_count, &count))
+		{
+			return TD_ERR_TRUNCATED;
+		}
+		for (int32_t event = 0; event < count; event++)
+		{
+			int32_t value;
+			if (!pack_get(&reader, PACK_F_fence_event, &value))
+			{
+				return TD_ERR_TRUNCATED;
+			}
+			if ((field = add_field(out, LPP_CHANNEL_FENCE, 0, 1)) == NULL)
+			{
+				return TD_ERR_NO_SPACE;
+			}
+			field->value[0] = value;
+		}
+	}
+	return TD_OK;
+}
+
+/**
+ * @brief Decode one uplink
+ *
+ * @param uplink payload, fPort, flags and keyframes of the device
+ * @param fields array for the decoded fields
+ * @param max_fields size of the array
+ * @param num returns the number of decoded fields, also if an error occurred
+ * @return uint8_t td_status_e
+ */
+uint8_t td_decode(const td_uplink_s *uplink, td_field_s *fields, uint16_t max_fields, uint16_t *num)
+{
+	td_out_s out = {fields, max_fields, 0};
+	uint8_t status;
+	if (uplink->flags & TD_FLAG_HELIUM)
+	{
+		status = decode_helium(uplink->data, uplink->size, &out);
+	}
+	else
+	{
+		switch (uplink->fport)
+		{
+		case TD_TRACK_FPORT:
+			status = decode_track(uplink->data, uplink->size, &out);
+			break;
+		case TD_POS_FPORT:
+			status = decode_compact(uplink->data, uplink->size, uplink->device, &out);
+			break;
+		case TD_STORE_FPORT:
+			status = decode_store(uplink->data, uplink->size, &out);
+			break;
+		case TD_PACKED_FPORT:
+			status = decode_packed(uplink->data, uplink->size, &out);
+			break;
+		default:
+			status = decode_lpp(uplink->data, uplink->size, 0, &out);
+			break;
+		}
+	}
+	*num = out.num;
+	return status;
+}
+
+/**
+ * @brief Decode a batch of uplinks into one field array
+ * 		The uplinks of one device must be in the order they were received.
+ *
+ * @param uplinks uplinks
+ * @param uplink_num number of uplinks
+ * @param fields array for the decoded fields of all uplinks
+ * @param max_fields size of the array
+ * @param results result of each uplink, first field, number of fields and status
+ * @return size_t number of decoded fields
+ */
+size_t td_decode_batch(const td_uplink_s *uplinks, size_t uplink_num, td_field_s *fields, size_t max_fields, td_result_s *results)
+{
+	size_t used = 0;
+	for (size_t idx = 0; idx < uplink_num; idx++)
+	{
+		size_t space = max_fields - used;
+		uint16_t num = 0;
+		results[idx].first = used;
+		results[idx].status = td_decode(&uplinks[idx], &fields[used], space > 0xFFFF ? 0xFFFF : (uint16_t)space, &num);
+		results[idx].num = num;
+		used += num;
+	}
+	return used;
+}
+
+/**
+ * @brief Name of a field type
+ *
+ */
+const char *td_type_name(uint8_t type)
+{
+	switch (type)
+	{
+	case 0:
+		return "digital_in";
+	case 1:
+		return "digital_out";
+	case 2:
+		return "analog_in";
+	case 3:
+		return "analog_out";
+	case 101:
+		return "illuminance";
+	case 102:
+		return "presence";
+	case 103:
+		return "temperature";
+	case 104:
+		return "humidity";
+	case 113:
+		return "accelerometer";
+	case 115:
+		return "barometer";
+	case 116:
+		return "voltage";
+	case 134:
+		return "gyrometer";
+	case TD_TYPE_POSITION:
+		return "position";
+	case TD_TYPE_TRACK_POINT:
+		return "track_point";
+	case TD_TYPE_STORED:
+		return "stored";
+	case TD_TYPE_DOP:
+		return "dop";
+	case TD_TYPE_BATTERY_MV:
+		return "battery_mv";
+	case TD_TYPE_BATTERY_SOC:
+		return "battery_soc";
+	case TD_TYPE_MISSING_KEYFRAME:
+		return "missing_keyframe";
+	default:
+		return "unknown";
+	}
+}
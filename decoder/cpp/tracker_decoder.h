@@ -0,0 +1,95 @@
+/**
+ * @file tracker_decoder.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host side decoder for all uplink formats of the LPWAN Tracker
+ *        No allocations, no global state. The decoded fields are written into arrays of the caller.
+ *        Uplinks of different devices can be decoded in parallel threads,
+ *        the keyframes of one device (td_device_s) must only be used by one thread at a time.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef TRACKER_DECODER_H
+#define TRACKER_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** fPorts of the tracker formats, all other fPorts carry Cayenne LPP data */
+#define TD_TRACK_FPORT 11
+#define TD_POS_FPORT 12
+#define TD_STORE_FPORT 13
+#define TD_PACKED_FPORT 14
+
+/**
+ * Field types
+ * Cayenne LPP fields keep their LPP type and channel, the values are the raw LPP values:
+ *   0 digital input (channel 11 accuracy, low byte of HDOP * 100, channel 12 satellites, channel 13 geofence event)
+ *   2 analog input in 0.01, 103 temperature in 0.1 degC, 104 humidity in 0.5 %RH,
+ *   113 accelerometer in 0.001 G (3 values), 115 barometer in 0.1 hPa, 116 voltage in 0.01 V
+ * LPP GNSS fields (136 and 137) are returned as TD_TYPE_POSITION.
+ * Positions are latitude and longitude in 1e-7 degrees and altitude in cm.
+ */
+#define TD_TYPE_POSITION 0xF0		   // latitude, longitude, altitude, source format (136, 137, TD_POS_FPORT, TD_PACKED_FPORT, 0 = Helium)
+#define TD_TYPE_TRACK_POINT 0xF1	   // latitude, longitude, altitude (0), time in s relative to the uplink
+#define TD_TYPE_STORED 0xF2			   // latitude, longitude, altitude, UTC (0 if unknown)
+#define TD_TYPE_DOP 0xF3			   // DOP * 100
+#define TD_TYPE_BATTERY_MV 0xF4		   // battery voltage as sent by the Helium format
+#define TD_TYPE_BATTERY_SOC 0xF5	   // battery state of charge in %, -1 if unknown
+#define TD_TYPE_MISSING_KEYFRAME 0xF6 // compact position with an unknown keyframe, value[0] = keyframe id
+
+/** Result of decoding an uplink */
+enum td_status_e
+{
+	TD_OK = 0,
+	TD_ERR_TRUNCATED,	 // payload ends inside a field
+	TD_ERR_UNKNOWN_TYPE, // unknown Cayenne LPP type, the fields before are valid
+	TD_ERR_NO_SPACE,	 // field array is full, the fields before are valid
+};
+
+/** A decoded field */
+struct td_field_s
+{
+	uint8_t channel; // LPP channel, 0 for the non LPP formats
+	uint8_t type;	 // LPP type or TD_TYPE_*
+	uint8_t count;	 // number of valid values
+	int32_t value[4];
+};
+
+/** Keyframes of the compact position format of one device */
+struct td_device_s
+{
+	int32_t lat[64];
+	int32_t lon[64];
+	int32_t alt[64]; // m
+	uint64_t valid = 0;
+};
+
+/** Uplink flags */
+#define TD_FLAG_HELIUM 0x01 // payload is in the Helium Mapper format (ATC+GNSS=2)
+
+/** An uplink of a batch */
+struct td_uplink_s
+{
+	const uint8_t *data;
+	uint8_t size;
+	uint8_t fport;
+	uint8_t flags;		 // TD_FLAG_*
+	td_device_s *device; // keyframes of the device, NULL if unknown
+};
+
+/** Result of an uplink of a batch */
+struct td_result_s
+{
+	size_t first; // index of the first field in the field array
+	uint16_t num; // number of fields
+	uint8_t status; // td_status_e
+};
+
+uint8_t td_decode(const td_uplink_s *uplink, td_field_s *fields, uint16_t max_fields, uint16_t *num);
+size_t td_decode_batch(const td_uplink_s *uplinks, size_t uplink_num, td_field_s *fields, size_t max_fields, td_result_s *results);
+const char *td_type_name(uint8_t type);
+
+#endif
@@ -0,0 +1,150 @@
+"""
+Generate the decoders of the packed format (ATC+GNSS=4) from src/payload_schema.h
+
+Writes
+    packed_schema.py   field table used by tracker_decoder.py
+    packed_decoder.js  decodeUplink() for The Things Network / ChirpStack
+
+Run it after every change of PACK_SCHEMA in src/payload_schema.h:
+    python gen_decoders.py
+"""
+import math
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SCHEMA_FILE = os.path.join(HERE, "..", "src", "payload_schema.h")
+
+ENCODINGS = {"PACK_LINEAR": "linear", "PACK_LOG2": "log2", "PACK_COUNT": "count", "PACK_REPEAT": "repeat"}
+
+HEADER = "Generated by gen_decoders.py from src/payload_schema.h, do not edit"
+
+
+def c_number(text):
+    """Value of a C integer or floating point literal"""
+    text = text.strip()
+    if re.fullmatch(r"-?0[xX][0-9a-fA-F]+", text):
+        return int(text, 16)
+    if re.fullmatch(r"-?\d+", text):
+        return int(text)
+    return float(text)
+
+
+def read_schema(path):
+    """Read the block flags and the field table"""
+    with open(path) as schema_file:
+        source = schema_file.read()
+    blocks = {name: int(value, 16) for name, value in re.findall(r"#define (PACK_[A-Z]+) (0x[0-9A-Fa-f]+)", source)}
+    batt_unknown = int(re.search(r"#define PACK_BATT_UNKNOWN (\d+)", source).group(1))
+    fields = []
+    for args in re.findall(r"^\s*FIELD\(([^)]*)\)", source, re.MULTILINE):
+        block, name, bits, signed, encoding, offset, mul, div, unit = [arg.strip() for arg in args.split(",")]
+        offset, mul, div, unit = c_number(offset), c_number(mul), c_number(div), c_number(unit)
+        # Decimals of the decoded value from the resolution of the field
+        step = unit if encoding == "PACK_LOG2" else unit * div / mul
+        decimals = 0 if step >= 1 else min(9, math.ceil(-math.log10(step)) + 1)
+        fields.append((blocks[block], name, int(bits), signed == "true", ENCODINGS[encoding],
+                       offset, mul, div, unit, decimals))
+    if not fields:
+        raise ValueError("no fields found in " + path)
+    return fields, batt_unknown
+
+
+def write_python(fields, batt_unknown, path):
+    lines = ['"""%s"""' % HEADER, "",
+             "BATT_UNKNOWN = %d" % batt_unknown, "",
+             "# (block flag, name, bits, signed, encoding, offset, mul, div, unit, decimals)",
+             "FIELDS = ["]
+    for field in fields:
+        lines.append("    (0x%02X, %r, %d, %r, %r, %r, %r, %r, %r, %d)," % field)
+    lines.append("]")
+    with open(path, "w") as out:
+        out.write("\n".join(lines) + "\n")
+
+
+def write_js(fields, batt_unknown, path):
+    rows = ",\n".join("  [0x%02X, \"%s\", %d, %s, \"%s\", %r, %r, %r, %r, %d]" %
+                      (block, name, bits, "true" if signed else "false", encoding, offset, mul, div, unit, decimals)
+                      for block, name, bits, signed, encoding, offset, mul, div, unit, decimals in fields)
+    source = """// %s
+// Decoder for the packed format of the LPWAN Tracker on fPort 14
+var BATT_UNKNOWN = %d;
+// [block flag, name, bits, signed, encoding, offset, mul, div, unit, decimals]
+var FIELDS = [
+%s
+];
+
+function decodePacked(bytes) {
+  var bit = 0;
+  function get(bits, signed) {
+    if (bit + bits > 8 * bytes.length) {
+      throw new Error("packed field exceeds payload");
+    }
+    var value = 0;
+    for (var idx = 0; idx < bits; idx++) {
+      value = value * 2 + ((bytes[bit >> 3] >> (7 - (bit & 7))) & 1);
+      bit++;
+    }
+    if (signed && value >= Math.pow(2, bits - 1)) {
+      value -= Math.pow(2, bits);
+    }
+    return value;
+  }
+  function scale(field, raw) {
+    var value = field[4] === "log2" ? Math.pow(2, raw / field[6] - field[5]) : (raw * field[7] / field[6] - field[5]) * field[8];
+    return Number(value.toFixed(field[9]));
+  }
+  var result = {};
+  var flags = 0;
+  var count = 1;
+  for (var idx = 0; idx < FIELDS.length; idx++) {
+    var field = FIELDS[idx];
+    if (field[0] !== 0 && !(flags & field[0])) {
+      continue;
+    }
+    if (field[4] === "repeat") {
+      var values = [];
+      for (var rep = 0; rep < count; rep++) {
+        values.push(scale(field, get(field[2], field[3])));
+      }
+      result[field[1]] = values;
+      continue;
+    }
+    var raw = get(field[2], field[3]);
+    if (field[1] === "flags") {
+      flags = raw;
+    } else if (field[4] === "count") {
+      count = scale(field, raw);
+    } else {
+      result[field[1]] = field[1] === "battery" && raw === BATT_UNKNOWN ? null : scale(field, raw);
+    }
+  }
+  return result;
+}
+
+function decodeUplink(input) {
+  if (input.fPort !== 14) {
+    return { errors: ["not a packed payload"] };
+  }
+  try {
+    return { data: decodePacked(input.bytes) };
+  } catch (err) {
+    return { errors: [err.message] };
+  }
+}
+""" % (HEADER, batt_unknown, rows)
+    with open(path, "w") as out:
+        out.write(source)
+
+
+def main():
+    fields, batt_unknown = read_schema(SCHEMA_FILE)
+    write_python(fields, batt_unknown, os.path.join(HERE, "packed_schema.py"))
+    write_js(fields, batt_unknown, os.path.join(HERE, "packed_decoder.js"))
+    print("%d fields" % len(fields))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
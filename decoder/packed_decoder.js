@@ -0,0 +1,81 @@
+// Generated by gen_decoders.py from src/payload_schema.h, do not edit
+// Decoder for the packed format of the LPWAN Tracker on fPort 14
+var BATT_UNKNOWN = 127;
+// [block flag, name, bits, signed, encoding, offset, mul, div, unit, decimals]
+var FIELDS = [
+  [0x00, "flags", 8, false, "linear", 0, 1, 1, 1, 0],
+  [0x00, "battery", 7, false, "linear", 0, 1, 1, 1, 0],
+  [0x01, "latitude", 24, false, "linear", 900000000, 16777215, 1800000000, 1e-07, 6],
+  [0x01, "longitude", 25, false, "linear", 1800000000, 33554431, 3600000000, 1e-07, 6],
+  [0x01, "altitude", 16, true, "linear", 0, 1, 1000, 0.001, 0],
+  [0x02, "satellites", 4, false, "linear", 0, 1, 1, 1, 0],
+  [0x02, "dop", 6, false, "linear", 0, 1, 20, 0.01, 2],
+  [0x04, "temperature", 10, false, "linear", 400, 1, 1, 0.1, 2],
+  [0x04, "humidity", 7, false, "linear", 0, 1, 2, 0.5, 0],
+  [0x04, "pressure", 10, false, "linear", -3000, 1, 10, 0.1, 0],
+  [0x08, "gas", 8, false, "log2", 4, 16, 1, 0.01, 3],
+  [0x10, "acc_x", 10, true, "linear", 0, 1, 4, 0.001, 4],
+  [0x10, "acc_y", 10, true, "linear", 0, 1, 4, 0.001, 4],
+  [0x10, "acc_z", 10, true, "linear", 0, 1, 4, 0.001, 4],
+  [0x20, "fence_count", 3, false, "count", -1, 1, 1, 1, 0],
+  [0x20, "fence_event", 8, false, "repeat", 0, 1, 1, 1, 0]
+];
+
+function decodePacked(bytes) {
+  var bit = 0;
+  function get(bits, signed) {
+    if (bit + bits > 8 * bytes.length) {
+      throw new Error("packed field exceeds payload");
+    }
+    var value = 0;
+    for (var idx = 0; idx < bits; idx++) {
+      value = value * 2 + ((bytes[bit >> 3] >> (7 - (bit & 7))) & 1);
+      bit++;
+    }
+    if (signed && value >= Math.pow(2, bits - 1)) {
+      value -= Math.pow(2, bits);
+    }
+    return value;
+  }
+  function scale(field, raw) {
+    var value = field[4] === "log2" ? Math.pow(2, raw / field[6] - field[5]) : (raw * field[7] / field[6] - field[5]) * field[8];
+    return Number(value.toFixed(field[9]));
+  }
+  var result = {};
+  var flags = 0;
+  var count = 1;
+  for (var idx = 0; idx < FIELDS.length; idx++) {
+    var field = FIELDS[idx];
+    if (field[0] !== 0 && !(flags & field[0])) {
+      continue;
+    }
+    if (field[4] === "repeat") {
+      var values = [];
+      for (var rep = 0; rep < count; rep++) {
+        values.push(scale(field, get(field[2], field[3])));
+      }
+      result[field[1]] = values;
+      continue;
+    }
+    var raw = get(field[2], field[3]);
+    if (field[1] === "flags") {
+      flags = raw;
+    } else if (field[4] === "count") {
+      count = scale(field, raw);
+    } else {
+      result[field[1]] = field[1] === "battery" && raw === BATT_UNKNOWN ? null : scale(field, raw);
+    }
+  }
+  return result;
+}
+
+function decodeUplink(input) {
+  if (input.fPort !== 14) {
+    return { errors: ["not a packed payload"] };
+  }
+  try {
+    return { data: decodePacked(input.bytes) };
+  } catch (err) {
+    return { errors: [err.message] };
+  }
+}
@@ -0,0 +1,23 @@
+"""Generated by gen_decoders.py from src/payload_schema.h, do not edit"""
+
+BATT_UNKNOWN = 127
+
+# (block flag, name, bits, signed, encoding, offset, mul, div, unit, decimals)
+FIELDS = [
+    (0x00, 'flags', 8, False, 'linear', 0, 1, 1, 1, 0),
+    (0x00, 'battery', 7, False, 'linear', 0, 1, 1, 1, 0),
+    (0x01, 'latitude', 24, False, 'linear', 900000000, 16777215, 1800000000, 1e-07, 6),
+    (0x01, 'longitude', 25, False, 'linear', 1800000000, 33554431, 3600000000, 1e-07, 6),
+    (0x01, 'altitude', 16, True, 'linear', 0, 1, 1000, 0.001, 0),
+    (0x02, 'satellites', 4, False, 'linear', 0, 1, 1, 1, 0),
+    (0x02, 'dop', 6, False, 'linear', 0, 1, 20, 0.01, 2),
+    (0x04, 'temperature', 10, False, 'linear', 400, 1, 1, 0.1, 2),
+    (0x04, 'humidity', 7, False, 'linear', 0, 1, 2, 0.5, 0),
+    (0x04, 'pressure', 10, False, 'linear', -3000, 1, 10, 0.1, 0),
+    (0x08, 'gas', 8, False, 'log2', 4, 16, 1, 0.01, 3),
+    (0x10, 'acc_x', 10, True, 'linear', 0, 1, 4, 0.001, 4),
+    (0x10, 'acc_y', 10, True, 'linear', 0, 1, 4, 0.001, 4),
+    (0x10, 'acc_z', 10, True, 'linear', 0, 1, 4, 0.001, 4),
+    (0x20, 'fence_count', 3, False, 'count', -1, 1, 1, 1, 0),
+    (0x20, 'fence_event', 8, False, 'repeat', 0, 1, 1, 1, 0),
+]
@@ -0,0 +1,249 @@
+"""
+Reference decoder for the LPWAN Tracker payloads
+
+fPort 11: track batches (ATC+TRACK)
+fPort 12: compact position (ATC+GNSS=3) followed by Cayenne LPP data
+fPort 13: stored positions (ATC+SLOG)
+fPort 14: packed format (ATC+GNSS=4)
+other:    Cayenne LPP data (ATC+GNSS=0 or 1)
+
+The compact position needs the keyframes of earlier uplinks, keep one
+TrackerDecoder per device and feed it all uplinks in the order they were received.
+
+The packed format is defined in src/payload_schema.h, packed_schema.py is
+generated from it with gen_decoders.py.
+
+Usage: python tracker_decoder.py <fport> <hex payload> [<fport> <hex payload> ...]
+"""
+import json
+import sys
+
+import packed_schema
+
+TRACK_FPORT = 11
+POS_FPORT = 12
+STORE_FPORT = 13
+PACKED_FPORT = 14
+
+# LPP type: (name, size, divisor, signed, number of values)
+LPP_TYPES = {
+    0: ("digital_in", 1, 1, False, 1),
+    2: ("analog_in", 2, 100, True, 1),
+    103: ("temperature", 2, 10, True, 1),
+    104: ("humidity", 1, 2, False, 1),
+    113: ("accelerometer", 6, 1000, True, 3),
+    115: ("barometer", 2, 10, False, 1),
+    116: ("voltage", 2, 100, False, 1),
+}
+
+
+def get_int(data, offset, size, signed):
+    """Read a big endian integer"""
+    return int.from_bytes(data[offset:offset + size], "big", signed=signed)
+
+
+def get_varint(data, offset):
+    """Read a zig-zag varint, returns value and new offset"""
+    value = 0
+    shift = 0
+    while True:
+        if offset >= len(data):
+            raise ValueError("varint exceeds payload")
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return (value >> 1) ^ -(value & 1), offset
+
+
+def decode_lpp(data, offset=0):
+    """Decode Cayenne LPP records, including the GNSS formats of the tracker"""
+    result = []
+    while offset + 2 <= len(data):
+        channel = data[offset]
+        lpp_type = data[offset + 1]
+        offset += 2
+        if lpp_type in (136, 137):
+            size = 3 if lpp_type == 136 else 4
+            divisor = 10000 if lpp_type == 136 else 1000000
+            if offset + 2 * size + 3 > len(data):
+                raise ValueError("GNSS record exceeds payload")
+            result.append({
+                "channel": channel,
+                "type": "gps",
+                "latitude": get_int(data, offset, size, True) / divisor,
+                "longitude": get_int(data, offset + size, size, True) / divisor,
+                "altitude": get_int(data, offset + 2 * size, 3, True) / 100,
+            })
+            offset += 2 * size + 3
+            continue
+        if lpp_type not in LPP_TYPES:
+            raise ValueError("unknown LPP type %d" % lpp_type)
+        name, size, divisor, signed, count = LPP_TYPES[lpp_type]
+        if offset + size > len(data):
+            raise ValueError("LPP record exceeds payload")
+        step = size // count
+        values = [get_int(data, offset + idx * step, step, signed) / divisor for idx in range(count)]
+        result.append({"channel": channel, "type": name, "value": values if count > 1 else values[0]})
+        offset += size
+    return result
+
+
+def decode_track(data):
+    """Decode a track batch, times are seconds relative to the uplink"""
+    count = data[0]
+    age = get_int(data, 1, 2, False)
+    lat = get_int(data, 3, 4, True)
+    lon = get_int(data, 7, 4, True)
+    time = -age
+    points = [{"latitude": lat / 1e7, "longitude": lon / 1e7, "time": time}]
+    offset = 11
+    for _ in range(1, count):
+        lat += get_int(data, offset, 2, True) * 10
+        lon += get_int(data, offset + 2, 2, True) * 10
+        time += get_int(data, offset + 4, 2, False)
+        points.append({"latitude": lat / 1e7, "longitude": wrap_lon(lon) / 1e7, "time": time})
+        offset += 6
+    return {"track": points}
+
+
+def decode_store(data):
+    """Decode a batch of stored positions, UTC 0 means the time is unknown"""
+    count = data[0]
+    if 1 + count * 14 > len(data):
+        raise ValueError("stored positions exceed payload")
+    positions = []
+    for idx in range(count):
+        offset = 1 + idx * 14
+        positions.append({
+            "utc": get_int(data, offset, 4, False),
+            "latitude": get_int(data, offset + 4, 4, True) / 1e7,
+            "longitude": get_int(data, offset + 8, 4, True) / 1e7,
+            "altitude": get_int(data, offset + 12, 2, True),
+        })
+    return {"stored": positions}
+
+
+class BitReader:
+    """Read values MSB first from a bit stream"""
+
+    def __init__(self, data):
+        self.data = data
+        self.bit = 0
+
+    def get(self, bits, signed=False):
+        if self.bit + bits > 8 * len(self.data):
+            raise ValueError("packed field exceeds payload")
+        value = 0
+        for _ in range(bits):
+            value = (value << 1) | ((self.data[self.bit >> 3] >> (7 - (self.bit & 7))) & 1)
+            self.bit += 1
+        if signed and value & (1 << (bits - 1)):
+            value -= 1 << bits
+        return value
+
+
+def packed_value(field, raw):
+    """Physical value of a raw field of the packed format"""
+    _, _, _, _, encoding, offset, mul, div, unit, decimals = field
+    if encoding == "log2":
+        value = 2 ** (raw / mul - offset)
+    else:
+        value = (raw * div / mul - offset) * unit
+    return round(value, decimals) if decimals else int(round(value))
+
+
+def decode_packed(data):
+    """Decode the packed format, blocks are present if their flag is set"""
+    reader = BitReader(data)
+    result = {}
+    flags = 0
+    count = 1
+    for field in packed_schema.FIELDS:
+        block, name, bits, signed, encoding = field[:5]
+        if block and not flags & block:
+            continue
+        if encoding == "repeat":
+            result[name] = [packed_value(field, reader.get(bits, signed)) for _ in range(count)]
+            continue
+        raw = reader.get(bits, signed)
+        if name == "flags":
+            flags = raw
+        elif encoding == "count":
+            count = packed_value(field, raw)
+        elif name == "battery" and raw == packed_schema.BATT_UNKNOWN:
+            result[name] = None
+        else:
+            result[name] = packed_value(field, raw)
+    return {"packed": result}
+
+
+def wrap_lon(lon):
+    """Longitude in 1e-7 degrees back into -180 to +180 degrees"""
+    if lon > 1800000000:
+        lon -= 3600000000
+    elif lon < -1800000000:
+        lon += 3600000000
+    return lon
+
+
+class TrackerDecoder:
+    """Decoder with the keyframes of one device"""
+
+    def __init__(self):
+        self.keyframes = {}
+
+    def decode_position(self, data):
+        """Decode a compact position record, returns position and offset of the LPP data"""
+        header = data[0]
+        key_id = header & 0x3F
+        if header & 0x80:
+            lat = get_int(data, 1, 4, True)
+            lon = get_int(data, 5, 4, True)
+            alt, offset = get_varint(data, 9)
+            self.keyframes[key_id] = (lat, lon, alt)
+            return {"latitude": lat / 1e7, "longitude": lon / 1e7, "altitude": alt, "keyframe": key_id}, offset
+        d_lat, offset = get_varint(data, 1)
+        d_lon, offset = get_varint(data, offset)
+        d_alt = 0
+        if header & 0x40:
+            d_alt, offset = get_varint(data, offset)
+        if key_id not in self.keyframes:
+            # Keyframe was lost, the position can not be decoded until the next keyframe
+            return {"missing_keyframe": key_id}, offset
+        lat, lon, alt = self.keyframes[key_id]
+        return {
+            "latitude": (lat + d_lat * 100) / 1e7,
+            "longitude": wrap_lon(lon + d_lon * 100) / 1e7,
+            "altitude": alt + d_alt,
+            "reference": key_id,
+        }, offset
+
+    def decode(self, fport, data):
+        """Decode one uplink"""
+        if fport == TRACK_FPORT:
+            return decode_track(data)
+        if fport == POS_FPORT:
+            position, offset = self.decode_position(data)
+            return {"position": position, "lpp": decode_lpp(data, offset)}
+        if fport == STORE_FPORT:
+            return decode_store(data)
+        if fport == PACKED_FPORT:
+            return decode_packed(data)
+        return {"lpp": decode_lpp(data)}
+
+
+def main(args):
+    if (len(args) == 0) or (len(args) % 2 != 0):
+        print(__doc__)
+        return 1
+    decoder = TrackerDecoder()
+    for idx in range(0, len(args), 2):
+        print(json.dumps(decoder.decode(int(args[idx]), bytes.fromhex(args[idx + 1]))))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
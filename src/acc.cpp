@@ -11,6 +11,8 @@
 #include "app.h"
 
 void acc_int_callback(void);
+void acc_still_callback(void);
+static void acc_still_config(void);
 
 /** The LIS3DH sensor */
 LIS3DH acc_sensor(I2C_MODE, 0x18);
@@ -21,6 +23,27 @@ bool g_submit_acc = false;
 /** Flag if locations acquistion requires higher fix and more satellites */
 bool g_loc_high_prec = false;
 
+/** millis() of the last motion interrupt */
+volatile time_t g_last_motion = 0;
+
+/** Time in s without movement before the device is stationary, 0 = off */
+uint8_t g_still_time = 0;
+
+/** Inactivity threshold, 1 LSB = 16 mg in the 2 g range */
+#define ACC_STILL_THS 0x05
+
+/** Samples per burst read, the Wire receive buffer holds 64 bytes */
+#define ACC_BURST_SAMPLES 10
+/** Number of samples in the ring buffer */
+#define ACC_RING_SIZE 64
+
+/** Samples read from the FIFO, oldest first */
+static acc_sample_s acc_ring[ACC_RING_SIZE];
+/** Index of the oldest sample */
+static uint8_t ring_head = 0;
+/** Number of samples in the ring buffer */
+static uint8_t ring_num = 0;
+
 /**
  * @brief Initialize LIS3DH 3-axis
  * acceleration sensor
@@ -75,10 +98,14 @@ bool init_acc(void)
 	acc_sensor.writeRegister(LIS3DH_INT1_DURATION, data_to_write);
 
 	acc_sensor.readRegister(&data_to_write, LIS3DH_CTRL_REG5);
-	data_to_write &= 0xF3;									   // Clear bits of interest
+	data_to_write &= 0xB3;									   // Clear bits of interest
 	data_to_write |= 0x08;									   // Latch interrupt (Cleared by reading int1_src)
+	data_to_write |= 0x40;									   // Enable FIFO
 	acc_sensor.writeRegister(LIS3DH_CTRL_REG5, data_to_write); // Set interrupt to latching
 
+	// FIFO in stream mode, always holds the last 32 samples
+	acc_sensor.writeRegister(LIS3DH_FIFO_CTRL_REG, 0x80);
+
 	// Select interrupt pin 1
 	data_to_write = 0;
 	data_to_write |= 0x40; // AOI1 event (Generator 1 interrupt on pin 1)
@@ -108,31 +135,193 @@ bool init_acc(void)
 	// Set the interrupt callback function
 	attachInterrupt(INT1_PIN, acc_int_callback, RISING);
 
+	// Activity/inactivity detection on pin 2, keep the line defined while the LIS3DH is not driving it
+	pinMode(INT2_PIN, INPUT_PULLDOWN);
+	acc_still_config();
+
+	return true;
+}
+
+/**
+ * @brief Setup the activity/inactivity detection of the LIS3DH
+ * 		After g_still_time seconds below ACC_STILL_THS the LIS3DH sets INT2 high, on the next movement low.
+ * 		The data rate does not change, the LIS3DH runs with 10 Hz already.
+ *
+ */
+static void acc_still_config(void)
+{
+	detachInterrupt(INT2_PIN);
+	uint8_t data_to_write = 0;
+	acc_sensor.readRegister(&data_to_write, LIS3DH_CTRL_REG6);
+	if (g_still_time == 0)
+	{
+		// Threshold 0 switches the function off
+		acc_sensor.writeRegister(LIS3DH_ACT_THS, 0x00);
+		data_to_write &= 0xF7; // No activity interrupt on pin 2
+		acc_sensor.writeRegister(LIS3DH_CTRL_REG6, data_to_write);
+		return;
+	}
+	acc_sensor.writeRegister(LIS3DH_ACT_THS, ACC_STILL_THS);
+	// Duration is (8 * ACT_DUR + 1) / 10 Hz
+	acc_sensor.writeRegister(LIS3DH_ACT_DUR, (uint8_t)((g_still_time * 10 - 1) / 8));
+	data_to_write |= 0x08; // Activity interrupt on pin 2, active high
+	acc_sensor.writeRegister(LIS3DH_CTRL_REG6, data_to_write);
+	attachInterrupt(INT2_PIN, acc_still_callback, CHANGE);
+}
+
+/**
+ * @brief Set the time without movement before the device is stationary
+ *
+ * @param seconds 1 to ACC_STILL_MAX, 0 = off
+ */
+void acc_still_set(uint8_t seconds)
+{
+	g_still_time = seconds > ACC_STILL_MAX ? ACC_STILL_MAX : seconds;
+	if (!acc_ok)
+	{
+		return;
+	}
+	if (xSemaphoreTake(g_i2c_sem, 1000) == pdTRUE)
+	{
+		acc_still_config();
+		xSemaphoreGive(g_i2c_sem);
+	}
+	// Restart the periodic sending if the detection was switched off while stationary
+	api_wake_loop(ACC_STILL);
+}
+
+/**
+ * @brief Check if the LIS3DH reports the device as stationary
+ *
+ * @return true if the detection is enabled and there was no movement for g_still_time seconds
+ */
+bool acc_still(void)
+{
+	return acc_ok && (g_still_time != 0) && (digitalRead(INT2_PIN) == HIGH);
+}
+
+/**
+ * @brief Convert a left aligned sample value into mg
+ * 		The resolution (8, 10 or 12 bit) does not matter, the value is always left aligned
+ *
+ * @param raw register value
+ * @return int16_t value in mg
+ */
+static int16_t acc_raw_to_mg(int16_t raw)
+{
+	switch (acc_sensor.settings.accelRange)
+	{
+	case 4:
+		return raw >> 3;
+	case 8:
+		return raw >> 2;
+	case 16:
+		return (raw >> 4) * 12;
+	default: // 2 g
+		return raw >> 4;
+	}
+}
+
+/**
+ * @brief Read all samples from the FIFO into the ring buffer
+ * 		Samples are read with burst reads, the register address wraps from OUT_Z_H back to OUT_X_L.
+ * 		If the ring buffer is full, the oldest samples are overwritten.
+ *
+ * @return uint8_t number of samples read
+ */
+uint8_t acc_fifo_read(void)
+{
+	uint8_t fifo_src = 0;
+	acc_sensor.readRegister(&fifo_src, LIS3DH_FIFO_SRC_REG);
+	// Full FIFO shows 31 samples plus the overrun flag
+	uint8_t available = (fifo_src & 0x40) ? 32 : (fifo_src & 0x1F);
+	uint8_t read_num = 0;
+	while (read_num < available)
+	{
+		uint8_t burst[ACC_BURST_SAMPLES * 6];
+		uint8_t burst_num = available - read_num > ACC_BURST_SAMPLES ? ACC_BURST_SAMPLES : available - read_num;
+		if (acc_sensor.readRegisterRegion(burst, LIS3DH_OUT_X_L, burst_num * 6) != IMU_SUCCESS)
+		{
+			MYLOGE("ACC", "FIFO read failed");
+			break;
+		}
+		for (uint8_t idx = 0; idx < burst_num; idx++)
+		{
+			acc_sample_s *sample = &acc_ring[(ring_head + ring_num) % ACC_RING_SIZE];
+			sample->x = acc_raw_to_mg((int16_t)(burst[6 * idx] | (burst[6 * idx + 1] << 8)));
+			sample->y = acc_raw_to_mg((int16_t)(burst[6 * idx + 2] | (burst[6 * idx + 3] << 8)));
+			sample->z = acc_raw_to_mg((int16_t)(burst[6 * idx + 4] | (burst[6 * idx + 5] << 8)));
+			if (ring_num < ACC_RING_SIZE)
+			{
+				ring_num++;
+			}
+			else
+			{
+				ring_head = (ring_head + 1) % ACC_RING_SIZE;
+			}
+		}
+		read_num += burst_num;
+	}
+	return read_num;
+}
+
+/**
+ * @brief Number of samples in the ring buffer
+ *
+ */
+uint8_t acc_ring_count(void)
+{
+	return ring_num;
+}
+
+/**
+ * @brief Take the oldest sample from the ring buffer
+ *
+ * @param sample returns the sample
+ * @return true if a sample was available
+ */
+bool acc_ring_take(acc_sample_s *sample)
+{
+	if (ring_num == 0)
+	{
+		return false;
+	}
+	*sample = acc_ring[ring_head];
+	ring_head = (ring_head + 1) % ACC_RING_SIZE;
+	ring_num--;
 	return true;
 }
 
+/**
+ * @brief Remove all samples from the ring buffer
+ *
+ */
+void acc_ring_clear(void)
+{
+	ring_head = 0;
+	ring_num = 0;
+}
+
 /**
  * @brief Read ACC X, Y and Z values
- * 		Used only for debug, the values are not transmitted over LoRa
+ * 		The newest sample of the FIFO is used, the ring buffer is not changed
  *
  */
 void read_acc(void)
 {
-	float acc_x_f = acc_sensor.readFloatAccelX();
-	float acc_y_f = acc_sensor.readFloatAccelY();
-	float acc_z_f = acc_sensor.readFloatAccelZ();
-
-	int16_t acc_x = (int16_t)(acc_x_f * 1000.0);
-	int16_t acc_y = (int16_t)(acc_y_f * 1000.0);
-	int16_t acc_z = (int16_t)(acc_z_f * 1000.0);
+	acc_fifo_read();
+	if (ring_num == 0)
+	{
+		MYLOGE("ACC", "No ACC sample");
+		return;
+	}
+	acc_sample_s *sample = &acc_ring[(ring_head + ring_num - 1) % ACC_RING_SIZE];
 
-	MYLOG("ACC", "X %.3f %.3f %d", acc_x_f, acc_x_f * 1000.0, acc_x);
-	MYLOG("ACC", "Y %.3f %.3f %d", acc_y_f, acc_y_f * 1000.0, acc_y);
-	MYLOG("ACC", "Z %.3f %.3f %d", acc_z_f, acc_z_f * 1000.0, acc_z);
+	MYLOG("ACC", "X %d Y %d Z %d mg", sample->x, sample->y, sample->z);
 
 	if (g_submit_acc)
 	{
-		g_data_packet.addAccelerometer(LPP_ACC, acc_x_f, acc_y_f, acc_z_f);
+		g_data_packet.addAccelerometer(LPP_ACC, sample->x / 1000.0, sample->y / 1000.0, sample->z / 1000.0);
 	}
 }
 
@@ -143,9 +332,20 @@ void read_acc(void)
  */
 void acc_int_callback(void)
 {
+	g_last_motion = millis();
 	api_wake_loop(ACC_TRIGGER);
 }
 
+/**
+ * @brief Activity/inactivity interrupt handler
+ * @note gives semaphore to wake up main loop
+ *
+ */
+void acc_still_callback(void)
+{
+	api_wake_loop(ACC_STILL);
+}
+
 /**
  * @brief Clear ACC interrupt register to enable next wakeup
  *
@@ -162,10 +362,15 @@ void disable_acc(bool disable_int)
 	{
 		clear_acc_int();
 		detachInterrupt(INT1_PIN);
+		detachInterrupt(INT2_PIN);
 	}
 	else
 	{
 		clear_acc_int();
 		attachInterrupt(INT1_PIN, acc_int_callback, RISING);
+		if (g_still_time != 0)
+		{
+			attachInterrupt(INT2_PIN, acc_still_callback, CHANGE);
+		}
 	}
 }
\ No newline at end of file
@@ -32,6 +32,11 @@ bool delayed_active = false;
 /** Minimum delay between sending new locations, set to 45 seconds */
 time_t min_delay = 45000;
 
+/** Max time a track batch waits in the uplink queue */
+#define TRACK_MAX_AGE 600000
+/** Max time a batch of stored positions waits in the uplink queue */
+#define STORE_MAX_AGE 120000
+
 // Forward declaration
 void send_delayed(TimerHandle_t unused);
 void at_settings(void);
@@ -42,6 +47,12 @@ uint8_t send_fail = 0;
 /** Flag for low battery protection */
 bool low_batt_protection = false;
 
+/** Flag if the send interval differs from the LoRaWAN settings (geofences, track recording or motion state) */
+bool short_interval = false;
+
+/** Flag if the device is stationary and the periodic sending is stopped */
+bool parked = false;
+
 /** Initialization result */
 bool init_result = true;
 
@@ -70,6 +81,72 @@ WisCayenne g_data_packet(255);
 /** Semaphore for I2C usage */
 SemaphoreHandle_t g_i2c_sem;
 
+/**
+ * @brief Max time a packet waits in the uplink queue
+ * 		After the send interval the next position replaces it
+ *
+ * @return uint32_t time in ms
+ */
+static uint32_t uplink_max_age(void)
+{
+	return g_lorawan_settings.send_repeat_time != 0 ? g_lorawan_settings.send_repeat_time : 300000;
+}
+
+/**
+ * @brief Interval at which positions are reported
+ * 		Motion state interval if the classifier is enabled, otherwise the send interval of the LoRaWAN settings.
+ * 		Shorter while outside of all geofences.
+ *
+ * @return uint32_t interval in ms
+ */
+uint32_t report_interval(void)
+{
+	uint32_t interval = motion_interval();
+	if (interval == 0)
+	{
+		interval = g_lorawan_settings.send_repeat_time;
+	}
+	if (geofence_burst() && (g_geofence_burst * 1000UL < interval))
+	{
+		interval = g_geofence_burst * 1000UL;
+	}
+	return interval;
+}
+
+/**
+ * @brief Send interval of the current situation
+ * 		Report interval, shorter while recording a track.
+ *
+ * @return uint32_t interval in ms
+ */
+uint32_t send_interval(void)
+{
+	uint32_t interval = report_interval();
+	if (track_moving() && (g_track_interval * 1000UL < interval))
+	{
+		interval = g_track_interval * 1000UL;
+	}
+	return interval;
+}
+
+/**
+ * @brief Time until the send timer starts the next acquisition
+ *
+ * @return uint32_t interval in ms, 0 if the timer does not start acquisitions (no periodic sending or parked)
+ */
+uint32_t next_acq_interval(void)
+{
+	if ((g_lorawan_settings.send_repeat_time == 0) || parked)
+	{
+		return 0;
+	}
+	if (low_batt_protection)
+	{
+		return 1 * 60 * 60 * 1000;
+	}
+	return send_interval();
+}
+
 /**
  * @brief Application specific setup functions
  *
@@ -184,6 +261,11 @@ bool init_app(void)
 
 	// Initialize ACC sensor
 	acc_ok = init_acc();
+	if (g_motion_enable)
+	{
+		// Motion state selects send interval and GNSS profile
+		motion_set(true);
+	}
 
 	// Initialize display sensor
 	has_oled = oled_init();
@@ -238,6 +320,14 @@ bool init_app(void)
 	{
 		AT_PRINTF("   Helium Mapper data format\n");
 	}
+	else if (g_gps_compact)
+	{
+		AT_PRINTF("   Compact position + Cayenne LPP data format\n");
+	}
+	else if (g_gps_packed)
+	{
+		AT_PRINTF("   Packed data format\n");
+	}
 	else
 	{
 		AT_PRINTF("   Cayenne LPP data format\n");
@@ -246,6 +336,14 @@ bool init_app(void)
 	{
 		AT_PRINTF("   Add ACC values to payload\n");
 	}
+	if (g_motion_enable)
+	{
+		AT_PRINTF("Send interval by motion state\n");
+	}
+	if (g_still_time != 0)
+	{
+		AT_PRINTF("Stop sending after %ds without movement\n", g_still_time);
+	}
 	AT_PRINTF("============================\n");
 
 	if (gnss_ok)
@@ -333,6 +431,9 @@ void app_event_handler(void)
 		}
 		MYLOG("APP", "Timer wakeup");
 
+		// Check if the motion state changed
+		motion_start();
+
 		// // Initialization failed, report error over AT interface */
 		// if (!init_result)
 		// {
@@ -400,7 +501,10 @@ void app_event_handler(void)
 			{
 				// Battery is higher than 4V, change send time back to original setting
 				low_batt_protection = false;
-				api_timer_restart(g_lorawan_settings.send_repeat_time); // Set send time to original setting
+				if (!parked)
+				{
+					api_timer_restart(send_interval()); // Set send time to original setting
+				}
 				MYLOG("APP", "Battery protection deactivated");
 			}
 		}
@@ -408,36 +512,13 @@ void app_event_handler(void)
 		{
 			if (low_batt_protection || (gnss_option == NO_GNSS_INIT))
 			{
-				if (g_lorawan_settings.lorawan_enable)
-				{
-					// Send only the battery level over LoRaWAN
-					lmh_error_status result = send_lora_packet(g_data_packet.getBuffer(), g_data_packet.getSize());
-					switch (result)
-					{
-					case LMH_SUCCESS:
-						MYLOG("APP", "Packet enqueued");
-						break;
-					case LMH_BUSY:
-						AT_PRINTF("+EVT:BUSY\n");
-						MYLOGE("APP", "LoRa transceiver is busy");
-						break;
-					case LMH_ERROR:
-						AT_PRINTF("+EVT:SIZE_ERROR\n");
-						MYLOGE("APP", "Packet error, too big to send with current DR");
-						break;
-					}
-				}
-				else
+				// Send only the battery level
+				uint8_t send_buff[UPLINK_MAX_SIZE];
+				uint8_t send_fport = g_lorawan_settings.app_port;
+				uint8_t send_size = payload_build(send_buff, &send_fport);
+				if (!uplink_enqueue(send_buff, send_size, send_fport, UPLINK_PRIO_NORMAL, uplink_max_age(), NULL))
 				{
-					// Send only the battery level over LoRa
-					if (send_p2p_packet(g_data_packet.getBuffer(), g_data_packet.getSize()))
-					{
-						MYLOG("APP", "Packet enqueued");
-					}
-					else
-					{
-						MYLOGE("APP", "Packet send error");
-					}
+					MYLOGE("APP", "Uplink queue full");
 				}
 				g_data_packet.reset();
 			}
@@ -456,10 +537,16 @@ void app_event_handler(void)
 		MYLOG("APP", "ACC triggered");
 		read_acc();
 		clear_acc_int();
+		motion_start();
 
 		// Check time since last send
 		bool send_now = true;
-		if (g_lorawan_settings.send_repeat_time != 0)
+		if (track_moving())
+		{
+			// Track recording has its own fix interval
+			send_now = false;
+		}
+		else if (g_lorawan_settings.send_repeat_time != 0)
 		{
 			if ((millis() - last_pos_send) < min_delay)
 			{
@@ -488,10 +575,10 @@ void app_event_handler(void)
 			g_task_event_type |= STATUS;
 		}
 
-		// Reset the standard timer
-		if (g_lorawan_settings.send_repeat_time != 0)
+		// Reset the standard timer, while parked it stays off until the LIS3DH reports activity on INT2
+		if ((g_lorawan_settings.send_repeat_time != 0) && !track_moving() && !parked && !low_batt_protection)
 		{
-			api_timer_restart(g_lorawan_settings.send_repeat_time);
+			api_timer_restart(send_interval());
 		}
 	}
 
@@ -506,9 +593,9 @@ void app_event_handler(void)
 			if (!gnss_active)
 			{
 				// Reset the standard timer
-				if (g_lorawan_settings.send_repeat_time != 0)
+				if ((g_lorawan_settings.send_repeat_time != 0) && !parked && !low_batt_protection)
 				{
-					api_timer_restart(g_lorawan_settings.send_repeat_time);
+					api_timer_restart(send_interval());
 				}
 				if (has_env_sensor)
 				{
@@ -563,64 +650,129 @@ void app_event_handler(void)
 		Serial.printf("Packetsize %d\n", g_data_packet.getSize());
 #endif
 
-		if (g_lorawan_settings.lorawan_enable)
+		// Position in the packet, stored in the log if the packet is not delivered
+		store_record_s fix;
+		bool has_fix = store_log_take(&fix);
+
+		if (g_gnss_dist_skip && !g_gnss_dist_heartbeat)
+		{
+			// Position did not change enough, nothing to send
+			MYLOG("APP", "Moved less than %dm, uplink skipped", g_gnss_min_dist);
+		}
+		else if (g_track_hold)
 		{
-			// Check payload size
-			if (g_lorawan_settings.lora_region == 8)
+			// Position is in the track, only a finished batch is sent
+			uint8_t batch[242];
+			uint8_t batch_size = track_batch(batch);
+			if (batch_size != 0)
 			{
-				if (g_lorawan_settings.data_rate == 0)
+				if (uplink_enqueue(batch, batch_size, TRACK_FPORT, UPLINK_PRIO_NORMAL, TRACK_MAX_AGE, NULL))
 				{
-					AT_PRINTF("+EVT:DR_ERROR\n");
-					return;
+					MYLOG("APP", "Track batch queued");
+					track_batch_sent();
 				}
-			}
-
-			// Send packet over LoRaWAN
-			lmh_error_status result;
-			result = send_lora_packet(g_data_packet.getBuffer(), g_data_packet.getSize());
-			switch (result)
-			{
-			case LMH_SUCCESS:
-				MYLOG("APP", "Packet enqueued");
-				break;
-			case LMH_BUSY:
-				AT_PRINTF("+EVT:BUSY\n");
-				MYLOGE("APP", "LoRa transceiver is busy");
-				break;
-			case LMH_ERROR:
-				result = send_lora_packet(g_data_packet.getBuffer(), g_data_packet.getSize());
-				switch (result)
+				else
 				{
-				case LMH_SUCCESS:
-					MYLOG("APP", "Packet enqueued");
-					break;
-				case LMH_BUSY:
-					AT_PRINTF("+EVT:BUSY\n");
-					MYLOGE("APP", "LoRa transceiver is busy");
-					break;
-				case LMH_ERROR:
-					AT_PRINTF("+EVT:SIZE_ERROR RETRY\n");
-					result = send_lora_packet(g_data_packet.getBuffer(), g_data_packet.getSize());
-					AT_PRINTF("+EVT:SIZE_ERROR\n");
-					MYLOGE("APP", "Packet error, too big to send with current DR");
+					MYLOGE("APP", "Track batch not queued");
 				}
-				break;
 			}
 		}
 		else
 		{
-			// Send packet over LoRa
-			if (send_p2p_packet(g_data_packet.getBuffer(), g_data_packet.getSize()))
+			// Arrange the payload for the current data rate
+			uint8_t send_buff[UPLINK_MAX_SIZE];
+			uint8_t send_fport = g_lorawan_settings.app_port;
+			uint8_t send_size = payload_build(send_buff, &send_fport);
+
+			// Geofence events go before everything else
+			uint8_t priority = g_geofence_stats.event_num != 0 ? UPLINK_PRIO_HIGH : UPLINK_PRIO_NORMAL;
+			if (uplink_enqueue(send_buff, send_size, send_fport, priority, uplink_max_age(), has_fix ? &fix : NULL))
 			{
-				MYLOG("APP", "Packet enqueued");
+				MYLOG("APP", "Packet queued");
+				if (send_fport == POS_FPORT)
+				{
+					pos_codec_sent();
+				}
 			}
 			else
 			{
-				AT_PRINTF("+EVT:SIZE_ERROR\n");
-				MYLOGE("APP", "Packet too big");
+				MYLOGE("APP", "Uplink queue full");
 			}
 		}
 		g_data_packet.reset();
+
+		// Other send interval while outside of all geofences, while recording a track or by motion state
+		if (parked)
+		{
+			// Last position before the device stopped, no periodic sending until it moves again
+			api_timer_stop();
+		}
+		else if (!low_batt_protection && (g_lorawan_settings.send_repeat_time != 0))
+		{
+			uint32_t interval = send_interval();
+			if ((interval != g_lorawan_settings.send_repeat_time) || short_interval)
+			{
+				api_timer_restart(interval);
+				short_interval = interval != g_lorawan_settings.send_repeat_time;
+			}
+		}
+	}
+
+	// Send the next batch of stored positions
+	if ((g_task_event_type & STORE_DRAIN) == STORE_DRAIN)
+	{
+		g_task_event_type &= N_STORE_DRAIN;
+		uint8_t batch[242];
+		uint8_t batch_size = store_log_batch(batch);
+		if (batch_size != 0)
+		{
+			bool queued = uplink_enqueue(batch, batch_size, STORE_FPORT, UPLINK_PRIO_LOW, STORE_MAX_AGE, NULL);
+			MYLOG("APP", "Stored positions %s", queued ? "queued" : "not queued");
+			store_log_batch_sent(queued);
+		}
+	}
+
+	// Window of the motion classifier is in the FIFO
+	if ((g_task_event_type & MOTION_SAMPLE) == MOTION_SAMPLE)
+	{
+		g_task_event_type &= N_MOTION_SAMPLE;
+		if (motion_sample() && !parked && !low_batt_protection && (g_lorawan_settings.send_repeat_time != 0))
+		{
+			// Motion state changed, use its send interval now
+			uint32_t interval = send_interval();
+			api_timer_restart(interval);
+			short_interval = interval != g_lorawan_settings.send_repeat_time;
+		}
+	}
+
+	// LIS3DH detected that the device stopped or moves again
+	if ((g_task_event_type & ACC_STILL) == ACC_STILL)
+	{
+		g_task_event_type &= N_ACC_STILL;
+		bool still = acc_still();
+		if (still && !parked)
+		{
+			MYLOG("APP", "Stationary, send last position and stop periodic sending");
+			parked = true;
+			api_timer_stop();
+			api_wake_loop(STATUS);
+		}
+		else if (!still && parked)
+		{
+			MYLOG("APP", "Moving again, restart periodic sending");
+			parked = false;
+			if ((g_lorawan_settings.send_repeat_time != 0) && !low_batt_protection)
+			{
+				api_timer_restart(send_interval());
+			}
+		}
+	}
+
+	// Retry of a queued uplink
+	if ((g_task_event_type & UPLINK_SEND) == UPLINK_SEND)
+	{
+		g_task_event_type &= N_UPLINK_SEND;
+		uplink_send();
 	}
 
 	if ((g_task_event_type & OLED_OFF) == OLED_OFF)
@@ -717,6 +869,8 @@ void lora_data_handler(void)
 		g_task_event_type &= N_LORA_TX_FIN;
 
 		MYLOG("APP", "TX cycle %s", g_rx_fin_result ? "finished ACK" : "failed NAK");
+		// Result of the queued packet, the next packet is sent
+		uplink_tx_finished(g_rx_fin_result);
 
 		if ((g_lorawan_settings.confirmed_msg_enabled) && (g_lorawan_settings.lorawan_enable))
 		{
@@ -783,6 +937,11 @@ void lora_data_handler(void)
 		}
 
 		MYLOG("APP", "%s", log_buff);
+
+		if (g_lorawan_settings.lorawan_enable && (g_last_fport == GEOFENCE_FPORT))
+		{
+			AT_PRINTF("+EVT:FENCE %s\n", geofence_downlink(g_rx_lora_data, g_rx_data_len) ? "OK" : "ERROR");
+		}
 	}
 }
 
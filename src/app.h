@@ -82,6 +82,9 @@ bool init_app(void);
 void app_event_handler(void);
 void ble_data_handler(void) __attribute__((weak));
 void lora_data_handler(void);
+uint32_t report_interval(void);
+uint32_t send_interval(void);
+uint32_t next_acq_interval(void);
 
 /** Application stuff */
 /** Examples for application events */
@@ -95,24 +98,379 @@ void lora_data_handler(void);
 #define N_OLED_OFF 0b1110111111111111
 #define SETTINGS 0b0000100000000000
 #define N_SETTINGS 0b1111011111111111
+#define STORE_DRAIN 0b0000010000000000
+#define N_STORE_DRAIN 0b1111101111111111
+#define UPLINK_SEND 0b0000001000000000
+#define N_UPLINK_SEND 0b1111110111111111
+#define MOTION_SAMPLE 0b0000000100000000
+#define N_MOTION_SAMPLE 0b1111111011111111
+#define ACC_STILL 0b0000000010000000
+#define N_ACC_STILL 0b1111111101111111
 
 // Accelerometer stuff
 #include <SparkFunLIS3DH.h>
 #define INT1_PIN WB_IO1 // Slot A or WB_IO3 // Slot C or WB_IO5 // Slot D or WB_IO3 // Slot C or
+#define INT2_PIN WB_IO6 // INT2 of the LIS3DH has to be connected to a free IO pin
+/** Max time without movement before the device is stationary, ACT_DUR 255 at 10 Hz */
+#define ACC_STILL_MAX 204
 bool init_acc(void);
 void clear_acc_int(void);
 void read_acc(void);
+/** Accelerometer sample in mg */
+struct acc_sample_s
+{
+	int16_t x;
+	int16_t y;
+	int16_t z;
+};
+uint8_t acc_fifo_read(void);
+uint8_t acc_ring_count(void);
+bool acc_ring_take(acc_sample_s *sample);
+void acc_ring_clear(void);
 void disable_acc(bool disable_int);
+void acc_still_set(uint8_t seconds);
+bool acc_still(void);
 extern bool g_submit_acc;
+extern uint8_t g_still_time;
+extern LIS3DH acc_sensor;
+#include "motion_class.h"
+/** Send interval and GNSS profile of a motion state */
+struct motion_cfg_s
+{
+	uint16_t interval; // s
+	uint8_t profile;
+};
+/** Motion classifier statistics */
+struct motion_stats_s
+{
+	uint32_t windows = 0;
+	uint32_t changes = 0;
+	uint16_t std_mg = 0;  // standard deviation of the magnitude in the last window
+	uint16_t jerk_mg = 0; // mean change between samples in the last window
+};
+const char *motion_name(uint8_t state);
+void motion_start(void);
+bool motion_sample(void);
+uint32_t motion_interval(void);
+void motion_set(bool enable);
+extern bool g_motion_enable;
+extern uint8_t g_motion_state;
+extern motion_cfg_s g_motion_cfg[];
+extern motion_stats_s g_motion_stats;
+extern volatile time_t g_last_motion;
 extern bool acc_ok;
 
 // GNSS functions
 #define NO_GNSS_INIT 0
 #define RAK12500_GNSS 1
 #define RAK12501_GNSS 2
-#include "TinyGPS++.h"
 #include <SparkFun_u-blox_GNSS_Arduino_Library.h>
+#include "geo_dist.h"
+#include "nmea.h"
+#include "gnss_filter.h"
+/** Poll interval while waiting for the next NAV-PVT frame */
+#define GNSS_PVT_POLL_MS 250
+/** Values of one navigation epoch */
+struct gnss_epoch_s
+{
+	int32_t latitude = 0;  // 1e-7 degrees
+	int32_t longitude = 0; // 1e-7 degrees
+	int32_t altitude = 0;  // mm above ellipsoid
+	uint16_t accuracy = 0; // HDOP * 100, PDOP if the NAV-DOP frame is missing
+	uint32_t h_acc = 0;	   // horizontal accuracy estimate in mm
+	uint32_t utc = 0;	   // UTC as Unix time, 0 if unknown
+	uint8_t fix_type = 0;
+	uint8_t sat_num = 0;
+	bool fix_ok = false;
+};
+/** Bus time statistics of the NAV-PVT acquisition */
+struct gnss_bus_stats_s
+{
+	uint32_t epochs = 0;	   // Number of received navigation epochs
+	uint32_t polls = 0;		   // Total number of bus transactions
+	uint32_t bus_us_total = 0; // Total bus time in us
+	uint32_t bus_us_last = 0;  // Bus time of the last epoch in us
+	uint32_t polls_last = 0;   // Bus transactions of the last epoch
+};
+/** RAK12501 NMEA output setup, GGA and RMC only */
+#define GNSS_NMEA_OUTPUT "PCAS03,1,0,0,0,1,0,0,0,0,0,,,0,0"
+/** RAK12501 NMEA output setup during the sky check, GGA, GSV and RMC */
+#define GNSS_NMEA_OUTPUT_GSV "PCAS03,1,0,0,1,1,0,0,0,0,0,,,0,0"
+/** Max NMEA output per measurement with GGA and RMC enabled (2 sentences of max 82 bytes) */
+#define GNSS_NMEA_EPOCH_BYTES 164
+/** Sleep time between reading the Serial1 RX buffer at a measurement rate in ms, wake up before the buffer can be half full */
+#define GNSS_NMEA_RX_SLEEP_MS(rate) ((SERIAL_BUFFER_SIZE / 2) * (rate) / GNSS_NMEA_EPOCH_BYTES)
+/** Sleep time while GSV sentences are enabled, the UART can be fully loaded at 9600 baud */
+#define GNSS_NMEA_RX_SLEEP_GSV_MS ((SERIAL_BUFFER_SIZE / 2) * 1000 / 960)
+/** Results of the sky check */
+#define GNSS_SKY_PENDING 0
+#define GNSS_SKY_OK 1
+#define GNSS_SKY_NONE 2
+/** Observation window of the sky check in ms */
+#define GNSS_SKY_WINDOW_MS 12000
+/** Interval of UBX-NAV-SAT polls during the sky check in ms */
+#define GNSS_SKY_SAMPLE_MS 2000
+/** C/N0 in dB-Hz that shows an open view to the sky */
+#define GNSS_SKY_STRONG_CNO 30
+/** Increase of the max C/N0 in dB-Hz that counts as improving signals */
+#define GNSS_SKY_CNO_TREND 3
+/** Number of usable satellites that make a fix likely */
+#define GNSS_SKY_MIN_USABLE 4
+void gnss_sky_start(void);
+uint8_t gnss_sky_check(time_t elapsed);
+extern volatile bool g_gnss_no_sky;
+/** GNSS power strategies between acquisitions */
+#define GNSS_PWR_AUTO 0	   // Select from send interval and TTFF
+#define GNSS_PWR_BACKUP 1  // Main supply off, V_BCKP on the always-on rail keeps RTC, almanac and ephemeris
+#define GNSS_PWR_STANDBY 2 // Software backup/standby mode of the module
+#define GNSS_PWR_OFF 3	   // Start type only, main supply was off longer than the ephemeris are valid
+/** Send intervals up to 10 minutes always keep the module in standby for hot starts */
+#define GNSS_HOT_START_LIMIT 600000
+/** Ephemeris validity, longer intervals lose them even with V_BCKP */
+#define GNSS_EPHEMERIS_VALID 14400000
+/** Current during acquisition in uA */
+#define GNSS_ACQ_UA 25000
+/** Current in software backup/standby mode in uA */
+#define GNSS_STANDBY_UA_RAK12500 30
+#define GNSS_STANDBY_UA_RAK12501 500
+/** Default TTFF in ms until measured values are available */
+#define GNSS_TTFF_DEF_BACKUP 5000	 // hot start, RTC and ephemeris kept by V_BCKP
+#define GNSS_TTFF_DEF_STANDBY 3000 // hot start from the module standby
+#define GNSS_TTFF_DEF_OFF 28000	 // warm start, RTC and almanac kept, ephemeris expired
+uint8_t gnss_select_power_mode(uint32_t interval);
+void gnss_power_down(void);
+void gnss_power_up(void);
+void gnss_record_ttff(bool got_fix, uint32_t acq_time);
+extern uint8_t g_gnss_pwr_mode;
+extern uint8_t g_gnss_pwr_last;
+extern uint32_t gnss_uart_baud;
+extern uint32_t g_ttff_avg[];
+extern SFE_UBLOX_GNSS my_gnss;
+/** TTFF statistics with and without aiding */
+struct gnss_aid_stats_s
+{
+	uint32_t aided_fixes = 0;
+	uint32_t aided_ms = 0;
+	uint32_t unaided_fixes = 0;
+	uint32_t unaided_ms = 0;
+};
+void gnss_aid_load(void);
+void gnss_aid_store(int32_t latitude, int32_t longitude, int32_t altitude, uint32_t accuracy, uint32_t utc);
+void gnss_aid_inject(void);
+void gnss_aid_record(bool got_fix, uint32_t acq_time);
+extern gnss_aid_stats_s g_gnss_aid_stats;
+/** Averaging not used, take the fix */
+#define GNSS_AVG_OFF 0
+/** Averaging needs more fixes */
+#define GNSS_AVG_MORE 1
+/** Averaging window finished */
+#define GNSS_AVG_DONE 2
+/** Result of the last averaging */
+struct gnss_avg_stats_s
+{
+	uint8_t samples = 0;
+	uint8_t rejected = 0;
+	uint32_t error_mm = 0;
+	uint32_t window_ms = 0;
+};
+void gnss_avg_start(void);
+uint8_t gnss_avg_add(int32_t latitude, int32_t longitude, int32_t altitude, uint32_t accuracy);
+bool gnss_avg_result(int64_t *latitude, int64_t *longitude, int32_t *altitude);
+extern uint16_t g_gnss_avg_target;
+extern gnss_avg_stats_s g_gnss_avg_stats;
+/** Distance of the last position to the last sent position */
+struct gnss_dist_stats_s
+{
+	uint32_t last_dist = 0;	 // m
+	uint32_t suppressed = 0; // number of positions not sent
+};
+bool gnss_dist_check(int32_t latitude, int32_t longitude, bool force);
+extern uint16_t g_gnss_min_dist;
+extern bool g_gnss_dist_heartbeat;
+extern volatile bool g_gnss_dist_skip;
+extern gnss_dist_stats_s g_gnss_dist_stats;
+/** Max number of geofences */
+#define GEOFENCE_MAX 8
+/** Max number of points of a polygon */
+#define GEOFENCE_MAX_POINTS 12
+/** Fence types */
+#define GEOFENCE_NONE 0
+#define GEOFENCE_CIRCLE 1
+#define GEOFENCE_POLYGON 2
+#define GEOFENCE_PARTIAL 3 // polygon with less than 3 points
+/** Fences not used */
+#define GEOFENCE_OFF 0
+/** Transitions, positions inside at the send interval, outside at the burst interval */
+#define GEOFENCE_BURST 1
+/** Only transitions are sent */
+#define GEOFENCE_TRANSITION 2
+/** Event flag for entering a fence, the low bits are the fence number */
+#define GEOFENCE_EVT_ENTER 0x80
+/** fPort for geofence downlinks */
+#define GEOFENCE_FPORT 10
+/** A geofence, circles use the first point as center */
+struct geofence_s
+{
+	uint8_t type = GEOFENCE_NONE;
+	uint8_t num_points = 0;
+	uint32_t radius = 0; // m
+	int32_t lat[GEOFENCE_MAX_POINTS];
+	int32_t lon[GEOFENCE_MAX_POINTS];
+};
+/** Fence state of the last fix */
+struct geofence_stats_s
+{
+	uint8_t known = 0;	// bit set if the state of the fence is known
+	uint8_t inside = 0; // bit set if the position is inside of the fence
+	uint8_t event_num = 0;
+	uint8_t events[GEOFENCE_MAX];
+	uint32_t transitions = 0;
+};
+void geofence_load(void);
+const geofence_s *geofence_get(uint8_t idx);
+bool geofence_set_circle(uint8_t idx, int32_t latitude, int32_t longitude, uint32_t radius);
+bool geofence_set_polygon(uint8_t idx, int32_t *latitude, int32_t *longitude, uint8_t num, bool append);
+bool geofence_delete(uint8_t idx);
+bool geofence_check(int32_t latitude, int32_t longitude);
+void geofence_add_events(void);
+bool geofence_burst(void);
+bool geofence_downlink(uint8_t *data, uint8_t len);
+extern uint8_t g_geofence_mode;
+extern uint16_t g_geofence_burst;
+extern geofence_stats_s g_geofence_stats;
+/** Track statistics */
+struct track_stats_s
+{
+	uint32_t fixes = 0;	  // fixes added to tracks
+	uint32_t points = 0;  // points sent after simplification
+	uint32_t batches = 0; // batches sent
+	uint32_t dropped = 0; // points dropped because batches could not be sent
+};
+/** fPort for track batches */
+#define TRACK_FPORT 11
+bool track_moving(void);
+bool track_add(int32_t latitude, int32_t longitude);
+uint8_t track_batch(uint8_t *buffer);
+void track_batch_sent(void);
+extern uint16_t g_track_tolerance;
+extern uint16_t g_track_interval;
+extern volatile bool g_track_hold;
+extern track_stats_s g_track_stats;
+/** Max size of a compact position record */
+#define POS_RECORD_MAX 16
+/** fPort for the compact position format */
+#define POS_FPORT 12
+/** Compact position statistics */
+struct pos_codec_stats_s
+{
+	uint32_t keyframes = 0;
+	uint32_t deltas = 0;
+	uint32_t bytes = 0;
+};
+void pos_codec_reset(void);
+uint8_t pos_codec_encode(int32_t latitude, int32_t longitude, int32_t altitude, uint8_t *buffer);
+void pos_codec_sent(void);
+void pos_codec_tx_result(uint8_t header, bool ack);
+extern bool g_gps_compact;
+extern uint8_t g_pos_record[];
+extern uint8_t g_pos_record_size;
+extern pos_codec_stats_s g_pos_codec_stats;
+/** fPort for batches of stored positions */
+#define STORE_FPORT 13
+/** Store-and-forward log statistics */
+struct store_stats_s
+{
+	uint16_t stored = 0; // positions in the log
+	uint32_t logged = 0; // positions written to the log
+	uint32_t sent = 0;	 // positions sent from the log
+	uint32_t dropped = 0; // positions lost because the log was full or damaged
+};
+/** A stored position */
+struct store_record_s
+{
+	uint32_t utc; // Unix time, 0 if unknown
+	int32_t lat;  // 1e-7 degrees
+	int32_t lon;  // 1e-7 degrees
+	int16_t alt;  // m
+	uint8_t sat_num;
+	uint8_t check; // checksum, detects records that were not completely written
+};
+void store_log_load(void);
+void store_log_fix(int32_t latitude, int32_t longitude, int32_t altitude, uint8_t sat_num, uint32_t utc);
+bool store_log_take(store_record_s *record);
+void store_log_add(const store_record_s *record);
+void store_log_link_ok(void);
+uint8_t store_log_batch(uint8_t *buffer);
+void store_log_batch_sent(bool enqueued);
+void store_log_batch_result(bool success);
+extern uint8_t g_store_share;
+extern store_stats_s g_store_stats;
+/** Max payload size of a queued uplink */
+#define UPLINK_MAX_SIZE 242
+/** Uplink priorities */
+#define UPLINK_PRIO_LOW 0	 // stored positions
+#define UPLINK_PRIO_NORMAL 1 // positions, tracks, battery
+#define UPLINK_PRIO_HIGH 2	 // geofence events
+/** Uplink queue statistics */
+struct uplink_stats_s
+{
+	uint32_t queued = 0;	// packets added to the queue
+	uint32_t sent = 0;		// packets handed to the LoRaWAN stack
+	uint32_t delivered = 0; // TX cycles finished successfully (ACK received for confirmed uplinks)
+	uint32_t failed = 0;	// TX cycles failed
+	uint32_t expired = 0;	// packets not sent before their deadline
+	uint32_t dropped = 0;	// packets dropped because of a full queue, size or too many retries
+	uint32_t retries = 0;	// send retries because the transceiver was busy
+};
+bool uplink_enqueue(uint8_t *data, uint8_t size, uint8_t fport, uint8_t priority, uint32_t max_age, store_record_s *fix);
+void uplink_send(void);
+void uplink_tx_finished(bool success);
+uint8_t uplink_pending(void);
+extern uplink_stats_s g_uplink_stats;
+/** fPort for the packed format */
+#define PACKED_FPORT 14
+#include "payload_lpp.h"
+uint8_t payload_build(uint8_t *buffer, uint8_t *fport);
+extern bool g_gps_packed;
+extern pack_fix_s g_pack_fix;
+/** Number of GNSS profiles */
+#define GNSS_PROFILE_NUM 3
+/** Profile used if nothing was selected, matches the former fixed configuration */
+#define GNSS_PROFILE_DEFAULT 1
+/** Acquisition statistics of a GNSS profile */
+struct gnss_profile_stats_s
+{
+	uint32_t fixes = 0;
+	uint32_t no_fixes = 0;
+	uint32_t fix_ms = 0;	 // sum of the acquisition times with fix
+	uint32_t charge_mas = 0; // estimated charge of all acquisitions in mA * s
+};
+void gnss_apply_config(void);
+void gnss_profile_casic(void);
+const char *gnss_profile_name_get(uint8_t profile);
+bool gnss_profile_set(uint8_t profile);
+void gnss_profile_use(uint8_t profile);
+bool gnss_profile_is_runtime(void);
+uint16_t gnss_profile_meas_rate(void);
+void gnss_profile_load(void);
+void gnss_profile_record(bool got_fix, uint32_t acq_time);
+extern uint8_t g_gnss_profile;
+extern volatile bool g_gnss_profile_changed;
+extern gnss_profile_stats_s g_gnss_profile_stats[];
+bool gnss_probe(void);
+bool gnss_wait_rak12501(void);
+extern bool i2c_gnss;
+void gnss_dbd_restore(void);
+void gnss_dbd_save(uint32_t utc);
+/** Number of bins of the TTFF histogram */
+#define TTFF_BIN_NUM 9
+void gnss_ttff_add(bool got_fix, uint32_t acq_time);
+uint32_t gnss_acq_timeout(uint32_t max_timeout);
+void gnss_ttff_histogram(uint8_t *fix_bins, uint8_t *nofix_bins, uint8_t start_type);
+uint8_t gnss_ttff_bin_limit(uint8_t bin);
+extern uint32_t g_gnss_timeout;
 bool init_gnss(void);
+void gnss_send_nmea(const char *sentence);
 bool poll_gnss(void);
 void gnss_task(void *pvParameters);
 extern SemaphoreHandle_t g_gnss_sem;
@@ -122,13 +480,15 @@ extern uint8_t gnss_option;
 extern bool gnss_ok;
 extern bool g_loc_high_prec;
 extern volatile bool gnss_active;
+extern gnss_bus_stats_s g_gnss_bus_stats;
 
 // LoRaWan functions
 #include <wisblock_cayenne.h>
 extern WisCayenne g_data_packet;
-#define LPP_ACC 64
 
 extern uint8_t g_last_fport;
+uint8_t lora_max_payload(void);
+uint32_t lora_airtime_ms(uint8_t size);
 
 // Temperature + Humidity stuff
 #include <Adafruit_Sensor.h>
@@ -189,6 +549,7 @@ extern SemaphoreHandle_t g_i2c_sem;
 #define MODE_MENU 2
 #define PREC_MENU 3
 #define DISPLAY_MENU 4
+#define GPROF_MENU 5
 
 // Button stuff
 void init_button(void);
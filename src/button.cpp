@@ -214,26 +214,32 @@ void button_handler(void)
 			// UI LoRa settings ? ==> go back
 			else if (ui_screen == 1)
 			{
-				oled_show_ui(TOP_MENU, 255, 5);
+				oled_show_ui(TOP_MENU, 255, 6);
 				ui_screen = 0;
 			}
 			// UI Mode settings ? ==> ==> go back
 			else if (ui_screen == 2)
 			{
-				oled_show_ui(TOP_MENU, 255, 5);
+				oled_show_ui(TOP_MENU, 255, 6);
 				ui_screen = 0;
 			}
 			// UI Precission settings ? ==> go back
 			else if (ui_screen == 3)
 			{
-				oled_show_ui(TOP_MENU, 255, 5);
+				oled_show_ui(TOP_MENU, 255, 6);
 				ui_screen = 0;
 			}
 			// UI Display settings ? ==> go back
 			else if (ui_screen == 4)
 			{
 				// oled_show_top_ui();
-				oled_show_ui(TOP_MENU, 255, 5);
+				oled_show_ui(TOP_MENU, 255, 6);
+				ui_screen = 0;
+			}
+			// UI GNSS profile ? ==> go back
+			else if (ui_screen == 5)
+			{
+				oled_show_ui(TOP_MENU, 255, 6);
 				ui_screen = 0;
 			}
 		}
@@ -273,6 +279,8 @@ void button_handler(void)
 					MYLOG("BTN", "Switch to 4 digit precision");
 					g_gps_prec_6 = false;
 					g_is_helium = false;
+					g_gps_compact = false;
+					g_gps_packed = false;
 					save_gps_settings();
 					oled_show_ui(MODE_MENU, 1, 4);
 				}
@@ -297,6 +305,13 @@ void button_handler(void)
 				g_display_saver = true;
 				oled_show_ui(DISPLAY_MENU, 1, 3);
 			}
+			// UI GNSS profile ? ==> Select low power profile
+			else if (ui_screen == 5)
+			{
+				MYLOG("BTN", "Switch to GNSS profile 0");
+				gnss_profile_set(0);
+				oled_show_ui(GPROF_MENU, 1, 4);
+			}
 		}
 		else
 		{
@@ -309,7 +324,7 @@ void button_handler(void)
 					oled_on_off(true);
 				}
 				settings_ui = true;
-				oled_show_ui(TOP_MENU, 255, 5);
+				oled_show_ui(TOP_MENU, 255, 6);
 				ui_screen = 0;
 			}
 			else
@@ -355,11 +370,13 @@ void button_handler(void)
 			// UI Mode settings ? ==> Set 6-digit Cayenne LPP mode
 			else if (ui_screen == 2)
 			{
-				if (!g_gps_prec_6)
+				if (!g_gps_prec_6 || g_gps_compact || g_gps_packed)
 				{
 					MYLOG("BTN", "Switch to 6 digit precision");
 					g_gps_prec_6 = true;
 					g_is_helium = false;
+					g_gps_compact = false;
+					g_gps_packed = false;
 					save_gps_settings();
 					oled_show_ui(MODE_MENU, 2, 4);
 				}
@@ -383,6 +400,13 @@ void button_handler(void)
 				g_display_saver = false;
 				oled_show_ui(DISPLAY_MENU, 2, 3);
 			}
+			// UI GNSS profile ? ==> Select fast TTFF profile
+			else if (ui_screen == 5)
+			{
+				MYLOG("BTN", "Switch to GNSS profile 1");
+				gnss_profile_set(1);
+				oled_show_ui(GPROF_MENU, 2, 4);
+			}
 		}
 		else
 		{
@@ -409,6 +433,8 @@ void button_handler(void)
 					MYLOG("BTN", "Switch to Helium");
 					g_gps_prec_6 = false;
 					g_is_helium = true;
+					g_gps_compact = false;
+					g_gps_packed = false;
 					save_gps_settings();
 					oled_show_ui(MODE_MENU, 3, 4);
 				}
@@ -421,6 +447,13 @@ void button_handler(void)
 			else if (ui_screen == 4)
 			{
 			}
+			// UI GNSS profile ? ==> Select high accuracy profile
+			else if (ui_screen == 5)
+			{
+				MYLOG("BTN", "Switch to GNSS profile 2");
+				gnss_profile_set(2);
+				oled_show_ui(GPROF_MENU, 3, 4);
+			}
 		}
 		break;
 	case 0x05: // Five Clicks
@@ -434,8 +467,17 @@ void button_handler(void)
 			}
 		}
 		break;
-	case 6:				  // Six Clicks
-		if (g_enable_ble) // If BLE is enabled, restart Advertising
+	case 6: // Six Clicks
+		if (settings_ui)
+		{
+			// UI top level ? ==> GNSS profile
+			if (ui_screen == 0)
+			{
+				oled_show_ui(GPROF_MENU, g_gnss_profile + 1, 4);
+				ui_screen = 5;
+			}
+		}
+		else if (g_enable_ble) // If BLE is enabled, restart Advertising
 		{
 			MYLOG("BTN", "BLE On.");
 			restart_advertising(15);
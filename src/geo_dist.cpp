@@ -0,0 +1,139 @@
+/**
+ * @file geo_dist.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Integer equirectangular distance between positions in 1e-7 degrees
+ *        Error below 0.01% (plus the rounding to 1 m) for distances up to 10 km and latitudes up to 70 degrees
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "geo_dist.h"
+
+/** cos(0..90 degrees) in Q15 */
+static const uint16_t cos_table[91] = {
+	32768, 32763, 32748, 32723, 32688, 32643, 32588, 32524, 32449, 32365,
+	32270, 32166, 32052, 31928, 31795, 31651, 31499, 31336, 31164, 30983,
+	30792, 30592, 30382, 30163, 29935, 29698, 29452, 29197, 28932, 28660,
+	28378, 28088, 27789, 27482, 27166, 26842, 26510, 26170, 25822, 25466,
+	25102, 24730, 24351, 23965, 23571, 23170, 22763, 22348, 21926, 21498,
+	21063, 20622, 20174, 19720, 19261, 18795, 18324, 17847, 17364, 16877,
+	16384, 15886, 15384, 14876, 14365, 13848, 13328, 12803, 12275, 11743,
+	11207, 10668, 10126, 9580, 9032, 8481, 7927, 7371, 6813, 6252,
+	5690, 5126, 4560, 3993, 3425, 2856, 2286, 1715, 1144, 572,
+	0};
+
+/**
+ * @brief Cosine of a latitude, table with linear interpolation
+ *
+ * @param latitude 1e-7 degrees
+ * @return int32_t cosine in Q15
+ */
+int32_t geo_cos_q15(int32_t latitude)
+{
+	uint32_t abs_lat = latitude < 0 ? -(int64_t)latitude : latitude;
+	if (abs_lat >= 900000000)
+	{
+		return 0;
+	}
+	uint32_t deg = abs_lat / 10000000;
+	uint32_t frac = abs_lat % 10000000;
+	return cos_table[deg] - (int32_t)(((int64_t)(cos_table[deg] - cos_table[deg + 1]) * frac) / 10000000);
+}
+
+/**
+ * @brief Longitude difference on the shortest way around the date line
+ *
+ * @param lon_from longitude of the start in 1e-7 degrees
+ * @param lon_to longitude of the end in 1e-7 degrees
+ * @return int32_t difference in 1e-7 degrees, -180 to +180 degrees
+ */
+int32_t geo_lon_offset(int32_t lon_from, int32_t lon_to)
+{
+	int64_t d_lon = (int64_t)lon_to - lon_from;
+	if (d_lon > 1800000000)
+	{
+		d_lon -= 3600000000LL;
+	}
+	else if (d_lon < -1800000000)
+	{
+		d_lon += 3600000000LL;
+	}
+	return (int32_t)d_lon;
+}
+
+/**
+ * @brief Offset between two positions in mm, north and east on the mean latitude
+ *
+ * @param lat_from latitude of the start in 1e-7 degrees
+ * @param lon_from longitude of the start in 1e-7 degrees
+ * @param lat_to latitude of the end in 1e-7 degrees
+ * @param lon_to longitude of the end in 1e-7 degrees
+ * @param north offset to the north in mm
+ * @param east offset to the east in mm
+ */
+void geo_offset_mm(int32_t lat_from, int32_t lon_from, int32_t lat_to, int32_t lon_to, int64_t *north, int64_t *east)
+{
+	int64_t d_lat = (int64_t)lat_to - lat_from;
+	int64_t d_lon = geo_lon_offset(lon_from, lon_to);
+	int32_t cos_lat = geo_cos_q15((int32_t)(lat_from + d_lat / 2));
+	*north = (d_lat * GEO_MM_PER_E7_Q16) >> 16;
+	*east = (((d_lon * cos_lat) >> 15) * GEO_MM_PER_E7_Q16) >> 16;
+}
+
+/**
+ * @brief Integer square root
+ *
+ * @param value input
+ * @return uint64_t floor(sqrt(value))
+ */
+uint64_t geo_isqrt(uint64_t value)
+{
+	uint64_t result = 0;
+	uint64_t bit = 1ULL << 62;
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+	while (bit != 0)
+	{
+		if (value >= result + bit)
+		{
+			value -= result + bit;
+			result = (result >> 1) + bit;
+		}
+		else
+		{
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+	return result;
+}
+
+/**
+ * @brief Distance between two positions
+ *
+ * @param lat_from latitude of the start in 1e-7 degrees
+ * @param lon_from longitude of the start in 1e-7 degrees
+ * @param lat_to latitude of the end in 1e-7 degrees
+ * @param lon_to longitude of the end in 1e-7 degrees
+ * @return uint32_t distance in meters
+ */
+uint32_t geo_distance_m(int32_t lat_from, int32_t lon_from, int32_t lat_to, int32_t lon_to)
+{
+	int64_t north;
+	int64_t east;
+	geo_offset_mm(lat_from, lon_from, lat_to, lon_to, &north, &east);
+	uint64_t abs_n = north < 0 ? -north : north;
+	uint64_t abs_e = east < 0 ? -east : east;
+	// Squares of more than 2^31 mm would overflow, continue in meters
+	if ((abs_n > 0x7FFFFFFF) || (abs_e > 0x7FFFFFFF))
+	{
+		abs_n /= 1000;
+		abs_e /= 1000;
+		return (uint32_t)geo_isqrt(abs_n * abs_n + abs_e * abs_e);
+	}
+	return (uint32_t)(geo_isqrt(abs_n * abs_n + abs_e * abs_e) / 1000);
+}
@@ -0,0 +1,26 @@
+/**
+ * @file geo_dist.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Integer distance kernel for positions in 1e-7 degrees
+ *        No Arduino dependencies, the same code is used on the servers
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef GEO_DIST_H
+#define GEO_DIST_H
+
+#include <stdint.h>
+
+/** mm per 1e-7 degree on the mean earth sphere (R = 6371008.8 m) in Q16 */
+#define GEO_MM_PER_E7_Q16 728723
+
+int32_t geo_cos_q15(int32_t latitude);
+int32_t geo_lon_offset(int32_t lon_from, int32_t lon_to);
+void geo_offset_mm(int32_t lat_from, int32_t lon_from, int32_t lat_to, int32_t lon_to, int64_t *north, int64_t *east);
+uint64_t geo_isqrt(uint64_t value);
+uint32_t geo_distance_m(int32_t lat_from, int32_t lon_from, int32_t lat_to, int32_t lon_to);
+
+#endif
@@ -0,0 +1,482 @@
+/**
+ * @file geofence.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Geofences (circles and polygons) stored in the flash
+ *        Each fix is checked against the fences, enter and exit events are added to the payload
+ *        and control when a position is sent
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+using namespace Adafruit_LittleFS_Namespace;
+
+/** Max size of a fence in 1e-7 degrees, keeps the point in polygon products inside int64 */
+#define GEOFENCE_MAX_SPAN 900000000
+/** Max radius of a circle in m */
+#define GEOFENCE_MAX_RADIUS 100000
+/** 1e-7 degrees per m * 1000 */
+#define GEOFENCE_E7_PER_M_1000 89832
+
+/** Fence mode, GEOFENCE_OFF, GEOFENCE_BURST or GEOFENCE_TRANSITION */
+uint8_t g_geofence_mode = GEOFENCE_OFF;
+
+/** Send interval outside of all fences in seconds, 0 = normal send interval */
+uint16_t g_geofence_burst = 0;
+
+/** Fence state and events of the last fix */
+geofence_stats_s g_geofence_stats;
+
+/** Stored fences */
+static geofence_s fences[GEOFENCE_MAX];
+
+/** Bounding box of each fence, offsets to the first point in 1e-7 degrees */
+struct fence_box_s
+{
+	int32_t min_lat;
+	int32_t max_lat;
+	int32_t min_lon;
+	int32_t max_lon;
+};
+static fence_box_s boxes[GEOFENCE_MAX];
+
+/**
+ * @brief Get the filename of a fence
+ *
+ */
+static void fence_file_name(uint8_t idx, char *name)
+{
+	snprintf(name, 8, "FNC%d", idx);
+}
+
+/**
+ * @brief Calculate the bounding box of a fence
+ *
+ * @param idx fence number
+ * @return true if the fence is valid and not too large
+ */
+static bool fence_box(uint8_t idx)
+{
+	geofence_s *fence = &fences[idx];
+	fence_box_s *box = &boxes[idx];
+	if (fence->type == GEOFENCE_CIRCLE)
+	{
+		if ((fence->radius == 0) || (fence->radius > GEOFENCE_MAX_RADIUS))
+		{
+			return false;
+		}
+		int32_t d_lat = (int32_t)((int64_t)fence->radius * GEOFENCE_E7_PER_M_1000 / 1000);
+		int32_t cos_lat = geo_cos_q15(fence->lat[0]);
+		if (cos_lat < 328)
+		{
+			// Closer than ~0.6 degrees to a pole
+			return false;
+		}
+		int32_t d_lon = (int32_t)(((int64_t)d_lat << 15) / cos_lat);
+		box->min_lat = -d_lat;
+		box->max_lat = d_lat;
+		box->min_lon = -d_lon;
+		box->max_lon = d_lon;
+		return true;
+	}
+	if ((fence->type != GEOFENCE_POLYGON) || (fence->num_points < 3) || (fence->num_points > GEOFENCE_MAX_POINTS))
+	{
+		return false;
+	}
+	*box = {0, 0, 0, 0};
+	for (uint8_t point = 1; point < fence->num_points; point++)
+	{
+		int32_t d_lat = fence->lat[point] - fence->lat[0];
+		int32_t d_lon = geo_lon_offset(fence->lon[0], fence->lon[point]);
+		box->min_lat = d_lat < box->min_lat ? d_lat : box->min_lat;
+		box->max_lat = d_lat > box->max_lat ? d_lat : box->max_lat;
+		box->min_lon = d_lon < box->min_lon ? d_lon : box->min_lon;
+		box->max_lon = d_lon > box->max_lon ? d_lon : box->max_lon;
+	}
+	return ((box->max_lat - box->min_lat) <= GEOFENCE_MAX_SPAN) && ((box->max_lon - box->min_lon) <= GEOFENCE_MAX_SPAN);
+}
+
+/**
+ * @brief Point in polygon test (ray casting) on offsets to the first point
+ *
+ * @param fence polygon
+ * @param d_lat latitude offset of the position
+ * @param d_lon longitude offset of the position
+ * @return true if the position is inside
+ */
+static bool in_polygon(geofence_s *fence, int64_t d_lat, int64_t d_lon)
+{
+	bool inside = false;
+	for (uint8_t point = 0, prev = fence->num_points - 1; point < fence->num_points; prev = point++)
+	{
+		int64_t y_i = fence->lat[point] - fence->lat[0];
+		int64_t y_j = fence->lat[prev] - fence->lat[0];
+		if ((y_i > d_lat) == (y_j > d_lat))
+		{
+			continue;
+		}
+		int64_t x_i = geo_lon_offset(fence->lon[0], fence->lon[point]);
+		int64_t x_j = geo_lon_offset(fence->lon[0], fence->lon[prev]);
+		// Position is left of the crossing point of the edge, without a division
+		int64_t num = (d_lat - y_i) * (x_j - x_i);
+		int64_t den = y_j - y_i;
+		int64_t lhs = (d_lon - x_i) * den;
+		if (den > 0 ? (lhs < num) : (lhs > num))
+		{
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+/**
+ * @brief Save a fence to the flash
+ *
+ * @param idx fence number
+ */
+static void fence_save(uint8_t idx)
+{
+	char name[8];
+	fence_file_name(idx, name);
+	InternalFS.remove(name);
+	if (fences[idx].type == GEOFENCE_NONE)
+	{
+		return;
+	}
+	File fence_file(InternalFS);
+	if (fence_file.open(name, FILE_O_WRITE))
+	{
+		fence_file.write((const uint8_t *)&fences[idx], sizeof(geofence_s));
+		fence_file.close();
+	}
+}
+
+/**
+ * @brief Read the fences from the flash
+ *
+ */
+void geofence_load(void)
+{
+	File fence_file(InternalFS);
+	for (uint8_t idx = 0; idx < GEOFENCE_MAX; idx++)
+	{
+		char name[8];
+		fence_file_name(idx, name);
+		fences[idx].type = GEOFENCE_NONE;
+		if (fence_file.open(name, FILE_O_READ))
+		{
+			if (fence_file.read((void *)&fences[idx], sizeof(geofence_s)) != sizeof(geofence_s))
+			{
+				fences[idx].type = GEOFENCE_NONE;
+			}
+			fence_file.close();
+		}
+		bool valid = (fences[idx].type <= GEOFENCE_PARTIAL) && (fences[idx].num_points <= GEOFENCE_MAX_POINTS);
+		if (valid && ((fences[idx].type == GEOFENCE_CIRCLE) || (fences[idx].type == GEOFENCE_POLYGON)))
+		{
+			valid = fence_box(idx);
+		}
+		if (!valid)
+		{
+			MYLOG("FENCE", "Fence %d invalid", idx);
+			fences[idx].type = GEOFENCE_NONE;
+		}
+	}
+	g_geofence_stats.known = 0;
+}
+
+/**
+ * @brief Get a fence
+ *
+ * @param idx fence number
+ * @return const geofence_s* fence, type is GEOFENCE_NONE if not used
+ */
+const geofence_s *geofence_get(uint8_t idx)
+{
+	return &fences[idx < GEOFENCE_MAX ? idx : 0];
+}
+
+/**
+ * @brief Set a circle fence
+ *
+ * @param idx fence number
+ * @param latitude center in 1e-7 degrees
+ * @param longitude center in 1e-7 degrees
+ * @param radius radius in m
+ * @return true if the fence was saved
+ */
+bool geofence_set_circle(uint8_t idx, int32_t latitude, int32_t longitude, uint32_t radius)
+{
+	if (idx >= GEOFENCE_MAX)
+	{
+		return false;
+	}
+	geofence_s fence = fences[idx];
+	fences[idx].type = GEOFENCE_CIRCLE;
+	fences[idx].num_points = 1;
+	fences[idx].radius = radius;
+	fences[idx].lat[0] = latitude;
+	fences[idx].lon[0] = longitude;
+	if (!fence_box(idx))
+	{
+		fences[idx] = fence;
+		return false;
+	}
+	g_geofence_stats.known &= ~(1 << idx);
+	fence_save(idx);
+	return true;
+}
+
+/**
+ * @brief Set the points of a polygon fence
+ * 		A polygon can be sent in several parts, the fence is only used once it has 3 points
+ *
+ * @param idx fence number
+ * @param latitude array with the latitudes in 1e-7 degrees
+ * @param longitude array with the longitudes in 1e-7 degrees
+ * @param num number of points
+ * @param append true to add the points to the existing polygon
+ * @return true if the points were saved
+ */
+bool geofence_set_polygon(uint8_t idx, int32_t *latitude, int32_t *longitude, uint8_t num, bool append)
+{
+	if (idx >= GEOFENCE_MAX)
+	{
+		return false;
+	}
+	geofence_s fence = fences[idx];
+	uint8_t start = 0;
+	if (append)
+	{
+		if ((fence.type != GEOFENCE_POLYGON) && (fence.type != GEOFENCE_PARTIAL))
+		{
+			return false;
+		}
+		start = fence.num_points;
+	}
+	if ((num == 0) || (start + num > GEOFENCE_MAX_POINTS))
+	{
+		return false;
+	}
+	for (uint8_t point = 0; point < num; point++)
+	{
+		fences[idx].lat[start + point] = latitude[point];
+		fences[idx].lon[start + point] = longitude[point];
+	}
+	fences[idx].num_points = start + num;
+	fences[idx].radius = 0;
+	if (fences[idx].num_points < 3)
+	{
+		fences[idx].type = GEOFENCE_PARTIAL;
+	}
+	else
+	{
+		fences[idx].type = GEOFENCE_POLYGON;
+		if (!fence_box(idx))
+		{
+			fences[idx] = fence;
+			return false;
+		}
+	}
+	g_geofence_stats.known &= ~(1 << idx);
+	fence_save(idx);
+	return true;
+}
+
+/**
+ * @brief Delete a fence
+ *
+ * @param idx fence number
+ * @return true if the fence number is valid
+ */
+bool geofence_delete(uint8_t idx)
+{
+	if (idx >= GEOFENCE_MAX)
+	{
+		return false;
+	}
+	fences[idx].type = GEOFENCE_NONE;
+	g_geofence_stats.known &= ~(1 << idx);
+	g_geofence_stats.inside &= ~(1 << idx);
+	fence_save(idx);
+	return true;
+}
+
+/**
+ * @brief Check a position against the fences
+ * 		The first check of a fence only sets its state, later checks report enter and exit events.
+ * 		Not used with the Helium Mapper format.
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @return true if the position should be sent
+ * @return false if the fence mode suppresses the position
+ */
+bool geofence_check(int32_t latitude, int32_t longitude)
+{
+	g_geofence_stats.event_num = 0;
+	if ((g_geofence_mode == GEOFENCE_OFF) || g_is_helium)
+	{
+		return true;
+	}
+
+	bool has_fence = false;
+	uint8_t was_known = g_geofence_stats.known;
+	for (uint8_t idx = 0; idx < GEOFENCE_MAX; idx++)
+	{
+		geofence_s *fence = &fences[idx];
+		if ((fence->type != GEOFENCE_CIRCLE) && (fence->type != GEOFENCE_POLYGON))
+		{
+			continue;
+		}
+		has_fence = true;
+
+		// Bounding box first, most fixes are far away from most fences
+		int32_t d_lat = latitude - fence->lat[0];
+		int32_t d_lon = geo_lon_offset(fence->lon[0], longitude);
+		bool inside = (d_lat >= boxes[idx].min_lat) && (d_lat <= boxes[idx].max_lat) && (d_lon >= boxes[idx].min_lon) && (d_lon <= boxes[idx].max_lon);
+		if (inside)
+		{
+			if (fence->type == GEOFENCE_CIRCLE)
+			{
+				inside = geo_distance_m(fence->lat[0], fence->lon[0], latitude, longitude) <= fence->radius;
+			}
+			else
+			{
+				inside = in_polygon(fence, d_lat, d_lon);
+			}
+		}
+
+		uint8_t mask = 1 << idx;
+		bool was_inside = (g_geofence_stats.inside & mask) != 0;
+		if (((g_geofence_stats.known & mask) != 0) && (inside != was_inside))
+		{
+			MYLOG("FENCE", "%s fence %d", inside ? "Entered" : "Left", idx);
+			g_geofence_stats.events[g_geofence_stats.event_num++] = inside ? (GEOFENCE_EVT_ENTER | idx) : idx;
+			g_geofence_stats.transitions++;
+		}
+		g_geofence_stats.known |= mask;
+		if (inside)
+		{
+			g_geofence_stats.inside |= mask;
+		}
+		else
+		{
+			g_geofence_stats.inside &= ~mask;
+		}
+	}
+
+	// The first position after a fence change or a restart tells the fence state
+	if (!has_fence || (g_geofence_stats.event_num != 0) || (g_geofence_stats.known != was_known))
+	{
+		return true;
+	}
+	return g_geofence_mode != GEOFENCE_TRANSITION;
+}
+
+/**
+ * @brief Add the enter and exit events of the last check to the payload
+ *
+ */
+void geofence_add_events(void)
+{
+	for (uint8_t event = 0; event < g_geofence_stats.event_num; event++)
+	{
+		g_data_packet.addDigitalInput(LPP_CHANNEL_FENCE, g_geofence_stats.events[event]);
+	}
+}
+
+/**
+ * @brief Check if the burst send interval is used
+ *
+ * @return true if the last position was outside of all fences
+ */
+bool geofence_burst(void)
+{
+	return (g_geofence_mode == GEOFENCE_BURST) && (g_geofence_burst != 0) && (g_geofence_stats.known != 0) && (g_geofence_stats.inside == 0);
+}
+
+/**
+ * @brief Read a big endian int32 from a downlink
+ *
+ */
+static int32_t get_int32(uint8_t *data)
+{
+	return (int32_t)(((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3]);
+}
+
+/**
+ * @brief Handle a geofence downlink
+ * 		0x01 idx lat[4] lon[4] radius[2] : set circle
+ * 		0x02 idx (lat[4] lon[4]) * n : set polygon
+ * 		0x03 idx (lat[4] lon[4]) * n : add points to polygon
+ * 		0x04 idx : delete fence, idx 0xFF deletes all fences
+ * 		0x05 mode burst[2] : set fence mode and burst interval in seconds
+ * 		Values are big endian, positions in 1e-7 degrees
+ *
+ * @param data downlink payload
+ * @param len length of the payload
+ * @return true if the command was valid
+ */
+bool geofence_downlink(uint8_t *data, uint8_t len)
+{
+	if (len < 2)
+	{
+		return false;
+	}
+	switch (data[0])
+	{
+	case 0x01:
+		if (len != 12)
+		{
+			return false;
+		}
+		return geofence_set_circle(data[1], get_int32(&data[2]), get_int32(&data[6]), (data[10] << 8) | data[11]);
+	case 0x02:
+	case 0x03:
+	{
+		if (((len - 2) % 8) != 0)
+		{
+			return false;
+		}
+		uint8_t num = (len - 2) / 8;
+		if (num > GEOFENCE_MAX_POINTS)
+		{
+			return false;
+		}
+		int32_t latitude[GEOFENCE_MAX_POINTS];
+		int32_t longitude[GEOFENCE_MAX_POINTS];
+		for (uint8_t point = 0; point < num; point++)
+		{
+			latitude[point] = get_int32(&data[2 + point * 8]);
+			longitude[point] = get_int32(&data[6 + point * 8]);
+		}
+		return geofence_set_polygon(data[1], latitude, longitude, num, data[0] == 0x03);
+	}
+	case 0x04:
+		if (data[1] == 0xFF)
+		{
+			for (uint8_t idx = 0; idx < GEOFENCE_MAX; idx++)
+			{
+				geofence_delete(idx);
+			}
+			return true;
+		}
+		return geofence_delete(data[1]);
+	case 0x05:
+		if ((len != 4) || (data[1] > GEOFENCE_TRANSITION))
+		{
+			return false;
+		}
+		g_geofence_mode = data[1];
+		g_geofence_burst = (data[2] << 8) | data[3];
+		save_gps_settings();
+		return true;
+	default:
+		return false;
+	}
+}
@@ -11,8 +11,7 @@
 #include "app.h"
 
 // The GNSS object
-TinyGPSPlus my_rak1910_gnss; // RAK12501_GNSS
-SFE_UBLOX_GNSS my_gnss;		 // RAK12500_GNSS
+SFE_UBLOX_GNSS my_gnss; // RAK12500_GNSS
 
 /** LoRa task handle */
 TaskHandle_t gnss_task_handle;
@@ -37,14 +36,147 @@ uint8_t gnss_option = 0;
 /** Flag if acquisition is active */
 volatile bool gnss_active = false;
 
+/** Flag if the last acquisition was aborted because no sky was visible */
+volatile bool g_gnss_no_sky = false;
+
 /** Switcher between different fake locations */
 uint8_t fake_gnss_selector = 0;
 
+/** Last navigation epoch decoded from an auto NAV-PVT frame */
+gnss_epoch_s pvt_epoch;
+
+/** Flag if a new NAV-PVT frame was received */
+volatile bool pvt_new_epoch = false;
+
+/** PDOP and time of week of the last NAV-PVT frame */
+static uint16_t pvt_pdop = 0;
+static uint32_t pvt_itow = 0;
+/** HDOP and time of week of the last NAV-DOP frame */
+static uint16_t dop_hdop = 0;
+static uint32_t dop_itow = 0;
+
+/** I2C/UART bus time statistics of the NAV-PVT acquisition */
+gnss_bus_stats_s g_gnss_bus_stats;
+
+/** Bus time accumulated since the last navigation epoch */
+uint32_t bus_us_since_epoch = 0;
+/** Bus transactions since the last navigation epoch */
+uint32_t polls_since_epoch = 0;
+
 int64_t fake_latitude[] = {144213730, 414861950, -80533010, -274789700};
 int64_t fake_longitude[] = {1210069140, -816814860, -349049060, 1530410440};
 
 // PH 144213730, 1210069140, 35.000 // Ohio 414861950, -816814860 // Recife -80533010, -349049060 // Brisbane -274789700, 1530410440
 
+/**
+ * @brief Callback for the auto NAV-PVT frame
+ * 		Called from checkCallbacks(), decodes all required values from the single frame
+ *
+ * @param ubxDataStruct pointer to the received NAV-PVT data
+ */
+void gnss_pvt_cb(UBX_NAV_PVT_data_t *ubxDataStruct)
+{
+	pvt_epoch.fix_ok = ubxDataStruct->flags.bits.gnssFixOK;
+	pvt_epoch.fix_type = ubxDataStruct->fixType;
+	pvt_epoch.sat_num = ubxDataStruct->numSV;
+	pvt_epoch.latitude = ubxDataStruct->lat;
+	pvt_epoch.longitude = ubxDataStruct->lon;
+	pvt_epoch.altitude = ubxDataStruct->height;
+	// NAV-PVT has no HDOP, it comes with the NAV-DOP frame of the same epoch
+	pvt_pdop = ubxDataStruct->pDOP;
+	pvt_itow = ubxDataStruct->iTOW;
+	pvt_epoch.h_acc = ubxDataStruct->hAcc;
+	pvt_epoch.utc = 0;
+	if (ubxDataStruct->valid.bits.validDate && ubxDataStruct->valid.bits.validTime)
+	{
+		pvt_epoch.utc = gnss_unix_time(ubxDataStruct->year, ubxDataStruct->month, ubxDataStruct->day,
+									   ubxDataStruct->hour, ubxDataStruct->min, ubxDataStruct->sec);
+	}
+	pvt_new_epoch = true;
+}
+
+/**
+ * @brief Callback for the auto NAV-DOP frame
+ * 		Only the HDOP is used, it is matched to the NAV-PVT frame by the time of week
+ *
+ * @param ubxDataStruct pointer to the received NAV-DOP data
+ */
+void gnss_dop_cb(UBX_NAV_DOP_data_t *ubxDataStruct)
+{
+	dop_hdop = ubxDataStruct->hDOP;
+	dop_itow = ubxDataStruct->iTOW;
+}
+
+/**
+ * @brief Check the GNSS module for a new NAV-PVT frame
+ * 		Reads pending data in a single bus transaction and updates the bus time statistics
+ *
+ * @return true if a new navigation epoch was decoded into pvt_epoch
+ * @return false if no new epoch is available
+ */
+bool gnss_pvt_check(void)
+{
+	xSemaphoreTake(g_i2c_sem, 2000);
+	uint32_t bus_start = micros();
+	my_gnss.checkUblox();
+	bus_us_since_epoch += micros() - bus_start;
+	polls_since_epoch++;
+	my_gnss.checkCallbacks();
+	xSemaphoreGive(g_i2c_sem);
+
+	if (!pvt_new_epoch)
+	{
+		return false;
+	}
+	pvt_new_epoch = false;
+	// Both frames are read in the same transaction. If the NAV-DOP frame of the epoch is missing,
+	// PDOP is used, it is always >= HDOP, so the precision check gets stricter, not weaker
+	pvt_epoch.accuracy = dop_itow == pvt_itow ? dop_hdop : pvt_pdop;
+
+	g_gnss_bus_stats.epochs++;
+	g_gnss_bus_stats.polls += polls_since_epoch;
+	g_gnss_bus_stats.bus_us_total += bus_us_since_epoch;
+	g_gnss_bus_stats.bus_us_last = bus_us_since_epoch;
+	g_gnss_bus_stats.polls_last = polls_since_epoch;
+	bus_us_since_epoch = 0;
+	polls_since_epoch = 0;
+	return true;
+}
+
+/**
+ * @brief Send a NMEA command to the RAK12501
+ * 		Adds the '$' start character, the checksum and the line end
+ *
+ * @param sentence command without '$' and checksum, e.g. "PCAS10,0"
+ */
+void gnss_send_nmea(const char *sentence)
+{
+	uint8_t checksum = 0;
+	for (const char *ptr = sentence; *ptr != 0; ptr++)
+	{
+		checksum ^= (uint8_t)*ptr;
+	}
+	char checksum_str[6];
+	snprintf(checksum_str, 6, "*%02X\r\n", checksum);
+	Serial1.print('$');
+	Serial1.print(sentence);
+	Serial1.print(checksum_str);
+	Serial1.flush();
+}
+
+/**
+ * @brief Setup the NMEA output of the RAK12501
+ * 		Only the sentences required for the location are enabled to keep the UART traffic low
+ *
+ */
+void gnss_setup_nmea(void)
+{
+	// Output GGA and RMC only, once per fix
+	gnss_send_nmea(GNSS_NMEA_OUTPUT);
+	// Constellations of the selected profile
+	gnss_profile_casic();
+}
+
 /**
  * @brief Initialize GNSS module
  *
@@ -57,6 +189,12 @@ bool init_gnss(void)
 	bool gnss_found = false;
 #endif
 
+	// Get the last known position for aiding
+	gnss_aid_load();
+
+	// Get the selected constellations and measurement rate
+	gnss_profile_load();
+
 	// Power on the GNSS module
 	digitalWrite(WB_IO2, HIGH);
 
@@ -66,119 +204,51 @@ bool init_gnss(void)
 	if (gnss_option == NO_GNSS_INIT)
 	{
 #if _USE_RAK12501_ == 0
-		xSemaphoreTake(g_i2c_sem, 2000);
-		if (!my_gnss.begin())
-		{
-			MYLOG("GNSS", "UBLOX did not answer on I2C, retry on Serial1");
-			i2c_gnss = false;
-		}
-		else
-		{
-			MYLOG("GNSS", "UBLOX found on I2C");
-			i2c_gnss = true;
-			gnss_found = true;
-			my_gnss.setI2COutput(COM_TYPE_UBX); // Set the I2C port to output UBX only (turn off NMEA noise)
-			my_gnss.setMeasurementRate(500);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GPS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GALILEO);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GLONASS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_SBAS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_BEIDOU);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_IMES);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_QZSS);
-			my_gnss.saveConfiguration(); // Save the current settings to flash and BBR
-			gnss_option = RAK12500_GNSS;
-		}
-		xSemaphoreGive(g_i2c_sem);
+		// Saved interface or parallel I2C and Serial1 probe
+		gnss_found = gnss_probe();
 
-		if (!i2c_gnss)
-		{
-			uint8_t retry = 0;
-			// Assume that the U-Blox GNSS is running at 9600 baud (the default) or at 38400 baud.
-			// Loop until we're in sync and then ensure it's at 38400 baud.
-			do
-			{
-				MYLOG("GNSS", "GNSS: trying 38400 baud");
-				Serial1.begin(38400);
-				while (!Serial1)
-					;
-				if (my_gnss.begin(Serial1) == true)
-				{
-					MYLOG("GNSS", "UBLOX found on Serial1 with 38400");
-					my_gnss.setUART1Output(COM_TYPE_UBX); // Set the UART port to output UBX only
-					my_gnss.setMeasurementRate(500);
-					my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GPS);
-					my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GALILEO);
-					my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GLONASS);
-					my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_SBAS);
-					my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_BEIDOU);
-					my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_IMES);
-					my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_QZSS);
-					my_gnss.saveConfiguration(); // Save the current settings to flash and BBR
-					gnss_found = true;
-
-					gnss_option = RAK12500_GNSS;
-					break;
-				}
-				delay(100);
-				MYLOG("GNSS", "GNSS: trying 9600 baud");
-				Serial1.begin(9600);
-				while (!Serial1)
-					;
-				if (my_gnss.begin(Serial1) == true)
-				{
-					MYLOG("GNSS", "GNSS: connected at 9600 baud, switching to 38400");
-					my_gnss.setSerialRate(38400);
-					delay(100);
-				}
-				else
-				{
-					my_gnss.factoryReset();
-					delay(2000); // Wait a bit before trying again to limit the Serial output
-				}
-				retry++;
-				if (retry == 3)
-				{
-					break;
-				}
-			} while (1);
-		}
-
-		if (gnss_found)
+		if (gnss_option == RAK12500_GNSS)
 		{
 			xSemaphoreTake(g_i2c_sem, 2000);
 			my_gnss.setI2COutput(COM_TYPE_UBX); // Set the I2C port to output UBX only (turn off NMEA noise)
-			my_gnss.setMeasurementRate(500);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GPS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GALILEO);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GLONASS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_SBAS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_BEIDOU);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_IMES);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_QZSS);
-
-			my_gnss.saveConfiguration(); // Save the current settings to flash and BBR
+
+			// Measurement rate and GNSS systems, only sent if the module configuration differs
+			gnss_apply_config();
+
+			// Let the module push one NAV-PVT and one NAV-DOP frame per navigation epoch
+			my_gnss.setAutoPVTcallbackPtr(&gnss_pvt_cb);
+			my_gnss.setAutoNAVDOPcallbackPtr(&gnss_dop_cb);
 			xSemaphoreGive(g_i2c_sem);
+
+			// Avoid a cold start after a reset or battery change
+			gnss_dbd_restore();
 			return true;
 		}
 
-		// No RAK12500 found, assume RAK12501 is plugged in
-		gnss_option = RAK12501_GNSS;
-		MYLOG("GNSS", "Initialize RAK12501");
-		Serial1.end();
-		delay(500);
-		Serial1.begin(9600);
-		while (!Serial1)
-			;
+		// No RAK12500 found, RAK12501 is plugged in (or assumed if nothing answered)
+		MYLOG("GNSS", "Initialize RAK12501 %s", gnss_found ? "" : "(assumed)");
+		if (!gnss_found)
+		{
+			Serial1.begin(9600);
+			while (!Serial1)
+				;
+		}
+		gnss_setup_nmea();
 		return true;
 #else
 		// Forced RAK12501
 		gnss_option = RAK12501_GNSS;
 		Serial1.begin(9600);
-		delay(5000);
 		MYLOG("GNSS", "Initialize RAK12501");
 		while (!Serial1)
 			;
+		// Continue as soon as the module sends its first sentence instead of a fixed delay
+		if (!gnss_wait_rak12501())
+		{
+			MYLOG("GNSS", "RAK12501 did not send NMEA");
+		}
+		gnss_uart_baud = 9600;
+		gnss_setup_nmea();
 		return true;
 #endif
 	}
@@ -196,11 +266,14 @@ bool init_gnss(void)
 			else
 			{
 				Serial1.begin(38400);
+				gnss_uart_baud = 38400;
 				my_gnss.begin(Serial1);
 				my_gnss.setUART1Output(COM_TYPE_UBX); // Set the UART port to output UBX only
 			}
 			xSemaphoreTake(g_i2c_sem, 2000);
-			my_gnss.setMeasurementRate(500);
+			gnss_apply_config();
+			my_gnss.setAutoPVTcallbackPtr(&gnss_pvt_cb);
+			my_gnss.setAutoNAVDOPcallbackPtr(&gnss_dop_cb);
 			xSemaphoreGive(g_i2c_sem);
 		}
 		else
@@ -208,6 +281,8 @@ bool init_gnss(void)
 			Serial1.begin(9600);
 			while (!Serial1)
 				;
+			gnss_uart_baud = 9600;
+			gnss_setup_nmea();
 		}
 		return true;
 	}
@@ -231,16 +306,47 @@ bool poll_gnss(void)
 	}
 
 	last_read_ok = false;
+	g_gnss_no_sky = false;
+	g_gnss_dist_skip = false;
+	g_track_hold = false;
+	g_pos_record_size = 0;
+	g_pack_fix.valid = false;
+
+	// Wake up the GNSS module
+	gnss_power_up();
+
+	// Sleep time between reading the NMEA sentences, the output grows with the measurement rate
+	uint32_t nmea_sleep_ms = GNSS_NMEA_RX_SLEEP_MS(gnss_profile_meas_rate());
+	uint32_t rx_sleep_ms = nmea_sleep_ms;
 
-	if (!g_is_helium)
+	if (gnss_option == RAK12501_GNSS)
 	{
+		// Start with a clean NMEA parser, drop old values
+		nmea_reset();
+		// Output configuration is lost after a power cut, enable GSV for the sky check
+		gnss_send_nmea(GNSS_NMEA_OUTPUT_GSV);
+		gnss_profile_casic();
+		g_gnss_profile_changed = false;
+		rx_sleep_ms = GNSS_NMEA_RX_SLEEP_GSV_MS;
+	}
+
+	if (gnss_option == RAK12500_GNSS)
+	{
+		// Make sure the auto NAV-PVT output survived the power cycle
 		xSemaphoreTake(g_i2c_sem, 2000);
-		// Startup GNSS module
-		// init_gnss();
-		// Power on the GNSS module
-		digitalWrite(WB_IO2, HIGH);
-		delay(500);
+		if (g_gnss_profile_changed || gnss_profile_is_runtime())
+		{
+			// New profile selected by AT command, settings UI or motion classifier.
+			// A runtime profile is only in the RAM of the module and is lost with a power cut
+			gnss_apply_config();
+			g_gnss_profile_changed = false;
+		}
+		my_gnss.setAutoPVTcallbackPtr(&gnss_pvt_cb);
+		my_gnss.setAutoNAVDOPcallbackPtr(&gnss_dop_cb);
 		xSemaphoreGive(g_i2c_sem);
+		pvt_new_epoch = false;
+		bus_us_since_epoch = 0;
+		polls_since_epoch = 0;
 	}
 
 	time_t time_out = millis();
@@ -266,6 +372,9 @@ bool poll_gnss(void)
 		check_limit = 90000;
 	}
 
+	// Learn the timeout from the recent acquisition times
+	check_limit = gnss_acq_timeout(check_limit);
+
 #if FAKE_GPS > 0
 	check_limit = 1000;
 #endif
@@ -280,9 +389,30 @@ bool poll_gnss(void)
 
 	time_t start_acq = millis();
 	time_t end_acq = millis();
+	// Flag if the first fix of an averaging window was found, end_acq keeps the TTFF
+	bool avg_first_fix = false;
+
+	// Send last known position and time to speed up the fix
+	gnss_aid_inject();
+
+	gnss_sky_start();
+	gnss_avg_start();
 
 	while ((millis() - time_out) < check_limit)
 	{
+		uint8_t sky_state = gnss_sky_check(millis() - start_acq);
+		if (sky_state == GNSS_SKY_NONE)
+		{
+			// No fix possible, don't waste energy
+			g_gnss_no_sky = true;
+			break;
+		}
+		if ((sky_state == GNSS_SKY_OK) && (rx_sleep_ms != nmea_sleep_ms))
+		{
+			// Sky check finished, switch back to the minimal NMEA output
+			gnss_send_nmea(GNSS_NMEA_OUTPUT);
+			rx_sleep_ms = nmea_sleep_ms;
+		}
 		if (gnss_option == RAK12500_GNSS)
 		{
 			if (settings_ui == true)
@@ -290,10 +420,15 @@ bool poll_gnss(void)
 				MYLOG("GNSS", "Settings UI is active");
 				return false;
 			}
-			xSemaphoreTake(g_i2c_sem, 2000);
-			if (my_gnss.getGnssFixOk())
+			if (!gnss_pvt_check())
+			{
+				// No new navigation epoch yet
+				delay(GNSS_PVT_POLL_MS);
+				continue;
+			}
+			if (pvt_epoch.fix_ok)
 			{
-				fix_type = my_gnss.getFixType(); // Get the fix type
+				fix_type = pvt_epoch.fix_type; // Get the fix type
 				if (fix_type == 1)
 					sprintf(fix_type_str, "Dead reckoning");
 				else if (fix_type == 2)
@@ -308,8 +443,8 @@ bool poll_gnss(void)
 					sprintf(fix_type_str, "No Fix");
 
 				bool fix_sufficient = false;
-				sat_num = my_gnss.getSIV();
-				accuracy = my_gnss.getHorizontalDOP();
+				sat_num = pvt_epoch.sat_num;
+				accuracy = pvt_epoch.accuracy;
 				if (g_loc_high_prec)
 				{
 					MYLOG("GNSS", "H Fixtype: %d %s", fix_type, fix_type_str);
@@ -331,90 +466,146 @@ bool poll_gnss(void)
 				}
 				if (fix_sufficient) /** Fix type 3D */
 				{
+					latitude = pvt_epoch.latitude;
+					longitude = pvt_epoch.longitude;
+					altitude = pvt_epoch.altitude;
+
+					// Collect more fixes if the device is parked
+					uint8_t avg_state = gnss_avg_add(latitude, longitude, altitude, pvt_epoch.h_acc);
+					if (!avg_first_fix)
+					{
+						avg_first_fix = true;
+						end_acq = millis();
+					}
+					if (avg_state == GNSS_AVG_MORE)
+					{
+						continue;
+					}
+					if (avg_state == GNSS_AVG_DONE)
+					{
+						gnss_avg_result(&latitude, &longitude, &altitude);
+					}
 					last_read_ok = true;
-					latitude = my_gnss.getLatitude();
-					longitude = my_gnss.getLongitude();
-					altitude = my_gnss.getAltitude();
-					accuracy = my_gnss.getHorizontalDOP();
 
-					MYLOG("GNSS", "Fixtype: %d %s", my_gnss.getFixType(), fix_type_str);
+					MYLOG("GNSS", "Fixtype: %d %s", fix_type, fix_type_str);
 					MYLOG("GNSS", "Lat: %.4f Lon: %.4f", latitude / 10000000.0, longitude / 10000000.0);
 					MYLOG("GNSS", "Alt: %.2f", altitude / 1000.0);
 					MYLOG("GNSS", "Acy: %.2f ", accuracy / 100.0);
-
-					end_acq = millis();
+					MYLOG("GNSS", "Bus time %ldus in %ld polls", (long)g_gnss_bus_stats.bus_us_last, (long)g_gnss_bus_stats.polls_last);
 
 					// Break the while()
 					break;
 				}
-				xSemaphoreGive(g_i2c_sem);
-			}
-			else
-			{
-				xSemaphoreGive(g_i2c_sem);
-				delay(1000);
 			}
 		}
 		else
 		{
+			// Process everything the UART interrupt buffered while the task was sleeping
 			while (Serial1.available() > 0)
 			{
-				// char gnss = Serial1.read();
-				// Serial.print(gnss);
-				// if (my_rak1910_gnss.encode(gnss))
-				if (my_rak1910_gnss.encode(Serial1.read()))
+				if (nmea_parse(Serial1.read()))
 				{
-					if (my_rak1910_gnss.location.isUpdated() && my_rak1910_gnss.location.isValid())
+					if (g_nmea_fix.pos_updated)
 					{
 						MYLOG("GNSS", "Location valid");
+						g_nmea_fix.pos_updated = false;
 						has_pos = true;
-						latitude = (uint64_t)(my_rak1910_gnss.location.lat() * 10000000.0);
-						longitude = (uint64_t)(my_rak1910_gnss.location.lng() * 10000000.0);
+						latitude = g_nmea_fix.latitude;
+						longitude = g_nmea_fix.longitude;
 					}
-					else if (my_rak1910_gnss.altitude.isUpdated() && my_rak1910_gnss.altitude.isValid())
+					if (g_nmea_fix.alt_updated)
 					{
 						MYLOG("GNSS", "Altitude valid");
+						g_nmea_fix.alt_updated = false;
 						has_alt = true;
-						altitude = (uint32_t)(my_rak1910_gnss.altitude.meters() * 1000);
+						altitude = g_nmea_fix.altitude;
 					}
-					else if (my_rak1910_gnss.hdop.isUpdated() && my_rak1910_gnss.hdop.isValid())
+					if (g_nmea_fix.hdop_updated)
 					{
-						accuracy = my_rak1910_gnss.hdop.hdop() * 100;
+						g_nmea_fix.hdop_updated = false;
+						accuracy = g_nmea_fix.hdop;
 					}
-					sat_num = my_rak1910_gnss.satellites.value();
+					sat_num = g_nmea_fix.sat_num;
 				}
 				// if (has_pos && has_alt)
 				if (has_pos && has_alt)
 				{
+					// Collect more fixes if the device is parked, HDOP with 5m UERE as accuracy
+					uint8_t avg_state = gnss_avg_add(latitude, longitude, altitude, accuracy * 50);
+					if (!avg_first_fix)
+					{
+						avg_first_fix = true;
+						end_acq = millis();
+					}
+					if (avg_state == GNSS_AVG_MORE)
+					{
+						// Wait for the next RMC and GGA
+						has_pos = false;
+						has_alt = false;
+						continue;
+					}
+					if (avg_state == GNSS_AVG_DONE)
+					{
+						gnss_avg_result(&latitude, &longitude, &altitude);
+					}
 					MYLOG("GNSS", "Lat: %.4f Lon: %.4f", latitude / 10000000.0, longitude / 10000000.0);
 					MYLOG("GNSS", "Alt: %.2f", altitude / 1000.0);
 					MYLOG("GNSS", "Acy: %.2f ", accuracy / 100.0);
 					last_read_ok = true;
-
-					end_acq = millis();
-
 					break;
 				}
 			}
-			if (has_pos && has_alt)
+			if (last_read_ok)
 			{
-				last_read_ok = true;
 				break;
 			}
+			// Poll, sleep until the next NMEA sentences are buffered
+			vTaskDelay(pdMS_TO_TICKS(rx_sleep_ms));
 		}
 	}
 
+	if (!last_read_ok && gnss_avg_result(&latitude, &longitude, &altitude))
+	{
+		// Acquisition timeout during the averaging, use the fixes collected so far
+		last_read_ok = true;
+	}
+
 	if (!last_read_ok)
 	{
 		end_acq = millis();
 	}
 
-	if (!g_is_helium)
+	// Remember the acquisition time for the power strategy, then power down the module
+	gnss_record_ttff(last_read_ok, end_acq - start_acq);
+	gnss_aid_record(last_read_ok, end_acq - start_acq);
+	gnss_profile_record(last_read_ok, end_acq - start_acq);
+	if (!g_gnss_no_sky)
+	{
+		// An aborted acquisition says nothing about the timeout
+		gnss_ttff_add(last_read_ok, end_acq - start_acq);
+	}
+	if (last_read_ok && (gnss_option == RAK12500_GNSS))
+	{
+		// Keep a copy of the navigation database while the module is still awake
+		gnss_dbd_save(pvt_epoch.utc);
+	}
+	if (g_is_helium && (gnss_option == RAK12500_GNSS))
 	{
-		// Power down the module
-		digitalWrite(WB_IO2, LOW);
-		delay(100);
+		// Helium Mapper keeps the module in its own power save mode, set it up before the power down
+		xSemaphoreTake(g_i2c_sem, 2000);
+		if (last_read_ok)
+		{
+			my_gnss.setMeasurementRate(10000);
+			my_gnss.setNavigationFrequency(1, 10000);
+			my_gnss.powerSaveMode(true, 10000);
+		}
+		else
+		{
+			my_gnss.setMeasurementRate(1000);
+		}
+		xSemaphoreGive(g_i2c_sem);
 	}
+	gnss_power_down();
 
 	if (last_read_ok)
 	{
@@ -424,6 +615,32 @@ bool poll_gnss(void)
 			return false;
 		}
 
+		// Remember the fix for aiding the next acquisition, accuracy from HDOP with 5m UERE on RAK12501
+		if (gnss_option == RAK12500_GNSS)
+		{
+			gnss_aid_store(latitude, longitude, altitude, pvt_epoch.h_acc, pvt_epoch.utc);
+		}
+		else
+		{
+			gnss_aid_store(latitude, longitude, altitude, accuracy * 50, g_nmea_fix.utc);
+		}
+
+		// Remove position jumps, the raw position stays in g_gnss_filter_stats
+		if (g_gnss_filter)
+		{
+			uint32_t restarts = g_gnss_filter_stats.restarts;
+			if (!gnss_filter_update(&latitude, &longitude, gnss_option == RAK12500_GNSS ? pvt_epoch.h_acc : accuracy * 50, millis(),
+									acc_ok ? g_last_motion : millis()))
+			{
+				MYLOG("GNSS", "Fix rejected, NIS %.1f", g_gnss_filter_stats.nis / 256.0);
+			}
+			else if (g_gnss_filter_stats.restarts != restarts)
+			{
+				MYLOG("GNSS", "Filter restarted");
+			}
+			MYLOG("GNSS", "Filtered Lat: %.6f Lon: %.6f", latitude / 10000000.0, longitude / 10000000.0);
+		}
+
 		if (has_oled && !settings_ui)
 		{
 			xSemaphoreTake(g_i2c_sem, 2000);
@@ -446,20 +663,58 @@ bool poll_gnss(void)
 			oled_add_line(oled_buff);
 			xSemaphoreGive(g_i2c_sem);
 		}
+		// Geofence transitions are always sent, otherwise the fence mode and the distance decide
+		bool fence_send = geofence_check(latitude, longitude);
+		if (!fence_send)
+		{
+			g_gnss_dist_skip = true;
+			return true;
+		}
+		// Too close to the last sent position, app_event_handler skips the uplink or sends a heartbeat
+		if (!gnss_dist_check(latitude, longitude, g_geofence_stats.event_num != 0))
+		{
+			return true;
+		}
+		// While moving the position goes into the track and is sent with the next batch
+		if ((g_geofence_stats.event_num == 0) && track_add(latitude, longitude))
+		{
+			return true;
+		}
 		if (!g_is_helium)
 		{
-			if (g_gps_prec_6)
+			geofence_add_events();
+			if (g_gps_packed)
 			{
-				// Save extended precision, not Cayenne LPP compatible
-				g_data_packet.addGNSS_6(LPP_CHANNEL_GPS, latitude, longitude, altitude);
+				// Packed format, position and quality are not added as LPP fields
+				g_pack_fix.latitude = latitude;
+				g_pack_fix.longitude = longitude;
+				g_pack_fix.altitude = altitude;
+				g_pack_fix.sat_num = sat_num;
+				g_pack_fix.dop = accuracy;
+				g_pack_fix.valid = true;
 			}
 			else
 			{
-				// Save default Cayenne LPP precision
-				g_data_packet.addGNSS_4(LPP_CHANNEL_GPS, latitude, longitude, altitude);
+				if (g_gps_compact)
+				{
+					// Compact position, sent in front of the LPP data
+					g_pos_record_size = pos_codec_encode(latitude, longitude, altitude, g_pos_record);
+				}
+				else if (g_gps_prec_6)
+				{
+					// Save extended precision, not Cayenne LPP compatible
+					g_data_packet.addGNSS_6(LPP_CHANNEL_GPS, latitude, longitude, altitude);
+				}
+				else
+				{
+					// Save default Cayenne LPP precision
+					g_data_packet.addGNSS_4(LPP_CHANNEL_GPS, latitude, longitude, altitude);
+				}
+				g_data_packet.addDigitalInput(LPP_CHANNEL_SATS, sat_num);
+				g_data_packet.addDigitalInput(LPP_CHANNEL_ACCURACY, accuracy);
 			}
-			g_data_packet.addDigitalInput(12, sat_num);
-			g_data_packet.addDigitalInput(11, accuracy);
+			// Kept in the store-and-forward log if the uplink fails
+			store_log_fix(latitude, longitude, altitude, sat_num, gnss_option == RAK12500_GNSS ? pvt_epoch.utc : g_nmea_fix.utc);
 		}
 		else
 		{
@@ -467,15 +722,6 @@ bool poll_gnss(void)
 			g_data_packet.addGNSS_H(latitude, longitude, altitude, accuracy, read_batt());
 		}
 
-		if (g_is_helium)
-		{
-			xSemaphoreTake(g_i2c_sem, 2000);
-			my_gnss.setMeasurementRate(10000);
-			my_gnss.setNavigationFrequency(1, 10000);
-			my_gnss.powerSaveMode(true, 10000);
-			xSemaphoreGive(g_i2c_sem);
-		}
-
 		return true;
 	}
 	else
@@ -484,7 +730,7 @@ bool poll_gnss(void)
 		{
 			xSemaphoreTake(g_i2c_sem, 2000);
 			oled_clear();
-			oled_add_line((char *)"No location fix");
+			oled_add_line(g_gnss_no_sky ? (char *)"No sky visible" : (char *)"No location fix");
 			if (gnss_option == RAK12500_GNSS)
 			{
 				snprintf(oled_buff, 127, "Fix: %s Sat: %d", fix_type_str, sat_num);
@@ -524,7 +770,16 @@ bool poll_gnss(void)
 		}
 		if (!g_is_helium)
 		{
-			if (g_gps_prec_6)
+			if (g_gps_packed)
+			{
+				g_pack_fix.latitude = latitude;
+				g_pack_fix.longitude = longitude;
+				g_pack_fix.altitude = altitude;
+				g_pack_fix.sat_num = 0;
+				g_pack_fix.dop = accuracy;
+				g_pack_fix.valid = true;
+			}
+			else if (g_gps_prec_6)
 			{
 				// Save extended precision, not Cayenne LPP compatible
 				g_data_packet.addGNSS_6(LPP_CHANNEL_GPS, latitude, longitude, altitude);
@@ -548,16 +803,6 @@ bool poll_gnss(void)
 	MYLOG("GNSS", "No valid location found");
 	last_read_ok = false;
 
-	if (g_is_helium)
-	{
-		if (gnss_option == RAK12500_GNSS)
-		{
-			xSemaphoreTake(g_i2c_sem, 2000);
-			my_gnss.setMeasurementRate(1000);
-			xSemaphoreGive(g_i2c_sem);
-		}
-	}
-
 	return false;
 }
 
@@ -570,12 +815,8 @@ void gnss_task(void *pvParameters)
 {
 	MYLOG("GNSS", "GNSS Task started");
 
-	if (!g_is_helium)
-	{
-		// Power down the module
-		digitalWrite(WB_IO2, LOW);
-		delay(100);
-	}
+	// Power down the module
+	gnss_power_down();
 
 	while (1)
 	{
@@ -586,7 +827,7 @@ void gnss_task(void *pvParameters)
 			AT_PRINTF("+EVT:START_LOCATION\n");
 			// Get location
 			bool got_location = poll_gnss();
-			AT_PRINTF("+EVT:LOCATION %s\n", got_location ? "FIX" : "NOFIX");
+			AT_PRINTF("+EVT:LOCATION %s\n", got_location ? "FIX" : (g_gnss_no_sky ? "NOSKY" : "NOFIX"));
 
 			// if ((g_task_sem != NULL) && got_location)
 			if (g_task_sem != NULL)
@@ -0,0 +1,263 @@
+/**
+ * @file gnss_aid.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Position and time aiding of the GNSS module from the last known fix
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+using namespace Adafruit_LittleFS_Namespace;
+
+/** Filename to save the last known position */
+static const char last_fix_name[] = "LASTFIX";
+
+/** Assumed max speed since the last fix for the position accuracy in mm/s */
+#define GNSS_AID_SPEED_MM_S 30000
+/** Max position accuracy sent to the module in mm */
+#define GNSS_AID_MAX_ACC_MM 300000000
+/** Position change in 1e-7 degrees (~1km) that requires saving the last fix to flash */
+#define GNSS_AID_SAVE_DIST 100000
+/** Seconds between GPS epoch 1980-01-06 and Unix epoch */
+#define GPS_UNIX_OFFSET 315964800
+/** GPS to UTC leap seconds */
+#define GPS_LEAP_SECONDS 18
+
+/** Last known position, saved in flash */
+struct gnss_last_fix_s
+{
+	int32_t latitude = 0;  // 1e-7 degrees
+	int32_t longitude = 0; // 1e-7 degrees
+	int32_t altitude = 0;  // mm
+	uint32_t accuracy = 0; // mm
+	bool valid = false;
+};
+
+/** Last known position */
+static gnss_last_fix_s last_fix;
+/** Last known position saved in flash */
+static gnss_last_fix_s saved_fix;
+/** Time of the last fix, millis() */
+static time_t last_fix_time = 0;
+
+/** UTC time of the last fix as Unix time */
+static uint32_t last_utc = 0;
+/** millis() when last_utc was received */
+static time_t last_utc_millis = 0;
+/** Flag if last_utc is valid */
+static bool utc_valid = false;
+
+/** Flag if aiding was sent for the current acquisition */
+static bool aid_used = false;
+
+/** TTFF statistics with and without aiding */
+gnss_aid_stats_s g_gnss_aid_stats;
+
+/**
+ * @brief Date for days since 1970-01-01
+ *
+ */
+static void civil_from_days(int32_t days, uint16_t *year, uint8_t *month, uint8_t *day)
+{
+	days += 719468;
+	int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+	uint32_t doe = (uint32_t)(days - era * 146097);
+	uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	uint32_t mp = (5 * doy + 2) / 153;
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = (uint16_t)(yoe + era * 400 + (*month <= 2));
+}
+
+/**
+ * @brief Read the last known position from flash
+ *
+ */
+void gnss_aid_load(void)
+{
+	File fix_file(InternalFS);
+	if (fix_file.open(last_fix_name, FILE_O_READ))
+	{
+		if (fix_file.read((void *)&saved_fix, sizeof(gnss_last_fix_s)) == sizeof(gnss_last_fix_s))
+		{
+			last_fix = saved_fix;
+			MYLOG("GNSS", "Last fix %.4f %.4f", last_fix.latitude / 10000000.0, last_fix.longitude / 10000000.0);
+		}
+		fix_file.close();
+	}
+}
+
+/**
+ * @brief Remember a good fix for the next acquisition
+ * 		Saved to flash only if the position changed by more than ~1km to protect the flash
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @param altitude mm
+ * @param accuracy horizontal accuracy in mm
+ * @param utc UTC of the fix as Unix time, 0 if unknown
+ */
+void gnss_aid_store(int32_t latitude, int32_t longitude, int32_t altitude, uint32_t accuracy, uint32_t utc)
+{
+	last_fix.latitude = latitude;
+	last_fix.longitude = longitude;
+	last_fix.altitude = altitude;
+	last_fix.accuracy = accuracy;
+	last_fix.valid = true;
+	last_fix_time = millis();
+
+	if (utc != 0)
+	{
+		last_utc = utc;
+		last_utc_millis = millis();
+		utc_valid = true;
+	}
+
+	if (!saved_fix.valid || (abs(latitude - saved_fix.latitude) + abs(longitude - saved_fix.longitude) > GNSS_AID_SAVE_DIST))
+	{
+		saved_fix = last_fix;
+		InternalFS.remove(last_fix_name);
+		File fix_file(InternalFS);
+		if (fix_file.open(last_fix_name, FILE_O_WRITE))
+		{
+			fix_file.write((const uint8_t *)&saved_fix, sizeof(gnss_last_fix_s));
+			fix_file.close();
+		}
+	}
+}
+
+/**
+ * @brief Send CASIC AID-INI with the approximate position and time to the RAK12501
+ *
+ * @param latitude degrees
+ * @param longitude degrees
+ * @param altitude meters
+ * @param pos_acc position accuracy in meters
+ * @param has_time true if GPS time is known
+ * @param gps_time seconds since GPS epoch
+ * @param time_acc time accuracy in seconds
+ */
+static void send_casic_aid_ini(double latitude, double longitude, double altitude, float pos_acc, bool has_time, uint32_t gps_time, float time_acc)
+{
+	uint8_t msg[8 + 56 + 4] = {0xBA, 0xCE, 56, 0, 0x0B, 0x01};
+	uint8_t *payload = &msg[6];
+	double tow = has_time ? (double)(gps_time % 604800) : 0.0;
+	float zero = 0.0;
+	uint32_t reserved = 0;
+	uint16_t week = has_time ? (uint16_t)(gps_time / 604800) : 0;
+	uint8_t time_source = 0;
+	// Bit 0 position valid, bit 1 time valid, bit 5 position is LLA
+	uint8_t flags = 0x21 | (has_time ? 0x02 : 0x00);
+
+	memcpy(&payload[0], &latitude, 8);
+	memcpy(&payload[8], &longitude, 8);
+	memcpy(&payload[16], &altitude, 8);
+	memcpy(&payload[24], &tow, 8);
+	memcpy(&payload[32], &zero, 4);
+	memcpy(&payload[36], &pos_acc, 4);
+	memcpy(&payload[40], &time_acc, 4);
+	memcpy(&payload[44], &zero, 4);
+	memcpy(&payload[48], &reserved, 4);
+	memcpy(&payload[52], &week, 2);
+	payload[54] = time_source;
+	payload[55] = flags;
+
+	// Checksum is (id << 24) + (class << 16) + length plus the sum of all payload words
+	uint32_t checksum = ((uint32_t)0x01 << 24) + ((uint32_t)0x0B << 16) + 56;
+	for (uint8_t idx = 0; idx < 56; idx += 4)
+	{
+		uint32_t word;
+		memcpy(&word, &payload[idx], 4);
+		checksum += word;
+	}
+	memcpy(&msg[6 + 56], &checksum, 4);
+
+	Serial1.write(msg, 6 + 56 + 4);
+	Serial1.flush();
+}
+
+/**
+ * @brief Send the last known position and the estimated time to the GNSS module
+ * 		Not needed after standby, the module still has position and time
+ *
+ */
+void gnss_aid_inject(void)
+{
+	aid_used = false;
+	if (!last_fix.valid || (g_gnss_pwr_last == GNSS_PWR_STANDBY))
+	{
+		return;
+	}
+
+	// Position accuracy grows with the time since the fix, after a reset the time is unknown
+	uint32_t pos_acc = GNSS_AID_MAX_ACC_MM;
+	if (last_fix_time != 0)
+	{
+		uint64_t moved = (uint64_t)(millis() - last_fix_time) * GNSS_AID_SPEED_MM_S / 1000;
+		if (last_fix.accuracy + moved < GNSS_AID_MAX_ACC_MM)
+		{
+			pos_acc = last_fix.accuracy + (uint32_t)moved;
+		}
+	}
+
+	// Estimated UTC, accuracy 1 s plus 50 ppm drift of the clock
+	uint32_t elapsed_ms = millis() - last_utc_millis;
+	uint32_t utc_now = last_utc + elapsed_ms / 1000;
+	uint16_t time_acc = 1 + elapsed_ms / 20000000;
+
+	MYLOG("GNSS", "Aiding pos acc %ldm, time %s", (long)(pos_acc / 1000), utc_valid ? "valid" : "unknown");
+
+	if (gnss_option == RAK12500_GNSS)
+	{
+		xSemaphoreTake(g_i2c_sem, 2000);
+		// UBX-MGA-INI-POS_LLH, altitude and accuracy in cm
+		my_gnss.setPositionAssistanceLLH(last_fix.latitude, last_fix.longitude, last_fix.altitude / 10, pos_acc / 10);
+		if (utc_valid)
+		{
+			// UBX-MGA-INI-TIME_UTC
+			uint16_t year;
+			uint8_t month;
+			uint8_t day;
+			civil_from_days(utc_now / 86400, &year, &month, &day);
+			uint32_t sec_of_day = utc_now % 86400;
+			my_gnss.setUTCTimeAssistance(year, month, day, sec_of_day / 3600, (sec_of_day / 60) % 60, sec_of_day % 60, 0, time_acc);
+		}
+		xSemaphoreGive(g_i2c_sem);
+	}
+	else
+	{
+		uint32_t gps_time = utc_now - GPS_UNIX_OFFSET + GPS_LEAP_SECONDS;
+		send_casic_aid_ini(last_fix.latitude / 10000000.0, last_fix.longitude / 10000000.0, last_fix.altitude / 1000.0,
+						   pos_acc / 1000.0, utc_valid, gps_time, time_acc);
+	}
+	aid_used = true;
+}
+
+/**
+ * @brief Count the acquisition time with or without aiding
+ *
+ * @param got_fix true if a location was found
+ * @param acq_time acquisition time in ms
+ */
+void gnss_aid_record(bool got_fix, uint32_t acq_time)
+{
+	if (!got_fix)
+	{
+		return;
+	}
+	if (aid_used)
+	{
+		g_gnss_aid_stats.aided_fixes++;
+		g_gnss_aid_stats.aided_ms += acq_time;
+	}
+	else
+	{
+		g_gnss_aid_stats.unaided_fixes++;
+		g_gnss_aid_stats.unaided_ms += acq_time;
+	}
+}
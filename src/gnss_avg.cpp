@@ -0,0 +1,240 @@
+/**
+ * @file gnss_avg.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Averaging of several fixes while the device is not moving
+ *        Outliers are removed, the mean is weighted by the accuracy of each fix
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Max number of fixes in the averaging window */
+#define GNSS_AVG_MAX_SAMPLES 64
+/** Max length of the averaging window in ms */
+#define GNSS_AVG_WINDOW_MS 60000
+/** Min number of fixes before the early stop */
+#define GNSS_AVG_MIN_SAMPLES 5
+/** Time without motion before the acquisition starts in ms */
+#define GNSS_AVG_STILL_MS 30000
+/** Consecutive fixes have correlated errors, number of fixes counted as one independent fix */
+#define GNSS_AVG_CORR_EPOCHS 5
+/** Fixes further away from the mean than this factor times their accuracy are outliers */
+#define GNSS_AVG_REJECT 3
+/** Lower limit of the accuracy of a single fix in mm, avoids huge weights */
+#define GNSS_AVG_MIN_ACC 500
+/** mm per 1e-7 degree latitude */
+#define GNSS_AVG_MM_PER_E7 11.132f
+
+/** Target error of the averaged position in cm, 0 = averaging off */
+uint16_t g_gnss_avg_target = 0;
+
+/** Result of the last averaging */
+gnss_avg_stats_s g_gnss_avg_stats;
+
+/** Fixes of the current window */
+struct avg_sample_s
+{
+	int32_t latitude;
+	int32_t longitude;
+	int32_t altitude;
+	uint32_t accuracy; // mm
+};
+
+/** Collected fixes */
+static avg_sample_s avg_samples[GNSS_AVG_MAX_SAMPLES];
+/** Number of collected fixes */
+static uint8_t avg_num = 0;
+/** millis() of the first fix of the window */
+static time_t avg_start = 0;
+/** Flag if averaging is used for the current acquisition */
+static bool avg_active = false;
+
+/** Averaged position and estimated error */
+static int32_t avg_latitude = 0;
+static int32_t avg_longitude = 0;
+static int32_t avg_altitude = 0;
+static uint32_t avg_error = 0;
+static uint8_t avg_rejected = 0;
+
+/**
+ * @brief Calculate the weighted mean, reject outliers and estimate the error
+ * 		Offsets are calculated in mm relative to the first fix
+ *
+ */
+static void avg_calculate(void)
+{
+	float cos_lat = cosf(avg_samples[0].latitude / 10000000.0f * DEG_TO_RAD);
+	float mean_n = 0;
+	float mean_e = 0;
+	float mean_alt = 0;
+	float sum_w = 0;
+	bool rejected[GNSS_AVG_MAX_SAMPLES] = {false};
+	avg_rejected = 0;
+
+	// Pass 1 with all fixes, pass 2 without the outliers
+	for (uint8_t pass = 0; pass < 2; pass++)
+	{
+		float sum_n = 0;
+		float sum_e = 0;
+		float sum_alt = 0;
+		sum_w = 0;
+		for (uint8_t idx = 0; idx < avg_num; idx++)
+		{
+			if (rejected[idx])
+			{
+				continue;
+			}
+			float acc = avg_samples[idx].accuracy < GNSS_AVG_MIN_ACC ? GNSS_AVG_MIN_ACC : avg_samples[idx].accuracy;
+			float weight = 1.0f / (acc * acc);
+			sum_n += weight * (avg_samples[idx].latitude - avg_samples[0].latitude) * GNSS_AVG_MM_PER_E7;
+			sum_e += weight * (avg_samples[idx].longitude - avg_samples[0].longitude) * GNSS_AVG_MM_PER_E7 * cos_lat;
+			sum_alt += weight * (avg_samples[idx].altitude - avg_samples[0].altitude);
+			sum_w += weight;
+		}
+		mean_n = sum_n / sum_w;
+		mean_e = sum_e / sum_w;
+		mean_alt = sum_alt / sum_w;
+
+		if (pass == 1)
+		{
+			break;
+		}
+		for (uint8_t idx = 0; idx < avg_num; idx++)
+		{
+			float acc = avg_samples[idx].accuracy < GNSS_AVG_MIN_ACC ? GNSS_AVG_MIN_ACC : avg_samples[idx].accuracy;
+			float d_n = (avg_samples[idx].latitude - avg_samples[0].latitude) * GNSS_AVG_MM_PER_E7 - mean_n;
+			float d_e = (avg_samples[idx].longitude - avg_samples[0].longitude) * GNSS_AVG_MM_PER_E7 * cos_lat - mean_e;
+			if ((d_n * d_n + d_e * d_e) > (GNSS_AVG_REJECT * acc) * (GNSS_AVG_REJECT * acc))
+			{
+				rejected[idx] = true;
+				avg_rejected++;
+			}
+		}
+		if (avg_rejected == avg_num)
+		{
+			// Nothing left, keep the mean of all fixes
+			memset(rejected, 0, sizeof(rejected));
+			avg_rejected = 0;
+		}
+	}
+
+	// Scatter of the remaining fixes around the mean
+	float sum_d2 = 0;
+	for (uint8_t idx = 0; idx < avg_num; idx++)
+	{
+		if (rejected[idx])
+		{
+			continue;
+		}
+		float acc = avg_samples[idx].accuracy < GNSS_AVG_MIN_ACC ? GNSS_AVG_MIN_ACC : avg_samples[idx].accuracy;
+		float d_n = (avg_samples[idx].latitude - avg_samples[0].latitude) * GNSS_AVG_MM_PER_E7 - mean_n;
+		float d_e = (avg_samples[idx].longitude - avg_samples[0].longitude) * GNSS_AVG_MM_PER_E7 * cos_lat - mean_e;
+		sum_d2 += (d_n * d_n + d_e * d_e) / (acc * acc);
+	}
+	uint8_t used = avg_num - avg_rejected;
+	float n_eff = (float)((used + GNSS_AVG_CORR_EPOCHS - 1) / GNSS_AVG_CORR_EPOCHS);
+	// Formal error of the weighted mean, corrected for the correlation of the fixes
+	float formal = sqrtf((float)used / n_eff / sum_w);
+	// Error from the scatter of the fixes
+	float scatter = sqrtf(sum_d2 / sum_w / n_eff);
+	avg_error = (uint32_t)(formal > scatter ? formal : scatter);
+
+	avg_latitude = avg_samples[0].latitude + (int32_t)lroundf(mean_n / GNSS_AVG_MM_PER_E7);
+	avg_longitude = avg_samples[0].longitude + (int32_t)lroundf(mean_e / (GNSS_AVG_MM_PER_E7 * cos_lat));
+	avg_altitude = avg_samples[0].altitude + (int32_t)lroundf(mean_alt);
+}
+
+/**
+ * @brief Start a new acquisition
+ * 		Averaging is only used if it is enabled and no motion was seen before the acquisition
+ *
+ */
+void gnss_avg_start(void)
+{
+	avg_num = 0;
+	avg_start = 0;
+	avg_active = (g_gnss_avg_target != 0) && !g_is_helium && ((millis() - g_last_motion) > GNSS_AVG_STILL_MS);
+	if (avg_active)
+	{
+		MYLOG("GNSS", "Averaging, target %dcm", g_gnss_avg_target);
+	}
+}
+
+/**
+ * @brief Add a fix to the averaging window
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @param altitude mm
+ * @param accuracy horizontal accuracy in mm
+ * @return uint8_t GNSS_AVG_OFF if averaging is not used, GNSS_AVG_MORE to collect more fixes, GNSS_AVG_DONE if the window is finished
+ */
+uint8_t gnss_avg_add(int32_t latitude, int32_t longitude, int32_t altitude, uint32_t accuracy)
+{
+	if (!avg_active)
+	{
+		return GNSS_AVG_OFF;
+	}
+	if (avg_num == 0)
+	{
+		avg_start = millis();
+	}
+	else if (g_last_motion > avg_start)
+	{
+		// Device started moving, the fixes collected so far are still good
+		MYLOG("GNSS", "Averaging stopped by motion");
+		return GNSS_AVG_DONE;
+	}
+
+	avg_samples[avg_num].latitude = latitude;
+	avg_samples[avg_num].longitude = longitude;
+	avg_samples[avg_num].altitude = altitude;
+	avg_samples[avg_num].accuracy = accuracy;
+	avg_num++;
+
+	if ((avg_num == GNSS_AVG_MAX_SAMPLES) || ((millis() - avg_start) > GNSS_AVG_WINDOW_MS))
+	{
+		return GNSS_AVG_DONE;
+	}
+	if (avg_num >= GNSS_AVG_MIN_SAMPLES)
+	{
+		avg_calculate();
+		if (avg_error <= (uint32_t)g_gnss_avg_target * 10)
+		{
+			return GNSS_AVG_DONE;
+		}
+	}
+	return GNSS_AVG_MORE;
+}
+
+/**
+ * @brief Get the averaged position
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @param altitude mm
+ * @return true if fixes were collected
+ * @return false if there are no fixes
+ */
+bool gnss_avg_result(int64_t *latitude, int64_t *longitude, int32_t *altitude)
+{
+	if (!avg_active || (avg_num == 0))
+	{
+		return false;
+	}
+	avg_calculate();
+	*latitude = avg_latitude;
+	*longitude = avg_longitude;
+	*altitude = avg_altitude;
+
+	g_gnss_avg_stats.samples = avg_num;
+	g_gnss_avg_stats.rejected = avg_rejected;
+	g_gnss_avg_stats.error_mm = avg_error;
+	g_gnss_avg_stats.window_ms = millis() - avg_start;
+	MYLOG("GNSS", "Averaged %d fixes, %d rejected, error %ldmm in %ldms", avg_num, avg_rejected, (long)avg_error, (long)g_gnss_avg_stats.window_ms);
+	avg_active = false;
+	return true;
+}
@@ -0,0 +1,376 @@
+/**
+ * @file gnss_cfg.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief GNSS profiles (constellations and measurement rate)
+ *        The RAK12500 configuration is only sent if it differs from the one in the module
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+using namespace Adafruit_LittleFS_Namespace;
+
+/** Filename to save the hash of the applied configuration */
+static const char gnss_cfg_name[] = "GCFG";
+
+/** Filename to save the selected profile */
+static const char gnss_profile_name[] = "GPROF";
+
+/** GNSS system IDs used in the profiles, bit number in gnss_mask */
+static const uint8_t gnss_cfg_ids[] = {
+	SFE_UBLOX_GNSS_ID_GPS,
+	SFE_UBLOX_GNSS_ID_SBAS,
+	SFE_UBLOX_GNSS_ID_GALILEO,
+	SFE_UBLOX_GNSS_ID_BEIDOU,
+	SFE_UBLOX_GNSS_ID_IMES,
+	SFE_UBLOX_GNSS_ID_QZSS,
+	SFE_UBLOX_GNSS_ID_GLONASS,
+};
+
+/** Number of GNSS systems */
+#define GNSS_CFG_NUM (sizeof(gnss_cfg_ids) / sizeof(uint8_t))
+
+/** GNSS profile */
+struct gnss_profile_s
+{
+	const char *name;
+	uint16_t meas_rate; // RAK12500 measurement rate in ms
+	uint8_t gnss_mask;	// RAK12500 GNSS systems, bit = 1 << SFE_UBLOX_GNSS_ID_xxx
+	uint8_t casic_mask; // RAK12501 PCAS04 mode, 1 = GPS, 2 = BDS, 4 = GLONASS
+	uint32_t acq_ua;	// Estimated current during acquisition in uA
+};
+
+/** Available profiles, M8 tracks max 3 major constellations at the same time */
+static const gnss_profile_s gnss_profiles[GNSS_PROFILE_NUM] = {
+	// GPS + Galileo + QZSS at 1 Hz
+	{"Low power GPS+GAL 1Hz", 1000, 0x25, 1, 23000},
+	// GPS + GLONASS + Galileo + SBAS + QZSS at 2 Hz, closest to the former fixed configuration
+	{"Fast TTFF all 2Hz", 500, 0x67, 7, 29000},
+	// GPS + Galileo + BeiDou + SBAS + QZSS at 1 Hz
+	{"High accuracy 1Hz", 1000, 0x2F, 3, 27000},
+};
+
+/** Selected profile */
+uint8_t g_gnss_profile = GNSS_PROFILE_DEFAULT;
+
+/** Profile saved with ATC+GPROF, only its configuration is saved in the module and in GCFG */
+static uint8_t saved_profile = GNSS_PROFILE_DEFAULT;
+
+/** Flag if the profile changed and has to be sent to the module */
+volatile bool g_gnss_profile_changed = false;
+
+/** Acquisition statistics per profile */
+gnss_profile_stats_s g_gnss_profile_stats[GNSS_PROFILE_NUM];
+
+/** Payload buffer for CFG-GNSS poll and set */
+static uint8_t cfg_payload[4 + 8 * 8];
+
+/**
+ * @brief FNV-1a hash over a configuration
+ *
+ * @param meas_rate measurement rate in ms
+ * @param enabled array with the enable flags in the order of gnss_cfg_ids
+ * @return uint32_t hash
+ */
+static uint32_t cfg_hash(uint16_t meas_rate, bool *enabled)
+{
+	uint32_t hash = 2166136261UL;
+	hash = (hash ^ (meas_rate & 0xFF)) * 16777619UL;
+	hash = (hash ^ (meas_rate >> 8)) * 16777619UL;
+	for (uint8_t idx = 0; idx < GNSS_CFG_NUM; idx++)
+	{
+		hash = (hash ^ gnss_cfg_ids[idx]) * 16777619UL;
+		hash = (hash ^ (enabled[idx] ? 1 : 0)) * 16777619UL;
+	}
+	return hash;
+}
+
+/**
+ * @brief Poll UBX-CFG-GNSS into the given packet
+ *
+ * @param packet packet with cfg_payload as payload
+ * @return true if the configuration was received
+ */
+static bool poll_cfg_gnss(ubxPacket *packet)
+{
+	packet->cls = UBX_CLASS_CFG;
+	packet->id = UBX_CFG_GNSS;
+	packet->len = 0;
+	packet->startingSpot = 0;
+	if (my_gnss.sendCommand(packet) != SFE_UBLOX_STATUS_DATA_RECEIVED)
+	{
+		return false;
+	}
+	// Never handle more config blocks than the buffer can hold
+	if (packet->len > sizeof(cfg_payload))
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Find the config block of a GNSS system in a CFG-GNSS payload
+ *
+ * @param packet CFG-GNSS packet
+ * @param gnss_id GNSS system
+ * @return uint8_t* pointer to the block or NULL if not found
+ */
+static uint8_t *find_cfg_block(ubxPacket *packet, uint8_t gnss_id)
+{
+	uint8_t num_blocks = packet->payload[3];
+	for (uint8_t block = 0; (block < num_blocks) && (4 + block * 8 + 8 <= packet->len); block++)
+	{
+		if (packet->payload[4 + block * 8] == gnss_id)
+		{
+			return &packet->payload[4 + block * 8];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Configure the RAK12500 if its configuration differs from the selected profile
+ * 		The hash of the module configuration (read back with one CFG-GNSS and one CFG-RATE poll)
+ * 		and the hash saved after the last configuration must both match the profile.
+ * 		Otherwise all GNSS systems are set with one CFG-GNSS message.
+ * 		The configuration is saved in the module and in GCFG only once after the saved profile changed.
+ * 		Profiles used by the motion classifier go into the RAM of the module only, no flash is written.
+ * 		Must be called with g_i2c_sem taken.
+ *
+ */
+void gnss_apply_config(void)
+{
+	const gnss_profile_s *profile = &gnss_profiles[g_gnss_profile];
+	bool enabled[GNSS_CFG_NUM];
+	for (uint8_t idx = 0; idx < GNSS_CFG_NUM; idx++)
+	{
+		enabled[idx] = (profile->gnss_mask & (1 << gnss_cfg_ids[idx])) != 0;
+	}
+	uint32_t table_hash = cfg_hash(profile->meas_rate, enabled);
+
+	// Hash saved after the last configuration
+	uint32_t saved_hash = 0;
+	File cfg_file(InternalFS);
+	if (cfg_file.open(gnss_cfg_name, FILE_O_READ))
+	{
+		cfg_file.read((void *)&saved_hash, sizeof(uint32_t));
+		cfg_file.close();
+	}
+
+	// Hash of the configuration in the module
+	ubxPacket packet = {0, 0, 0, 0, 0, cfg_payload, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
+	bool cfg_ok = poll_cfg_gnss(&packet);
+	uint32_t module_hash = 0;
+	if (cfg_ok)
+	{
+		for (uint8_t idx = 0; idx < GNSS_CFG_NUM; idx++)
+		{
+			uint8_t *block = find_cfg_block(&packet, gnss_cfg_ids[idx]);
+			enabled[idx] = (block != NULL) && (block[4] & 0x01);
+		}
+		module_hash = cfg_hash(my_gnss.getMeasurementRate(), enabled);
+	}
+
+	// Runtime profiles are never saved, the saved profile only if it changed
+	bool save = (g_gnss_profile == saved_profile) && (saved_hash != table_hash);
+	if ((module_hash == table_hash) && !save)
+	{
+		MYLOG("GNSS", "Configuration unchanged %08lX", (unsigned long)table_hash);
+		return;
+	}
+	MYLOG("GNSS", "Apply profile %s", profile->name);
+	MYLOG("GNSS", "Configure module, saved %08lX module %08lX table %08lX", (unsigned long)saved_hash, (unsigned long)module_hash, (unsigned long)table_hash);
+
+	my_gnss.setMeasurementRate(profile->meas_rate);
+
+	// M8 has no CFG-VALSET, all GNSS systems are changed with a single CFG-GNSS
+	if (cfg_ok)
+	{
+		for (uint8_t idx = 0; idx < GNSS_CFG_NUM; idx++)
+		{
+			uint8_t *block = find_cfg_block(&packet, gnss_cfg_ids[idx]);
+			if (block == NULL)
+			{
+				continue;
+			}
+			if ((profile->gnss_mask & (1 << gnss_cfg_ids[idx])) != 0)
+			{
+				block[4] |= 0x01;
+			}
+			else
+			{
+				block[4] &= ~0x01;
+			}
+		}
+		cfg_ok = my_gnss.sendCommand(&packet) == SFE_UBLOX_STATUS_DATA_SENT;
+	}
+
+	if (!cfg_ok)
+	{
+		MYLOG("GNSS", "CFG-GNSS failed");
+		return;
+	}
+	if (!save)
+	{
+		// RAM only, after a power cut the module starts with the saved profile again
+		return;
+	}
+
+	my_gnss.saveConfiguration(); // Save the current settings to flash and BBR
+
+	InternalFS.remove(gnss_cfg_name);
+	if (cfg_file.open(gnss_cfg_name, FILE_O_WRITE))
+	{
+		cfg_file.write((const uint8_t *)&table_hash, sizeof(uint32_t));
+		cfg_file.close();
+	}
+}
+
+/**
+ * @brief Send the constellations of the selected profile to the RAK12501
+ * 		The L76K keeps its 1 Hz rate, the NMEA sleep time is sized for it
+ *
+ */
+void gnss_profile_casic(void)
+{
+	char mode_cmd[16];
+	snprintf(mode_cmd, 16, "PCAS04,%d", gnss_profiles[g_gnss_profile].casic_mask);
+	gnss_send_nmea(mode_cmd);
+}
+
+/**
+ * @brief Get the name of a profile
+ *
+ * @param profile profile number
+ * @return const char* name
+ */
+const char *gnss_profile_name_get(uint8_t profile)
+{
+	if (profile >= GNSS_PROFILE_NUM)
+	{
+		return "";
+	}
+	return gnss_profiles[profile].name;
+}
+
+/**
+ * @brief Select a profile, it is sent to the module at the next acquisition
+ *
+ * @param profile profile number
+ * @return true if the profile exists
+ */
+bool gnss_profile_set(uint8_t profile)
+{
+	if (profile >= GNSS_PROFILE_NUM)
+	{
+		return false;
+	}
+	if (profile != g_gnss_profile)
+	{
+		g_gnss_profile = profile;
+		g_gnss_profile_changed = true;
+	}
+	saved_profile = profile;
+
+	InternalFS.remove(gnss_profile_name);
+	if (g_gnss_profile != GNSS_PROFILE_DEFAULT)
+	{
+		char profile_char = '0' + g_gnss_profile;
+		File profile_file(InternalFS);
+		if (profile_file.open(gnss_profile_name, FILE_O_WRITE))
+		{
+			profile_file.write(&profile_char, 1);
+			profile_file.close();
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Use a profile without saving it, used by the motion classifier
+ * 		Neither the profile nor the module configuration is written to flash
+ *
+ * @param profile profile number
+ */
+void gnss_profile_use(uint8_t profile)
+{
+	if ((profile < GNSS_PROFILE_NUM) && (profile != g_gnss_profile))
+	{
+		g_gnss_profile = profile;
+		g_gnss_profile_changed = true;
+	}
+}
+
+/**
+ * @brief Check if a runtime profile is used instead of the saved one
+ * 		The module loses it with every power cut and it has to be sent again
+ *
+ * @return true if the profile is not the saved one
+ */
+bool gnss_profile_is_runtime(void)
+{
+	return g_gnss_profile != saved_profile;
+}
+
+/**
+ * @brief Get the measurement rate of the active profile
+ * 		The L76K of the RAK12501 always measures at 1 Hz
+ *
+ * @return uint16_t measurement rate in ms
+ */
+uint16_t gnss_profile_meas_rate(void)
+{
+	if (gnss_option == RAK12501_GNSS)
+	{
+		return 1000;
+	}
+	return gnss_profiles[g_gnss_profile].meas_rate;
+}
+
+/**
+ * @brief Read the selected profile from flash
+ *
+ */
+void gnss_profile_load(void)
+{
+	g_gnss_profile = GNSS_PROFILE_DEFAULT;
+	File profile_file(InternalFS);
+	if (profile_file.open(gnss_profile_name, FILE_O_READ))
+	{
+		char profile_char = '0';
+		profile_file.read(&profile_char, 1);
+		profile_file.close();
+		if ((profile_char >= '0') && (profile_char < '0' + GNSS_PROFILE_NUM))
+		{
+			g_gnss_profile = profile_char - '0';
+		}
+	}
+	saved_profile = g_gnss_profile;
+}
+
+/**
+ * @brief Count acquisition time and estimated charge for the active profile
+ *
+ * @param got_fix true if a location was found
+ * @param acq_time acquisition time in ms
+ */
+void gnss_profile_record(bool got_fix, uint32_t acq_time)
+{
+	gnss_profile_stats_s *stats = &g_gnss_profile_stats[g_gnss_profile];
+	if (got_fix)
+	{
+		stats->fixes++;
+		stats->fix_ms += acq_time;
+	}
+	else
+	{
+		stats->no_fixes++;
+	}
+	// uA * ms / 1000000 = mA * s
+	stats->charge_mas += (uint64_t)gnss_profiles[g_gnss_profile].acq_ua * acq_time / 1000000;
+}
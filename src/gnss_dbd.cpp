@@ -0,0 +1,190 @@
+/**
+ * @file gnss_dbd.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Cache of the RAK12500 navigation database (UBX-MGA-DBD) in flash
+ *        Restored after a reset or battery change to avoid a full cold start
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+using namespace Adafruit_LittleFS_Namespace;
+
+/** Filename to save the navigation database */
+static const char nav_db_name[] = "NAVDB";
+
+/** Marker of a valid database file */
+#define GNSS_DBD_MARK 0xDBD1
+/** Max size of the navigation database in bytes */
+#define GNSS_DBD_MAX_SIZE 12288
+/** Min time between two database writes in seconds */
+#define GNSS_DBD_SAVE_INTERVAL 7200
+/** Max age of the saved database in seconds, the almanac is still usable after the ephemeris expired */
+#define GNSS_DBD_MAX_AGE 604800
+
+/** Header of the database file */
+struct gnss_dbd_header_s
+{
+	uint16_t mark = 0;
+	uint16_t length = 0;   // number of database bytes following the header
+	uint32_t utc = 0;	   // UTC of the database dump as Unix time
+	uint32_t checksum = 0; // sum of all database bytes
+};
+
+/** UTC of the saved database, 0 if nothing saved */
+static uint32_t saved_utc = 0;
+
+/**
+ * @brief Simple checksum over the database bytes
+ *
+ */
+static uint32_t dbd_checksum(uint8_t *data, uint16_t length)
+{
+	uint32_t sum = 0;
+	for (uint16_t idx = 0; idx < length; idx++)
+	{
+		sum += data[idx];
+	}
+	return sum;
+}
+
+/**
+ * @brief Read the UTC time from the GNSS module
+ *
+ * @return uint32_t UTC as Unix time, 0 if the module has no valid time
+ */
+static uint32_t module_utc(void)
+{
+	if (!my_gnss.getDateValid() || !my_gnss.getTimeValid())
+	{
+		return 0;
+	}
+	return gnss_unix_time(my_gnss.getYear(), my_gnss.getMonth(), my_gnss.getDay(),
+						  my_gnss.getHour(), my_gnss.getMinute(), my_gnss.getSecond());
+}
+
+/**
+ * @brief Push the saved navigation database into the RAK12500
+ * 		If the module still knows the time, an outdated database is dropped.
+ * 		Without time the module checks the age of the data itself after the first fix.
+ *
+ */
+void gnss_dbd_restore(void)
+{
+	if (gnss_option != RAK12500_GNSS)
+	{
+		return;
+	}
+
+	File dbd_file(InternalFS);
+	if (!dbd_file.open(nav_db_name, FILE_O_READ))
+	{
+		MYLOG("GNSS", "No saved navigation database");
+		return;
+	}
+
+	gnss_dbd_header_s header;
+	if ((dbd_file.read((void *)&header, sizeof(gnss_dbd_header_s)) != sizeof(gnss_dbd_header_s)) || (header.mark != GNSS_DBD_MARK) || (header.length > GNSS_DBD_MAX_SIZE))
+	{
+		MYLOG("GNSS", "Invalid navigation database file");
+		dbd_file.close();
+		InternalFS.remove(nav_db_name);
+		return;
+	}
+	saved_utc = header.utc;
+
+	xSemaphoreTake(g_i2c_sem, 2000);
+	uint32_t now = module_utc();
+	xSemaphoreGive(g_i2c_sem);
+	if ((now != 0) && (now - header.utc > GNSS_DBD_MAX_AGE))
+	{
+		MYLOG("GNSS", "Navigation database is %ld s old, dropped", (long)(now - header.utc));
+		dbd_file.close();
+		InternalFS.remove(nav_db_name);
+		saved_utc = 0;
+		return;
+	}
+
+	uint8_t *database = (uint8_t *)malloc(header.length);
+	if (database == NULL)
+	{
+		dbd_file.close();
+		return;
+	}
+	uint16_t read_len = dbd_file.read((void *)database, header.length);
+	dbd_file.close();
+
+	if ((read_len == header.length) && (dbd_checksum(database, header.length) == header.checksum))
+	{
+		xSemaphoreTake(g_i2c_sem, 2000);
+		size_t pushed = my_gnss.pushAssistNowData(database, header.length);
+		xSemaphoreGive(g_i2c_sem);
+		MYLOG("GNSS", "Restored navigation database, %d of %d bytes", pushed, header.length);
+	}
+	else
+	{
+		MYLOG("GNSS", "Navigation database checksum error");
+		InternalFS.remove(nav_db_name);
+		saved_utc = 0;
+	}
+	free(database);
+}
+
+/**
+ * @brief Save the navigation database of the RAK12500 after a good fix
+ * 		Written at most every GNSS_DBD_SAVE_INTERVAL seconds to protect the flash.
+ * 		Must be called before the module is powered down.
+ *
+ * @param utc UTC of the fix as Unix time, 0 if unknown
+ */
+void gnss_dbd_save(uint32_t utc)
+{
+	if ((gnss_option != RAK12500_GNSS) || (utc == 0))
+	{
+		return;
+	}
+	if ((saved_utc != 0) && (utc - saved_utc < GNSS_DBD_SAVE_INTERVAL))
+	{
+		return;
+	}
+
+	uint8_t *database = (uint8_t *)malloc(GNSS_DBD_MAX_SIZE);
+	if (database == NULL)
+	{
+		return;
+	}
+
+	xSemaphoreTake(g_i2c_sem, 2000);
+	size_t length = my_gnss.readNavigationDatabase(database, GNSS_DBD_MAX_SIZE);
+	xSemaphoreGive(g_i2c_sem);
+
+	// A full buffer means the database was truncated
+	if ((length != 0) && (length < GNSS_DBD_MAX_SIZE))
+	{
+		gnss_dbd_header_s header;
+		header.mark = GNSS_DBD_MARK;
+		header.length = length;
+		header.utc = utc;
+		header.checksum = dbd_checksum(database, length);
+
+		InternalFS.remove(nav_db_name);
+		File dbd_file(InternalFS);
+		if (dbd_file.open(nav_db_name, FILE_O_WRITE))
+		{
+			dbd_file.write((const uint8_t *)&header, sizeof(gnss_dbd_header_s));
+			dbd_file.write(database, length);
+			dbd_file.close();
+			saved_utc = utc;
+			MYLOG("GNSS", "Saved navigation database, %d bytes", length);
+		}
+	}
+	else
+	{
+		MYLOG("GNSS", "Navigation database not saved, %d bytes", length);
+	}
+	free(database);
+}
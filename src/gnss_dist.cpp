@@ -0,0 +1,59 @@
+/**
+ * @file gnss_dist.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Send-on-distance, positions closer than the min distance to the last sent position are not sent
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Min distance to the last sent position in m, 0 = every position is sent */
+uint16_t g_gnss_min_dist = 0;
+
+/** Flag if a heartbeat without position is sent instead of skipping the uplink */
+bool g_gnss_dist_heartbeat = false;
+
+/** Flag if the position of the current acquisition was not added to the payload */
+volatile bool g_gnss_dist_skip = false;
+
+/** Result of the last check */
+gnss_dist_stats_s g_gnss_dist_stats;
+
+/** Last sent position in 1e-7 degrees */
+static int32_t sent_lat = 0;
+static int32_t sent_lon = 0;
+/** Flag if a position was sent already */
+static bool sent_valid = false;
+
+/**
+ * @brief Check if a position has to be sent
+ * 		Helium Mapper needs every position, the check is not used in that format
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @param force true to send the position regardless of the distance
+ * @return true if the position is far enough from the last sent position, it becomes the new last sent position
+ * @return false if the position is too close to the last sent position
+ */
+bool gnss_dist_check(int32_t latitude, int32_t longitude, bool force)
+{
+	g_gnss_dist_skip = false;
+	if (sent_valid)
+	{
+		g_gnss_dist_stats.last_dist = geo_distance_m(sent_lat, sent_lon, latitude, longitude);
+		if (!force && (g_gnss_min_dist != 0) && !g_is_helium && (g_gnss_dist_stats.last_dist < g_gnss_min_dist))
+		{
+			MYLOG("GNSS", "Moved %ldm, min %dm", (long)g_gnss_dist_stats.last_dist, g_gnss_min_dist);
+			g_gnss_dist_stats.suppressed++;
+			g_gnss_dist_skip = true;
+			return false;
+		}
+	}
+	sent_lat = latitude;
+	sent_lon = longitude;
+	sent_valid = true;
+	return true;
+}
@@ -0,0 +1,274 @@
+/**
+ * @file gnss_filter.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fixed-point constant velocity Kalman filter for the reported positions
+ *        Rejects position jumps (multipath) by checking the innovation against the fix accuracy.
+ *        The state is kept between the location acquisitions.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include "gnss_filter.h"
+
+/** Acceleration noise density in mm^2/s^3 while moving */
+#define GNSS_FILT_Q 250000
+/** Max position variance in mm^2, keeps the fixed-point math in range (~1 km sigma) */
+#define GNSS_FILT_P_MAX 1000000000000LL
+/** Max velocity variance in mm^2/s^2 (~30 m/s sigma) */
+#define GNSS_FILT_V_MAX 1000000000LL
+/** Max gap between two fixes for the velocity model in ms, longer gaps restart the velocity */
+#define GNSS_FILT_MAX_GAP 300000
+/** Gate for the normalized innovation squared * 256, chi-square 2 DOF 99.7% = 11.8 */
+#define GNSS_FILT_GATE (118 * 256 / 10)
+/** Consecutive rejected fixes before the filter follows the new position */
+#define GNSS_FILT_MAX_REJECT 3
+/** Max offset from the origin in mm before the origin is moved */
+#define GNSS_FILT_REBASE 10000000
+/** mm per 1e-7 degree latitude * 1000 */
+#define GNSS_FILT_MM_PER_E7_1000 11132
+/** Radians per 1e-7 degree */
+#define GNSS_FILT_RAD_PER_E7 (3.14159265f / 1800000000.0f)
+
+/** One axis of the filter, position in mm, velocity in mm/s */
+struct filt_axis_s
+{
+	int64_t pos = 0;
+	int64_t vel = 0;
+	int64_t p11 = 0; // position variance mm^2
+	int64_t p12 = 0; // covariance mm^2/s
+	int64_t p22 = 0; // velocity variance mm^2/s^2
+};
+
+/** Flag if the filter is on */
+bool g_gnss_filter = true;
+
+/** Last raw and filtered position for debugging */
+gnss_filter_stats_s g_gnss_filter_stats;
+
+/** North and east axis */
+static filt_axis_s filt_n;
+static filt_axis_s filt_e;
+/** Origin of the local frame in 1e-7 degrees */
+static int32_t origin_lat = 0;
+static int32_t origin_lon = 0;
+/** cos(latitude of the origin) * 65536 */
+static int32_t origin_cos_q16 = 65536;
+/** Time of the last update in ms */
+static time_t last_update = 0;
+/** Flag if the filter has a state */
+static bool filt_valid = false;
+/** Number of consecutive rejected fixes */
+static uint8_t reject_count = 0;
+
+/**
+ * @brief Limit a variance
+ *
+ */
+static int64_t limit_p(int64_t value, int64_t max)
+{
+	return value > max ? max : value;
+}
+
+/**
+ * @brief Convert a position into mm north and east of the origin
+ *
+ */
+static void to_local(int32_t latitude, int32_t longitude, int64_t *north, int64_t *east)
+{
+	*north = (int64_t)(latitude - origin_lat) * GNSS_FILT_MM_PER_E7_1000 / 1000;
+	*east = (((int64_t)(longitude - origin_lon) * GNSS_FILT_MM_PER_E7_1000 / 1000) * origin_cos_q16) >> 16;
+}
+
+/**
+ * @brief Restart the filter at a position
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @param variance variance of the position in mm^2
+ */
+static void filt_reset(int32_t latitude, int32_t longitude, int64_t variance)
+{
+	origin_lat = latitude;
+	origin_lon = longitude;
+	origin_cos_q16 = (int32_t)(cosf(latitude * GNSS_FILT_RAD_PER_E7) * 65536.0f);
+	if (origin_cos_q16 < 1)
+	{
+		origin_cos_q16 = 1;
+	}
+	filt_n = filt_axis_s();
+	filt_e = filt_axis_s();
+	filt_n.p11 = filt_e.p11 = variance;
+	filt_n.p22 = filt_e.p22 = GNSS_FILT_V_MAX;
+	filt_valid = true;
+	reject_count = 0;
+}
+
+/**
+ * @brief Predict one axis
+ *
+ * @param axis filter axis
+ * @param dt time since the last update in ms
+ * @param q acceleration noise density in mm^2/s^3
+ */
+static void filt_predict(filt_axis_s *axis, int64_t dt, int64_t q)
+{
+	axis->pos += axis->vel * dt / 1000;
+	// Multiply by dt in s step by step to stay inside int64
+	int64_t q_dt = q * dt / 1000;		   // mm^2/s^2
+	int64_t q_dt2 = q_dt * dt / 1000;	   // mm^2/s
+	int64_t q_dt3 = q_dt2 * dt / 1000;	   // mm^2
+	int64_t p22_dt = axis->p22 * dt / 1000; // mm^2/s
+	axis->p11 = limit_p(axis->p11 + 2 * axis->p12 * dt / 1000 + p22_dt * dt / 1000 + q_dt3 / 3, GNSS_FILT_P_MAX);
+	axis->p12 = axis->p12 + p22_dt + q_dt2 / 2;
+	axis->p22 = limit_p(axis->p22 + q_dt, GNSS_FILT_V_MAX);
+	// Covariance can not be larger than the variances allow after the limits
+	int64_t p12_max = (int64_t)sqrtf((float)axis->p11 * (float)axis->p22);
+	if (axis->p12 > p12_max)
+	{
+		axis->p12 = p12_max;
+	}
+}
+
+/**
+ * @brief Update one axis with a measurement
+ *
+ * @param axis filter axis
+ * @param innovation measurement minus predicted position in mm
+ * @param s innovation variance in mm^2
+ */
+static void filt_correct(filt_axis_s *axis, int64_t innovation, int64_t s)
+{
+	// Kalman gains in Q16
+	int64_t k1 = (axis->p11 << 16) / s;
+	int64_t k2 = (axis->p12 << 16) / s;
+	axis->pos += (k1 * innovation) >> 16;
+	axis->vel += (k2 * innovation) >> 16;
+	int64_t p11 = axis->p11;
+	int64_t p12 = axis->p12;
+	axis->p11 = p11 - ((k1 * p11) >> 16);
+	axis->p12 = p12 - ((k1 * p12) >> 16);
+	axis->p22 = axis->p22 - ((k2 * p12) >> 16);
+	if (axis->p22 < 0)
+	{
+		axis->p22 = 0;
+	}
+}
+
+/**
+ * @brief Filter a new fix
+ * 		Without motion since the last fix the position is expected unchanged.
+ * 		A fix that does not fit the prediction is rejected and the predicted position is used,
+ * 		after GNSS_FILT_MAX_REJECT rejected fixes in a row the filter restarts at the new fix.
+ *
+ * @param latitude in: measured, out: filtered latitude in 1e-7 degrees
+ * @param longitude in: measured, out: filtered longitude in 1e-7 degrees
+ * @param accuracy horizontal accuracy of the fix in mm
+ * @param now time of the fix in ms
+ * @param last_motion time of the last detected motion in ms, now if motion is not detected
+ * @return true if the fix was accepted
+ * @return false if the fix was rejected as outlier
+ */
+bool gnss_filter_update(int64_t *latitude, int64_t *longitude, uint32_t accuracy, time_t now, time_t last_motion)
+{
+	g_gnss_filter_stats.raw_lat = *latitude;
+	g_gnss_filter_stats.raw_lon = *longitude;
+	g_gnss_filter_stats.accepted = true;
+	g_gnss_filter_stats.nis = 0;
+
+	int64_t r = (int64_t)accuracy * accuracy;
+	if (r < 1000000)
+	{
+		// At least 1 m
+		r = 1000000;
+	}
+
+	if (!filt_valid)
+	{
+		filt_reset(*latitude, *longitude, r);
+	}
+	else
+	{
+		int64_t dt = now - last_update;
+		bool moved = last_motion >= last_update;
+		if (!moved)
+		{
+			// Parked, position unchanged, velocity zero
+			filt_n.vel = 0;
+			filt_e.vel = 0;
+		}
+		else if (dt > GNSS_FILT_MAX_GAP)
+		{
+			// Too long for the velocity model, the position can be anywhere within the reach of the max speed
+			filt_n.vel = 0;
+			filt_e.vel = 0;
+			filt_n.p11 = filt_e.p11 = GNSS_FILT_P_MAX;
+			filt_n.p12 = filt_e.p12 = 0;
+			filt_n.p22 = filt_e.p22 = GNSS_FILT_V_MAX;
+		}
+		else
+		{
+			filt_predict(&filt_n, dt, GNSS_FILT_Q);
+			filt_predict(&filt_e, dt, GNSS_FILT_Q);
+		}
+
+		int64_t meas_n;
+		int64_t meas_e;
+		to_local(*latitude, *longitude, &meas_n, &meas_e);
+		int64_t y_n = meas_n - filt_n.pos;
+		int64_t y_e = meas_e - filt_e.pos;
+		int64_t s_n = filt_n.p11 + r;
+		int64_t s_e = filt_e.p11 + r;
+
+		// Normalized innovation squared * 256, innovation limited to 100 km to stay in range
+		int64_t lim_n = y_n > 100000000 ? 100000000 : (y_n < -100000000 ? -100000000 : y_n);
+		int64_t lim_e = y_e > 100000000 ? 100000000 : (y_e < -100000000 ? -100000000 : y_e);
+		int64_t nis = ((lim_n * lim_n) << 8) / s_n + ((lim_e * lim_e) << 8) / s_e;
+		g_gnss_filter_stats.nis = nis > UINT32_MAX ? UINT32_MAX : (uint32_t)nis;
+
+		if ((nis > GNSS_FILT_GATE) && (reject_count < GNSS_FILT_MAX_REJECT - 1))
+		{
+			reject_count++;
+			g_gnss_filter_stats.accepted = false;
+			g_gnss_filter_stats.rejected++;
+		}
+		else if (nis > GNSS_FILT_GATE)
+		{
+			// The fixes agree with each other, not with the filter
+			g_gnss_filter_stats.restarts++;
+			filt_reset(*latitude, *longitude, r);
+		}
+		else
+		{
+			reject_count = 0;
+			filt_correct(&filt_n, y_n, s_n);
+			filt_correct(&filt_e, y_e, s_e);
+		}
+	}
+	last_update = now;
+
+	// Filtered position back to degrees
+	*latitude = origin_lat + filt_n.pos * 1000 / GNSS_FILT_MM_PER_E7_1000;
+	*longitude = origin_lon + ((filt_e.pos << 16) / origin_cos_q16) * 1000 / GNSS_FILT_MM_PER_E7_1000;
+
+	// Keep the offsets small
+	if ((llabs(filt_n.pos) > GNSS_FILT_REBASE) || (llabs(filt_e.pos) > GNSS_FILT_REBASE))
+	{
+		filt_axis_s keep_n = filt_n;
+		filt_axis_s keep_e = filt_e;
+		filt_reset(*latitude, *longitude, 0);
+		filt_n = keep_n;
+		filt_e = keep_e;
+		filt_n.pos = 0;
+		filt_e.pos = 0;
+	}
+
+	g_gnss_filter_stats.filt_lat = *latitude;
+	g_gnss_filter_stats.filt_lon = *longitude;
+	g_gnss_filter_stats.sigma_mm = (uint32_t)sqrtf((float)(filt_n.p11 + filt_e.p11) / 2.0f);
+	return g_gnss_filter_stats.accepted;
+}
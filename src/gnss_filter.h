@@ -0,0 +1,35 @@
+/**
+ * @file gnss_filter.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fixed-point constant velocity Kalman filter for the reported positions
+ *        No Arduino dependencies, the same code is used by the host replay test
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef GNSS_FILTER_H
+#define GNSS_FILTER_H
+
+#include <stdint.h>
+#include <time.h>
+
+/** Raw and filtered position of the last fix */
+struct gnss_filter_stats_s
+{
+	int32_t raw_lat = 0;
+	int32_t raw_lon = 0;
+	int32_t filt_lat = 0;
+	int32_t filt_lon = 0;
+	uint32_t sigma_mm = 0; // estimated error of the filtered position
+	uint32_t rejected = 0; // number of rejected fixes
+	uint32_t restarts = 0; // number of restarts at a new position after rejected fixes
+	uint32_t nis = 0;	   // normalized innovation squared * 256 of the last fix
+	bool accepted = false;
+};
+bool gnss_filter_update(int64_t *latitude, int64_t *longitude, uint32_t accuracy, time_t now, time_t last_motion);
+extern bool g_gnss_filter;
+extern gnss_filter_stats_s g_gnss_filter_stats;
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * @file gnss_power.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief GNSS power strategy between location acquisitions
+ *        Keeps ephemeris and RTC of the GNSS module alive if it saves energy
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Configured power strategy, GNSS_PWR_AUTO selects it from the time until the next acquisition and TTFF */
+uint8_t g_gnss_pwr_mode = GNSS_PWR_AUTO;
+
+/** Start type of the next acquisition, after a reset the ephemeris are treated as expired */
+uint8_t g_gnss_pwr_last = GNSS_PWR_OFF;
+
+/** millis() of the last power cut, used to find out if the ephemeris expired meanwhile */
+static time_t pwr_cut_time = 0;
+
+/** Baudrate of the GNSS UART, 0 if the GNSS is not connected over Serial1 */
+uint32_t gnss_uart_baud = 0;
+
+/** Average time to first fix in ms after each start type */
+uint32_t g_ttff_avg[4] = {0, GNSS_TTFF_DEF_BACKUP, GNSS_TTFF_DEF_STANDBY, GNSS_TTFF_DEF_OFF};
+
+/**
+ * @brief Select the power strategy for the time until the next acquisition
+ * 		Standby is used if the standby current until the next acquisition costs less
+ * 		than the longer acquisition after a power cut
+ * 		The V_BCKP supply of the module cannot be switched, a power cut always keeps RTC and
+ * 		almanac, the ephemeris only until they expire
+ *
+ * @param interval time until the next acquisition in ms, 0 if unknown
+ * @return uint8_t GNSS_PWR_BACKUP or GNSS_PWR_STANDBY
+ */
+uint8_t gnss_select_power_mode(uint32_t interval)
+{
+	if (g_gnss_pwr_mode != GNSS_PWR_AUTO)
+	{
+		return g_gnss_pwr_mode;
+	}
+
+	if (interval == 0)
+	{
+		// Only triggered by movement, time until next acquisition is unknown
+		return GNSS_PWR_BACKUP;
+	}
+
+	if (interval <= GNSS_HOT_START_LIMIT)
+	{
+		return GNSS_PWR_STANDBY;
+	}
+
+	// After a power cut the start is hot only while the ephemeris are valid
+	uint8_t cut_start = interval <= GNSS_EPHEMERIS_VALID ? GNSS_PWR_BACKUP : GNSS_PWR_OFF;
+
+	// Charge in uA * s
+	uint64_t standby_ua = gnss_option == RAK12500_GNSS ? GNSS_STANDBY_UA_RAK12500 : GNSS_STANDBY_UA_RAK12501;
+	uint64_t standby_cost = standby_ua * interval / 1000;
+	uint64_t acq_saving = 0;
+	if (g_ttff_avg[cut_start] > g_ttff_avg[GNSS_PWR_STANDBY])
+	{
+		acq_saving = (uint64_t)GNSS_ACQ_UA * (g_ttff_avg[cut_start] - g_ttff_avg[GNSS_PWR_STANDBY]) / 1000;
+	}
+
+	if (standby_cost < acq_saving)
+	{
+		return GNSS_PWR_STANDBY;
+	}
+	return GNSS_PWR_BACKUP;
+}
+
+/**
+ * @brief Put the GNSS module into the selected power mode
+ *
+ */
+void gnss_power_down(void)
+{
+	if (g_is_helium)
+	{
+		// Helium Mapper keeps the GNSS module in its own power save mode
+		return;
+	}
+
+	// Send interval of the motion state, geofence or track, not only the configured one
+	uint32_t interval = next_acq_interval();
+	g_gnss_pwr_last = gnss_select_power_mode(interval);
+	if ((interval == 0) && (g_gnss_pwr_last == GNSS_PWR_STANDBY) && (gnss_option != RAK12500_GNSS))
+	{
+		// RAK12501 standby is timed, without a next acquisition it would wake up for nothing
+		g_gnss_pwr_last = GNSS_PWR_BACKUP;
+	}
+	MYLOG("GNSS", "Power down, mode %d", g_gnss_pwr_last);
+
+	switch (g_gnss_pwr_last)
+	{
+	case GNSS_PWR_STANDBY:
+		if (gnss_option == RAK12500_GNSS)
+		{
+			// Software backup mode (UBX-RXM-PMREQ), wake up with activity on the UART RX line
+			xSemaphoreTake(g_i2c_sem, 2000);
+			my_gnss.powerOffWithInterrupt(0, VAL_RXM_PMREQ_WAKEUPSOURCE_UARTRX);
+			xSemaphoreGive(g_i2c_sem);
+		}
+		else
+		{
+			// Standby until the next scheduled acquisition, can be woken up earlier over UART
+			char standby_cmd[24];
+			snprintf(standby_cmd, 24, "PCAS12,%ld", (long)(interval / 1000));
+			gnss_send_nmea(standby_cmd);
+		}
+		break;
+	default:
+		// Cut the main supply, V_BCKP of the module stays on the always-on rail
+		// Release the UART to avoid powering the module through the TX line
+		pwr_cut_time = millis();
+		digitalWrite(WB_IO2, LOW);
+		if (gnss_uart_baud != 0)
+		{
+			Serial1.end();
+		}
+		delay(100);
+		break;
+	}
+}
+
+/**
+ * @brief Wake up the GNSS module from the power mode used in gnss_power_down()
+ *
+ */
+void gnss_power_up(void)
+{
+	if (g_is_helium)
+	{
+		return;
+	}
+
+	switch (g_gnss_pwr_last)
+	{
+	case GNSS_PWR_STANDBY:
+		if (gnss_uart_baud == 0)
+		{
+			// I2C connected module, Serial1 is only used for the wake up
+			Serial1.begin(9600);
+		}
+		// Any activity on the RX line wakes up the module, the characters are lost
+		Serial1.write(0xFF);
+		Serial1.write('\r');
+		Serial1.write('\n');
+		Serial1.flush();
+		if (gnss_uart_baud == 0)
+		{
+			Serial1.end();
+		}
+		delay(100);
+		break;
+	default:
+		xSemaphoreTake(g_i2c_sem, 2000);
+		digitalWrite(WB_IO2, HIGH);
+		delay(500);
+		xSemaphoreGive(g_i2c_sem);
+		if (gnss_uart_baud != 0)
+		{
+			Serial1.begin(gnss_uart_baud);
+		}
+		if ((g_gnss_pwr_last == GNSS_PWR_BACKUP) && ((millis() - pwr_cut_time) > GNSS_EPHEMERIS_VALID))
+		{
+			// Record the TTFF as start with expired ephemeris
+			g_gnss_pwr_last = GNSS_PWR_OFF;
+		}
+		break;
+	}
+}
+
+/**
+ * @brief Record the acquisition time for the power mode used before the acquisition
+ *
+ * @param got_fix true if the acquisition found a location
+ * @param acq_time acquisition time in ms
+ */
+void gnss_record_ttff(bool got_fix, uint32_t acq_time)
+{
+	if (!got_fix)
+	{
+		return;
+	}
+	uint32_t *avg = &g_ttff_avg[g_gnss_pwr_last];
+	*avg = (*avg * 3 + acq_time) / 4;
+	MYLOG("GNSS", "TTFF %ldms after mode %d, average %ldms", (long)acq_time, g_gnss_pwr_last, (long)*avg);
+}
@@ -0,0 +1,330 @@
+/**
+ * @file gnss_probe.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Detection of the GNSS module type, interface and baudrate
+ *        Serial1 is sniffed for NMEA or UBX while the I2C probe runs.
+ *        The result is saved to go straight to the known interface on the next boot.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+using namespace Adafruit_LittleFS_Namespace;
+
+/** Filename to save the probe result */
+static const char gnss_probe_name[] = "GPROBE";
+
+/** Time to listen for traffic on Serial1 in ms, the modules send at least once per second */
+#define GNSS_SNIFF_MS 1200
+/** Time to wait for the first NMEA sentence of the RAK12501 after power up in ms */
+#define GNSS_RAK12501_BOOT_MS 5000
+
+/** Nothing valid received */
+#define SNIFF_NONE 0
+/** Valid NMEA sentence received */
+#define SNIFF_NMEA 1
+/** UBX sync characters received */
+#define SNIFF_UBX 2
+
+/** Saved probe result */
+struct gnss_probe_s
+{
+	uint8_t option = NO_GNSS_INIT; // RAK12500_GNSS or RAK12501_GNSS
+	bool i2c = false;
+	uint32_t baud = 0;
+};
+
+/**
+ * @brief Convert a hex character
+ *
+ * @return int8_t value or -1 if not a hex character
+ */
+static int8_t hex_value(char c)
+{
+	if ((c >= '0') && (c <= '9'))
+	{
+		return c - '0';
+	}
+	if ((c >= 'A') && (c <= 'F'))
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+/**
+ * @brief Listen on Serial1 for a valid NMEA sentence or UBX sync characters
+ * 		Bytes received before the call (e.g. during the I2C probe) are checked as well
+ *
+ * @param window_ms max time to listen
+ * @return uint8_t SNIFF_NONE, SNIFF_NMEA or SNIFF_UBX
+ */
+static uint8_t sniff_serial(uint32_t window_ms)
+{
+	time_t start = millis();
+	bool in_sentence = false;
+	bool in_checksum = false;
+	uint8_t checksum = 0;
+	uint8_t check_chars = 0;
+	int8_t received = 0;
+	uint8_t length = 0;
+	char last_char = 0;
+
+	while ((millis() - start) < window_ms)
+	{
+		if (!Serial1.available())
+		{
+			delay(10);
+			continue;
+		}
+		char c = Serial1.read();
+
+		if ((last_char == (char)0xB5) && (c == (char)0x62))
+		{
+			return SNIFF_UBX;
+		}
+		last_char = c;
+
+		if (c == '$')
+		{
+			in_sentence = true;
+			in_checksum = false;
+			checksum = 0;
+			check_chars = 0;
+			received = 0;
+			length = 0;
+			continue;
+		}
+		if (!in_sentence)
+		{
+			continue;
+		}
+		if (in_checksum)
+		{
+			int8_t value = hex_value(c);
+			if (value < 0)
+			{
+				in_sentence = false;
+				continue;
+			}
+			received = (received << 4) | value;
+			if (++check_chars == 2)
+			{
+				if (((uint8_t)received == checksum) && (length > 5))
+				{
+					return SNIFF_NMEA;
+				}
+				in_sentence = false;
+			}
+			continue;
+		}
+		if (c == '*')
+		{
+			in_checksum = true;
+			continue;
+		}
+		if ((c < 0x20) || (c > 0x7E) || (++length > 82))
+		{
+			// Garbage from a wrong baudrate
+			in_sentence = false;
+			continue;
+		}
+		checksum ^= c;
+	}
+	return SNIFF_NONE;
+}
+
+/**
+ * @brief Save the probe result
+ *
+ */
+static void save_probe(void)
+{
+	gnss_probe_s probe;
+	probe.option = gnss_option;
+	probe.i2c = i2c_gnss;
+	probe.baud = gnss_uart_baud;
+
+	InternalFS.remove(gnss_probe_name);
+	File probe_file(InternalFS);
+	if (probe_file.open(gnss_probe_name, FILE_O_WRITE))
+	{
+		probe_file.write((const uint8_t *)&probe, sizeof(gnss_probe_s));
+		probe_file.close();
+	}
+}
+
+/**
+ * @brief Try the GNSS module found on the last boot
+ *
+ * @return true if the module answered on the saved interface
+ */
+static bool probe_cached(void)
+{
+	gnss_probe_s probe;
+	File probe_file(InternalFS);
+	if (!probe_file.open(gnss_probe_name, FILE_O_READ))
+	{
+		return false;
+	}
+	bool read_ok = probe_file.read((void *)&probe, sizeof(gnss_probe_s)) == sizeof(gnss_probe_s);
+	probe_file.close();
+	if (!read_ok)
+	{
+		return false;
+	}
+
+	bool found = false;
+	if ((probe.option == RAK12500_GNSS) && probe.i2c)
+	{
+		xSemaphoreTake(g_i2c_sem, 2000);
+		found = my_gnss.begin();
+		xSemaphoreGive(g_i2c_sem);
+	}
+	else if (probe.option == RAK12500_GNSS)
+	{
+		Serial1.begin(probe.baud);
+		found = my_gnss.begin(Serial1);
+	}
+	else if (probe.option == RAK12501_GNSS)
+	{
+		Serial1.begin(9600);
+		found = sniff_serial(GNSS_RAK12501_BOOT_MS) == SNIFF_NMEA;
+	}
+
+	if (!found)
+	{
+		MYLOG("GNSS", "Saved GNSS interface did not answer");
+		if (!probe.i2c)
+		{
+			Serial1.end();
+		}
+		return false;
+	}
+
+	MYLOG("GNSS", "Saved GNSS interface answered");
+	gnss_option = probe.option;
+	i2c_gnss = probe.i2c;
+	gnss_uart_baud = probe.i2c ? 0 : (probe.option == RAK12500_GNSS ? probe.baud : 9600);
+	return true;
+}
+
+/**
+ * @brief Connect to a u-blox module on Serial1 and switch it to 38400 baud
+ *
+ * @param baud current baudrate of the module
+ * @return true if the module answered
+ */
+static bool begin_serial_ublox(uint32_t baud)
+{
+	if (baud != 38400)
+	{
+		Serial1.begin(baud);
+		if (!my_gnss.begin(Serial1))
+		{
+			return false;
+		}
+		MYLOG("GNSS", "GNSS: connected at %ld baud, switching to 38400", (long)baud);
+		my_gnss.setSerialRate(38400);
+		delay(100);
+	}
+	Serial1.begin(38400);
+	if (!my_gnss.begin(Serial1))
+	{
+		return false;
+	}
+	MYLOG("GNSS", "UBLOX found on Serial1 with 38400");
+	my_gnss.setUART1Output(COM_TYPE_UBX); // Set the UART port to output UBX only
+	gnss_option = RAK12500_GNSS;
+	i2c_gnss = false;
+	gnss_uart_baud = 38400;
+	return true;
+}
+
+/**
+ * @brief Detect the GNSS module
+ * 		Uses the saved result of the last boot if the module still answers there.
+ * 		Otherwise Serial1 buffers at 9600 baud while the I2C probe runs, the buffered
+ * 		traffic tells if a module is on Serial1. A silent module is polled at 38400 and 9600.
+ * 		Sets gnss_option, i2c_gnss and gnss_uart_baud.
+ *
+ * @return true if a module was identified, false if RAK12501 is only assumed
+ */
+bool gnss_probe(void)
+{
+	if (probe_cached())
+	{
+		return true;
+	}
+
+	// Listen at 9600 baud in the background while the I2C probe runs
+	Serial1.begin(9600);
+	while (Serial1.available())
+	{
+		Serial1.read();
+	}
+
+	xSemaphoreTake(g_i2c_sem, 2000);
+	bool found = my_gnss.begin();
+	xSemaphoreGive(g_i2c_sem);
+	if (found)
+	{
+		MYLOG("GNSS", "UBLOX found on I2C");
+		Serial1.end();
+		gnss_option = RAK12500_GNSS;
+		i2c_gnss = true;
+		gnss_uart_baud = 0;
+		save_probe();
+		return true;
+	}
+	MYLOG("GNSS", "UBLOX did not answer on I2C, check Serial1");
+
+	// Check what arrived during the I2C probe
+	uint8_t traffic = sniff_serial(GNSS_SNIFF_MS);
+	if (traffic != SNIFF_NONE)
+	{
+		// u-blox answers UBX polls even while sending NMEA, the RAK12501 does not
+		if (begin_serial_ublox(9600))
+		{
+			save_probe();
+			return true;
+		}
+		if (traffic == SNIFF_NMEA)
+		{
+			MYLOG("GNSS", "NMEA without UBX at 9600, RAK12501");
+			gnss_option = RAK12501_GNSS;
+			i2c_gnss = false;
+			gnss_uart_baud = 9600;
+			save_probe();
+			return true;
+		}
+	}
+
+	// A u-blox with UBX only output can be silent, try 38400 then 9600 with polls
+	if (begin_serial_ublox(38400) || begin_serial_ublox(9600))
+	{
+		save_probe();
+		return true;
+	}
+
+	// Nothing answered, assume RAK12501 but do not save the guess
+	gnss_option = RAK12501_GNSS;
+	i2c_gnss = false;
+	gnss_uart_baud = 9600;
+	Serial1.end();
+	return false;
+}
+
+/**
+ * @brief Wait until the RAK12501 sends its first NMEA sentence after power up
+ *
+ * @return true if the module is talking
+ */
+bool gnss_wait_rak12501(void)
+{
+	return sniff_serial(GNSS_RAK12501_BOOT_MS) == SNIFF_NMEA;
+}
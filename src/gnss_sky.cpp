@@ -0,0 +1,170 @@
+/**
+ * @file gnss_sky.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Early abort of the location acquisition if no sky is visible
+ *        Watches the satellite signal strengths during the first seconds
+ *        of an acquisition
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** First sample of the current acquisition */
+static gnss_sky_s first_sky;
+/** Last sample of the current acquisition */
+static gnss_sky_s last_sky;
+/** Best values seen during the current acquisition */
+static gnss_sky_s best_sky;
+/** Number of samples of the current acquisition */
+static uint8_t sky_samples = 0;
+/** Time of the last UBX-NAV-SAT poll */
+static time_t last_sky_poll = 0;
+/** Result of the sky check of the current acquisition */
+static uint8_t sky_result = GNSS_SKY_PENDING;
+
+/**
+ * @brief Reset the sky check at the start of an acquisition
+ *
+ */
+void gnss_sky_start(void)
+{
+	first_sky = gnss_sky_s();
+	last_sky = gnss_sky_s();
+	best_sky = gnss_sky_s();
+	sky_samples = 0;
+	last_sky_poll = 0;
+	sky_result = GNSS_SKY_PENDING;
+}
+
+/**
+ * @brief Read the satellite signal strengths from UBX-NAV-SAT
+ *
+ * @param sky pointer to the summary
+ * @return true if NAV-SAT was received
+ * @return false if the poll failed
+ */
+static bool read_ubx_sky(gnss_sky_s *sky)
+{
+	xSemaphoreTake(g_i2c_sem, 2000);
+	bool result = my_gnss.getNAVSAT();
+	if (result)
+	{
+		uint8_t num_svs = my_gnss.packetUBXNAVSAT->data.header.numSvs;
+		for (uint8_t idx = 0; (idx < num_svs) && (idx < UBX_NAV_SAT_MAX_BLOCKS); idx++)
+		{
+			uint8_t cno = my_gnss.packetUBXNAVSAT->data.blocks[idx].cno;
+			if (cno == 0)
+			{
+				continue;
+			}
+			sky->tracked++;
+			if (cno >= GNSS_SKY_USABLE_CNO)
+			{
+				sky->usable++;
+			}
+			if (cno > sky->max_cno)
+			{
+				sky->max_cno = cno;
+			}
+		}
+	}
+	xSemaphoreGive(g_i2c_sem);
+	return result;
+}
+
+/**
+ * @brief Add a sample and decide after the observation window
+ *
+ * @param sky new sample
+ * @param elapsed time since start of the acquisition in ms
+ */
+static void add_sample(gnss_sky_s *sky, time_t elapsed)
+{
+	if (sky_samples == 0)
+	{
+		first_sky = *sky;
+	}
+	last_sky = *sky;
+	sky_samples++;
+	if (sky->tracked > best_sky.tracked)
+	{
+		best_sky.tracked = sky->tracked;
+	}
+	if (sky->usable > best_sky.usable)
+	{
+		best_sky.usable = sky->usable;
+	}
+	if (sky->max_cno > best_sky.max_cno)
+	{
+		best_sky.max_cno = sky->max_cno;
+	}
+
+	MYLOG("GNSS", "Sky: tracked %d usable %d max C/N0 %d", sky->tracked, sky->usable, sky->max_cno);
+
+	if (best_sky.usable >= GNSS_SKY_MIN_USABLE)
+	{
+		// Enough satellites with good signal, a fix is likely
+		sky_result = GNSS_SKY_OK;
+		return;
+	}
+	if (elapsed < GNSS_SKY_WINDOW_MS)
+	{
+		return;
+	}
+
+	// Signals are still improving, give the acquisition a chance
+	bool improving = (last_sky.usable > first_sky.usable) || (last_sky.max_cno > first_sky.max_cno + GNSS_SKY_CNO_TREND);
+	if (!improving && (best_sky.max_cno < GNSS_SKY_STRONG_CNO))
+	{
+		MYLOG("GNSS", "No sky, best: tracked %d usable %d max C/N0 %d", best_sky.tracked, best_sky.usable, best_sky.max_cno);
+		sky_result = GNSS_SKY_NONE;
+	}
+	else
+	{
+		sky_result = GNSS_SKY_OK;
+	}
+}
+
+/**
+ * @brief Check the satellite signal strengths during the acquisition
+ * 		Polls UBX-NAV-SAT on the RAK12500, uses the GSV summary of the NMEA parser on the RAK12501
+ *
+ * @param elapsed time since start of the acquisition in ms
+ * @return uint8_t GNSS_SKY_PENDING, GNSS_SKY_OK or GNSS_SKY_NONE
+ */
+uint8_t gnss_sky_check(time_t elapsed)
+{
+	if (sky_result != GNSS_SKY_PENDING)
+	{
+		return sky_result;
+	}
+
+	gnss_sky_s sky;
+	if (gnss_option == RAK12500_GNSS)
+	{
+		if ((millis() - last_sky_poll) < GNSS_SKY_SAMPLE_MS)
+		{
+			return sky_result;
+		}
+		last_sky_poll = millis();
+		if (!read_ubx_sky(&sky))
+		{
+			return sky_result;
+		}
+	}
+	else
+	{
+		if (!g_nmea_sky.updated)
+		{
+			return sky_result;
+		}
+		g_nmea_sky.updated = false;
+		sky = g_nmea_sky;
+	}
+
+	add_sample(&sky, elapsed);
+	return sky_result;
+}
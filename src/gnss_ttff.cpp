@@ -0,0 +1,204 @@
+/**
+ * @file gnss_ttff.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief TTFF history and adaptive GNSS acquisition timeout
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Number of acquisitions kept in the history */
+#define TTFF_HISTORY_SIZE 16
+/** Minimum number of fixes before the timeout is learned from the history */
+#define TTFF_MIN_SAMPLES 4
+/** Percentile of the fix times used for the timeout */
+#define TTFF_PERCENTILE 90
+/** Margin added to the percentile in ms */
+#define TTFF_MARGIN 5000
+/** Minimum acquisition timeout in ms */
+#define TTFF_TIMEOUT_MIN 15000
+/** Max scale of the timeout after failed acquisitions in percent */
+#define TTFF_SCALE_MAX 400
+
+/** Upper limits of the histogram bins in seconds, last bin is everything above */
+static const uint8_t ttff_bins[TTFF_BIN_NUM - 1] = {5, 10, 15, 20, 30, 45, 60, 90};
+
+/** One acquisition in the history */
+struct ttff_entry_s
+{
+	uint16_t acq_time_ds = 0; // acquisition time in 1/10 seconds
+	uint8_t start_type = 0;	  // power mode before the acquisition
+	bool got_fix = false;
+};
+
+/** Ring buffer with the latest acquisitions */
+static ttff_entry_s ttff_history[TTFF_HISTORY_SIZE];
+/** Next write position in the history */
+static uint8_t ttff_head = 0;
+/** Number of valid entries in the history */
+static uint8_t ttff_count = 0;
+
+/** Scale of the learned timeout in percent, grows after failures, shrinks after quick fixes */
+static uint16_t ttff_scale = 100;
+
+/** Last calculated timeout in ms */
+uint32_t g_gnss_timeout = 0;
+
+/**
+ * @brief Add an acquisition result to the history
+ *
+ * @param got_fix true if a location was found
+ * @param acq_time acquisition time in ms
+ */
+void gnss_ttff_add(bool got_fix, uint32_t acq_time)
+{
+	uint32_t acq_time_ds = acq_time / 100;
+	ttff_history[ttff_head].acq_time_ds = acq_time_ds > 0xFFFF ? 0xFFFF : acq_time_ds;
+	ttff_history[ttff_head].start_type = g_gnss_pwr_last;
+	ttff_history[ttff_head].got_fix = got_fix;
+	ttff_head = (ttff_head + 1) % TTFF_HISTORY_SIZE;
+	if (ttff_count < TTFF_HISTORY_SIZE)
+	{
+		ttff_count++;
+	}
+
+	if (!got_fix)
+	{
+		// Give the next acquisition more time
+		ttff_scale = ttff_scale * 3 / 2;
+		if (ttff_scale > TTFF_SCALE_MAX)
+		{
+			ttff_scale = TTFF_SCALE_MAX;
+		}
+	}
+	else if ((g_gnss_timeout != 0) && (acq_time < g_gnss_timeout / 2))
+	{
+		// Quick fix, move back to the learned timeout
+		ttff_scale = ttff_scale * 3 / 4;
+		if (ttff_scale < 100)
+		{
+			ttff_scale = 100;
+		}
+	}
+}
+
+/**
+ * @brief Collect the fix times of the history
+ *
+ * @param start_type power mode to filter for, 0xFF for all
+ * @param times array for TTFF_HISTORY_SIZE fix times in 1/10 seconds
+ * @return uint8_t number of collected fix times
+ */
+static uint8_t collect_fix_times(uint8_t start_type, uint16_t *times)
+{
+	uint8_t num = 0;
+	for (uint8_t idx = 0; idx < ttff_count; idx++)
+	{
+		if (ttff_history[idx].got_fix && ((start_type == 0xFF) || (ttff_history[idx].start_type == start_type)))
+		{
+			times[num++] = ttff_history[idx].acq_time_ds;
+		}
+	}
+	return num;
+}
+
+/**
+ * @brief Calculate the acquisition timeout from the TTFF history
+ * 		Uses a high percentile of the recent fix times for the current start type plus a margin
+ *
+ * @param max_timeout upper limit of the timeout in ms
+ * @return uint32_t timeout in ms
+ */
+uint32_t gnss_acq_timeout(uint32_t max_timeout)
+{
+	uint16_t times[TTFF_HISTORY_SIZE];
+	uint8_t num = collect_fix_times(g_gnss_pwr_last, times);
+	if (num < TTFF_MIN_SAMPLES)
+	{
+		// Not enough fixes with this start type, use all start types
+		num = collect_fix_times(0xFF, times);
+	}
+	if (num < TTFF_MIN_SAMPLES)
+	{
+		// Not enough history, use the max timeout
+		g_gnss_timeout = max_timeout;
+		return g_gnss_timeout;
+	}
+
+	// Insertion sort, max TTFF_HISTORY_SIZE entries
+	for (uint8_t idx = 1; idx < num; idx++)
+	{
+		uint16_t value = times[idx];
+		int8_t pos = idx - 1;
+		while ((pos >= 0) && (times[pos] > value))
+		{
+			times[pos + 1] = times[pos];
+			pos--;
+		}
+		times[pos + 1] = value;
+	}
+
+	uint32_t percentile = (uint32_t)times[((num - 1) * TTFF_PERCENTILE) / 100] * 100;
+	uint32_t timeout = (percentile + TTFF_MARGIN) * ttff_scale / 100;
+	if (timeout < TTFF_TIMEOUT_MIN)
+	{
+		timeout = TTFF_TIMEOUT_MIN;
+	}
+	if (timeout > max_timeout)
+	{
+		timeout = max_timeout;
+	}
+	g_gnss_timeout = timeout;
+	return g_gnss_timeout;
+}
+
+/**
+ * @brief Get the histogram of the TTFF history
+ *
+ * @param fix_bins array for TTFF_BIN_NUM counters of acquisitions with fix
+ * @param nofix_bins array for TTFF_BIN_NUM counters of acquisitions without fix
+ * @param start_type power mode to filter for, 0xFF for all
+ */
+void gnss_ttff_histogram(uint8_t *fix_bins, uint8_t *nofix_bins, uint8_t start_type)
+{
+	memset(fix_bins, 0, TTFF_BIN_NUM);
+	memset(nofix_bins, 0, TTFF_BIN_NUM);
+	for (uint8_t idx = 0; idx < ttff_count; idx++)
+	{
+		if ((start_type != 0xFF) && (ttff_history[idx].start_type != start_type))
+		{
+			continue;
+		}
+		uint8_t bin = 0;
+		while ((bin < TTFF_BIN_NUM - 1) && (ttff_history[idx].acq_time_ds > ttff_bins[bin] * 10))
+		{
+			bin++;
+		}
+		if (ttff_history[idx].got_fix)
+		{
+			fix_bins[bin]++;
+		}
+		else
+		{
+			nofix_bins[bin]++;
+		}
+	}
+}
+
+/**
+ * @brief Get the upper limit of a histogram bin
+ *
+ * @param bin bin number
+ * @return uint8_t upper limit in seconds, 0 for the last bin
+ */
+uint8_t gnss_ttff_bin_limit(uint8_t bin)
+{
+	if (bin >= TTFF_BIN_NUM - 1)
+	{
+		return 0;
+	}
+	return ttff_bins[bin];
+}
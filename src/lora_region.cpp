@@ -0,0 +1,97 @@
+/**
+ * @file lora_region.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Max payload and time on air per LoRaWAN region and data rate
+ *        Region codes as in g_lorawan_settings.lora_region
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "lora_region.h"
+
+/** Max payload size per data rate for each region, 0 = data rate not usable */
+static const uint8_t max_payload_eu[8] = {51, 51, 51, 115, 242, 242, 242, 242};
+static const uint8_t max_payload_us[5] = {11, 53, 125, 242, 242};
+static const uint8_t max_payload_au[7] = {51, 51, 51, 115, 242, 242, 242};
+static const uint8_t max_payload_as[8] = {0, 0, 11, 53, 125, 242, 242, 242}; // with dwell time limit
+
+/**
+ * @brief Max application payload of a region and data rate
+ *
+ * @param region region code, 0 AS923, 1 AU915, 4 EU433, 5 EU868, 8 US915, 9..11 AS923-2..4, others like EU868
+ * @param data_rate data rate
+ * @return uint8_t max size in bytes, 0 if the data rate is not usable
+ */
+uint8_t lora_region_max_payload(uint8_t region, uint8_t data_rate)
+{
+	switch (region)
+	{
+	case 0:	 // AS923
+	case 9:	 // AS923-2
+	case 10: // AS923-3
+	case 11: // AS923-4
+		return data_rate < 8 ? max_payload_as[data_rate] : 0;
+	case 1: // AU915
+		return data_rate < 7 ? max_payload_au[data_rate] : 0;
+	case 8: // US915
+		return data_rate < 5 ? max_payload_us[data_rate] : 0;
+	case 4: // EU433, same data rates as EU868
+	case 5: // EU868
+	default:
+		return data_rate < 8 ? max_payload_eu[data_rate] : 0;
+	}
+}
+
+/**
+ * @brief Time on air of a LoRaWAN uplink of a region and data rate
+ *
+ * @param region region code, see lora_region_max_payload()
+ * @param data_rate data rate
+ * @param size application payload size in bytes
+ * @return uint32_t time on air in ms
+ */
+uint32_t lora_region_airtime_ms(uint8_t region, uint8_t data_rate, uint8_t size)
+{
+	uint16_t length = size + LORA_FRAME_OVERHEAD;
+	switch (region)
+	{
+	case 8: // US915
+		return lora_symbol_airtime_ms(data_rate < 4 ? 10 - data_rate : 8, data_rate < 4 ? 125 : 500, length);
+	case 1: // AU915
+		return lora_symbol_airtime_ms(data_rate < 6 ? 12 - data_rate : 8, data_rate < 6 ? 125 : 500, length);
+	default:
+		if (data_rate == 7)
+		{
+			// FSK 50kbps, preamble, sync word, length and CRC
+			return ((length + 11) * 8) / 50 + 1;
+		}
+		return lora_symbol_airtime_ms(data_rate < 6 ? 12 - data_rate : 7, data_rate < 6 ? 125 : 250, length);
+	}
+}
+
+/**
+ * @brief Time on air of a LoRa packet
+ * 		Explicit header, CRC on, coding rate 4/5, 8 symbols preamble
+ *
+ * @param sf spreading factor 5..12, others are handled as SF7
+ * @param bw bandwidth in kHz, 125, 250 or 500
+ * @param length PHY payload size in bytes
+ * @return uint32_t time on air in ms, rounded up
+ */
+uint32_t lora_symbol_airtime_ms(uint8_t sf, uint16_t bw, uint16_t length)
+{
+	if ((sf < 5) || (sf > 12))
+	{
+		sf = 7;
+	}
+	uint32_t symbol_us = (1000UL << sf) / bw;
+	bool low_dr = (sf >= 11) && (bw == 125);
+	int32_t bits = 8 * length - 4 * sf + 28 + 16;
+	int32_t bits_per_block = 4 * (sf - (low_dr ? 2 : 0));
+	int32_t blocks = bits > 0 ? (bits + bits_per_block - 1) / bits_per_block : 0;
+	// Preamble 8 + 4.25 symbols, payload symbols in quarter symbols
+	uint32_t quarter_symbols = 49 + 4 * (8 + blocks * 5);
+	return (quarter_symbols * symbol_us / 4 + 999) / 1000;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file lora_region.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Max payload and time on air per LoRaWAN region and data rate
+ *        No Arduino dependencies, the same code is used by the host tests
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef LORA_REGION_H
+#define LORA_REGION_H
+
+#include <stdint.h>
+
+/** LoRaWAN overhead of an uplink, MAC header, frame header, fPort and MIC */
+#define LORA_FRAME_OVERHEAD 13
+
+uint8_t lora_region_max_payload(uint8_t region, uint8_t data_rate);
+uint32_t lora_region_airtime_ms(uint8_t region, uint8_t data_rate, uint8_t size);
+uint32_t lora_symbol_airtime_ms(uint8_t sf, uint16_t bw, uint16_t length);
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * @file motion.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Motion state classifier on the LIS3DH data
+ *        Short windows of the acceleration magnitude are classified by motion_classify(), see motion_class.cpp.
+ *        The samples of a window are collected by the LIS3DH FIFO and read in one go.
+ *        The state selects the send interval and the GNSS profile.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Time until the FIFO has the samples of a window, with some margin */
+#define MOTION_WINDOW_MS (MOTION_WINDOW * MOTION_SAMPLE_MS + 200)
+/** Number of windows with the same result before the state changes */
+#define MOTION_CONFIRM 2
+
+/** Flag if the classifier selects the send interval and GNSS profile */
+bool g_motion_enable = false;
+
+/** Current motion state */
+uint8_t g_motion_state = MOTION_STATIONARY;
+
+/** Send interval in s and GNSS profile per motion state */
+motion_cfg_s g_motion_cfg[MOTION_STATE_NUM] = {
+	{21600, 0}, // stationary, 6 hours
+	{120, 0},	// walking
+	{30, 1},	// vehicle
+	{300, 0},	// transport vibration
+};
+
+/** Classifier statistics */
+motion_stats_s g_motion_stats;
+
+/** Names of the states */
+static const char *motion_names[MOTION_STATE_NUM] = {"stationary", "walking", "vehicle", "vibration"};
+
+/** Magnitude of the samples of the window in mg */
+static uint16_t window[MOTION_WINDOW];
+/** Number of samples in the window */
+static uint8_t window_num = 0;
+/** Flag if a window is sampled */
+static bool sampling = false;
+/** State of the last window and number of windows with this state */
+static uint8_t candidate = MOTION_STATIONARY;
+static uint8_t candidate_num = 0;
+
+/** Timer for the end of a window */
+static SoftwareTimer sample_timer;
+/** Flag if the timer was initialized */
+static bool timer_init = false;
+
+/**
+ * @brief Timer callback, wake up the loop to read the samples of the window
+ *
+ */
+static void sample_wakeup(TimerHandle_t unused)
+{
+	api_wake_loop(MOTION_SAMPLE);
+}
+
+/**
+ * @brief Get the name of a motion state
+ *
+ */
+const char *motion_name(uint8_t state)
+{
+	return state < MOTION_STATE_NUM ? motion_names[state] : "";
+}
+
+/**
+ * @brief Start sampling a window if the classifier is enabled and no window is sampled
+ *
+ */
+void motion_start(void)
+{
+	if (!g_motion_enable || !acc_ok || sampling)
+	{
+		return;
+	}
+	if (!timer_init)
+	{
+		sample_timer.begin(MOTION_WINDOW_MS, sample_wakeup, NULL, false);
+		timer_init = true;
+	}
+	// Older samples do not belong to the window
+	if (xSemaphoreTake(g_i2c_sem, 10) == pdTRUE)
+	{
+		acc_fifo_read();
+		xSemaphoreGive(g_i2c_sem);
+	}
+	acc_ring_clear();
+	window_num = 0;
+	sampling = true;
+	sample_timer.setPeriod(MOTION_WINDOW_MS);
+	sample_timer.start();
+}
+
+/**
+ * @brief Read the samples of the window from the FIFO and classify the window
+ * 		A new state is accepted after MOTION_CONFIRM windows with the same result,
+ * 		windows are sampled back to back until the state is confirmed.
+ *
+ * @return true if the motion state changed
+ */
+bool motion_sample(void)
+{
+	if (!sampling)
+	{
+		return false;
+	}
+	if (xSemaphoreTake(g_i2c_sem, 10) == pdTRUE)
+	{
+		acc_fifo_read();
+		xSemaphoreGive(g_i2c_sem);
+	}
+	acc_sample_s sample;
+	while ((window_num < MOTION_WINDOW) && acc_ring_take(&sample))
+	{
+		window[window_num++] = motion_magnitude(sample.x, sample.y, sample.z);
+	}
+	if (window_num < MOTION_WINDOW)
+	{
+		// I2C was busy or samples are missing, wait for the rest
+		sample_timer.setPeriod((MOTION_WINDOW - window_num) * MOTION_SAMPLE_MS + 200);
+		sample_timer.start();
+		return false;
+	}
+
+	uint8_t state = motion_classify(window, &g_motion_stats.std_mg, &g_motion_stats.jerk_mg);
+	g_motion_stats.windows++;
+	MYLOG("MOT", "Std %d Jerk %d", g_motion_stats.std_mg, g_motion_stats.jerk_mg);
+	window_num = 0;
+	if (state == candidate)
+	{
+		candidate_num++;
+	}
+	else
+	{
+		candidate = state;
+		candidate_num = 1;
+	}
+	if ((state == g_motion_state) || (candidate_num >= MOTION_CONFIRM))
+	{
+		sampling = false;
+	}
+	else
+	{
+		// Next window right away
+		sample_timer.setPeriod(MOTION_WINDOW_MS);
+		sample_timer.start();
+	}
+	if ((state == g_motion_state) || (candidate_num < MOTION_CONFIRM))
+	{
+		return false;
+	}
+
+	MYLOG("MOT", "Motion state %s", motion_name(state));
+	g_motion_state = state;
+	g_motion_stats.changes++;
+	gnss_profile_use(g_motion_cfg[state].profile);
+	return true;
+}
+
+/**
+ * @brief Send interval of the current motion state
+ *
+ * @return uint32_t interval in ms, 0 if the classifier is disabled
+ */
+uint32_t motion_interval(void)
+{
+	if (!g_motion_enable || !acc_ok)
+	{
+		return 0;
+	}
+	return g_motion_cfg[g_motion_state].interval * 1000UL;
+}
+
+/**
+ * @brief Enable or disable the classifier
+ * 		When disabled, the saved GNSS profile is used again
+ *
+ * @param enable true to enable
+ */
+void motion_set(bool enable)
+{
+	g_motion_enable = enable;
+	if (enable)
+	{
+		gnss_profile_use(g_motion_cfg[g_motion_state].profile);
+		motion_start();
+		return;
+	}
+	if (timer_init)
+	{
+		sample_timer.stop();
+	}
+	sampling = false;
+	uint8_t used = g_gnss_profile;
+	gnss_profile_load();
+	if (used != g_gnss_profile)
+	{
+		g_gnss_profile_changed = true;
+	}
+}
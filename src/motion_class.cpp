@@ -0,0 +1,73 @@
+/**
+ * @file motion_class.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Motion state classifier on windows of the acceleration magnitude
+ *        The windows are classified by variance and energy of the changes, integer math only.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdlib.h>
+
+#include "geo_dist.h"
+#include "motion_class.h"
+
+/**
+ * @brief Magnitude of an acceleration sample
+ *
+ * @param x x axis in mg
+ * @param y y axis in mg
+ * @param z z axis in mg
+ * @return uint16_t magnitude in mg
+ */
+uint16_t motion_magnitude(int16_t x, int16_t y, int16_t z)
+{
+	return (uint16_t)geo_isqrt((uint64_t)((int32_t)x * x + (int32_t)y * y + (int32_t)z * z));
+}
+
+/**
+ * @brief Classify a full window
+ * 		stationary: standard deviation of the magnitude below MOTION_STILL_MG
+ * 		walking: standard deviation above MOTION_WALK_MG, steps are strong and slow
+ * 		vehicle or transport vibration: in between, vibration has more energy in the changes between samples
+ * 		than in the deviation (high frequency), driving has slow changes (low frequency)
+ *
+ * @param window MOTION_WINDOW magnitudes in mg
+ * @param std_mg returns the standard deviation of the magnitude in mg
+ * @param jerk_mg returns the mean change between samples in mg
+ * @return uint8_t motion state
+ */
+uint8_t motion_classify(const uint16_t *window, uint16_t *std_mg, uint16_t *jerk_mg)
+{
+	uint32_t sum = 0;
+	for (uint8_t idx = 0; idx < MOTION_WINDOW; idx++)
+	{
+		sum += window[idx];
+	}
+	uint32_t mean = sum / MOTION_WINDOW;
+	uint32_t var_sum = 0;
+	uint32_t jerk_sum = 0;
+	for (uint8_t idx = 0; idx < MOTION_WINDOW; idx++)
+	{
+		int32_t diff = (int32_t)window[idx] - (int32_t)mean;
+		var_sum += diff * diff;
+		if (idx != 0)
+		{
+			jerk_sum += abs((int32_t)window[idx] - (int32_t)window[idx - 1]);
+		}
+	}
+	*std_mg = (uint16_t)geo_isqrt(var_sum / MOTION_WINDOW);
+	*jerk_mg = jerk_sum / (MOTION_WINDOW - 1);
+
+	if (*std_mg < MOTION_STILL_MG)
+	{
+		return MOTION_STATIONARY;
+	}
+	if (*std_mg >= MOTION_WALK_MG)
+	{
+		return MOTION_WALKING;
+	}
+	return *jerk_mg > *std_mg ? MOTION_VIBRATION : MOTION_VEHICLE;
+}
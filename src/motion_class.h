@@ -0,0 +1,36 @@
+/**
+ * @file motion_class.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Motion state classifier on windows of the acceleration magnitude
+ *        No Arduino dependencies, the same code is used by the host tests
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef MOTION_CLASS_H
+#define MOTION_CLASS_H
+
+#include <stdint.h>
+
+/** Motion states */
+#define MOTION_STATIONARY 0
+#define MOTION_WALKING 1
+#define MOTION_VEHICLE 2
+#define MOTION_VIBRATION 3
+#define MOTION_STATE_NUM 4
+
+/** Samples per window, the FIFO holds 32 samples */
+#define MOTION_WINDOW 32
+/** Time between samples in ms, matches the 10 Hz data rate of the LIS3DH */
+#define MOTION_SAMPLE_MS 100
+/** Standard deviation of the magnitude below which the device is stationary in mg, 8 bit low power mode has 16 mg steps */
+#define MOTION_STILL_MG 20
+/** Standard deviation of the magnitude above which the device is carried by a walking person in mg */
+#define MOTION_WALK_MG 120
+
+uint16_t motion_magnitude(int16_t x, int16_t y, int16_t z);
+uint8_t motion_classify(const uint16_t *window, uint16_t *std_mg, uint16_t *jerk_mg);
+
+#endif
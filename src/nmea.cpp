@@ -0,0 +1,526 @@
+/**
+ * @file nmea.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Streaming NMEA parser for the RAK12501
+ *        Decodes only GGA, RMC, GSA and GSV sentences directly into the
+ *        fixed point values used for the payload, no float or double math
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <string.h>
+
+#include "nmea.h"
+
+/** Parser states */
+#define NMEA_IDLE 0
+#define NMEA_BODY 1
+#define NMEA_CHECKSUM_1 2
+#define NMEA_CHECKSUM_2 3
+
+/** Sentence types */
+#define NMEA_UNKNOWN 0
+#define NMEA_GGA 1
+#define NMEA_RMC 2
+#define NMEA_GSA 3
+#define NMEA_GSV 4
+
+/** Max length of a single term */
+#define NMEA_TERM_SIZE 16
+
+/** Decoded values, updated after each sentence with a valid checksum */
+nmea_fix_s g_nmea_fix;
+
+/** Signal strength summary of the satellites in view, updated once per epoch */
+gnss_sky_s g_nmea_sky;
+
+/** Signal strength summary collected from the GSV sentences of the current epoch */
+static gnss_sky_s epoch_sky;
+
+/** Current parser state */
+static uint8_t parser_state = NMEA_IDLE;
+/** Calculated checksum of the current sentence */
+static uint8_t calc_checksum = 0;
+/** Received checksum of the current sentence */
+static uint8_t recv_checksum = 0;
+/** Type of the current sentence */
+static uint8_t sentence_type = NMEA_UNKNOWN;
+/** Index of the current term */
+static uint8_t term_idx = 0;
+/** Buffer for the current term */
+static char term_buff[NMEA_TERM_SIZE];
+/** Length of the current term */
+static uint8_t term_len = 0;
+
+/** Staged values of the current sentence, committed only if the checksum is valid */
+static int32_t staged_lat = 0;
+static int32_t staged_lon = 0;
+static int32_t staged_alt = 0;
+static uint16_t staged_hdop = 0;
+static uint8_t staged_sats = 0;
+static uint8_t staged_fix_type = 0;
+static bool staged_valid = false;
+static bool staged_has_pos = false;
+static bool staged_has_alt = false;
+static bool staged_has_hdop = false;
+static gnss_sky_s staged_sky;
+static int32_t staged_sec_of_day = -1;
+static int32_t staged_date = -1;
+
+/**
+ * @brief Days since 1970-01-01 for a date
+ *
+ */
+static int32_t days_from_civil(int32_t year, uint32_t month, uint32_t day)
+{
+	year -= month <= 2;
+	int32_t era = (year >= 0 ? year : year - 399) / 400;
+	uint32_t yoe = (uint32_t)(year - era * 400);
+	uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int32_t)doe - 719468;
+}
+
+/**
+ * @brief Convert a UTC date and time into Unix time
+ *
+ * @return uint32_t seconds since 1970-01-01
+ */
+uint32_t gnss_unix_time(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second)
+{
+	return (uint32_t)days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+/**
+ * @brief Convert a hex character
+ *
+ * @param hex_char character '0'..'9', 'A'..'F'
+ * @return int8_t value or -1 if not a hex character
+ */
+static int8_t hex_value(char hex_char)
+{
+	if ((hex_char >= '0') && (hex_char <= '9'))
+	{
+		return hex_char - '0';
+	}
+	if ((hex_char >= 'A') && (hex_char <= 'F'))
+	{
+		return hex_char - 'A' + 10;
+	}
+	if ((hex_char >= 'a') && (hex_char <= 'f'))
+	{
+		return hex_char - 'a' + 10;
+	}
+	return -1;
+}
+
+/**
+ * @brief Parse a decimal number into a fixed point integer
+ *
+ * @param term string with the number, e.g. "-12.345"
+ * @param decimals number of decimals of the result, e.g. 3 returns -12345
+ * @param value pointer to the result
+ * @return true if the term contained a number
+ * @return false if the term was empty, invalid or too large
+ */
+static bool parse_fixed(const char *term, uint8_t decimals, int32_t *value)
+{
+	bool negative = false;
+	bool has_digits = false;
+	bool in_fraction = false;
+	int32_t result = 0;
+	uint8_t frac_digits = 0;
+
+	if (*term == '-')
+	{
+		negative = true;
+		term++;
+	}
+	for (; *term != 0; term++)
+	{
+		if (*term == '.')
+		{
+			in_fraction = true;
+		}
+		else if ((*term >= '0') && (*term <= '9'))
+		{
+			has_digits = true;
+			if (in_fraction)
+			{
+				if (frac_digits == decimals)
+				{
+					// Ignore additional decimals
+					continue;
+				}
+				frac_digits++;
+			}
+			if (result > 214748363)
+			{
+				// More digits than an int32_t can hold
+				return false;
+			}
+			result = result * 10 + (*term - '0');
+		}
+		else
+		{
+			return false;
+		}
+	}
+	// Pad missing decimals
+	for (; frac_digits < decimals; frac_digits++)
+	{
+		if (result > 214748363)
+		{
+			return false;
+		}
+		result *= 10;
+	}
+	*value = negative ? -result : result;
+	return has_digits;
+}
+
+/**
+ * @brief Parse a NMEA coordinate (d)ddmm.mmmmm into 1e-7 degrees
+ *
+ * @param term string with the coordinate
+ * @param value pointer to the result
+ * @return true if the term contained a coordinate
+ * @return false if the term was empty or invalid
+ */
+static bool parse_coord(const char *term, int32_t *value)
+{
+	// Minutes with 5 decimals, e.g. 12130.12345 => 1213012345
+	int32_t raw;
+	if (!parse_fixed(term, 5, &raw) || (raw < 0))
+	{
+		return false;
+	}
+	int32_t degrees = raw / 10000000;
+	int32_t minutes_e5 = raw % 10000000;
+	// 1e-7 degrees = minutes_e5 * 1e7 / (60 * 1e5) = minutes_e5 * 100 / 60, rounded
+	*value = degrees * 10000000 + (minutes_e5 * 5 + 1) / 3;
+	return true;
+}
+
+/**
+ * @brief Process a complete term of the current sentence
+ *
+ */
+static void term_complete(void)
+{
+	term_buff[term_len] = 0;
+
+	if (term_idx == 0)
+	{
+		// Sentence type, ignore the talker ID (GP, GN, BD, ...)
+		sentence_type = NMEA_UNKNOWN;
+		if (term_len == 5)
+		{
+			const char *type = &term_buff[2];
+			if (strcmp(type, "GGA") == 0)
+			{
+				sentence_type = NMEA_GGA;
+			}
+			else if (strcmp(type, "RMC") == 0)
+			{
+				sentence_type = NMEA_RMC;
+			}
+			else if (strcmp(type, "GSA") == 0)
+			{
+				sentence_type = NMEA_GSA;
+			}
+			else if (strcmp(type, "GSV") == 0)
+			{
+				sentence_type = NMEA_GSV;
+			}
+		}
+		staged_sats = 0;
+		staged_fix_type = 0;
+		staged_valid = false;
+		staged_has_pos = false;
+		staged_has_alt = false;
+		staged_has_hdop = false;
+		staged_sky = gnss_sky_s();
+		staged_sec_of_day = -1;
+		staged_date = -1;
+		return;
+	}
+
+	int32_t value;
+	switch (sentence_type)
+	{
+	case NMEA_GGA:
+		switch (term_idx)
+		{
+		case 2: // Latitude
+			staged_has_pos = parse_coord(term_buff, &staged_lat);
+			break;
+		case 3: // N/S
+			if (term_buff[0] == 'S')
+			{
+				staged_lat = -staged_lat;
+			}
+			break;
+		case 4: // Longitude
+			staged_has_pos = staged_has_pos && parse_coord(term_buff, &staged_lon);
+			break;
+		case 5: // E/W
+			if (term_buff[0] == 'W')
+			{
+				staged_lon = -staged_lon;
+			}
+			break;
+		case 6: // Fix quality
+			staged_valid = (term_len != 0) && (term_buff[0] != '0');
+			break;
+		case 7: // Satellites in use
+			if (parse_fixed(term_buff, 0, &value))
+			{
+				staged_sats = (uint8_t)value;
+			}
+			break;
+		case 8: // HDOP
+			if (parse_fixed(term_buff, 2, &value))
+			{
+				staged_hdop = (uint16_t)value;
+				staged_has_hdop = true;
+			}
+			break;
+		case 9: // Altitude above mean sea level
+			staged_has_alt = parse_fixed(term_buff, 3, &staged_alt);
+			break;
+		}
+		break;
+	case NMEA_RMC:
+		switch (term_idx)
+		{
+		case 1: // UTC time hhmmss.ss
+			if (parse_fixed(term_buff, 0, &value) && (term_len >= 6))
+			{
+				staged_sec_of_day = (value / 10000) * 3600 + ((value / 100) % 100) * 60 + value % 100;
+			}
+			break;
+		case 9: // UTC date ddmmyy
+			if ((term_len == 6) && parse_fixed(term_buff, 0, &value))
+			{
+				staged_date = value;
+			}
+			break;
+		case 2: // Status
+			staged_valid = term_buff[0] == 'A';
+			break;
+		case 3: // Latitude
+			staged_has_pos = parse_coord(term_buff, &staged_lat);
+			break;
+		case 4: // N/S
+			if (term_buff[0] == 'S')
+			{
+				staged_lat = -staged_lat;
+			}
+			break;
+		case 5: // Longitude
+			staged_has_pos = staged_has_pos && parse_coord(term_buff, &staged_lon);
+			break;
+		case 6: // E/W
+			if (term_buff[0] == 'W')
+			{
+				staged_lon = -staged_lon;
+			}
+			break;
+		}
+		break;
+	case NMEA_GSA:
+		switch (term_idx)
+		{
+		case 2: // Fix type 1 = no fix, 2 = 2D, 3 = 3D
+			if (parse_fixed(term_buff, 0, &value))
+			{
+				staged_fix_type = (uint8_t)value;
+			}
+			break;
+		case 16: // HDOP
+			if (parse_fixed(term_buff, 2, &value))
+			{
+				staged_hdop = (uint16_t)value;
+				staged_has_hdop = true;
+			}
+			break;
+		}
+		break;
+	case NMEA_GSV:
+		// Up to 4 satellites per sentence, each with PRN, elevation, azimuth and SNR
+		if ((term_idx >= 7) && (((term_idx - 4) % 4) == 3) && parse_fixed(term_buff, 0, &value) && (value > 0))
+		{
+			staged_sky.tracked++;
+			if (value >= GNSS_SKY_USABLE_CNO)
+			{
+				staged_sky.usable++;
+			}
+			if (value > staged_sky.max_cno)
+			{
+				staged_sky.max_cno = (uint8_t)value;
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Commit the staged values of a sentence with a valid checksum
+ *
+ */
+static void sentence_complete(void)
+{
+	switch (sentence_type)
+	{
+	case NMEA_GGA:
+		// GGA starts a new epoch, publish the signal strengths of the last epoch
+		g_nmea_sky = epoch_sky;
+		g_nmea_sky.updated = true;
+		epoch_sky = gnss_sky_s();
+		g_nmea_fix.sat_num = staged_sats;
+		if (staged_has_hdop)
+		{
+			g_nmea_fix.hdop = staged_hdop;
+			g_nmea_fix.hdop_updated = true;
+		}
+		if (staged_valid && staged_has_alt)
+		{
+			g_nmea_fix.altitude = staged_alt;
+			g_nmea_fix.alt_updated = true;
+		}
+		break;
+	case NMEA_RMC:
+		if (staged_valid && staged_has_pos)
+		{
+			g_nmea_fix.latitude = staged_lat;
+			g_nmea_fix.longitude = staged_lon;
+			g_nmea_fix.pos_updated = true;
+		}
+		if (staged_valid && (staged_sec_of_day >= 0) && (staged_date >= 0))
+		{
+			g_nmea_fix.utc = gnss_unix_time(2000 + staged_date % 100, (staged_date / 100) % 100, staged_date / 10000, 0, 0, 0) + staged_sec_of_day;
+		}
+		break;
+	case NMEA_GSA:
+		g_nmea_fix.fix_type = staged_fix_type;
+		if (staged_has_hdop)
+		{
+			g_nmea_fix.hdop = staged_hdop;
+			g_nmea_fix.hdop_updated = true;
+		}
+		break;
+	case NMEA_GSV:
+		epoch_sky.tracked += staged_sky.tracked;
+		epoch_sky.usable += staged_sky.usable;
+		if (staged_sky.max_cno > epoch_sky.max_cno)
+		{
+			epoch_sky.max_cno = staged_sky.max_cno;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Reset the parser and the decoded values
+ *
+ */
+void nmea_reset(void)
+{
+	parser_state = NMEA_IDLE;
+	g_nmea_fix = nmea_fix_s();
+	g_nmea_sky = gnss_sky_s();
+	epoch_sky = gnss_sky_s();
+}
+
+/**
+ * @brief Feed one received character into the NMEA parser
+ *
+ * @param rx_char received character
+ * @return true if a GGA, RMC, GSA or GSV sentence with valid checksum was completed
+ * @return false if no sentence was completed
+ */
+bool nmea_parse(char rx_char)
+{
+	if (rx_char == '$')
+	{
+		// Start of a new sentence, resynchronizes after garbage
+		parser_state = NMEA_BODY;
+		calc_checksum = 0;
+		term_idx = 0;
+		term_len = 0;
+		sentence_type = NMEA_UNKNOWN;
+		return false;
+	}
+
+	switch (parser_state)
+	{
+	case NMEA_BODY:
+		if (rx_char == '*')
+		{
+			term_complete();
+			parser_state = NMEA_CHECKSUM_1;
+			return false;
+		}
+		if ((rx_char == '\r') || (rx_char == '\n'))
+		{
+			// Sentence without checksum is not accepted
+			parser_state = NMEA_IDLE;
+			return false;
+		}
+		calc_checksum ^= (uint8_t)rx_char;
+		if (rx_char == ',')
+		{
+			term_complete();
+			term_idx++;
+			term_len = 0;
+			// Skip all terms of sentences that are not used
+			if ((term_idx == 1) && (sentence_type == NMEA_UNKNOWN))
+			{
+				parser_state = NMEA_IDLE;
+			}
+			return false;
+		}
+		if (term_len < (NMEA_TERM_SIZE - 1))
+		{
+			term_buff[term_len++] = rx_char;
+		}
+		return false;
+	case NMEA_CHECKSUM_1:
+	{
+		int8_t nibble = hex_value(rx_char);
+		if (nibble < 0)
+		{
+			parser_state = NMEA_IDLE;
+			return false;
+		}
+		recv_checksum = nibble << 4;
+		parser_state = NMEA_CHECKSUM_2;
+		return false;
+	}
+	case NMEA_CHECKSUM_2:
+	{
+		int8_t nibble = hex_value(rx_char);
+		parser_state = NMEA_IDLE;
+		if (nibble < 0)
+		{
+			return false;
+		}
+		recv_checksum |= nibble;
+		if ((recv_checksum != calc_checksum) || (sentence_type == NMEA_UNKNOWN))
+		{
+			return false;
+		}
+		sentence_complete();
+		return true;
+	}
+	default:
+		return false;
+	}
+}
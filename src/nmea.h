@@ -0,0 +1,47 @@
+/**
+ * @file nmea.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Streaming NMEA parser for the RAK12501
+ *        No Arduino dependencies, the same code is used by the host benchmark
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef NMEA_H
+#define NMEA_H
+
+#include <stdint.h>
+
+/** Signal strength summary of the satellites in view */
+struct gnss_sky_s
+{
+	uint8_t tracked = 0; // Satellites with a C/N0 value
+	uint8_t usable = 0;	 // Satellites with C/N0 >= GNSS_SKY_USABLE_CNO
+	uint8_t max_cno = 0; // Highest C/N0 in dB-Hz
+	bool updated = false;
+};
+/** C/N0 in dB-Hz for a satellite that can be used for a fix */
+#define GNSS_SKY_USABLE_CNO 22
+/** Values decoded by the NMEA parser */
+struct nmea_fix_s
+{
+	int32_t latitude = 0;  // 1e-7 degrees
+	int32_t longitude = 0; // 1e-7 degrees
+	int32_t altitude = 0;  // mm above mean sea level
+	uint16_t hdop = 0;	   // HDOP * 100
+	uint8_t sat_num = 0;
+	uint8_t fix_type = 0; // 1 = no fix, 2 = 2D, 3 = 3D
+	uint32_t utc = 0;	  // UTC of the last valid RMC as Unix time, 0 if unknown
+	bool pos_updated = false;
+	bool alt_updated = false;
+	bool hdop_updated = false;
+};
+bool nmea_parse(char rx_char);
+void nmea_reset(void);
+extern nmea_fix_s g_nmea_fix;
+extern gnss_sky_s g_nmea_sky;
+uint32_t gnss_unix_time(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+
+#endif
@@ -44,7 +44,7 @@ void oled_off_cb(TimerHandle_t unused);
 bool g_display_saver = false;
 
 /** UI entries for top level */
-char *ui_top[] = {(char *)"BACK", (char *)"LoRaWAN/LoRa", (char *)"Packet Mode", (char *)"Location Precision", (char *)"Display"};
+char *ui_top[] = {(char *)"BACK", (char *)"LoRaWAN/LoRa", (char *)"Packet Mode", (char *)"Location Precision", (char *)"Display", (char *)"GNSS Profile"};
 /** UI entries for LoRa selection */
 char *ui_lora[] = {(char *)"BACK", (char *)"LoRaWAN", (char *)"LoRa P2P"};
 /** UI entries for packet mode */
@@ -53,7 +53,9 @@ char *ui_mode[] = {(char *)"BACK", (char *)"CayenneLPP 4 digit", (char *)"Cayenn
 char *ui_prec[] = {(char *)"BACK", (char *)"any fix", (char *)"6 Sat, ACCU < 2.5"};
 /** UI entries for display power saver */
 char *ui_disp[] = {(char *)"BACK", (char *)"Display saver on", (char *)"Display saver off"};
-/** UI screen selected 0 = top, 1 = LoRa, 2 = Mode, 3 = ACCU, 4 = Display saver */
+/** UI entries for GNSS profile */
+char *ui_gprof[] = {(char *)"BACK", (char *)"Low power 1Hz", (char *)"Fast TTFF 2Hz", (char *)"High accuracy 1Hz"};
+/** UI screen selected 0 = top, 1 = LoRa, 2 = Mode, 3 = ACCU, 4 = Display saver, 5 = GNSS profile */
 uint8_t ui_screen = 0;
 
 /**
@@ -337,6 +339,9 @@ void oled_show_ui(uint8_t sett_scr, uint8_t highlighted, uint8_t entries)
 	case 4:
 		use_menu = ui_disp;
 		break;
+	case 5:
+		use_menu = ui_gprof;
+		break;
 	}
 
 	oled_clear();
@@ -0,0 +1,114 @@
+/**
+ * @file payload.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Payload assembly for the max payload of the current data rate
+ *        Max payload and time on air for the current region and data rate.
+ *        The LPP and packed formats are arranged by payload_lpp.cpp.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+#include "lora_region.h"
+
+/** Flag if the packed format is used */
+bool g_gps_packed = false;
+
+/** Position for the packed format */
+pack_fix_s g_pack_fix;
+
+/** The LPP assembly in payload_lpp.cpp uses its own copy of the WisBlock channels */
+static_assert((LPP_CHANNEL_GPS == PAYLOAD_LPP_GPS) && (LPP_CHANNEL_BATT == PAYLOAD_LPP_BATT) && (LPP_CHANNEL_HUMID == PAYLOAD_LPP_HUMID) &&
+				  (LPP_CHANNEL_TEMP == PAYLOAD_LPP_TEMP) && (LPP_CHANNEL_PRESS == PAYLOAD_LPP_PRESS) && (LPP_CHANNEL_GAS == PAYLOAD_LPP_GAS),
+			  "LPP channels of payload_lpp.h do not match wisblock_cayenne.h");
+
+/**
+ * @brief Data rate the MAC uses for the next uplink
+ * 		With ADR the network changes it, the configured data rate is only used before the join.
+ *
+ * @return uint8_t data rate
+ */
+static uint8_t lora_data_rate(void)
+{
+	if (g_lpwan_has_joined)
+	{
+		MibRequestConfirm_t mib_req;
+		mib_req.Type = MIB_CHANNELS_DATARATE;
+		if (LoRaMacMibGetRequestConfirm(&mib_req) == LORAMAC_STATUS_OK)
+		{
+			return mib_req.Param.ChannelsDatarate;
+		}
+	}
+	return g_lorawan_settings.data_rate;
+}
+
+/**
+ * @brief Max application payload with the current region and data rate
+ *
+ * @return uint8_t max size in bytes
+ */
+uint8_t lora_max_payload(void)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return 240;
+	}
+	return lora_region_max_payload(g_lorawan_settings.lora_region, lora_data_rate());
+}
+
+/**
+ * @brief Time on air of an uplink with the current region and data rate
+ * 		LoRa: explicit header, CRC on, coding rate 4/5, 8 symbols preamble
+ *
+ * @param size application payload size in bytes
+ * @return uint32_t time on air in ms
+ */
+uint32_t lora_airtime_ms(uint8_t size)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		uint16_t bw = g_lorawan_settings.p2p_bandwidth == 2 ? 500 : (g_lorawan_settings.p2p_bandwidth == 1 ? 250 : 125);
+		return lora_symbol_airtime_ms(g_lorawan_settings.p2p_sf, bw, size);
+	}
+	return lora_region_airtime_ms(g_lorawan_settings.lora_region, lora_data_rate(), size);
+}
+
+/**
+ * @brief Build the uplink from the collected data for the max payload of the current data rate
+ *
+ * @param buffer output, at least UPLINK_MAX_SIZE bytes
+ * @param fport returns the fPort, unchanged for the Cayenne LPP format
+ * @return uint8_t size of the packet
+ */
+uint8_t payload_build(uint8_t *buffer, uint8_t *fport)
+{
+	uint8_t max_size = lora_max_payload();
+	uint8_t size = 0;
+	if (g_is_helium)
+	{
+		// Fixed format, nothing to arrange
+		size = g_data_packet.getSize() > UPLINK_MAX_SIZE ? UPLINK_MAX_SIZE : g_data_packet.getSize();
+		memcpy(buffer, g_data_packet.getBuffer(), size);
+	}
+	else if (g_gps_packed)
+	{
+		size = payload_packed_frame(&g_pack_fix, g_data_packet.getBuffer(), g_data_packet.getSize(), buffer, max_size);
+		*fport = PACKED_FPORT;
+		g_pack_fix.valid = false;
+	}
+	else
+	{
+		bool with_record = false;
+		size = payload_lpp_frame(g_pos_record, g_pos_record_size, g_data_packet.getBuffer(), g_data_packet.getSize(), buffer, max_size, &with_record);
+		if (with_record)
+		{
+			// Compact position in front of the LPP data on its own fPort
+			*fport = POS_FPORT;
+		}
+	}
+	g_payload_stats.packets++;
+	g_payload_stats.bytes += size;
+	return size;
+}
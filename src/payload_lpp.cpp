@@ -0,0 +1,479 @@
+/**
+ * @file payload_lpp.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Payload assembly for the max payload of the current data rate
+ *        Cayenne LPP fields are added by priority, fields that do not fit are deferred to the next uplink.
+ *        No field is added past the max payload, a GNSS field that does not fit is sent with 4 digit precision.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <string.h>
+
+#include "payload_lpp.h"
+#include "payload_pack.h"
+
+/** Field priorities, lower value is added first */
+#define PAYLOAD_PRIO_POSITION 0
+#define PAYLOAD_PRIO_BATTERY 1
+#define PAYLOAD_PRIO_QUALITY 2
+#define PAYLOAD_PRIO_ENV 3
+#define PAYLOAD_PRIO_ACC 4
+#define PAYLOAD_PRIO_OTHER 5
+#define PAYLOAD_PRIO_NUM 6
+
+/** Max number of LPP fields in a packet */
+#define PAYLOAD_MAX_FIELDS 24
+/** Max size of the deferred fields */
+#define PAYLOAD_DEFER_SIZE 64
+
+/** Keyframe flag in the header of a compact position record, see pos_codec.cpp */
+#define PAYLOAD_POS_KEYFRAME 0x80
+
+/** Payload statistics */
+payload_stats_s g_payload_stats;
+
+/** Fields that did not fit into the last packet */
+static uint8_t deferred[PAYLOAD_DEFER_SIZE];
+static uint8_t deferred_size = 0;
+
+/** An LPP field in a buffer */
+struct lpp_field_s
+{
+	const uint8_t *data;
+	uint8_t size;
+	uint8_t priority;
+};
+
+/**
+ * @brief Size of an LPP field without channel and type
+ *
+ * @param type LPP type
+ * @return uint8_t size in bytes, 0 if the type is unknown
+ */
+static uint8_t lpp_data_size(uint8_t type)
+{
+	switch (type)
+	{
+	case 0:	  // digital input
+	case 1:	  // digital output
+	case 102: // presence
+	case 104: // humidity
+		return 1;
+	case 2:	  // analog input
+	case 3:	  // analog output
+	case 101: // illuminance
+	case 103: // temperature
+	case 115: // barometer
+	case 116: // voltage
+		return 2;
+	case 113: // accelerometer
+	case 134: // gyrometer
+		return 6;
+	case PAYLOAD_LPP_GNSS_4:
+		return PAYLOAD_LPP_GNSS_4_SIZE - 2;
+	case PAYLOAD_LPP_GNSS_6:
+		return PAYLOAD_LPP_GNSS_6_SIZE - 2;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Priority of an LPP field
+ *
+ * @param channel LPP channel
+ * @return uint8_t priority
+ */
+static uint8_t lpp_priority(uint8_t channel)
+{
+	switch (channel)
+	{
+	case PAYLOAD_LPP_GPS:
+	case LPP_CHANNEL_FENCE:
+		return PAYLOAD_PRIO_POSITION;
+	case PAYLOAD_LPP_BATT:
+		return PAYLOAD_PRIO_BATTERY;
+	case LPP_CHANNEL_ACCURACY:
+	case LPP_CHANNEL_SATS:
+		return PAYLOAD_PRIO_QUALITY;
+	case PAYLOAD_LPP_HUMID:
+	case PAYLOAD_LPP_TEMP:
+	case PAYLOAD_LPP_PRESS:
+	case PAYLOAD_LPP_GAS:
+		return PAYLOAD_PRIO_ENV;
+	case LPP_ACC:
+		return PAYLOAD_PRIO_ACC;
+	default:
+		return PAYLOAD_PRIO_OTHER;
+	}
+}
+
+/**
+ * @brief Split an LPP buffer into fields
+ *
+ * @param data LPP data
+ * @param size size of the LPP data
+ * @param fields array for the fields
+ * @param num number of fields already in the array, returns the new number
+ * @return true if the buffer could be parsed
+ */
+static bool lpp_split(const uint8_t *data, uint8_t size, lpp_field_s *fields, uint8_t *num)
+{
+	uint8_t offset = 0;
+	while (offset < size)
+	{
+		uint8_t data_size = (size - offset >= 2) ? lpp_data_size(data[offset + 1]) : 0;
+		if ((data_size == 0) || (offset + 2 + data_size > size) || (*num == PAYLOAD_MAX_FIELDS))
+		{
+			return false;
+		}
+		fields[*num].data = &data[offset];
+		fields[*num].size = 2 + data_size;
+		fields[*num].priority = lpp_priority(data[offset]);
+		(*num)++;
+		offset += 2 + data_size;
+	}
+	return true;
+}
+
+/**
+ * @brief Keep a field that did not fit for the next packet
+ *
+ * @param data LPP field with channel and type
+ * @param size size of the field
+ */
+static void defer_field(const uint8_t *data, uint8_t size)
+{
+	if (deferred_size + size <= PAYLOAD_DEFER_SIZE)
+	{
+		memcpy(&deferred[deferred_size], data, size);
+		deferred_size += size;
+		g_payload_stats.deferred++;
+	}
+	else
+	{
+		g_payload_stats.dropped++;
+	}
+}
+
+/**
+ * @brief Read a big endian value of an LPP field
+ *
+ */
+static int32_t lpp_value(const uint8_t *data, uint8_t size, bool is_signed)
+{
+	uint32_t value = 0;
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		value = (value << 8) | data[idx];
+	}
+	if (is_signed && (value & (1UL << (8 * size - 1))))
+	{
+		value |= ~0UL << (8 * size);
+	}
+	return (int32_t)value;
+}
+
+/**
+ * @brief Write a big endian value
+ *
+ */
+static void put_value(uint8_t *data, int32_t value, uint8_t size)
+{
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		data[idx] = (uint8_t)(value >> (8 * (size - 1 - idx)));
+	}
+}
+
+/**
+ * @brief Rounded division
+ *
+ */
+static int32_t div_round(int32_t value, int32_t divisor)
+{
+	return (value >= 0 ? value + divisor / 2 : value - divisor / 2) / divisor;
+}
+
+/**
+ * @brief Write a GNSS field with 4 digit precision
+ *
+ * @param field output, PAYLOAD_LPP_GNSS_4_SIZE bytes
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @param altitude cm
+ */
+static void lpp_gnss_4(uint8_t *field, int32_t latitude, int32_t longitude, int32_t altitude)
+{
+	field[0] = PAYLOAD_LPP_GPS;
+	field[1] = PAYLOAD_LPP_GNSS_4;
+	put_value(&field[2], div_round(latitude, 1000), 3);
+	put_value(&field[5], div_round(longitude, 1000), 3);
+	put_value(&field[8], altitude, 3);
+}
+
+/**
+ * @brief GNSS field with 4 digit precision from a compact position keyframe
+ *
+ * @param record keyframe, see pos_codec_encode()
+ * @param size size of the record
+ * @param field output, PAYLOAD_LPP_GNSS_4_SIZE bytes
+ * @return true if the record is a keyframe
+ */
+static bool keyframe_gnss_4(const uint8_t *record, uint8_t size, uint8_t *field)
+{
+	if ((size < 10) || !(record[0] & PAYLOAD_POS_KEYFRAME))
+	{
+		// A delta record without its keyframe is of no use
+		return false;
+	}
+	uint32_t zigzag = 0;
+	for (uint8_t idx = 9, shift = 0; (idx < size) && (shift < 32); idx++, shift += 7)
+	{
+		zigzag |= (uint32_t)(record[idx] & 0x7F) << shift;
+	}
+	int32_t alt_m = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+	lpp_gnss_4(field, lpp_value(&record[1], 4, true), lpp_value(&record[5], 4, true), alt_m * 100);
+	return true;
+}
+
+/**
+ * @brief Assemble the LPP fields by priority into the max size
+ * 		Fields of the last packet that did not fit are added if there is no newer value.
+ * 		The position is never deferred, an old position is of no use. If the 6 digit GNSS field does not fit,
+ * 		the position is sent with 4 digit precision, if that does not fit either it is dropped.
+ * 		Geofence events are deferred like the other fields, the position must not be lost because of them.
+ *
+ * @param lpp_data LPP data of the packet
+ * @param lpp_size size of the LPP data
+ * @param buffer output
+ * @param max_size max size of the LPP data
+ * @return uint8_t size of the LPP data
+ */
+static uint8_t lpp_assemble(const uint8_t *lpp_data, uint8_t lpp_size, uint8_t *buffer, uint8_t max_size)
+{
+	lpp_field_s fields[PAYLOAD_MAX_FIELDS];
+	uint8_t num = 0;
+	if (!lpp_split(lpp_data, lpp_size, fields, &num))
+	{
+		// Unknown field, send the packet as it is if it fits
+		deferred_size = 0;
+		if (lpp_size > max_size)
+		{
+			g_payload_stats.dropped++;
+			return 0;
+		}
+		memcpy(buffer, lpp_data, lpp_size);
+		return lpp_size;
+	}
+	uint8_t fresh_num = num;
+	uint8_t old_deferred[PAYLOAD_DEFER_SIZE];
+	uint8_t old_size = deferred_size;
+	memcpy(old_deferred, deferred, deferred_size);
+	lpp_split(old_deferred, old_size, fields, &num);
+	deferred_size = 0;
+
+	uint8_t size = 0;
+	for (uint8_t priority = 0; priority < PAYLOAD_PRIO_NUM; priority++)
+	{
+		for (uint8_t idx = 0; idx < num; idx++)
+		{
+			lpp_field_s *field = &fields[idx];
+			if (field->priority != priority)
+			{
+				continue;
+			}
+			if ((idx >= fresh_num) && (field->data[0] != LPP_CHANNEL_FENCE))
+			{
+				// Deferred field, skip it if the packet has a newer value
+				bool replaced = false;
+				for (uint8_t fresh = 0; fresh < fresh_num; fresh++)
+				{
+					if ((fields[fresh].data[0] == field->data[0]) && (fields[fresh].data[1] == field->data[1]))
+					{
+						replaced = true;
+						break;
+					}
+				}
+				if (replaced)
+				{
+					continue;
+				}
+			}
+			if (size + field->size <= max_size)
+			{
+				memcpy(&buffer[size], field->data, field->size);
+				size += field->size;
+			}
+			else if (field->data[0] != PAYLOAD_LPP_GPS)
+			{
+				defer_field(field->data, field->size);
+			}
+			else if ((field->data[1] == PAYLOAD_LPP_GNSS_6) && (size + PAYLOAD_LPP_GNSS_4_SIZE <= max_size))
+			{
+				const uint8_t *data = &field->data[2];
+				lpp_gnss_4(&buffer[size], lpp_value(data, 4, true) * 10, lpp_value(&data[4], 4, true) * 10, lpp_value(&data[8], 3, true));
+				size += PAYLOAD_LPP_GNSS_4_SIZE;
+			}
+			else
+			{
+				g_payload_stats.dropped++;
+			}
+		}
+	}
+	return size;
+}
+
+/**
+ * @brief Build a Cayenne LPP packet, with the compact position in front if there is one
+ * 		If the compact position does not fit, a keyframe is sent as 4 digit GNSS field instead
+ * 		and the packet goes out on the LPP fPort, the keyframe is then sent again with the next position.
+ *
+ * @param pos_record compact position record, see pos_codec_encode()
+ * @param pos_size size of the record, 0 if there is none
+ * @param lpp_data LPP data of the packet
+ * @param lpp_size size of the LPP data
+ * @param buffer output, at least max_size bytes
+ * @param max_size max size of the packet
+ * @param with_record returns true if the packet starts with the compact position (POS_FPORT)
+ * @return uint8_t size of the packet
+ */
+uint8_t payload_lpp_frame(const uint8_t *pos_record, uint8_t pos_size, const uint8_t *lpp_data, uint8_t lpp_size,
+						  uint8_t *buffer, uint8_t max_size, bool *with_record)
+{
+	*with_record = false;
+	if (pos_size == 0)
+	{
+		return lpp_assemble(lpp_data, lpp_size, buffer, max_size);
+	}
+	if (pos_size <= max_size)
+	{
+		// Compact position goes in front of the LPP data on its own fPort
+		memcpy(buffer, pos_record, pos_size);
+		*with_record = true;
+		return pos_size + lpp_assemble(lpp_data, lpp_size, &buffer[pos_size], max_size - pos_size);
+	}
+	uint8_t with_gnss[PAYLOAD_LPP_GNSS_4_SIZE + 255];
+	if (!keyframe_gnss_4(pos_record, pos_size, with_gnss))
+	{
+		g_payload_stats.dropped++;
+		return lpp_assemble(lpp_data, lpp_size, buffer, max_size);
+	}
+	uint8_t size = lpp_size > 255 - PAYLOAD_LPP_GNSS_4_SIZE ? 255 - PAYLOAD_LPP_GNSS_4_SIZE : lpp_size;
+	memcpy(&with_gnss[PAYLOAD_LPP_GNSS_4_SIZE], lpp_data, size);
+	return lpp_assemble(with_gnss, PAYLOAD_LPP_GNSS_4_SIZE + size, buffer, max_size);
+}
+
+/**
+ * @brief State of charge of a LiPo battery
+ *
+ * @param centi_volt battery voltage in 0.01 V
+ * @return uint8_t state of charge in %
+ */
+static uint8_t batt_soc(int32_t centi_volt)
+{
+	static const uint16_t soc_volt[11] = {330, 350, 360, 365, 370, 375, 380, 385, 390, 400, 410};
+	if (centi_volt <= soc_volt[0])
+	{
+		return 0;
+	}
+	for (uint8_t idx = 1; idx < 11; idx++)
+	{
+		if (centi_volt < soc_volt[idx])
+		{
+			return (idx - 1) * 10 + (centi_volt - soc_volt[idx - 1]) * 10 / (soc_volt[idx] - soc_volt[idx - 1]);
+		}
+	}
+	return 100;
+}
+
+/**
+ * @brief Build the packed format from the position and the LPP fields
+ * 		The frame is encoded by pack_encode(), see payload_pack.cpp.
+ * 		Geofence events that do not fit are deferred to the next packet, the position is always sent.
+ *
+ * @param fix position
+ * @param lpp_data LPP data of the packet
+ * @param lpp_size size of the LPP data
+ * @param buffer output
+ * @param max_size max size of the packet
+ * @return uint8_t size of the packet
+ */
+uint8_t payload_packed_frame(const pack_fix_s *fix, const uint8_t *lpp_data, uint8_t lpp_size, uint8_t *buffer, uint8_t max_size)
+{
+	// Deferred fields first, newer values of the packet replace them
+	lpp_field_s fields[PAYLOAD_MAX_FIELDS];
+	uint8_t num = 0;
+	uint8_t old_deferred[PAYLOAD_DEFER_SIZE];
+	uint8_t old_size = deferred_size;
+	memcpy(old_deferred, deferred, deferred_size);
+	deferred_size = 0;
+	lpp_split(old_deferred, old_size, fields, &num);
+	lpp_split(lpp_data, lpp_size, fields, &num);
+
+	pack_values_s values;
+	values.has_position = fix->valid;
+	values.latitude = fix->latitude;
+	values.longitude = fix->longitude;
+	values.altitude = fix->altitude;
+	values.sat_num = fix->sat_num;
+	values.dop = fix->dop;
+	uint8_t env_found = 0;
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		const uint8_t *data = &fields[idx].data[2];
+		switch (fields[idx].data[0])
+		{
+		case PAYLOAD_LPP_BATT:
+			values.battery = batt_soc(lpp_value(data, 2, false));
+			break;
+		case PAYLOAD_LPP_TEMP:
+			values.temperature = lpp_value(data, 2, true);
+			env_found |= 1;
+			break;
+		case PAYLOAD_LPP_HUMID:
+			values.humidity = data[0];
+			env_found |= 2;
+			break;
+		case PAYLOAD_LPP_PRESS:
+			values.pressure = lpp_value(data, 2, false);
+			env_found |= 4;
+			break;
+		case PAYLOAD_LPP_GAS:
+			values.gas = lpp_value(data, 2, true);
+			values.has_gas = values.gas > 0;
+			break;
+		case LPP_ACC:
+			for (uint8_t axis = 0; axis < 3; axis++)
+			{
+				values.acc[axis] = lpp_value(&data[2 * axis], 2, true);
+			}
+			values.has_acc = true;
+			break;
+		case LPP_CHANNEL_FENCE:
+			if (values.event_num < PACK_EVENT_MAX)
+			{
+				values.events[values.event_num++] = data[0];
+			}
+			else
+			{
+				defer_field(fields[idx].data, fields[idx].size);
+			}
+			break;
+		}
+	}
+	values.has_env = env_found == 7;
+
+	// Fence events that did not fit go with the next packet
+	uint8_t event_num = values.event_num;
+	uint8_t size = pack_encode(&values, buffer, max_size);
+	for (uint8_t event = values.event_num; event < event_num; event++)
+	{
+		uint8_t field[3] = {LPP_CHANNEL_FENCE, 0, values.events[event]};
+		defer_field(field, 3);
+	}
+	return size;
+}
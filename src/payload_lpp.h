@@ -0,0 +1,59 @@
+/**
+ * @file payload_lpp.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Payload assembly for the max payload of the current data rate
+ *        No Arduino dependencies, the same code is used by the host tests
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef PAYLOAD_LPP_H
+#define PAYLOAD_LPP_H
+
+#include <stdint.h>
+
+/** LPP channels of wisblock_cayenne.h, payload.cpp checks that they match */
+#define PAYLOAD_LPP_GPS 1
+#define PAYLOAD_LPP_BATT 2
+#define PAYLOAD_LPP_HUMID 3
+#define PAYLOAD_LPP_TEMP 4
+#define PAYLOAD_LPP_PRESS 5
+#define PAYLOAD_LPP_GAS 6
+/** LPP channels of the tracker */
+#define LPP_ACC 64
+#define LPP_CHANNEL_FENCE 13
+#define LPP_CHANNEL_ACCURACY 11
+#define LPP_CHANNEL_SATS 12
+/** LPP GNSS types and field sizes with channel and type */
+#define PAYLOAD_LPP_GNSS_4 136
+#define PAYLOAD_LPP_GNSS_6 137
+#define PAYLOAD_LPP_GNSS_4_SIZE 11
+#define PAYLOAD_LPP_GNSS_6_SIZE 13
+
+/** Position for the packed format */
+struct pack_fix_s
+{
+	int32_t latitude;  // 1e-7 degrees
+	int32_t longitude; // 1e-7 degrees
+	int32_t altitude;  // mm
+	uint8_t sat_num;
+	int32_t dop; // DOP * 100
+	bool valid = false;
+};
+/** Payload assembly statistics */
+struct payload_stats_s
+{
+	uint32_t packets = 0;  // payloads built
+	uint32_t bytes = 0;	   // bytes of all payloads
+	uint32_t deferred = 0; // fields moved to the next uplink
+	uint32_t dropped = 0;  // fields that did not fit into this or the next uplink
+};
+
+uint8_t payload_lpp_frame(const uint8_t *pos_record, uint8_t pos_size, const uint8_t *lpp_data, uint8_t lpp_size,
+						  uint8_t *buffer, uint8_t max_size, bool *with_record);
+uint8_t payload_packed_frame(const pack_fix_s *fix, const uint8_t *lpp_data, uint8_t lpp_size, uint8_t *buffer, uint8_t max_size);
+extern payload_stats_s g_payload_stats;
+
+#endif
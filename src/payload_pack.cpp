@@ -0,0 +1,109 @@
+/**
+ * @file payload_pack.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Encoder of the packed payload format (ATC+GNSS=4)
+ *        The layout is defined in payload_schema.h.
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "payload_pack.h"
+
+/**
+ * @brief Build a packed frame
+ * 		Blocks are added by priority as long as they fit into the max size.
+ * 		The position is always added, then as many fence events as fit.
+ *
+ * @param values values of the frame, event_num returns the number of events sent
+ * @param buffer output, at least max_size bytes
+ * @param max_size max size of the frame
+ * @return uint8_t size of the frame
+ */
+uint8_t pack_encode(pack_values_s *values, uint8_t *buffer, uint8_t max_size)
+{
+	uint8_t flags = 0;
+	uint16_t bits = pack_block_bits(PACK_HEADER);
+	if (values->has_position)
+	{
+		flags |= PACK_POSITION;
+		bits += pack_block_bits(PACK_POSITION);
+	}
+	// Fence events as many as fit
+	if (values->event_num > PACK_EVENT_MAX)
+	{
+		values->event_num = PACK_EVENT_MAX;
+	}
+	while ((values->event_num != 0) && (PACK_FRAME_SIZE(bits + pack_block_bits(PACK_FENCE) + (values->event_num - 1) * pack_schema[PACK_F_fence_event].bits) > max_size))
+	{
+		values->event_num--;
+	}
+	if (values->event_num != 0)
+	{
+		flags |= PACK_FENCE;
+		bits += pack_block_bits(PACK_FENCE) + (values->event_num - 1) * pack_schema[PACK_F_fence_event].bits;
+	}
+	if (values->has_position && (PACK_FRAME_SIZE(bits + pack_block_bits(PACK_QUALITY)) <= max_size))
+	{
+		flags |= PACK_QUALITY;
+		bits += pack_block_bits(PACK_QUALITY);
+	}
+	if (values->has_env && (PACK_FRAME_SIZE(bits + pack_block_bits(PACK_ENV)) <= max_size))
+	{
+		flags |= PACK_ENV;
+		bits += pack_block_bits(PACK_ENV);
+	}
+	if (values->has_gas && (PACK_FRAME_SIZE(bits + pack_block_bits(PACK_GAS)) <= max_size))
+	{
+		flags |= PACK_GAS;
+		bits += pack_block_bits(PACK_GAS);
+	}
+	if (values->has_acc && (PACK_FRAME_SIZE(bits + pack_block_bits(PACK_ACC)) <= max_size))
+	{
+		flags |= PACK_ACC;
+		bits += pack_block_bits(PACK_ACC);
+	}
+
+	bit_writer_s writer = {buffer, 0};
+	pack_put(&writer, PACK_F_flags, flags);
+	pack_put(&writer, PACK_F_battery, values->battery);
+	if (flags & PACK_POSITION)
+	{
+		pack_put(&writer, PACK_F_latitude, values->latitude);
+		pack_put(&writer, PACK_F_longitude, values->longitude);
+		pack_put(&writer, PACK_F_altitude, values->altitude);
+	}
+	if (flags & PACK_QUALITY)
+	{
+		pack_put(&writer, PACK_F_satellites, values->sat_num);
+		pack_put(&writer, PACK_F_dop, values->dop);
+	}
+	if (flags & PACK_ENV)
+	{
+		pack_put(&writer, PACK_F_temperature, values->temperature);
+		pack_put(&writer, PACK_F_humidity, values->humidity);
+		pack_put(&writer, PACK_F_pressure, values->pressure);
+	}
+	if (flags & PACK_GAS)
+	{
+		pack_put(&writer, PACK_F_gas, values->gas);
+	}
+	if (flags & PACK_ACC)
+	{
+		pack_put(&writer, PACK_F_acc_x, values->acc[0]);
+		pack_put(&writer, PACK_F_acc_y, values->acc[1]);
+		pack_put(&writer, PACK_F_acc_z, values->acc[2]);
+	}
+	if (flags & PACK_FENCE)
+	{
+		pack_put(&writer, PACK_F_fence_count, values->event_num);
+		for (uint8_t event = 0; event < values->event_num; event++)
+		{
+			pack_put(&writer, PACK_F_fence_event, values->events[event]);
+		}
+	}
+	// Fill the last byte
+	put_bits(&writer, 0, (8 - (writer.bits & 7)) & 7);
+	return writer.bits / 8;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file payload_pack.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Encoder of the packed payload format (ATC+GNSS=4)
+ *        No Arduino dependencies, the same code is used by the host tests
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef PAYLOAD_PACK_H
+#define PAYLOAD_PACK_H
+
+#include <stdint.h>
+#include <math.h>
+#include "payload_schema.h"
+
+/** Max number of fence events in a frame, limited by the 3 bit count */
+#define PACK_EVENT_MAX 8
+
+/**
+ * @brief Bit writer for the packed format, MSB first
+ *
+ */
+struct bit_writer_s
+{
+	uint8_t *buffer;
+	uint16_t bits;
+};
+
+/**
+ * @brief Write a value into the bit stream
+ *
+ * @param writer bit writer
+ * @param value value, only the low bits are written
+ * @param bits number of bits
+ */
+static inline void put_bits(bit_writer_s *writer, uint32_t value, uint8_t bits)
+{
+	for (int8_t bit = bits - 1; bit >= 0; bit--)
+	{
+		uint8_t mask = 0x80 >> (writer->bits & 7);
+		if ((value >> bit) & 1)
+		{
+			writer->buffer[writer->bits >> 3] |= mask;
+		}
+		else
+		{
+			writer->buffer[writer->bits >> 3] &= ~mask;
+		}
+		writer->bits++;
+	}
+}
+
+/**
+ * @brief Write a field of the packed format
+ * 		With a constant field index the schema lookups are resolved by the compiler
+ *
+ * @param writer bit writer
+ * @param idx field index PACK_F_<name>
+ * @param value value in device units
+ */
+static inline void pack_put(bit_writer_s *writer, uint8_t idx, int32_t value)
+{
+	const pack_field_s &field = pack_schema[idx];
+	int64_t raw;
+	if (field.encoding == PACK_LOG2)
+	{
+		raw = value > 0 ? lroundf(field.mul * (log2f(value * (float)field.unit) + field.offset)) : 0;
+	}
+	else
+	{
+		int64_t scaled = ((int64_t)value + field.offset) * field.mul;
+		raw = (scaled >= 0 ? scaled + field.div / 2 : scaled - field.div / 2) / field.div;
+	}
+	raw = raw < pack_raw_min(idx) ? pack_raw_min(idx) : (raw > pack_raw_max(idx) ? pack_raw_max(idx) : raw);
+	put_bits(writer, (uint32_t)raw, field.bits);
+}
+
+/**
+ * @brief Values of a packed frame in device units
+ *
+ */
+struct pack_values_s
+{
+	uint8_t battery = PACK_BATT_UNKNOWN; // state of charge in %
+	bool has_position = false;
+	int32_t latitude = 0;  // 1e-7 degrees
+	int32_t longitude = 0; // 1e-7 degrees
+	int32_t altitude = 0;  // mm
+	uint8_t sat_num = 0;
+	int32_t dop = 0; // DOP * 100
+	bool has_env = false;
+	int32_t temperature = 0; // 0.1 degrees C
+	int32_t humidity = 0;	 // 0.5 %
+	int32_t pressure = 0;	 // 0.1 hPa
+	bool has_gas = false;
+	int32_t gas = 0; // 0.01 kOhm
+	bool has_acc = false;
+	int32_t acc[3] = {0, 0, 0}; // mG
+	uint8_t event_num = 0;
+	uint8_t events[PACK_EVENT_MAX];
+};
+
+uint8_t pack_encode(pack_values_s *values, uint8_t *buffer, uint8_t max_size);
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ * @file payload_schema.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Schema of the packed payload format (ATC+GNSS=4)
+ *        No Arduino dependencies, the same schema is used by the host decoders.
+ *        The Python and JS decoders are generated from this file with decoder/gen_decoders.py
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef PAYLOAD_SCHEMA_H
+#define PAYLOAD_SCHEMA_H
+
+#include <stdint.h>
+
+/** Blocks of the packed format, the flags byte tells which blocks follow the header */
+#define PACK_HEADER 0x00 // always present
+#define PACK_POSITION 0x01
+#define PACK_QUALITY 0x02
+#define PACK_ENV 0x04
+#define PACK_GAS 0x08
+#define PACK_ACC 0x10
+#define PACK_FENCE 0x20
+
+/** Field encodings */
+#define PACK_LINEAR 0 // raw = round((value + offset) * mul / div)
+#define PACK_LOG2 1	  // raw = round(mul * (log2(value * unit) + offset))
+#define PACK_COUNT 2  // like PACK_LINEAR, number of repeats of the next field
+#define PACK_REPEAT 3 // like PACK_LINEAR, repeated as often as the count before
+
+/**
+ * @brief Fields in the order they are sent, one field per line
+ * 		block, name, bits, signed, encoding, offset, mul, div, unit
+ * 		value is in device units, value * unit is the physical value
+ * 		decoded value = (raw * div / mul - offset) * unit
+ */
+#define PACK_SCHEMA(FIELD)                                                                           \
+	FIELD(PACK_HEADER, flags, 8, false, PACK_LINEAR, 0, 1, 1, 1)                                     \
+	FIELD(PACK_HEADER, battery, 7, false, PACK_LINEAR, 0, 1, 1, 1)                                   \
+	FIELD(PACK_POSITION, latitude, 24, false, PACK_LINEAR, 900000000, 0xFFFFFF, 1800000000, 1e-7)    \
+	FIELD(PACK_POSITION, longitude, 25, false, PACK_LINEAR, 1800000000, 0x1FFFFFF, 3600000000, 1e-7) \
+	FIELD(PACK_POSITION, altitude, 16, true, PACK_LINEAR, 0, 1, 1000, 0.001)                         \
+	FIELD(PACK_QUALITY, satellites, 4, false, PACK_LINEAR, 0, 1, 1, 1)                               \
+	FIELD(PACK_QUALITY, dop, 6, false, PACK_LINEAR, 0, 1, 20, 0.01)                                  \
+	FIELD(PACK_ENV, temperature, 10, false, PACK_LINEAR, 400, 1, 1, 0.1)                             \
+	FIELD(PACK_ENV, humidity, 7, false, PACK_LINEAR, 0, 1, 2, 0.5)                                   \
+	FIELD(PACK_ENV, pressure, 10, false, PACK_LINEAR, -3000, 1, 10, 0.1)                             \
+	FIELD(PACK_GAS, gas, 8, false, PACK_LOG2, 4, 16, 1, 0.01)                                        \
+	FIELD(PACK_ACC, acc_x, 10, true, PACK_LINEAR, 0, 1, 4, 0.001)                                    \
+	FIELD(PACK_ACC, acc_y, 10, true, PACK_LINEAR, 0, 1, 4, 0.001)                                    \
+	FIELD(PACK_ACC, acc_z, 10, true, PACK_LINEAR, 0, 1, 4, 0.001)                                    \
+	FIELD(PACK_FENCE, fence_count, 3, false, PACK_COUNT, -1, 1, 1, 1)                                \
+	FIELD(PACK_FENCE, fence_event, 8, false, PACK_REPEAT, 0, 1, 1, 1)
+
+/** Battery value if no battery voltage is known */
+#define PACK_BATT_UNKNOWN 127
+
+/** Field index, PACK_F_<name> */
+enum pack_field_e
+{
+#define PACK_FIELD_ENUM(block, name, bits, is_signed, encoding, offset, mul, div, unit) PACK_F_##name,
+	PACK_SCHEMA(PACK_FIELD_ENUM)
+#undef PACK_FIELD_ENUM
+		PACK_FIELD_NUM
+};
+
+/** Field descriptor */
+struct pack_field_s
+{
+	uint8_t block;
+	const char *name;
+	uint8_t bits;
+	bool is_signed;
+	uint8_t encoding;
+	int64_t offset;
+	int64_t mul;
+	int64_t div;
+	double unit;
+};
+
+/** Field descriptors, indexed by pack_field_e */
+static constexpr pack_field_s pack_schema[PACK_FIELD_NUM] = {
+#define PACK_FIELD_DESC(block, name, bits, is_signed, encoding, offset, mul, div, unit) \
+	{block, #name, bits, is_signed, encoding, offset, mul, div, unit},
+	PACK_SCHEMA(PACK_FIELD_DESC)
+#undef PACK_FIELD_DESC
+};
+
+/**
+ * @brief Number of bits of a block, fields that repeat are counted once
+ *
+ * @param block PACK_HEADER, PACK_POSITION, ...
+ * @param idx first field to count, for the recursion
+ * @return constexpr uint16_t number of bits
+ */
+constexpr uint16_t pack_block_bits(uint8_t block, uint8_t idx = 0)
+{
+	return idx == PACK_FIELD_NUM ? 0 : (pack_schema[idx].block == block ? pack_schema[idx].bits : 0) + pack_block_bits(block, idx + 1);
+}
+
+/**
+ * @brief Smallest raw value of a field
+ *
+ */
+constexpr int32_t pack_raw_min(uint8_t idx)
+{
+	return pack_schema[idx].is_signed ? -(1L << (pack_schema[idx].bits - 1)) : 0;
+}
+
+/**
+ * @brief Largest raw value of a field
+ *
+ */
+constexpr int32_t pack_raw_max(uint8_t idx)
+{
+	return pack_schema[idx].is_signed ? (1L << (pack_schema[idx].bits - 1)) - 1 : (1L << pack_schema[idx].bits) - 1;
+}
+
+/** Number of bytes of a frame with the given blocks, fence events not included */
+#define PACK_FRAME_SIZE(blocks_bits) (((blocks_bits) + 7) / 8)
+
+// Position must fit into the smallest usable max payload (US915 DR0, AS923 DR2)
+static_assert(PACK_FRAME_SIZE(pack_block_bits(PACK_HEADER) + pack_block_bits(PACK_POSITION)) <= 11,
+			  "Packed position does not fit into 11 bytes");
+// Position, quality, battery and environment data in less than 16 bytes
+static_assert(PACK_FRAME_SIZE(pack_block_bits(PACK_HEADER) + pack_block_bits(PACK_POSITION) + pack_block_bits(PACK_QUALITY) + pack_block_bits(PACK_ENV)) < 16,
+			  "Packed report does not fit into 15 bytes");
+// Largest frame with the max number of fence events (8)
+static_assert(PACK_FRAME_SIZE(pack_block_bits(PACK_HEADER) + pack_block_bits(PACK_POSITION) + pack_block_bits(PACK_QUALITY) + pack_block_bits(PACK_ENV) +
+							  pack_block_bits(PACK_GAS) + pack_block_bits(PACK_ACC) + pack_block_bits(PACK_FENCE) + 7 * pack_schema[PACK_F_fence_event].bits) <= 242,
+			  "Packed frame does not fit into 242 bytes");
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * @file pos_codec.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Compact position format
+ *        Keyframes with the absolute position, in between zig-zag varint deltas to the last keyframe
+ *        that is known to be delivered (confirmed uplink) or assumed to be delivered (periodic resync)
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Number of positions after which a keyframe is sent */
+#define POS_CODEC_RESYNC 10
+/** Max delta in 1e-5 degrees, larger deltas need more than 2 bytes and a keyframe is sent instead */
+#define POS_CODEC_MAX_DELTA 8191
+/** Min altitude change in m that is sent */
+#define POS_CODEC_ALT_STEP 5
+/** Header flags */
+#define POS_CODEC_KEYFRAME 0x80
+#define POS_CODEC_ALTITUDE 0x40
+#define POS_CODEC_ID_MASK 0x3F
+
+/** Flag if the compact position format is used */
+bool g_gps_compact = false;
+
+/** Encoded position of the current acquisition */
+uint8_t g_pos_record[POS_RECORD_MAX];
+uint8_t g_pos_record_size = 0;
+
+/** Codec statistics */
+pos_codec_stats_s g_pos_codec_stats;
+
+/** A keyframe */
+struct pos_key_s
+{
+	int32_t lat; // 1e-7 degrees
+	int32_t lon; // 1e-7 degrees
+	int32_t alt; // m
+	uint8_t id;
+	bool valid;
+};
+
+/** Keyframe the deltas refer to */
+static pos_key_s ref_key = {0, 0, 0, 0, false};
+/** Keyframe in the last encoded record, waiting to be sent or acknowledged */
+static pos_key_s new_key = {0, 0, 0, 0, false};
+/** Flag if the last sent keyframe waits for the ACK */
+static bool key_pending = false;
+/** Id of the next keyframe */
+static uint8_t next_id = 0;
+/** Number of deltas since the last keyframe */
+static uint8_t since_key = 0;
+
+/**
+ * @brief Write a zig-zag varint
+ *
+ * @param buffer output
+ * @param value signed value
+ * @return uint8_t number of bytes written
+ */
+static uint8_t put_varint(uint8_t *buffer, int32_t value)
+{
+	uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	uint8_t size = 0;
+	while (zigzag >= 0x80)
+	{
+		buffer[size++] = (uint8_t)(zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	buffer[size++] = (uint8_t)zigzag;
+	return size;
+}
+
+/**
+ * @brief Rounded division
+ *
+ */
+static int32_t div_round(int32_t value, int32_t divisor)
+{
+	return (value >= 0 ? value + divisor / 2 : value - divisor / 2) / divisor;
+}
+
+/**
+ * @brief Forget the keyframes, the next position is sent as keyframe
+ *
+ */
+void pos_codec_reset(void)
+{
+	ref_key.valid = false;
+	new_key.valid = false;
+	key_pending = false;
+}
+
+/**
+ * @brief Encode a position
+ * 		Keyframe: header (0x80 | 0x40 | id), latitude and longitude in 1e-7 degrees (4 bytes big endian each), altitude in m (varint)
+ * 		Delta: header (0x40 if altitude follows | id of the keyframe), latitude and longitude change in 1e-5 degrees (varint each),
+ * 		altitude change in m (varint)
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @param altitude mm
+ * @param buffer output, at least POS_RECORD_MAX bytes
+ * @return uint8_t size of the record
+ */
+uint8_t pos_codec_encode(int32_t latitude, int32_t longitude, int32_t altitude, uint8_t *buffer)
+{
+	int32_t alt_m = div_round(altitude, 1000);
+	int32_t d_lat = 0;
+	int32_t d_lon = 0;
+	bool keyframe = !ref_key.valid || (since_key >= POS_CODEC_RESYNC);
+	if (!keyframe)
+	{
+		d_lat = div_round(latitude - ref_key.lat, 100);
+		d_lon = div_round(geo_lon_offset(ref_key.lon, longitude), 100);
+		keyframe = (abs(d_lat) > POS_CODEC_MAX_DELTA) || (abs(d_lon) > POS_CODEC_MAX_DELTA);
+	}
+
+	uint8_t size = 0;
+	if (keyframe)
+	{
+		new_key = {latitude, longitude, alt_m, next_id, true};
+		next_id = (next_id + 1) & POS_CODEC_ID_MASK;
+		buffer[size++] = POS_CODEC_KEYFRAME | POS_CODEC_ALTITUDE | new_key.id;
+		for (uint8_t shift = 0; shift < 4; shift++)
+		{
+			buffer[size++] = (uint8_t)(latitude >> (24 - 8 * shift));
+		}
+		for (uint8_t shift = 0; shift < 4; shift++)
+		{
+			buffer[size++] = (uint8_t)(longitude >> (24 - 8 * shift));
+		}
+		size += put_varint(&buffer[size], alt_m);
+		g_pos_codec_stats.keyframes++;
+	}
+	else
+	{
+		if (!key_pending)
+		{
+			new_key.valid = false;
+		}
+		int32_t d_alt = alt_m - ref_key.alt;
+		bool with_alt = abs(d_alt) >= POS_CODEC_ALT_STEP;
+		buffer[size++] = (with_alt ? POS_CODEC_ALTITUDE : 0) | ref_key.id;
+		size += put_varint(&buffer[size], d_lat);
+		size += put_varint(&buffer[size], d_lon);
+		if (with_alt)
+		{
+			size += put_varint(&buffer[size], d_alt);
+		}
+		g_pos_codec_stats.deltas++;
+	}
+	g_pos_codec_stats.bytes += size;
+	return size;
+}
+
+/**
+ * @brief The last encoded record was enqueued
+ * 		Without confirmed uplinks a keyframe is assumed to be delivered,
+ * 		with confirmed uplinks it is used after the ACK
+ *
+ */
+void pos_codec_sent(void)
+{
+	if (!new_key.valid)
+	{
+		since_key++;
+		return;
+	}
+	if (g_lorawan_settings.lorawan_enable && g_lorawan_settings.confirmed_msg_enabled)
+	{
+		key_pending = true;
+		return;
+	}
+	ref_key = new_key;
+	new_key.valid = false;
+	since_key = 0;
+}
+
+/**
+ * @brief Result of the TX cycle of a compact position
+ * 		Several positions can wait in the uplink queue, only the result of the pending keyframe counts
+ *
+ * @param header first byte of the record that was sent
+ * @param ack true if the uplink was acknowledged
+ */
+void pos_codec_tx_result(uint8_t header, bool ack)
+{
+	if (!key_pending || !(header & POS_CODEC_KEYFRAME) || ((header & POS_CODEC_ID_MASK) != new_key.id))
+	{
+		return;
+	}
+	key_pending = false;
+	if (ack && new_key.valid)
+	{
+		ref_key = new_key;
+		since_key = 0;
+	}
+	new_key.valid = false;
+}
@@ -0,0 +1,507 @@
+/**
+ * @file store_log.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Store-and-forward log for positions that could not be delivered
+ *        Append-only ring of segment files in the flash, drained in batches
+ *        with a limited share of the airtime after the link is back
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+using namespace Adafruit_LittleFS_Namespace;
+
+/** Number of segment files, the oldest segment is dropped if all are full */
+#define STORE_SEGMENTS 8
+/** Number of records in a segment file */
+#define STORE_SEG_RECORDS 32
+/** Marker of a valid segment file */
+#define STORE_SEG_MARK 0x51F0
+/** Size of a record in a batch */
+#define STORE_BATCH_RECORD 14
+/** Min pause between two batches in ms */
+#define STORE_MIN_PAUSE 10000
+/** Pause before the next try if a batch could not be sent in ms */
+#define STORE_RETRY_MS 60000
+
+/** Share of the airtime for draining the log in percent, 0 = log not used */
+uint8_t g_store_share = 0;
+
+/** Log statistics */
+store_stats_s g_store_stats;
+
+/** Header of a segment file */
+struct store_seg_header_s
+{
+	uint16_t mark;
+	uint16_t reserved;
+	uint32_t seq; // segment number, the file name is seq % STORE_SEGMENTS
+};
+
+/** Position of the cursor file, the first record of the oldest segment that was not sent */
+struct store_cursor_s
+{
+	uint32_t seq;
+	uint8_t idx;
+};
+
+/** Filename of the cursor */
+static const char cursor_name[] = "SLGR";
+
+/** Oldest segment and first record that was not sent */
+static uint32_t read_seq = 0;
+static uint8_t read_idx = 0;
+/** Segment that is written */
+static uint32_t write_seq = 0;
+/** Number of records in each segment file */
+static uint8_t seg_num[STORE_SEGMENTS];
+
+/** Position in the current packet */
+static store_record_s fix;
+static bool fix_valid = false;
+/** Records and size of the last batch */
+static uint8_t batch_num = 0;
+static uint8_t batch_size = 0;
+/** Damaged records of the last batch, included in batch_num but not sent */
+static uint8_t batch_damaged = 0;
+/** Flag if the next batch is scheduled */
+static bool drain_active = false;
+
+/** Timer for the next batch */
+static SoftwareTimer drain_timer;
+
+/**
+ * @brief Get the filename of a segment
+ *
+ */
+static void seg_file_name(uint32_t seq, char *name)
+{
+	snprintf(name, 8, "SLG%d", (int)(seq % STORE_SEGMENTS));
+}
+
+/**
+ * @brief Checksum of a record
+ *
+ */
+static uint8_t record_check(const store_record_s *record)
+{
+	const uint8_t *data = (const uint8_t *)record;
+	uint8_t sum = 0x5A;
+	for (uint8_t idx = 0; idx < offsetof(store_record_s, check); idx++)
+	{
+		sum = (sum << 1 | sum >> 7) ^ data[idx];
+	}
+	return sum;
+}
+
+/**
+ * @brief Save the cursor, no file means the oldest segment is sent from the start
+ *
+ */
+static void cursor_save(void)
+{
+	InternalFS.remove(cursor_name);
+	if (read_idx == 0)
+	{
+		return;
+	}
+	store_cursor_s cursor = {read_seq, read_idx};
+	File cursor_file(InternalFS);
+	if (cursor_file.open(cursor_name, FILE_O_WRITE))
+	{
+		cursor_file.write((const uint8_t *)&cursor, sizeof(store_cursor_s));
+		cursor_file.close();
+	}
+}
+
+/**
+ * @brief Remove the oldest segment
+ *
+ */
+static void drop_read_segment(void)
+{
+	char name[8];
+	seg_file_name(read_seq, name);
+	InternalFS.remove(name);
+	seg_num[read_seq % STORE_SEGMENTS] = 0;
+	read_seq++;
+	read_idx = 0;
+}
+
+/**
+ * @brief Number of records in the log
+ *
+ */
+static uint16_t stored_num(void)
+{
+	uint16_t num = 0;
+	for (uint32_t seq = read_seq; seq != write_seq + 1; seq++)
+	{
+		num += seg_num[seq % STORE_SEGMENTS];
+	}
+	return num - read_idx;
+}
+
+/**
+ * @brief Timer callback, wake up the loop to send the next batch
+ *
+ */
+static void drain_wakeup(TimerHandle_t unused)
+{
+	api_wake_loop(STORE_DRAIN);
+}
+
+/**
+ * @brief Schedule the next batch
+ *
+ * @param pause time until the next batch in ms
+ */
+static void drain_schedule(uint32_t pause)
+{
+	if ((g_store_share == 0) || (g_store_stats.stored == 0))
+	{
+		drain_active = false;
+		return;
+	}
+	drain_timer.stop();
+	drain_timer.setPeriod(pause);
+	drain_timer.start();
+	drain_active = true;
+}
+
+/**
+ * @brief Find the segments in the flash
+ *
+ */
+void store_log_load(void)
+{
+	static bool timer_init = false;
+	if (!timer_init)
+	{
+		drain_timer.begin(STORE_MIN_PAUSE, drain_wakeup, NULL, false);
+		timer_init = true;
+	}
+
+	bool found = false;
+	File seg_file(InternalFS);
+	for (uint8_t slot = 0; slot < STORE_SEGMENTS; slot++)
+	{
+		char name[8];
+		seg_file_name(slot, name);
+		seg_num[slot] = 0;
+		if (!seg_file.open(name, FILE_O_READ))
+		{
+			continue;
+		}
+		store_seg_header_s header;
+		bool valid = (seg_file.read((void *)&header, sizeof(store_seg_header_s)) == sizeof(store_seg_header_s)) &&
+					 (header.mark == STORE_SEG_MARK) && (header.seq % STORE_SEGMENTS == slot);
+		uint32_t size = seg_file.size();
+		seg_file.close();
+		if (!valid)
+		{
+			InternalFS.remove(name);
+			continue;
+		}
+		// A record that was not completely written is ignored
+		uint32_t num = (size - sizeof(store_seg_header_s)) / sizeof(store_record_s);
+		seg_num[slot] = num > STORE_SEG_RECORDS ? STORE_SEG_RECORDS : num;
+		if (!found || ((int32_t)(header.seq - read_seq) < 0))
+		{
+			read_seq = header.seq;
+		}
+		if (!found || ((int32_t)(header.seq - write_seq) > 0))
+		{
+			write_seq = header.seq;
+		}
+		found = true;
+	}
+	read_idx = 0;
+	if (!found)
+	{
+		read_seq = 0;
+		write_seq = 0;
+		InternalFS.remove(cursor_name);
+	}
+	else
+	{
+		File cursor_file(InternalFS);
+		store_cursor_s cursor;
+		if (cursor_file.open(cursor_name, FILE_O_READ))
+		{
+			if ((cursor_file.read((void *)&cursor, sizeof(store_cursor_s)) == sizeof(store_cursor_s)) &&
+				(cursor.seq == read_seq) && (cursor.idx <= seg_num[read_seq % STORE_SEGMENTS]))
+			{
+				read_idx = cursor.idx;
+			}
+			cursor_file.close();
+		}
+	}
+	g_store_stats.stored = stored_num();
+	MYLOG("STORE", "%d positions in the log", g_store_stats.stored);
+}
+
+/**
+ * @brief Remember the position of the current packet, it is stored if the uplink fails
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @param altitude mm
+ * @param sat_num number of satellites
+ * @param utc UTC of the fix as Unix time, 0 if unknown
+ */
+void store_log_fix(int32_t latitude, int32_t longitude, int32_t altitude, uint8_t sat_num, uint32_t utc)
+{
+	if ((g_store_share == 0) || g_is_helium)
+	{
+		fix_valid = false;
+		return;
+	}
+	int32_t alt_m = altitude / 1000;
+	fix.utc = utc;
+	fix.lat = latitude;
+	fix.lon = longitude;
+	fix.alt = alt_m > INT16_MAX ? INT16_MAX : (alt_m < INT16_MIN ? INT16_MIN : alt_m);
+	fix.sat_num = sat_num;
+	fix.check = record_check(&fix);
+	fix_valid = true;
+}
+
+/**
+ * @brief Take the position of the current packet
+ *
+ * @param record copy of the position
+ * @return true if the current packet has a position that can be stored
+ */
+bool store_log_take(store_record_s *record)
+{
+	bool valid = fix_valid;
+	*record = fix;
+	fix_valid = false;
+	return valid;
+}
+
+/**
+ * @brief Append a position that could not be delivered to the log
+ * 		If all segments are full, the oldest segment is dropped
+ *
+ * @param record position from store_log_take()
+ */
+void store_log_add(const store_record_s *record)
+{
+	if ((g_store_share == 0) || (record->check != record_check(record)))
+	{
+		return;
+	}
+
+	uint8_t slot = write_seq % STORE_SEGMENTS;
+	if (seg_num[slot] == STORE_SEG_RECORDS)
+	{
+		write_seq++;
+		slot = write_seq % STORE_SEGMENTS;
+		if (write_seq - read_seq >= STORE_SEGMENTS)
+		{
+			// Log is full, the oldest positions are lost
+			g_store_stats.dropped += seg_num[slot] - read_idx;
+			batch_num = 0;
+			batch_damaged = 0;
+			drop_read_segment();
+			cursor_save();
+		}
+	}
+
+	char name[8];
+	seg_file_name(write_seq, name);
+	File seg_file(InternalFS);
+	if (seg_num[slot] == 0)
+	{
+		InternalFS.remove(name);
+		if (!seg_file.open(name, FILE_O_WRITE))
+		{
+			g_store_stats.dropped++;
+			return;
+		}
+		store_seg_header_s header = {STORE_SEG_MARK, 0, write_seq};
+		seg_file.write((const uint8_t *)&header, sizeof(store_seg_header_s));
+	}
+	else if (!seg_file.open(name, FILE_O_WRITE))
+	{
+		g_store_stats.dropped++;
+		return;
+	}
+	// Files opened for writing are appended
+	seg_file.write((const uint8_t *)record, sizeof(store_record_s));
+	seg_file.close();
+	seg_num[slot]++;
+	g_store_stats.logged++;
+	g_store_stats.stored = stored_num();
+	MYLOG("STORE", "Position stored, %d in the log", g_store_stats.stored);
+}
+
+/**
+ * @brief Remove the positions of the last batch from the log
+ *
+ */
+static void commit_batch(void)
+{
+	if (batch_num == 0)
+	{
+		return;
+	}
+	g_store_stats.sent += batch_num - batch_damaged;
+	g_store_stats.dropped += batch_damaged;
+	read_idx += batch_num;
+	batch_num = 0;
+	batch_damaged = 0;
+	if (read_idx >= seg_num[read_seq % STORE_SEGMENTS])
+	{
+		bool last = read_seq == write_seq;
+		drop_read_segment();
+		if (last)
+		{
+			// Log is empty, the next position starts a new segment
+			write_seq = read_seq;
+		}
+	}
+	cursor_save();
+	g_store_stats.stored = stored_num();
+	MYLOG("STORE", "%d positions left in the log", g_store_stats.stored);
+}
+
+/**
+ * @brief A TX cycle was successful, the link is back and draining of the log is started
+ *
+ */
+void store_log_link_ok(void)
+{
+	if (!drain_active)
+	{
+		drain_schedule(STORE_MIN_PAUSE);
+	}
+}
+
+/**
+ * @brief Result of the TX cycle of a batch
+ *
+ * @param success true if the batch was delivered (ACK received for confirmed uplinks)
+ */
+void store_log_batch_result(bool success)
+{
+	if (success)
+	{
+		commit_batch();
+	}
+	else
+	{
+		batch_num = 0;
+		batch_damaged = 0;
+	}
+	// Keep the airtime of the log below the share
+	uint32_t pause = lora_airtime_ms(batch_size) * (100 - g_store_share) / (g_store_share != 0 ? g_store_share : 1);
+	drain_schedule(pause < STORE_MIN_PAUSE ? STORE_MIN_PAUSE : pause);
+}
+
+/**
+ * @brief Encode the next batch
+ * 		Header: number of positions
+ * 		Each position: UTC as Unix time (4 bytes, 0 = unknown), latitude and longitude in 1e-7 degrees (4 bytes each),
+ * 		altitude in m (2 bytes), all values big endian
+ *
+ * @param buffer buffer for the payload, at least lora_max_payload() bytes
+ * @return uint8_t size of the batch, 0 if nothing to send
+ */
+uint8_t store_log_batch(uint8_t *buffer)
+{
+	drain_active = false;
+	batch_num = 0;
+	batch_damaged = 0;
+	batch_size = 0;
+	if ((g_store_share == 0) || (g_store_stats.stored == 0) || g_is_helium)
+	{
+		return 0;
+	}
+	uint8_t max_size = lora_max_payload();
+	uint8_t capacity = max_size > 1 ? (max_size - 1) / STORE_BATCH_RECORD : 0;
+	if (capacity == 0)
+	{
+		// Data rate too low, try again later
+		drain_schedule(STORE_RETRY_MS);
+		return 0;
+	}
+	uint8_t slot = read_seq % STORE_SEGMENTS;
+	while ((read_idx >= seg_num[slot]) && (read_seq != write_seq))
+	{
+		drop_read_segment();
+		cursor_save();
+		slot = read_seq % STORE_SEGMENTS;
+	}
+
+	char name[8];
+	seg_file_name(read_seq, name);
+	File seg_file(InternalFS);
+	if (!seg_file.open(name, FILE_O_READ))
+	{
+		return 0;
+	}
+	seg_file.seek(sizeof(store_seg_header_s) + read_idx * sizeof(store_record_s));
+	uint8_t size = 1;
+	uint8_t count = 0;
+	while ((read_idx + batch_num < seg_num[slot]) && (count < capacity))
+	{
+		store_record_s record;
+		if (seg_file.read((void *)&record, sizeof(store_record_s)) != sizeof(store_record_s))
+		{
+			break;
+		}
+		batch_num++;
+		if (record.check != record_check(&record))
+		{
+			// Removed with the batch, counted as dropped when the batch is committed
+			batch_damaged++;
+			continue;
+		}
+		uint32_t values[3] = {record.utc, (uint32_t)record.lat, (uint32_t)record.lon};
+		for (uint8_t value = 0; value < 3; value++)
+		{
+			for (uint8_t shift = 0; shift < 4; shift++)
+			{
+				buffer[size++] = (uint8_t)(values[value] >> (24 - 8 * shift));
+			}
+		}
+		buffer[size++] = (uint8_t)((uint16_t)record.alt >> 8);
+		buffer[size++] = (uint8_t)record.alt;
+		count++;
+	}
+	seg_file.close();
+	buffer[0] = count;
+	if (count == 0)
+	{
+		// Only damaged records, skip them
+		commit_batch();
+		drain_schedule(STORE_MIN_PAUSE);
+		return 0;
+	}
+	batch_size = size;
+	return size;
+}
+
+/**
+ * @brief Result of queueing the batch
+ *
+ * @param enqueued true if the batch was queued, it is removed from the log after the TX cycle
+ */
+void store_log_batch_sent(bool enqueued)
+{
+	if (enqueued)
+	{
+		drain_active = true;
+	}
+	else
+	{
+		drain_schedule(STORE_RETRY_MS);
+	}
+}
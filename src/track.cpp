@@ -0,0 +1,356 @@
+/**
+ * @file track.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Track recording while moving
+ *        The fixes are simplified with Douglas-Peucker over a sliding window and sent
+ *        as delta encoded batches that fill the max payload of the current data rate
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Number of fixes in the simplification window */
+#define TRACK_WINDOW 32
+/** Max number of simplified points waiting to be sent */
+#define TRACK_MAX_POINTS 48
+/** Size of the batch header (number of points, age, first position) */
+#define TRACK_HEADER_SIZE 11
+/** Size of a delta encoded point */
+#define TRACK_POINT_SIZE 6
+/** Min time without motion before the track is closed in ms */
+#define TRACK_STOP_MS 60000
+
+/** Max deviation of the simplified track in m, 0 = track recording off */
+uint16_t g_track_tolerance = 0;
+
+/** Fix interval while recording a track in s */
+uint16_t g_track_interval = 30;
+
+/** Flag if the position of the current acquisition was added to the track */
+volatile bool g_track_hold = false;
+
+/** Track statistics */
+track_stats_s g_track_stats;
+
+/** A track point */
+struct track_point_s
+{
+	int32_t lat;
+	int32_t lon;
+	uint32_t time; // s since start
+};
+
+/** Fixes not yet simplified, the first is the last simplified point */
+static track_point_s window[TRACK_WINDOW];
+static uint8_t window_num = 0;
+/** Simplified points waiting to be sent */
+static track_point_s points[TRACK_MAX_POINTS];
+static uint8_t points_num = 0;
+/** Number of points in the last batch */
+static uint8_t batch_num = 0;
+/** Flag if a batch should be sent */
+static bool batch_ready = false;
+/** Flag if a track is recorded */
+static bool recording = false;
+
+/**
+ * @brief Number of points that fit into one batch
+ *
+ * @return uint8_t max number of points
+ */
+static uint8_t batch_capacity(void)
+{
+	uint8_t max_size = lora_max_payload();
+	if (max_size < TRACK_HEADER_SIZE)
+	{
+		return 0;
+	}
+	uint8_t capacity = 1 + (max_size - TRACK_HEADER_SIZE) / TRACK_POINT_SIZE;
+	return capacity > TRACK_MAX_POINTS ? TRACK_MAX_POINTS : capacity;
+}
+
+/**
+ * @brief Distance of a point from the line between two points
+ *
+ * @param start start of the line
+ * @param end end of the line
+ * @param point point
+ * @return float distance in m
+ */
+static float line_distance(track_point_s *start, track_point_s *end, track_point_s *point)
+{
+	int64_t line_n, line_e, point_n, point_e;
+	geo_offset_mm(start->lat, start->lon, end->lat, end->lon, &line_n, &line_e);
+	geo_offset_mm(start->lat, start->lon, point->lat, point->lon, &point_n, &point_e);
+	float len = sqrtf((float)line_n * line_n + (float)line_e * line_e);
+	if (len < 1.0f)
+	{
+		return sqrtf((float)point_n * point_n + (float)point_e * point_e) / 1000.0f;
+	}
+	return fabsf((float)line_n * point_e - (float)line_e * point_n) / len / 1000.0f;
+}
+
+/**
+ * @brief Douglas-Peucker over the window, without recursion
+ *
+ * @param keep flags of the points to keep, first and last are always kept
+ * @return uint8_t number of kept points without the first one
+ */
+static uint8_t simplify(bool *keep)
+{
+	uint8_t stack[TRACK_WINDOW][2];
+	uint8_t stack_num = 0;
+	memset(keep, 0, TRACK_WINDOW);
+	keep[0] = true;
+	keep[window_num - 1] = true;
+	stack[stack_num][0] = 0;
+	stack[stack_num][1] = window_num - 1;
+	stack_num++;
+	while (stack_num != 0)
+	{
+		stack_num--;
+		uint8_t first = stack[stack_num][0];
+		uint8_t last = stack[stack_num][1];
+		float max_dist = 0;
+		uint8_t max_idx = 0;
+		for (uint8_t idx = first + 1; idx < last; idx++)
+		{
+			float dist = line_distance(&window[first], &window[last], &window[idx]);
+			if (dist > max_dist)
+			{
+				max_dist = dist;
+				max_idx = idx;
+			}
+		}
+		if (max_dist > g_track_tolerance)
+		{
+			keep[max_idx] = true;
+			stack[stack_num][0] = first;
+			stack[stack_num][1] = max_idx;
+			stack_num++;
+			stack[stack_num][0] = max_idx;
+			stack[stack_num][1] = last;
+			stack_num++;
+		}
+	}
+	uint8_t kept = 0;
+	for (uint8_t idx = 1; idx < window_num; idx++)
+	{
+		kept += keep[idx] ? 1 : 0;
+	}
+	return kept;
+}
+
+/**
+ * @brief Append a point, if batches could not be sent and the points are full the oldest point is dropped
+ *
+ * @param point point to append
+ */
+static void add_point(const track_point_s *point)
+{
+	if (points_num == TRACK_MAX_POINTS)
+	{
+		memmove(&points[0], &points[1], (TRACK_MAX_POINTS - 1) * sizeof(track_point_s));
+		points_num--;
+		g_track_stats.dropped++;
+	}
+	points[points_num++] = *point;
+}
+
+/**
+ * @brief Move the simplified window into the points, the last fix starts the next window
+ *
+ */
+static void commit_window(void)
+{
+	if (window_num < 2)
+	{
+		return;
+	}
+	bool keep[TRACK_WINDOW];
+	simplify(keep);
+	for (uint8_t idx = 1; idx < window_num; idx++)
+	{
+		if (!keep[idx])
+		{
+			continue;
+		}
+		add_point(&window[idx]);
+	}
+	window[0] = window[window_num - 1];
+	window_num = 1;
+}
+
+/**
+ * @brief Check if the device is recording a track
+ *
+ * @return true if track recording is on and the device is moving
+ */
+bool track_moving(void)
+{
+	return recording && (g_track_tolerance != 0);
+}
+
+/**
+ * @brief Add a fix to the track
+ * 		The first fix starts the track. If the device did not move for TRACK_STOP_MS, the track is closed and sent.
+ *
+ * @param latitude 1e-7 degrees
+ * @param longitude 1e-7 degrees
+ * @return true if the fix was added to the track and is sent with a batch
+ * @return false if track recording is not used, the fix is sent as usual
+ */
+bool track_add(int32_t latitude, int32_t longitude)
+{
+	g_track_hold = false;
+	if ((g_track_tolerance == 0) || g_is_helium || (batch_capacity() < 2))
+	{
+		recording = false;
+		return false;
+	}
+	bool moving = !acc_ok || ((millis() - g_last_motion) < TRACK_STOP_MS);
+	track_point_s fix = {latitude, longitude, (uint32_t)(millis() / 1000)};
+	if (!moving && !recording)
+	{
+		if (points_num == 0)
+		{
+			return false;
+		}
+		// Rest of the last track could not be sent yet, the stationary position goes with it
+		add_point(&fix);
+		g_track_stats.fixes++;
+		batch_ready = true;
+		g_track_hold = true;
+		return true;
+	}
+
+	g_track_stats.fixes++;
+	if (!recording)
+	{
+		// Start of a new track
+		recording = true;
+		window_num = 0;
+		add_point(&fix);
+	}
+	window[window_num++] = fix;
+	if (window_num == TRACK_WINDOW)
+	{
+		commit_window();
+	}
+
+	bool keep[TRACK_WINDOW];
+	uint8_t pending = points_num + (window_num > 1 ? simplify(keep) : 0);
+	if (!moving)
+	{
+		// Stopped, send the rest of the track
+		commit_window();
+		recording = false;
+		batch_ready = true;
+	}
+	else if (pending >= batch_capacity())
+	{
+		commit_window();
+		batch_ready = true;
+	}
+	else if ((g_lorawan_settings.send_repeat_time != 0) && ((fix.time - points[0].time) * 1000 >= report_interval()))
+	{
+		// Oldest point waits longer than the report interval, the track fix interval does not count here
+		commit_window();
+		batch_ready = true;
+	}
+	MYLOG("TRACK", "%d points, %d pending, %s", points_num, pending, batch_ready ? "send" : "wait");
+	g_track_hold = true;
+	return true;
+}
+
+/**
+ * @brief Write a big endian value
+ *
+ */
+static void put_value(uint8_t *buffer, uint32_t value, uint8_t size)
+{
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		buffer[idx] = (uint8_t)(value >> (8 * (size - 1 - idx)));
+	}
+}
+
+/**
+ * @brief Encode the next batch if one is ready
+ * 		Header: number of points, age of the first point in s (2 bytes), latitude, longitude of the first point in 1e-7 degrees (4 bytes each)
+ * 		Each following point: latitude and longitude change in 1e-6 degrees (2 bytes each), time since the previous point in s (2 bytes)
+ * 		All values big endian. A change that does not fit into 2 bytes ends the batch.
+ *
+ * @param buffer buffer for the payload, at least lora_max_payload() bytes
+ * @return uint8_t size of the batch, 0 if no batch is ready
+ */
+uint8_t track_batch(uint8_t *buffer)
+{
+	if (!batch_ready || (points_num == 0))
+	{
+		return 0;
+	}
+	uint8_t capacity = batch_capacity();
+	if (capacity == 0)
+	{
+		return 0;
+	}
+	uint32_t now = millis() / 1000;
+	uint32_t age = now - points[0].time;
+	put_value(&buffer[1], age > 0xFFFF ? 0xFFFF : age, 2);
+	put_value(&buffer[3], points[0].lat, 4);
+	put_value(&buffer[7], points[0].lon, 4);
+	uint8_t size = TRACK_HEADER_SIZE;
+
+	// Deltas to the decoded position, rounding errors do not add up
+	int32_t last_lat = points[0].lat;
+	int32_t last_lon = points[0].lon;
+	batch_num = 1;
+	while ((batch_num < points_num) && (batch_num < capacity))
+	{
+		track_point_s *point = &points[batch_num];
+		int32_t d_lat = (point->lat - last_lat + (point->lat >= last_lat ? 5 : -5)) / 10;
+		int32_t d_lon = (point->lon - last_lon + (point->lon >= last_lon ? 5 : -5)) / 10;
+		uint32_t d_time = point->time - points[batch_num - 1].time;
+		if ((d_lat > INT16_MAX) || (d_lat < INT16_MIN) || (d_lon > INT16_MAX) || (d_lon < INT16_MIN) || (d_time > 0xFFFF))
+		{
+			break;
+		}
+		put_value(&buffer[size], (uint16_t)d_lat, 2);
+		put_value(&buffer[size + 2], (uint16_t)d_lon, 2);
+		put_value(&buffer[size + 4], d_time, 2);
+		size += TRACK_POINT_SIZE;
+		last_lat += d_lat * 10;
+		last_lon += d_lon * 10;
+		batch_num++;
+	}
+	buffer[0] = batch_num;
+	return size;
+}
+
+/**
+ * @brief Remove the points of the last batch after it was sent
+ *
+ */
+void track_batch_sent(void)
+{
+	if (batch_num > points_num)
+	{
+		batch_num = points_num;
+	}
+	g_track_stats.batches++;
+	g_track_stats.points += batch_num;
+	memmove(&points[0], &points[batch_num], (points_num - batch_num) * sizeof(track_point_s));
+	points_num -= batch_num;
+	batch_num = 0;
+	// Points that did not fit are sent with the next fix
+	batch_ready = points_num != 0;
+	if ((points_num == 0) && recording && (window_num != 0))
+	{
+		// Next batch starts with the last fix
+		points[points_num++] = window[0];
+	}
+}
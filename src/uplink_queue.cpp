@@ -0,0 +1,382 @@
+/**
+ * @file uplink_queue.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Uplink queue with priorities, deadlines and retries
+ *        Packets wait in a fixed pool until the transceiver is free, only one packet
+ *        is handed to the LoRaWAN stack at a time and the next one is sent after TX finished
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Number of packets in the queue */
+#define UPLINK_QUEUE_SIZE 6
+/** First retry delay after the transceiver was busy in ms, doubled with each retry */
+#define UPLINK_RETRY_MS 2000
+/** Max retry delay in ms */
+#define UPLINK_RETRY_MAX_MS 32000
+/** Max number of retries before a packet is dropped */
+#define UPLINK_MAX_RETRIES 8
+/** Max time from sending until the TX finished event in ms, the transceiver is assumed to be free after that */
+#define UPLINK_TX_TIMEOUT 120000
+
+/** Queue statistics */
+uplink_stats_s g_uplink_stats;
+
+/** A queued packet */
+struct uplink_s
+{
+	uint8_t data[UPLINK_MAX_SIZE];
+	uint8_t size;
+	uint8_t fport;
+	uint8_t priority;
+	uint8_t retries;
+	uint32_t seq;		// order of the packets with the same priority
+	time_t next_try;	// millis() of the next try
+	time_t deadline;	// millis() after which the packet is dropped
+	bool has_fix;		// position is stored in the log if the packet is not delivered
+	store_record_s fix;
+	bool used;
+};
+
+/** Packet pool */
+static uplink_s queue[UPLINK_QUEUE_SIZE];
+/** Sequence number of the next packet */
+static uint32_t next_seq = 0;
+/** Packet waiting for the TX finished event, -1 if the transceiver is free */
+static int8_t in_flight = -1;
+/** Time the packet in flight was sent */
+static time_t in_flight_start = 0;
+
+/** Timer for the next retry */
+static SoftwareTimer retry_timer;
+/** Flag if the timer was initialized */
+static bool timer_init = false;
+
+/**
+ * @brief Timer callback, wake up the loop to send the next packet
+ *
+ */
+static void retry_wakeup(TimerHandle_t unused)
+{
+	api_wake_loop(UPLINK_SEND);
+}
+
+/**
+ * @brief A packet is finished, delivered or not
+ *
+ * @param idx queue index
+ * @param success true if the packet was delivered
+ */
+static void packet_done(uint8_t idx, bool success)
+{
+	uplink_s *packet = &queue[idx];
+	if (success)
+	{
+		g_uplink_stats.delivered++;
+		store_log_link_ok();
+	}
+	else if (packet->has_fix)
+	{
+		// Keep the position for later
+		store_log_add(&packet->fix);
+	}
+	if (packet->fport == POS_FPORT)
+	{
+		pos_codec_tx_result(packet->data[0], success);
+	}
+	else if (packet->fport == STORE_FPORT)
+	{
+		store_log_batch_result(success);
+	}
+	packet->used = false;
+}
+
+/**
+ * @brief Find the packet that is sent next
+ * 		Highest priority first, oldest first within the same priority
+ *
+ * @param now current millis()
+ * @param next_try returns the earliest retry time of the waiting packets
+ * @return int8_t queue index, -1 if no packet can be sent now
+ */
+static int8_t next_packet(time_t now, time_t *next_try)
+{
+	int8_t found = -1;
+	bool waiting = false;
+	for (uint8_t idx = 0; idx < UPLINK_QUEUE_SIZE; idx++)
+	{
+		uplink_s *packet = &queue[idx];
+		if (!packet->used || (idx == in_flight))
+		{
+			continue;
+		}
+		if ((int32_t)(now - packet->deadline) >= 0)
+		{
+			MYLOG("UPQ", "Packet on fPort %d expired", packet->fport);
+			g_uplink_stats.expired++;
+			packet_done(idx, false);
+			continue;
+		}
+		if ((int32_t)(packet->next_try - now) > 0)
+		{
+			if (!waiting || ((int32_t)(packet->next_try - *next_try) < 0))
+			{
+				*next_try = packet->next_try;
+			}
+			waiting = true;
+			continue;
+		}
+		if ((found < 0) || (packet->priority > queue[found].priority) ||
+			((packet->priority == queue[found].priority) && ((int32_t)(packet->seq - queue[found].seq) < 0)))
+		{
+			found = idx;
+		}
+	}
+	if (!waiting)
+	{
+		*next_try = 0;
+	}
+	return found;
+}
+
+/**
+ * @brief Retry a packet later or drop it after too many retries
+ *
+ * @param idx queue index
+ * @param now current millis()
+ */
+static void packet_retry(uint8_t idx, time_t now)
+{
+	uplink_s *packet = &queue[idx];
+	g_uplink_stats.retries++;
+	if (packet->retries >= UPLINK_MAX_RETRIES)
+	{
+		g_uplink_stats.dropped++;
+		packet_done(idx, false);
+		return;
+	}
+	uint32_t delay_ms = UPLINK_RETRY_MS << packet->retries;
+	packet->next_try = now + (delay_ms > UPLINK_RETRY_MAX_MS ? UPLINK_RETRY_MAX_MS : delay_ms);
+	packet->retries++;
+}
+
+/**
+ * @brief Send the next packet if the transceiver is free
+ *
+ */
+void uplink_send(void)
+{
+	time_t now = millis();
+	if (in_flight >= 0)
+	{
+		if ((now - in_flight_start) < UPLINK_TX_TIMEOUT)
+		{
+			// Next packet is sent after TX finished
+			return;
+		}
+		MYLOGE("UPQ", "No TX finished event");
+		g_uplink_stats.failed++;
+		int8_t idx = in_flight;
+		in_flight = -1;
+		packet_done(idx, false);
+	}
+
+	while (true)
+	{
+		time_t next_try = 0;
+		int8_t idx = next_packet(now, &next_try);
+		if (idx < 0)
+		{
+			if (next_try != 0)
+			{
+				// Wake up for the next retry
+				retry_timer.stop();
+				retry_timer.setPeriod((next_try - now) > 0 ? (next_try - now) : 1);
+				retry_timer.start();
+			}
+			return;
+		}
+
+		uplink_s *packet = &queue[idx];
+		uint8_t max_size = lora_max_payload();
+		if (packet->size > max_size)
+		{
+			// Does not fit with the current data rate, sending it again would not help
+			AT_PRINTF("+EVT:SIZE_ERROR\n");
+			MYLOGE("UPQ", "Packet too big, %d bytes, max %d", packet->size, max_size);
+			g_uplink_stats.dropped++;
+			packet_done(idx, false);
+			continue;
+		}
+
+		bool sent = false;
+		bool busy = true;
+		if (g_lorawan_settings.lorawan_enable)
+		{
+			lmh_error_status result = send_lora_packet(packet->data, packet->size, packet->fport);
+			sent = result == LMH_SUCCESS;
+			if (result == LMH_BUSY)
+			{
+				AT_PRINTF("+EVT:BUSY\n");
+				MYLOGE("UPQ", "LoRa transceiver is busy");
+			}
+			else if (result == LMH_ERROR)
+			{
+				// Payload and pending MAC commands did not fit, try later, other packets may fit
+				MYLOGE("UPQ", "Packet error");
+				busy = false;
+			}
+		}
+		else
+		{
+			sent = send_p2p_packet(packet->data, packet->size);
+		}
+
+		if (sent)
+		{
+			MYLOG("UPQ", "Packet on fPort %d enqueued", packet->fport);
+			g_uplink_stats.sent++;
+			in_flight = idx;
+			in_flight_start = now;
+			// Wake up if the TX finished event does not come
+			retry_timer.stop();
+			retry_timer.setPeriod(UPLINK_TX_TIMEOUT + 100);
+			retry_timer.start();
+			return;
+		}
+		packet_retry(idx, now);
+		if (busy && packet->used)
+		{
+			// No other packet can be sent now, try again with the retry of this packet
+			retry_timer.stop();
+			retry_timer.setPeriod(packet->next_try - now);
+			retry_timer.start();
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Add a packet to the queue and send it if the transceiver is free
+ * 		If the queue is full, the oldest packet with the lowest priority is dropped
+ * 		if its priority is lower than the priority of the new packet
+ *
+ * @param data payload
+ * @param size payload size
+ * @param fport fPort, ignored in LoRa P2P mode
+ * @param priority UPLINK_PRIO_LOW, UPLINK_PRIO_NORMAL or UPLINK_PRIO_HIGH
+ * @param max_age time in ms after which the packet is dropped if it could not be sent
+ * @param fix position that is stored in the log if the packet is not delivered, NULL if none
+ * @return true if the packet was queued
+ * @return false if the queue is full with packets of the same or higher priority
+ */
+bool uplink_enqueue(uint8_t *data, uint8_t size, uint8_t fport, uint8_t priority, uint32_t max_age, store_record_s *fix)
+{
+	if (!timer_init)
+	{
+		retry_timer.begin(UPLINK_RETRY_MS, retry_wakeup, NULL, false);
+		timer_init = true;
+	}
+	if (size > UPLINK_MAX_SIZE)
+	{
+		g_uplink_stats.dropped++;
+		return false;
+	}
+
+	int8_t slot = -1;
+	int8_t victim = -1;
+	for (uint8_t idx = 0; idx < UPLINK_QUEUE_SIZE; idx++)
+	{
+		if (!queue[idx].used)
+		{
+			slot = idx;
+			break;
+		}
+		if ((idx != in_flight) && (queue[idx].priority < priority) &&
+			((victim < 0) || (queue[idx].priority < queue[victim].priority) ||
+			 ((queue[idx].priority == queue[victim].priority) && ((int32_t)(queue[idx].seq - queue[victim].seq) < 0))))
+		{
+			victim = idx;
+		}
+	}
+	if (slot < 0)
+	{
+		if (victim < 0)
+		{
+			MYLOGE("UPQ", "Queue full");
+			g_uplink_stats.dropped++;
+			if (fix != NULL)
+			{
+				store_log_add(fix);
+			}
+			return false;
+		}
+		MYLOG("UPQ", "Queue full, packet on fPort %d dropped", queue[victim].fport);
+		g_uplink_stats.dropped++;
+		packet_done(victim, false);
+		slot = victim;
+	}
+
+	uplink_s *packet = &queue[slot];
+	memcpy(packet->data, data, size);
+	packet->size = size;
+	packet->fport = fport;
+	packet->priority = priority;
+	packet->retries = 0;
+	packet->seq = next_seq++;
+	packet->next_try = millis();
+	packet->deadline = packet->next_try + max_age;
+	packet->has_fix = fix != NULL;
+	if (fix != NULL)
+	{
+		packet->fix = *fix;
+	}
+	packet->used = true;
+	g_uplink_stats.queued++;
+
+	uplink_send();
+	return true;
+}
+
+/**
+ * @brief TX finished, the result of the packet in flight is known and the next packet is sent
+ *
+ * @param success true if the TX cycle was successful (ACK received for confirmed uplinks)
+ */
+void uplink_tx_finished(bool success)
+{
+	if (in_flight >= 0)
+	{
+		int8_t idx = in_flight;
+		in_flight = -1;
+		retry_timer.stop();
+		if (!success)
+		{
+			g_uplink_stats.failed++;
+		}
+		packet_done(idx, success);
+	}
+	else if (success)
+	{
+		store_log_link_ok();
+	}
+	uplink_send();
+}
+
+/**
+ * @brief Number of packets in the queue
+ *
+ */
+uint8_t uplink_pending(void)
+{
+	uint8_t num = 0;
+	for (uint8_t idx = 0; idx < UPLINK_QUEUE_SIZE; idx++)
+	{
+		num += queue[idx].used ? 1 : 0;
+	}
+	return num;
+}
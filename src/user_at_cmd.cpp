@@ -26,6 +26,39 @@ static const char submit_acc[] = "ACC";
 /** Filename to save data format setting */
 static const char helium_format[] = "HELIUM";
 
+/** Filename to save GNSS power strategy setting */
+static const char gnss_pwr_name[] = "GPWR";
+
+/** Filename to save GNSS averaging target */
+static const char gnss_avg_name[] = "GAVG";
+
+/** Filename to save disabled position filter */
+static const char gnss_filt_name[] = "GFILT";
+
+/** Filename to save the send-on-distance setting */
+static const char gnss_dist_name[] = "GDIST";
+
+/** Filename to save the geofence mode */
+static const char fence_mode_name[] = "GFMODE";
+
+/** Filename to save the track recording setting */
+static const char track_name[] = "TRACK";
+
+/** Filename to save the compact position format setting */
+static const char compact_name[] = "GCOMP";
+
+/** Filename to save the packed format setting */
+static const char packed_name[] = "GPACK";
+
+/** Filename to save the store-and-forward log setting */
+static const char store_name[] = "SLOG";
+
+/** Filename to save the motion classifier settings */
+static const char motion_file_name[] = "MOTION";
+
+/** Filename to save the stationary detection setting */
+static const char still_name[] = "STILL";
+
 /** Filename to save Battery check setting */
 static const char batt_name[] = "BATT";
 
@@ -107,9 +140,20 @@ static int at_query_gnss()
 	{
 		snprintf(g_at_query_buf, ATQUERY_SIZE, "GPS precision: 2");
 	}
+	else if (g_gps_compact)
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "GPS precision: 3 Keyframes %ld Deltas %ld Bytes %ld",
+				 (long)g_pos_codec_stats.keyframes, (long)g_pos_codec_stats.deltas, (long)g_pos_codec_stats.bytes);
+	}
+	else if (g_gps_packed)
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "GPS precision: 4 Packets %ld Bytes %ld",
+				 (long)g_payload_stats.packets, (long)g_payload_stats.bytes);
+	}
 	else
 	{
-		snprintf(g_at_query_buf, ATQUERY_SIZE, "GPS precision: %d", g_gps_prec_6 ? 1 : 0);
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "GPS precision: %d Deferred %ld Dropped %ld", g_gps_prec_6 ? 1 : 0,
+				 (long)g_payload_stats.deferred, (long)g_payload_stats.dropped);
 	}
 	return 0;
 }
@@ -117,10 +161,12 @@ static int at_query_gnss()
 /**
  * @brief Command to set the GNSS precision
  *
- * @param str Either '0' or '1' or '2'
+ * @param str Either '0' or '1' or '2' or '3' or '4'
  *  '0' sets the precission to 4 digits
  *  '1' sets the precission to 6 digits
  *  '2' sets the dataformat to Helium Mapper
+ *  '3' sets the compact position format
+ *  '4' sets the packed format
  * @return int 0 if the command was succesfull, 5 if the parameter was wrong
  */
 static int at_exec_gnss(char *str)
@@ -129,17 +175,40 @@ static int at_exec_gnss(char *str)
 	{
 		g_is_helium = false;
 		g_gps_prec_6 = false;
+		g_gps_compact = false;
+		g_gps_packed = false;
 		save_gps_settings();
 	}
 	else if (str[0] == '1')
 	{
 		g_is_helium = false;
 		g_gps_prec_6 = true;
+		g_gps_compact = false;
+		g_gps_packed = false;
 		save_gps_settings();
 	}
 	else if (str[0] == '2')
 	{
 		g_is_helium = true;
+		g_gps_compact = false;
+		g_gps_packed = false;
+		save_gps_settings();
+	}
+	else if (str[0] == '3')
+	{
+		g_is_helium = false;
+		g_gps_prec_6 = true;
+		g_gps_compact = true;
+		g_gps_packed = false;
+		pos_codec_reset();
+		save_gps_settings();
+	}
+	else if (str[0] == '4')
+	{
+		g_is_helium = false;
+		g_gps_prec_6 = true;
+		g_gps_compact = false;
+		g_gps_packed = true;
 		save_gps_settings();
 	}
 	else
@@ -239,6 +308,628 @@ static int at_exec_gnss_prec(char *str)
 	return 0;
 }
 
+/**
+ * @brief Returns in g_at_query_buf the bus time statistics of the GNSS acquisition
+ *
+ * @return int always 0
+ */
+static int at_query_gnss_stat()
+{
+	uint32_t avg_us = 0;
+	uint32_t avg_polls = 0;
+	if (g_gnss_bus_stats.epochs != 0)
+	{
+		avg_us = g_gnss_bus_stats.bus_us_total / g_gnss_bus_stats.epochs;
+		avg_polls = g_gnss_bus_stats.polls / g_gnss_bus_stats.epochs;
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Epochs %ld Bus/epoch avg %ldus last %ldus Polls/epoch avg %ld last %ld",
+			 (long)g_gnss_bus_stats.epochs, (long)avg_us, (long)g_gnss_bus_stats.bus_us_last,
+			 (long)avg_polls, (long)g_gnss_bus_stats.polls_last);
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the GNSS power strategy and the measured TTFF
+ *
+ * @return int always 0
+ */
+static int at_query_gnss_pwr()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Mode %d Next %d TTFF backup %ldms standby %ldms expired %ldms",
+			 g_gnss_pwr_mode, gnss_select_power_mode(next_acq_interval()), (long)g_ttff_avg[GNSS_PWR_BACKUP],
+			 (long)g_ttff_avg[GNSS_PWR_STANDBY], (long)g_ttff_avg[GNSS_PWR_OFF]);
+	return 0;
+}
+
+/**
+ * @brief Command to set the GNSS power strategy between acquisitions
+ *
+ * @param str '0' to '2'
+ *  '0' select automatically from send interval and TTFF
+ *  '1' cut main supply, V_BCKP stays on
+ *  '2' software backup/standby mode of the module
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_gnss_pwr(char *str)
+{
+	if ((str[0] < '0') || (str[0] > '2') || (str[1] != 0))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_gnss_pwr_mode = str[0] - '0';
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Print the TTFF histogram of the recent acquisitions
+ * 		One line per start type, each bin shows fix/no fix counts
+ *
+ * @return int always 0
+ */
+static int at_query_ttff()
+{
+	const char *start_names[] = {"all", "backup", "standby", "expired"};
+	uint8_t fix_bins[TTFF_BIN_NUM];
+	uint8_t nofix_bins[TTFF_BIN_NUM];
+
+	AT_PRINTF("Timeout %lds\n", (long)(g_gnss_timeout / 1000));
+	AT_PRINTF("Bins <=s:");
+	for (uint8_t bin = 0; bin < TTFF_BIN_NUM - 1; bin++)
+	{
+		AT_PRINTF(" %d", gnss_ttff_bin_limit(bin));
+	}
+	AT_PRINTF(" >%d\n", gnss_ttff_bin_limit(TTFF_BIN_NUM - 2));
+	for (uint8_t start_type = GNSS_PWR_BACKUP; start_type <= GNSS_PWR_OFF + 1; start_type++)
+	{
+		// Last line shows all start types
+		uint8_t filter = start_type > GNSS_PWR_OFF ? 0xFF : start_type;
+		gnss_ttff_histogram(fix_bins, nofix_bins, filter);
+		AT_PRINTF("%s:", start_names[filter == 0xFF ? 0 : filter]);
+		for (uint8_t bin = 0; bin < TTFF_BIN_NUM; bin++)
+		{
+			AT_PRINTF(" %d/%d", fix_bins[bin], nofix_bins[bin]);
+		}
+		AT_PRINTF("\n");
+	}
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the TTFF with and without aiding
+ *
+ * @return int always 0
+ */
+static int at_query_gnss_aid()
+{
+	uint32_t aided_avg = 0;
+	uint32_t unaided_avg = 0;
+	if (g_gnss_aid_stats.aided_fixes != 0)
+	{
+		aided_avg = g_gnss_aid_stats.aided_ms / g_gnss_aid_stats.aided_fixes;
+	}
+	if (g_gnss_aid_stats.unaided_fixes != 0)
+	{
+		unaided_avg = g_gnss_aid_stats.unaided_ms / g_gnss_aid_stats.unaided_fixes;
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Aided %ld fixes avg %ldms Unaided %ld fixes avg %ldms",
+			 (long)g_gnss_aid_stats.aided_fixes, (long)aided_avg, (long)g_gnss_aid_stats.unaided_fixes, (long)unaided_avg);
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the averaging target and the result of the last averaging
+ *
+ * @return int always 0
+ */
+static int at_query_gnss_avg()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Target %dcm Last %d fixes %d rejected error %ldmm in %ldms",
+			 g_gnss_avg_target, g_gnss_avg_stats.samples, g_gnss_avg_stats.rejected,
+			 (long)g_gnss_avg_stats.error_mm, (long)g_gnss_avg_stats.window_ms);
+	return 0;
+}
+
+/**
+ * @brief Command to set the target error of the stationary averaging
+ *
+ * @param str target error in cm, 0 = averaging off
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_gnss_avg(char *str)
+{
+	for (uint8_t idx = 0; str[idx] != 0; idx++)
+	{
+		if ((str[idx] < '0') || (str[idx] > '9'))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+	}
+	long target = strtol(str, NULL, 10);
+	if ((str[0] == 0) || (target > 10000))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_gnss_avg_target = target;
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the position filter status with raw and filtered position of the last fix
+ *
+ * @return int always 0
+ */
+static int at_query_gnss_filter()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d Raw %.6f %.6f Filt %.6f %.6f Err %ldmm %s Rejected %ld",
+			 g_gnss_filter ? 1 : 0,
+			 g_gnss_filter_stats.raw_lat / 10000000.0, g_gnss_filter_stats.raw_lon / 10000000.0,
+			 g_gnss_filter_stats.filt_lat / 10000000.0, g_gnss_filter_stats.filt_lon / 10000000.0,
+			 (long)g_gnss_filter_stats.sigma_mm, g_gnss_filter_stats.accepted ? "accepted" : "rejected",
+			 (long)g_gnss_filter_stats.rejected);
+	return 0;
+}
+
+/**
+ * @brief Command to enable or disable the position filter
+ *
+ * @param str '0' raw positions, '1' filtered positions
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_gnss_filter(char *str)
+{
+	if ((str[0] < '0') || (str[0] > '1') || (str[1] != 0))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_gnss_filter = str[0] == '1';
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the send-on-distance setting and the result of the last check
+ *
+ * @return int always 0
+ */
+static int at_query_gnss_dist()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%d Last %ldm Suppressed %ld",
+			 g_gnss_min_dist, g_gnss_dist_heartbeat ? 1 : 0,
+			 (long)g_gnss_dist_stats.last_dist, (long)g_gnss_dist_stats.suppressed);
+	return 0;
+}
+
+/**
+ * @brief Command to set the send-on-distance
+ *
+ * @param str <min distance in m>:<mode> mode 0 = skip the uplink, 1 = send a heartbeat without position
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_gnss_dist(char *str)
+{
+	char *end;
+	long min_dist = strtol(str, &end, 10);
+	if ((end == str) || (min_dist < 0) || (min_dist > 10000))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	bool heartbeat = false;
+	if (end[0] == ':')
+	{
+		if ((end[1] < '0') || (end[1] > '1') || (end[2] != 0))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		heartbeat = end[1] == '1';
+	}
+	else if (end[0] != 0)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_gnss_min_dist = min_dist;
+	g_gnss_dist_heartbeat = heartbeat;
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Print all geofences
+ *
+ * @return int always 0
+ */
+static int at_query_fence()
+{
+	for (uint8_t idx = 0; idx < GEOFENCE_MAX; idx++)
+	{
+		const geofence_s *fence = geofence_get(idx);
+		bool inside = (g_geofence_stats.inside & (1 << idx)) != 0;
+		bool known = (g_geofence_stats.known & (1 << idx)) != 0;
+		switch (fence->type)
+		{
+		case GEOFENCE_CIRCLE:
+			AT_PRINTF("%d C %.6f %.6f %ldm %s\n", idx, fence->lat[0] / 10000000.0, fence->lon[0] / 10000000.0,
+					  (long)fence->radius, known ? (inside ? "inside" : "outside") : "unknown");
+			break;
+		case GEOFENCE_POLYGON:
+		case GEOFENCE_PARTIAL:
+			AT_PRINTF("%d P %d points %s\n", idx, fence->num_points,
+					  fence->type == GEOFENCE_PARTIAL ? "incomplete" : (known ? (inside ? "inside" : "outside") : "unknown"));
+			for (uint8_t point = 0; point < fence->num_points; point++)
+			{
+				AT_PRINTF("  %.6f %.6f\n", fence->lat[point] / 10000000.0, fence->lon[point] / 10000000.0);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Parse a coordinate in degrees
+ *
+ * @param str string with the coordinate, on return points behind the coordinate
+ * @param max max absolute value in degrees
+ * @param value coordinate in 1e-7 degrees
+ * @return true if the coordinate is valid
+ */
+static bool parse_coord(char **str, double max, int32_t *value)
+{
+	char *end;
+	double degrees = strtod(*str, &end);
+	if ((end == *str) || (degrees > max) || (degrees < -max))
+	{
+		return false;
+	}
+	*value = (int32_t)lround(degrees * 10000000.0);
+	*str = end;
+	return true;
+}
+
+/**
+ * @brief Command to set or delete a geofence
+ *
+ * @param str <fence>:C:<lat>:<lon>:<radius> circle
+ * 			<fence>:P:<lat>:<lon>:<lat>:<lon>... polygon
+ * 			<fence>:A:<lat>:<lon>... add points to a polygon
+ * 			<fence>:D delete
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_fence(char *str)
+{
+	if ((str[0] < '0') || (str[0] >= '0' + GEOFENCE_MAX) || (str[1] != ':') || (str[2] == 0))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	uint8_t idx = str[0] - '0';
+	char type = toupper(str[2]);
+	char *param = &str[3];
+
+	if (type == 'D')
+	{
+		if (param[0] != 0)
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		geofence_delete(idx);
+		return 0;
+	}
+
+	int32_t latitude[GEOFENCE_MAX_POINTS];
+	int32_t longitude[GEOFENCE_MAX_POINTS];
+	uint8_t num = 0;
+	while ((param[0] == ':') && (num < GEOFENCE_MAX_POINTS))
+	{
+		param++;
+		if (!parse_coord(&param, 90.0, &latitude[num]) || (param[0] != ':'))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		param++;
+		if (!parse_coord(&param, 180.0, &longitude[num]))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		num++;
+		if ((type == 'C') && (param[0] == ':'))
+		{
+			break;
+		}
+	}
+
+	bool result = false;
+	if (type == 'C')
+	{
+		char *end;
+		long radius = (param[0] == ':') ? strtol(&param[1], &end, 10) : 0;
+		if ((num == 1) && (radius > 0) && (end[0] == 0))
+		{
+			result = geofence_set_circle(idx, latitude[0], longitude[0], radius);
+		}
+	}
+	else if ((type == 'P') || (type == 'A'))
+	{
+		if (param[0] == 0)
+		{
+			result = geofence_set_polygon(idx, latitude, longitude, num, type == 'A');
+		}
+	}
+	return result ? 0 : AT_ERRNO_PARA_VAL;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the geofence mode, burst interval and fence state
+ *
+ * @return int always 0
+ */
+static int at_query_fence_mode()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%d Inside %02X Transitions %ld",
+			 g_geofence_mode, g_geofence_burst, g_geofence_stats.inside, (long)g_geofence_stats.transitions);
+	return 0;
+}
+
+/**
+ * @brief Command to set the geofence mode
+ *
+ * @param str <mode>[:<burst interval in s>] mode 0 = off, 1 = transitions + periodic inside + burst outside, 2 = transitions only
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_fence_mode(char *str)
+{
+	if ((str[0] < '0') || (str[0] > '0' + GEOFENCE_TRANSITION))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	long burst = 0;
+	if (str[1] == ':')
+	{
+		char *end;
+		burst = strtol(&str[2], &end, 10);
+		if ((end == &str[2]) || (end[0] != 0) || (burst < 0) || (burst > 65535))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+	}
+	else if (str[1] != 0)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_geofence_mode = str[0] - '0';
+	g_geofence_burst = burst;
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the track setting and statistics
+ *
+ * @return int always 0
+ */
+static int at_query_track()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%d Fixes %ld Points %ld Batches %ld Dropped %ld",
+			 g_track_tolerance, g_track_interval, (long)g_track_stats.fixes, (long)g_track_stats.points,
+			 (long)g_track_stats.batches, (long)g_track_stats.dropped);
+	return 0;
+}
+
+/**
+ * @brief Command to set the track recording
+ *
+ * @param str <tolerance in m>:<fix interval in s> tolerance 0 = track recording off
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_track(char *str)
+{
+	char *end;
+	long tolerance = strtol(str, &end, 10);
+	if ((end == str) || (tolerance < 0) || (tolerance > 1000))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	long interval = g_track_interval;
+	if (end[0] == ':')
+	{
+		char *param = &end[1];
+		interval = strtol(param, &end, 10);
+		if ((end == param) || (interval < 5) || (interval > 3600))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+	}
+	if (end[0] != 0)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_track_tolerance = tolerance;
+	g_track_interval = interval;
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the motion classifier settings, state and statistics
+ *
+ * @return int always 0
+ */
+static int at_query_motion()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d State %s Std %d Jerk %d Windows %ld Changes %ld 0:%d:%d 1:%d:%d 2:%d:%d 3:%d:%d",
+			 g_motion_enable ? 1 : 0, motion_name(g_motion_state), g_motion_stats.std_mg, g_motion_stats.jerk_mg,
+			 (long)g_motion_stats.windows, (long)g_motion_stats.changes,
+			 g_motion_cfg[0].interval, g_motion_cfg[0].profile, g_motion_cfg[1].interval, g_motion_cfg[1].profile,
+			 g_motion_cfg[2].interval, g_motion_cfg[2].profile, g_motion_cfg[3].interval, g_motion_cfg[3].profile);
+	return 0;
+}
+
+/**
+ * @brief Command to set the motion classifier
+ *
+ * @param str '0' or '1' to disable or enable the classifier
+ * 	or <state>:<interval>:<profile> to set the send interval in seconds (10 to 65535) and the GNSS profile of a motion state
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_motion(char *str)
+{
+	char *end;
+	long value = strtol(str, &end, 10);
+	if (end == str)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	if (end[0] == 0)
+	{
+		if ((value != 0) && (value != 1))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		motion_set(value == 1);
+		save_gps_settings();
+		return 0;
+	}
+
+	if ((end[0] != ':') || (value < 0) || (value >= MOTION_STATE_NUM))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	char *param = &end[1];
+	long interval = strtol(param, &end, 10);
+	if ((end == param) || (end[0] != ':') || (interval < 10) || (interval > 65535))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	param = &end[1];
+	long profile = strtol(param, &end, 10);
+	if ((end == param) || (end[0] != 0) || (profile < 0) || (profile >= GNSS_PROFILE_NUM))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_motion_cfg[value].interval = interval;
+	g_motion_cfg[value].profile = profile;
+	if (g_motion_enable && (value == g_motion_state))
+	{
+		gnss_profile_use(profile);
+	}
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the stationary detection setting and state
+ *
+ * @return int always 0
+ */
+static int at_query_still()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d %s", g_still_time, acc_still() ? "stationary" : "moving");
+	return 0;
+}
+
+/**
+ * @brief Command to set the stationary detection
+ *
+ * @param str time in seconds without movement before the periodic sending stops (1 to 204), 0 = off
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_still(char *str)
+{
+	char *end;
+	long seconds = strtol(str, &end, 10);
+	if ((end == str) || (end[0] != 0) || (seconds < 0) || (seconds > ACC_STILL_MAX))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	acc_still_set(seconds);
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the store-and-forward setting and statistics
+ *
+ * @return int always 0
+ */
+static int at_query_store()
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d Stored %d Logged %ld Sent %ld Dropped %ld",
+			 g_store_share, g_store_stats.stored, (long)g_store_stats.logged, (long)g_store_stats.sent,
+			 (long)g_store_stats.dropped);
+	return 0;
+}
+
+/**
+ * @brief Command to set the store-and-forward log
+ *
+ * @param str share of the airtime in percent for sending stored positions, 0 = log off
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_store(char *str)
+{
+	char *end;
+	long share = strtol(str, &end, 10);
+	if ((end == str) || (end[0] != 0) || (share < 0) || (share > 100))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_store_share = share;
+	save_gps_settings();
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the uplink queue statistics
+ *
+ * @return int always 0
+ */
+static int at_query_uplink()
+{
+	uint32_t rate = g_uplink_stats.queued != 0 ? g_uplink_stats.delivered * 100 / g_uplink_stats.queued : 0;
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Pending %d Queued %ld Sent %ld Delivered %ld (%ld%%) Failed %ld Expired %ld Dropped %ld Retries %ld",
+			 uplink_pending(), (long)g_uplink_stats.queued, (long)g_uplink_stats.sent, (long)g_uplink_stats.delivered, (long)rate,
+			 (long)g_uplink_stats.failed, (long)g_uplink_stats.expired, (long)g_uplink_stats.dropped, (long)g_uplink_stats.retries);
+	return 0;
+}
+
+/**
+ * @brief Print the selected GNSS profile and the statistics of all profiles
+ *
+ * @return int always 0
+ */
+static int at_query_gnss_profile()
+{
+	AT_PRINTF("Profile %d %s\n", g_gnss_profile, gnss_profile_name_get(g_gnss_profile));
+	for (uint8_t profile = 0; profile < GNSS_PROFILE_NUM; profile++)
+	{
+		gnss_profile_stats_s *stats = &g_gnss_profile_stats[profile];
+		uint32_t avg_ms = stats->fixes != 0 ? stats->fix_ms / stats->fixes : 0;
+		uint32_t acq_num = stats->fixes + stats->no_fixes;
+		uint32_t mas_per_acq = acq_num != 0 ? stats->charge_mas / acq_num : 0;
+		AT_PRINTF("%d %s: fix %ld nofix %ld TTFF %ldms %ldmAs/acq\n", profile, gnss_profile_name_get(profile),
+				  (long)stats->fixes, (long)stats->no_fixes, (long)avg_ms, (long)mas_per_acq);
+	}
+	return 0;
+}
+
+/**
+ * @brief Command to select the GNSS profile
+ *
+ * @param str '0' low power, '1' fast TTFF, '2' high accuracy
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_gnss_profile(char *str)
+{
+	if ((str[0] < '0') || (str[0] >= '0' + GNSS_PROFILE_NUM) || (str[1] != 0))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	gnss_profile_set(str[0] - '0');
+	return 0;
+}
+
 /**
  * @brief Read saved setting for precision and packet format
  *
@@ -285,6 +976,100 @@ void read_gps_settings(void)
 		g_loc_high_prec = true;
 		// MYLOG("USR_AT", "File not found, set high location acquistion precision");
 	}
+	g_gnss_pwr_mode = GNSS_PWR_AUTO;
+	if (InternalFS.exists(gnss_pwr_name))
+	{
+		char pwr_mode = '0';
+		gps_file.open(gnss_pwr_name, FILE_O_READ);
+		gps_file.read(&pwr_mode, 1);
+		gps_file.close();
+		if ((pwr_mode >= '0') && (pwr_mode <= '2'))
+		{
+			g_gnss_pwr_mode = pwr_mode - '0';
+		}
+		else if (pwr_mode == '3')
+		{
+			// Former full power off, the module keeps V_BCKP anyway
+			g_gnss_pwr_mode = GNSS_PWR_BACKUP;
+		}
+	}
+	g_gnss_filter = !InternalFS.exists(gnss_filt_name);
+	g_gnss_avg_target = 0;
+	if (InternalFS.exists(gnss_avg_name))
+	{
+		gps_file.open(gnss_avg_name, FILE_O_READ);
+		gps_file.read(&g_gnss_avg_target, sizeof(uint16_t));
+		gps_file.close();
+	}
+	g_gnss_min_dist = 0;
+	g_gnss_dist_heartbeat = false;
+	if (InternalFS.exists(gnss_dist_name))
+	{
+		uint8_t dist_setting[3] = {0};
+		gps_file.open(gnss_dist_name, FILE_O_READ);
+		gps_file.read(dist_setting, 3);
+		gps_file.close();
+		g_gnss_min_dist = dist_setting[0] | (dist_setting[1] << 8);
+		g_gnss_dist_heartbeat = dist_setting[2] == 1;
+	}
+	g_geofence_mode = GEOFENCE_OFF;
+	g_geofence_burst = 0;
+	if (InternalFS.exists(fence_mode_name))
+	{
+		uint8_t fence_setting[3] = {0};
+		gps_file.open(fence_mode_name, FILE_O_READ);
+		gps_file.read(fence_setting, 3);
+		gps_file.close();
+		g_geofence_mode = fence_setting[0] <= GEOFENCE_TRANSITION ? fence_setting[0] : GEOFENCE_OFF;
+		g_geofence_burst = fence_setting[1] | (fence_setting[2] << 8);
+	}
+	geofence_load();
+	g_gps_compact = !g_is_helium && InternalFS.exists(compact_name);
+	g_gps_packed = !g_is_helium && !g_gps_compact && InternalFS.exists(packed_name);
+	g_track_tolerance = 0;
+	g_track_interval = 30;
+	if (InternalFS.exists(track_name))
+	{
+		uint16_t track_setting[2] = {0, 30};
+		gps_file.open(track_name, FILE_O_READ);
+		gps_file.read(track_setting, 2 * sizeof(uint16_t));
+		gps_file.close();
+		g_track_tolerance = track_setting[0];
+		g_track_interval = track_setting[1] < 5 ? 5 : track_setting[1];
+	}
+	g_store_share = 0;
+	if (InternalFS.exists(store_name))
+	{
+		gps_file.open(store_name, FILE_O_READ);
+		gps_file.read(&g_store_share, 1);
+		gps_file.close();
+		g_store_share = g_store_share > 100 ? 100 : g_store_share;
+	}
+	store_log_load();
+	g_still_time = 0;
+	if (InternalFS.exists(still_name))
+	{
+		gps_file.open(still_name, FILE_O_READ);
+		gps_file.read(&g_still_time, 1);
+		gps_file.close();
+		g_still_time = g_still_time > ACC_STILL_MAX ? ACC_STILL_MAX : g_still_time;
+	}
+	if (InternalFS.exists(motion_file_name))
+	{
+		uint8_t motion_setting[1 + 3 * MOTION_STATE_NUM];
+		gps_file.open(motion_file_name, FILE_O_READ);
+		if (gps_file.read(motion_setting, sizeof(motion_setting)) == sizeof(motion_setting))
+		{
+			g_motion_enable = motion_setting[0] == 1;
+			for (uint8_t state = 0; state < MOTION_STATE_NUM; state++)
+			{
+				uint16_t interval = motion_setting[1 + 3 * state] | (motion_setting[2 + 3 * state] << 8);
+				g_motion_cfg[state].interval = interval < 10 ? 10 : interval;
+				g_motion_cfg[state].profile = motion_setting[3 + 3 * state] < GNSS_PROFILE_NUM ? motion_setting[3 + 3 * state] : GNSS_PROFILE_DEFAULT;
+			}
+		}
+		gps_file.close();
+	}
 }
 
 /**
@@ -343,6 +1128,112 @@ void save_gps_settings(void)
 		gps_file.close();
 		// MYLOG("USR_AT", "Created File for high location precision");
 	}
+	// Save GNSS power strategy, no file means automatic selection
+	InternalFS.remove(gnss_pwr_name);
+	if (g_gnss_pwr_mode != GNSS_PWR_AUTO)
+	{
+		char pwr_mode = '0' + g_gnss_pwr_mode;
+		gps_file.open(gnss_pwr_name, FILE_O_WRITE);
+		gps_file.write(&pwr_mode, 1);
+		gps_file.close();
+	}
+	// Save position filter setting, no file means filter is on
+	if (g_gnss_filter)
+	{
+		InternalFS.remove(gnss_filt_name);
+	}
+	else
+	{
+		gps_file.open(gnss_filt_name, FILE_O_WRITE);
+		gps_file.write("1");
+		gps_file.close();
+	}
+	// Save GNSS averaging target, no file means averaging is off
+	InternalFS.remove(gnss_avg_name);
+	if (g_gnss_avg_target != 0)
+	{
+		gps_file.open(gnss_avg_name, FILE_O_WRITE);
+		gps_file.write((const uint8_t *)&g_gnss_avg_target, sizeof(uint16_t));
+		gps_file.close();
+	}
+	// Save send-on-distance, no file means every position is sent
+	InternalFS.remove(gnss_dist_name);
+	if (g_gnss_min_dist != 0)
+	{
+		uint8_t dist_setting[3] = {(uint8_t)(g_gnss_min_dist & 0xFF), (uint8_t)(g_gnss_min_dist >> 8), (uint8_t)(g_gnss_dist_heartbeat ? 1 : 0)};
+		gps_file.open(gnss_dist_name, FILE_O_WRITE);
+		gps_file.write(dist_setting, 3);
+		gps_file.close();
+	}
+	// Save geofence mode, no file means fences are not used
+	InternalFS.remove(fence_mode_name);
+	if (g_geofence_mode != GEOFENCE_OFF)
+	{
+		uint8_t fence_setting[3] = {g_geofence_mode, (uint8_t)(g_geofence_burst & 0xFF), (uint8_t)(g_geofence_burst >> 8)};
+		gps_file.open(fence_mode_name, FILE_O_WRITE);
+		gps_file.write(fence_setting, 3);
+		gps_file.close();
+	}
+	// Save compact position format, no file means LPP position
+	if (g_gps_compact)
+	{
+		gps_file.open(compact_name, FILE_O_WRITE);
+		gps_file.write("1");
+		gps_file.close();
+	}
+	else
+	{
+		InternalFS.remove(compact_name);
+	}
+	// Save packed format, no file means LPP data
+	if (g_gps_packed)
+	{
+		gps_file.open(packed_name, FILE_O_WRITE);
+		gps_file.write("1");
+		gps_file.close();
+	}
+	else
+	{
+		InternalFS.remove(packed_name);
+	}
+	// Save track recording setting, no file means track recording is off
+	InternalFS.remove(track_name);
+	if (g_track_tolerance != 0)
+	{
+		uint16_t track_setting[2] = {g_track_tolerance, g_track_interval};
+		gps_file.open(track_name, FILE_O_WRITE);
+		gps_file.write((const uint8_t *)track_setting, 2 * sizeof(uint16_t));
+		gps_file.close();
+	}
+	// Save store-and-forward setting, no file means the log is off
+	InternalFS.remove(store_name);
+	if (g_store_share != 0)
+	{
+		gps_file.open(store_name, FILE_O_WRITE);
+		gps_file.write(&g_store_share, 1);
+		gps_file.close();
+	}
+	// Save stationary detection setting, no file means the detection is off
+	InternalFS.remove(still_name);
+	if (g_still_time != 0)
+	{
+		gps_file.open(still_name, FILE_O_WRITE);
+		gps_file.write(&g_still_time, 1);
+		gps_file.close();
+	}
+	// Save motion classifier settings, the intervals are kept while the classifier is off
+	InternalFS.remove(motion_file_name);
+	uint8_t motion_setting[1 + 3 * MOTION_STATE_NUM];
+	motion_setting[0] = g_motion_enable ? 1 : 0;
+	for (uint8_t state = 0; state < MOTION_STATE_NUM; state++)
+	{
+		motion_setting[1 + 3 * state] = (uint8_t)(g_motion_cfg[state].interval & 0xFF);
+		motion_setting[2 + 3 * state] = (uint8_t)(g_motion_cfg[state].interval >> 8);
+		motion_setting[3 + 3 * state] = g_motion_cfg[state].profile;
+	}
+	gps_file.open(motion_file_name, FILE_O_WRITE);
+	gps_file.write(motion_setting, sizeof(motion_setting));
+	gps_file.close();
 }
 
 /**
@@ -352,9 +1243,24 @@ void save_gps_settings(void)
 atcmd_t g_user_at_cmd_list_gps[] = {
 	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
 	// GNSS commands
-	{"+GNSS", "Get/Set the GNSS precision and format 0 = 4 digit, 1 = 6 digit, 2 = Helium Mapper", at_query_gnss, at_exec_gnss, NULL, "RW"},
+	{"+GNSS", "Get/Set the GNSS precision and format 0 = 4 digit, 1 = 6 digit, 2 = Helium Mapper, 3 = compact, 4 = packed", at_query_gnss, at_exec_gnss, NULL, "RW"},
 	{"+PREC", "Get/Set the GNSS acquisition precision 0 = only fix type 3D, 1 = fix type 3D and >= 6 satellites", at_query_gnss_prec, at_exec_gnss_prec, NULL, "RW"},
 	{"+ACC", "Get/Set whether ACC values are included in the payload", at_query_acc, at_exec_acc, NULL, "RW"},
+	{"+GPWR", "Get/Set the GNSS power strategy 0 = auto, 1 = power cut, V_BCKP stays on, 2 = module standby", at_query_gnss_pwr, at_exec_gnss_pwr, NULL, "RW"},
+	{"+TTFF", "Get the TTFF histogram (fix/no fix per bin) and the learned acquisition timeout", at_query_ttff, NULL, at_query_ttff, "R"},
+	{"+GPROF", "Get/Set the GNSS profile 0 = low power GPS+GAL 1Hz, 1 = fast TTFF 2Hz, 2 = high accuracy 1Hz", at_query_gnss_profile, at_exec_gnss_profile, at_query_gnss_profile, "RW"},
+	{"+GAVG", "Get/Set the target error in cm of the stationary averaging, 0 = off", at_query_gnss_avg, at_exec_gnss_avg, NULL, "RW"},
+	{"+GFILT", "Get/Set the position filter 0 = raw positions, 1 = filtered positions", at_query_gnss_filter, at_exec_gnss_filter, NULL, "RW"},
+	{"+GDIST", "Get/Set the min distance in m to the last sent position and the mode 0 = skip uplink, 1 = heartbeat", at_query_gnss_dist, at_exec_gnss_dist, NULL, "RW"},
+	{"+FENCE", "Get/Set a geofence <n>:C:<lat>:<lon>:<radius>, <n>:P:<lat>:<lon>:..., <n>:A:<lat>:<lon>:..., <n>:D", at_query_fence, at_exec_fence, at_query_fence, "RW"},
+	{"+FMODE", "Get/Set the geofence mode 0 = off, 1 = burst outside, 2 = transitions only and the burst interval in s", at_query_fence_mode, at_exec_fence_mode, NULL, "RW"},
+	{"+TRACK", "Get/Set the track recording, max deviation in m (0 = off) and fix interval in s while moving", at_query_track, at_exec_track, NULL, "RW"},
+	{"+SLOG", "Get/Set the store-and-forward log, share of the airtime in percent for stored positions, 0 = off", at_query_store, at_exec_store, NULL, "RW"},
+	{"+UPQ", "Get the uplink queue statistics", at_query_uplink, NULL, at_query_uplink, "R"},
+	{"+MOTION", "Get/Set the motion classifier 0 = off, 1 = on, or <state>:<interval s>:<GNSS profile>", at_query_motion, at_exec_motion, NULL, "RW"},
+	{"+STILL", "Get/Set the time in s without movement before the periodic sending stops, 0 = off", at_query_still, at_exec_still, NULL, "RW"},
+	{"+GAID", "Get TTFF with and without position/time aiding", at_query_gnss_aid, NULL, at_query_gnss_aid, "R"},
+	{"+GSTAT", "Get GNSS bus time statistics per navigation epoch", at_query_gnss_stat, NULL, at_query_gnss_stat, "R"},
 };
 
 /*****************************************